@@ -15,6 +15,11 @@ zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtxlock")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawblock")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawtx")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawtxlock")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"masternode")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"mnwinner")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"budgetproposal")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"finalizedbudget")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"spork")
 zmqSubSocket.connect("tcp://127.0.0.1:%i" % port)
 
 try:
@@ -46,6 +51,21 @@ try:
         elif topic == "rawtxlock":
             print('- RAW TX LOCK ('+sequence+') -')
             print(binascii.hexlify(body).decode("utf-8"))
+        elif topic == "masternode":
+            print('- MASTERNODE ('+sequence+') -')
+            print(binascii.hexlify(body[31::-1]).decode("utf-8") + '-' + str(struct.unpack('<I', body[32:36])[0]) + (' removed' if struct.unpack('<?', body[36:37])[0] else ''))
+        elif topic == "mnwinner":
+            print('- MASTERNODE WINNER ('+sequence+') -')
+            print(binascii.hexlify(body).decode("utf-8"))
+        elif topic == "budgetproposal":
+            print('- BUDGET PROPOSAL ('+sequence+') -')
+            print(binascii.hexlify(body[31::-1]).decode("utf-8"))
+        elif topic == "finalizedbudget":
+            print('- FINALIZED BUDGET ('+sequence+') -')
+            print(binascii.hexlify(body[31::-1]).decode("utf-8"))
+        elif topic == "spork":
+            print('- SPORK ('+sequence+') -')
+            print(struct.unpack('<iqq', body))
 
 except KeyboardInterrupt:
     zmqContext.destroy()
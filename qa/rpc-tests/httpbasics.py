@@ -10,6 +10,8 @@
 from test_framework import BitcoinTestFramework
 from util import *
 import base64
+import socket
+import time
 
 try:
     import http.client as httplib
@@ -22,7 +24,7 @@ except ImportError:
 
 class HTTPBasicsTest (BitcoinTestFramework):        
     def setup_nodes(self):
-        return start_nodes(4, self.options.tmpdir, extra_args=[['-rpckeepalive=1'], ['-rpckeepalive=0'], [], []])
+        return start_nodes(4, self.options.tmpdir, extra_args=[['-rpckeepalive=1'], ['-rpckeepalive=0'], [], ['-rpcservertimeout=3', '-rpcmaxconnections=4']])
 
     def run_test(self):        
         
@@ -97,6 +99,49 @@ class HTTPBasicsTest (BitcoinTestFramework):
         out1 = conn.getresponse().read();
         assert_equal('"error":null' in out1, True)
         assert_equal(conn.sock!=None, True) #connection must be closed because bitcoind should use keep-alive by default
-        
+
+        #node3 (4th node) closes idle connections after 3 seconds and allows 4 connections
+        urlNode3 = urlparse.urlparse(self.nodes[3].url)
+        authpair = urlNode3.username + ':' + urlNode3.password
+        headers = {"Authorization": "Basic " + base64.b64encode(authpair)}
+        request = "POST / HTTP/1.1\r\nAuthorization: Basic %s\r\nContent-Length: %d\r\n\r\n%s" % (
+            base64.b64encode(authpair), len('{"method": "getbestblockhash"}'), '{"method": "getbestblockhash"}')
+
+        #a keep-alive connection that stays idle is closed, also in the middle of a request
+        idle = socket.create_connection((urlNode3.hostname, urlNode3.port))
+        idle.sendall(request)
+        assert_equal(idle.recv(15), "HTTP/1.1 200 OK")
+        partial = socket.create_connection((urlNode3.hostname, urlNode3.port))
+        partial.sendall(request[:20])
+        time.sleep(5)
+        for sock in [idle, partial]:
+            sock.settimeout(10)
+            while sock.recv(4096) != "":
+                pass
+            sock.close()
+
+        #the test framework's own connection timed out as well, and is opened again
+        assert_equal(self.nodes[3].getbestblockhash(), self.nodes[0].getbestblockhash())
+        time.sleep(5)
+
+        #beyond 4 open connections, further ones are answered with 503 and closed
+        socks = [ socket.create_connection((urlNode3.hostname, urlNode3.port)) for i in range(4) ]
+        time.sleep(0.5)
+        extra = socket.create_connection((urlNode3.hostname, urlNode3.port))
+        extra.settimeout(10)
+        assert_equal(extra.recv(12), "HTTP/1.1 503")
+        extra.close()
+
+        #once one closes, a new connection is served again
+        socks.pop().close()
+        time.sleep(0.5)
+        conn = httplib.HTTPConnection(urlNode3.hostname, urlNode3.port)
+        conn.request('POST', '/', '{"method": "getbestblockhash"}', headers)
+        out1 = conn.getresponse().read();
+        assert_equal('"error":null' in out1, True)
+        conn.close()
+        for sock in socks:
+            sock.close()
+
 if __name__ == '__main__':
     HTTPBasicsTest ().main ()
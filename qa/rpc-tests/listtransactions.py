@@ -8,6 +8,7 @@
 from test_framework import BitcoinTestFramework
 from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
 from util import *
+import threading
 
 
 def check_array_result(object_array, to_match, expected):
@@ -94,6 +95,45 @@ class ListTransactionsTest(BitcoinTestFramework):
                            {"category":"receive","amount":Decimal("0.44")},
                            {"txid":txid, "account" : "toself"} )
 
+        self.run_stream_test()
+
+    def run_stream_test(self):
+        # A large listtransactions reply is streamed in chunks, built in batches
+        # of 1000 transactions; the node keeps connecting blocks while it is sent
+        for i in range(1100):
+            self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 0.01)
+            if i % 100 == 99:
+                self.nodes[0].setgenerate(True, 1)
+        self.nodes[0].setgenerate(True, 1)
+        self.sync_all()
+        height = self.nodes[0].getblockcount()
+
+        errors = []
+        def generate_blocks():
+            try:
+                miner = AuthServiceProxy(self.nodes[1].url)
+                for i in range(20):
+                    miner.setgenerate(True, 1)
+            except Exception as e:
+                errors.append(e)
+        thread = threading.Thread(target=generate_blocks)
+        thread.start()
+        rounds = 0
+        while thread.is_alive() or rounds == 0:
+            txs = self.nodes[0].listtransactions("*", 100000)
+            assert(len(txs) >= 2200)
+            rounds += 1
+        thread.join()
+        assert_equal(errors, [])
+        self.sync_all()
+        assert_equal(self.nodes[0].getblockcount(), height + 20)
+
+        # the streamed reply matches a paged one
+        txs = self.nodes[0].listtransactions("*", 100000)
+        assert_equal(txs[-10:], self.nodes[0].listtransactions("*", 10))
+        assert_equal(txs[-20:-10], self.nodes[0].listtransactions("*", 10, 10))
+        assert(len(self.nodes[0].listunspent()) >= 1100)
+
 if __name__ == '__main__':
     ListTransactionsTest().main()
 
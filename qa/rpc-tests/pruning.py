@@ -0,0 +1,88 @@
+#!/usr/bin/env python2
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test -prune with small block files (-fastprune): the blocks within the
+# reorganization window stay, budget collateral stays available by txid
+# and NODE_NETWORK is no longer advertised.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+from decimal import Decimal
+import struct
+
+MIN_BLOCKS_TO_KEEP = 288
+NODE_NETWORK = 1
+
+class PruningTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=prune", "-prune=1", "-fastprune"]))
+
+    def send_collateral(self, node):
+        # A budget-collateral-like transaction: an OP_RETURN output committing to
+        # a 32 byte hash and burning an amount
+        utxo = node.listunspent()[0]
+        change = utxo["amount"] - Decimal("10.1")
+        rawtx = node.createrawtransaction([{"txid": utxo["txid"], "vout": utxo["vout"]}],
+                                          {node.getnewaddress(): change})
+        # version, one input with an empty scriptSig, then the output count
+        pos = (4 + 1 + 32 + 4 + 1 + 4) * 2
+        assert_equal(rawtx[pos:pos+2], "01")
+        burn = struct.pack("<q", 10 * 100000000).encode("hex") + "22" + "6a20" + "ab" * 32
+        rawtx = rawtx[:pos] + "02" + rawtx[pos+2:-8] + burn + rawtx[-8:]
+        signed = node.signrawtransaction(rawtx)
+        assert_equal(signed["complete"], True)
+        return node.sendrawtransaction(signed["hex"])
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.setgenerate(True, 101)
+        txid = self.send_collateral(node)
+        node.setgenerate(True, 1)
+        collateralheight = node.getblockcount()
+
+        node.setgenerate(True, 400)
+        tip = node.getblockcount()
+        info = node.getblockchaininfo()
+        assert_equal(info["pruned"], True)
+        pruneheight = info["pruneheight"]
+        assert(pruneheight > collateralheight)
+        assert(pruneheight <= tip - MIN_BLOCKS_TO_KEEP)
+
+        # blocks below the prune height are gone
+        try:
+            node.getblock(node.getblockhash(1))
+            raise AssertionError("pruned block still available")
+        except JSONRPCException as e:
+            assert("pruned" in e.error["message"])
+
+        # the last MIN_BLOCKS_TO_KEEP blocks, and with them the undo data of every
+        # reorganization we'd accept, are still there
+        for height in range(tip - MIN_BLOCKS_TO_KEEP, tip + 1):
+            node.getblock(node.getblockhash(height))
+
+        # budget collateral is still looked up by txid, also after a restart
+        assert_equal(node.getrawtransaction(txid, 1)["txid"], txid)
+        stop_node(node, 0)
+        wait_bitcoinds()
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-debug=prune", "-prune=1", "-fastprune"])
+        node = self.nodes[0]
+        assert_equal(node.getblockcount(), tip)
+        assert_equal(node.getrawtransaction(txid, 1)["txid"], txid)
+
+        # a pruned node can't serve the full chain
+        assert_equal(int(node.getnetworkinfo()["localservices"], 16) & NODE_NETWORK, 0)
+        print "Success"
+
+if __name__ == '__main__':
+    PruningTest().main()
@@ -40,8 +40,10 @@ except ImportError:
     import httplib
 import base64
 import decimal
+import errno
 import json
 import logging
+import socket
 try:
     import urllib.parse as urlparse
 except ImportError:
@@ -115,13 +117,7 @@ class AuthServiceProxy(object):
                                'method': self.__service_name,
                                'params': args,
                                'id': AuthServiceProxy.__id_count}, default=EncodeDecimal)
-        self.__conn.request('POST', self.__url.path, postdata,
-                            {'Host': self.__url.hostname,
-                             'User-Agent': USER_AGENT,
-                             'Authorization': self.__auth_header,
-                             'Content-type': 'application/json'})
-
-        response = self._get_response()
+        response = self._request('POST', self.__url.path, postdata)
         if response['error'] is not None:
             raise JSONRPCException(response['error'])
         elif 'result' not in response:
@@ -133,13 +129,31 @@ class AuthServiceProxy(object):
     def _batch(self, rpc_call_list):
         postdata = json.dumps(list(rpc_call_list), default=EncodeDecimal)
         log.debug("--> "+postdata)
-        self.__conn.request('POST', self.__url.path, postdata,
-                            {'Host': self.__url.hostname,
-                             'User-Agent': USER_AGENT,
-                             'Authorization': self.__auth_header,
-                             'Content-type': 'application/json'})
-
-        return self._get_response()
+        return self._request('POST', self.__url.path, postdata)
+
+    def _request(self, method, path, postdata):
+        '''
+        Do a HTTP request, and do it again on a new connection if the server
+        closed the persistent one meanwhile (e.g. after -rpcservertimeout).
+        '''
+        headers = {'Host': self.__url.hostname,
+                   'User-Agent': USER_AGENT,
+                   'Authorization': self.__auth_header,
+                   'Content-type': 'application/json'}
+        try:
+            self.__conn.request(method, path, postdata, headers)
+            return self._get_response()
+        except (httplib.BadStatusLine, socket.error) as e:
+            # an empty status line, a broken pipe or a reset mean the server
+            # closed the connection; anything else, like a timeout, is passed on
+            if isinstance(e, httplib.BadStatusLine):
+                if e.line not in ("", "''") and "closed the connection" not in e.line:
+                    raise
+            elif getattr(e, "errno", None) not in (errno.EPIPE, errno.ECONNRESET):
+                raise
+            self.__conn.close()
+            self.__conn.request(method, path, postdata, headers)
+            return self._get_response()
 
     def _get_response(self):
         http_response = self.__conn.getresponse()
@@ -8,7 +8,11 @@
 #
 
 from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import JSONRPCException
 from util import *
+from io import BytesIO
+from struct import unpack
+import binascii
 import json
 
 try:
@@ -20,9 +24,9 @@ try:
 except ImportError:
     import urlparse
 
-def http_get_call(host, port, path, response_object = 0):
+def http_get_call(host, port, path, response_object = 0, headers = {}):
     conn = httplib.HTTPConnection(host, port)
-    conn.request('GET', path)
+    conn.request('GET', path, None, headers)
     
     if response_object:
         return conn.getresponse()
@@ -30,9 +34,179 @@ def http_get_call(host, port, path, response_object = 0):
     return conn.getresponse().read()
 
 
+def hash_from_bin(byte_str):
+    return binascii.hexlify(byte_str[::-1]).decode('ascii')
+
+def read_compact_size(stream):
+    n = unpack("<B", stream.read(1))[0]
+    if n == 253:
+        n = unpack("<H", stream.read(2))[0]
+    elif n == 254:
+        n = unpack("<I", stream.read(4))[0]
+    elif n == 255:
+        n = unpack("<Q", stream.read(8))[0]
+    return n
+
 class RESTTest (BitcoinTestFramework):
     FORMAT_SEPARATOR = "."
-    
+
+    def get_etag(self, url, path):
+        response = http_get_call(url.hostname, url.port, path, True)
+        assert_equal(response.status, 200)
+        response.read()
+        return response.getheader('etag')
+
+    def assert_not_modified(self, url, path, etag):
+        response = http_get_call(url.hostname, url.port, path, True, {'If-None-Match': etag})
+        assert_equal(response.status, 304)
+        assert_equal(response.read(), "")
+        assert_equal(response.getheader('etag'), etag)
+
+    def run_etag_test(self, url):
+        # the binary chain info only changes with the chain
+        path = '/rest/chaininfo'+self.FORMAT_SEPARATOR+'bin'
+        etag = self.get_etag(url, path)
+        assert(etag is not None)
+        self.assert_not_modified(url, path, etag)
+
+        # the JSON chain info has the verification progress, which changes with
+        # the clock, so it is never answered with 304
+        response = http_get_call(url.hostname, url.port, '/rest/chaininfo'+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 200)
+        assert_equal(response.getheader('etag'), None)
+        json_obj = json.loads(response.read())
+        assert_equal(json_obj['bestblockhash'], self.nodes[0].getbestblockhash())
+
+        # masternode list and budget: unchanged between requests
+        paths = [ '/rest/masternodes'+self.FORMAT_SEPARATOR+'bin',
+                  '/rest/masternodes'+self.FORMAT_SEPARATOR+'json',
+                  '/rest/budget'+self.FORMAT_SEPARATOR+'bin',
+                  '/rest/budget'+self.FORMAT_SEPARATOR+'json' ]
+        etags = [ self.get_etag(url, p) for p in paths ]
+        for p, e in zip(paths, etags):
+            assert(e is not None)
+            assert_equal(self.get_etag(url, p), e)
+            self.assert_not_modified(url, p, e)
+        assert_equal(len(set(etags)), len(etags))
+
+        # an empty budget is an empty list
+        response = http_get_call(url.hostname, url.port, '/rest/budget'+self.FORMAT_SEPARATOR+'hex')
+        assert_equal(response, "00\n")
+
+        # the mempool tag changes with a new transaction, the others with a block
+        path = '/rest/mempool/contents'+self.FORMAT_SEPARATOR+'json'
+        etag = self.get_etag(url, path)
+        self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), 1)
+        assert(self.get_etag(url, path) != etag)
+
+        chainetag = self.get_etag(url, '/rest/chaininfo'+self.FORMAT_SEPARATOR+'bin')
+        self.nodes[0].setgenerate(True, 1)
+        self.sync_all()
+        assert(self.get_etag(url, '/rest/chaininfo'+self.FORMAT_SEPARATOR+'bin') != chainetag)
+        for p, e in zip(paths, etags):
+            assert(self.get_etag(url, p) != e)
+
+    def get_utxos_bin(self, url, request):
+        response = http_get_call(url.hostname, url.port, '/rest/getutxos'+request+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        stream = BytesIO(response.read())
+        height = unpack("<i", stream.read(4))[0]
+        hash_tip = hash_from_bin(stream.read(32))
+        bitmap = stream.read(read_compact_size(stream))
+        count = read_compact_size(stream)
+        return height, hash_tip, bitmap, count
+
+    def run_getutxos_test(self, url):
+        # an output of a transaction that is still in the mempool
+        txid = self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), 0.1)
+        self.sync_all()
+        n = [ vout['n'] for vout in self.nodes[0].getrawtransaction(txid, 1)['vout'] if vout['value'] == Decimal('0.1') ][0]
+        request = '/'+txid+'-'+str(n)
+
+        # only found when the mempool is checked as well
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/getutxos'+request+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(json_obj['chainHeight'], self.nodes[0].getblockcount())
+        assert_equal(json_obj['chaintipHash'], self.nodes[0].getbestblockhash())
+        assert_equal(json_obj['bitmap'], "0")
+        assert_equal(len(json_obj['utxos']), 0)
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/getutxos/checkmempool'+request+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(json_obj['bitmap'], "1")
+        assert_equal(len(json_obj['utxos']), 1)
+        assert_equal(Decimal(str(json_obj['utxos'][0]['value'])), Decimal('0.1'))
+
+        height, hash_tip, bitmap, count = self.get_utxos_bin(url, request)
+        assert_equal(height, self.nodes[0].getblockcount())
+        assert_equal(hash_tip, self.nodes[0].getbestblockhash())
+        assert_equal(bitmap, b"\x00")
+        assert_equal(count, 0)
+        height, hash_tip, bitmap, count = self.get_utxos_bin(url, '/checkmempool'+request)
+        assert_equal(bitmap, b"\x01")
+        assert_equal(count, 1)
+
+        # once mined it is found either way, next to an output that doesn't exist
+        self.nodes[0].setgenerate(True, 1)
+        self.sync_all()
+        request += '/'+txid+'-'+str(n + 10)
+        for prefix in [ '', '/checkmempool' ]:
+            json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/getutxos'+prefix+request+self.FORMAT_SEPARATOR+'json'))
+            assert_equal(json_obj['chaintipHash'], self.nodes[0].getbestblockhash())
+            assert_equal(json_obj['bitmap'], "10")
+            assert_equal(len(json_obj['utxos']), 1)
+            height, hash_tip, bitmap, count = self.get_utxos_bin(url, prefix+request)
+            assert_equal(hash_tip, self.nodes[0].getbestblockhash())
+            assert_equal(bitmap, b"\x01")
+            assert_equal(count, 1)
+
+        # malformed and empty requests
+        for path in [ '/rest/getutxos/checkmempool', '/rest/getutxos/'+txid, '/rest/getutxos/'+txid+'-x' ]:
+            response = http_get_call(url.hostname, url.port, path+self.FORMAT_SEPARATOR+'json', True)
+            assert_equal(response.status, 400)
+
+    def run_headers_test(self, url):
+        # headers of the active chain from the given hash on, at most up to the tip
+        height = self.nodes[0].getblockcount()
+        start = self.nodes[0].getblockhash(height - 4)
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/headers/5/'+start+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(len(json_obj), 5)
+        for i, header in enumerate(json_obj):
+            assert_equal(header['hash'], self.nodes[0].getblockhash(height - 4 + i))
+            assert_equal(header['height'], height - 4 + i)
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/headers/10/'+start+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(len(json_obj), 5)
+        assert_equal(json_obj[4]['hash'], self.nodes[0].getbestblockhash())
+
+        response = http_get_call(url.hostname, url.port, '/rest/headers/1/'+start+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        header_size = len(response.read())
+        assert_greater_than(header_size, 79)
+        response = http_get_call(url.hostname, url.port, '/rest/headers/5/'+start+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        assert_equal(len(response.read()), 5 * header_size)
+
+        # an unknown hash has no headers; counts out of range are refused
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/headers/5/'+'00'*32+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(len(json_obj), 0)
+        for count in [ '0', '2001', 'x' ]:
+            response = http_get_call(url.hostname, url.port, '/rest/headers/'+count+'/'+start+self.FORMAT_SEPARATOR+'json', True)
+            assert_equal(response.status, 400)
+
+    def run_latency_test(self, url):
+        # made-up REST paths and RPC methods all count as "unknown"
+        for i in range(3):
+            response = http_get_call(url.hostname, url.port, '/rest/nosuch%d/x' % i + self.FORMAT_SEPARATOR+'json', True)
+            assert_equal(response.status, 404)
+            try:
+                getattr(self.nodes[0], 'nosuchmethod%d' % i)()
+                raise AssertionError("unknown method succeeded")
+            except JSONRPCException as e:
+                assert_equal(e.error['code'], -32601)
+        latencies = self.nodes[0].getrpcinfo()['latencies']
+        assert_greater_than(latencies['unknown']['count'], 5)
+        assert_greater_than(latencies['rest/getutxos']['count'], 0)
+        assert_greater_than(latencies['rest/headers']['count'], 0)
+        for name in latencies:
+            assert('nosuch' not in name)
+
     def run_test(self):
         url = urlparse.urlparse(self.nodes[0].url)
         bb_hash = self.nodes[0].getbestblockhash()
@@ -82,8 +256,12 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         for tx in txs:
             assert_equal(tx in json_obj['tx'], True)
-                
-        
+
+        self.run_getutxos_test(url)
+        self.run_headers_test(url)
+        self.run_etag_test(url)
+        self.run_latency_test(url)
+
 
 if __name__ == '__main__':
     RESTTest ().main ()
@@ -0,0 +1,93 @@
+#!/usr/bin/env python2
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test JSON-RPC batches: runs of read-only calls are served by several
+# threads, but replies stay in request order, calls that change state
+# still act as barriers, and a failing call only affects its own reply.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+
+class RPCBatchTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-rpcbatchthreads=4"]))
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.setgenerate(True, 50)
+        hashes = [ node.getblockhash(height) for height in range(51) ]
+
+        # many read-only calls: every reply has the id of its request
+        batch = []
+        for i in range(200):
+            height = i % 51
+            if i % 2:
+                batch.append({"method": "getblockhash", "params": [height], "id": i})
+            else:
+                batch.append({"method": "getblock", "params": [hashes[height]], "id": i})
+        replies = node._batch(batch)
+        assert_equal(len(replies), 200)
+        for i, reply in enumerate(replies):
+            assert_equal(reply["id"], i)
+            assert_equal(reply["error"], None)
+            if i % 2:
+                assert_equal(reply["result"], hashes[i % 51])
+            else:
+                assert_equal(reply["result"]["hash"], hashes[i % 51])
+
+        # failing calls among them only fail their own reply
+        batch = [
+            {"method": "getblockhash", "params": [1], "id": 0},
+            {"method": "getblockhash", "params": [1000], "id": 1},
+            {"method": "getblockhash", "params": [2], "id": 2},
+            {"method": "nosuchmethod", "params": [], "id": 3},
+            {"method": "getblock", "params": ["00" * 32], "id": 4},
+            {"method": "getblockhash", "params": [3], "id": 5},
+            {"method": "getblockhash", "params": ["x"], "id": 6},
+            {"method": "getblockhash", "params": [4], "id": 7},
+        ]
+        replies = node._batch(batch)
+        assert_equal([ reply["id"] for reply in replies ], range(8))
+        for i in [0, 2, 5, 7]:
+            assert_equal(replies[i]["error"], None)
+        assert_equal(replies[0]["result"], hashes[1])
+        assert_equal(replies[2]["result"], hashes[2])
+        assert_equal(replies[5]["result"], hashes[3])
+        assert_equal(replies[7]["result"], hashes[4])
+        assert_equal(replies[1]["error"]["code"], -8)
+        assert_equal(replies[3]["error"]["code"], -32601)
+        assert_equal(replies[4]["error"]["code"], -5)
+        assert(replies[6]["error"] is not None)
+        for i in [1, 3, 4, 6]:
+            assert_equal(replies[i]["result"], None)
+
+        # a call that changes state runs after the calls before it, and before
+        # the calls after it
+        batch = [ {"method": "getblockcount", "params": [], "id": i} for i in range(10) ]
+        batch.append({"method": "setgenerate", "params": [True, 1], "id": 10})
+        batch += [ {"method": "getblockcount", "params": [], "id": i} for i in range(11, 21) ]
+        replies = node._batch(batch)
+        assert_equal([ reply["id"] for reply in replies ], range(21))
+        for i in range(10):
+            assert_equal(replies[i]["result"], 50)
+        assert_equal(replies[10]["error"], None)
+        for i in range(11, 21):
+            assert_equal(replies[i]["result"], 51)
+
+        # the threads were used, and are still fine
+        assert_equal(node.getblockcount(), 51)
+        print "Success"
+
+if __name__ == '__main__':
+    RPCBatchTest().main()
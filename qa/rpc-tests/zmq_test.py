@@ -7,10 +7,12 @@
 # Test ZMQ interface
 #
 
-from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import *
+from test_framework import BitcoinTestFramework
+from util import *
 import zmq
 import binascii
+import struct
+import threading
 
 try:
     import http.client as httplib
@@ -21,6 +23,16 @@ try:
 except ImportError:
     import urlparse
 
+def bytes_to_hex_str(byte_str):
+    return binascii.hexlify(byte_str).decode('ascii')
+
+# hashes are sent in network byte order
+def hash_to_hex_str(byte_str):
+    return bytes_to_hex_str(byte_str[::-1])
+
+TOPICS = [ b"hashblock", b"hashtx", b"masternode", b"mnwinner",
+           b"budgetproposal", b"finalizedbudget", b"spork" ]
+
 class ZMQTest (BitcoinTestFramework):
 
     port = 28332
@@ -28,43 +40,58 @@ class ZMQTest (BitcoinTestFramework):
     def setup_nodes(self):
         self.zmqContext = zmq.Context()
         self.zmqSubSocket = self.zmqContext.socket(zmq.SUB)
-        self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashblock")
-        self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtx")
+        for topic in TOPICS:
+            self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, topic)
         self.zmqSubSocket.connect("tcp://127.0.0.1:%i" % self.port)
+        self.sequence = {}
+        address = 'tcp://127.0.0.1:'+str(self.port)
         return start_nodes(4, self.options.tmpdir, extra_args=[
-            ['-zmqpubhashtx=tcp://127.0.0.1:'+str(self.port), '-zmqpubhashblock=tcp://127.0.0.1:'+str(self.port)],
+            [ '-zmqpub'+topic+'='+address for topic in TOPICS ],
             [],
             [],
             []
             ])
 
+    def receive(self, timeout = 60000):
+        if not self.zmqSubSocket.poll(timeout):
+            raise AssertionError("no zmq message within %d ms" % timeout)
+        msg = self.zmqSubSocket.recv_multipart()
+        assert_equal(len(msg), 3)
+        topic = msg[0]
+        body = msg[1]
+        # every topic counts its messages; a gap or a repeat means messages
+        # were lost or mixed up on the socket
+        sequence = struct.unpack('<I', msg[2])[0]
+        if topic in self.sequence:
+            assert_equal(sequence, self.sequence[topic] + 1)
+        self.sequence[topic] = sequence
+        return topic, body
+
+    def receive_topic(self, topic):
+        while True:
+            msg_topic, body = self.receive()
+            if msg_topic == topic:
+                return body
+
     def run_test(self):
         self.sync_all()
 
-        genhashes = self.nodes[0].generate(1)
+        genhashes = self.nodes[0].setgenerate(True, 1)
         self.sync_all()
 
         print "listen..."
-        msg = self.zmqSubSocket.recv_multipart()
-        topic = msg[0]
-        body = msg[1]
-
-        msg = self.zmqSubSocket.recv_multipart()
-        topic = msg[0]
-        body = msg[1]
+        body = self.receive_topic(b"hashblock")
         blkhash = bytes_to_hex_str(body)
 
         assert_equal(genhashes[0], blkhash) #blockhash from generate must be equal to the hash received over zmq
 
         n = 10
-        genhashes = self.nodes[1].generate(n)
+        genhashes = self.nodes[1].setgenerate(True, n)
         self.sync_all()
 
         zmqHashes = []
-        for x in range(0,n*2):
-            msg = self.zmqSubSocket.recv_multipart()
-            topic = msg[0]
-            body = msg[1]
+        while len(zmqHashes) < n:
+            topic, body = self.receive()
             if topic == b"hashblock":
                 zmqHashes.append(bytes_to_hex_str(body))
 
@@ -76,15 +103,59 @@ class ZMQTest (BitcoinTestFramework):
         self.sync_all()
 
         # now we should receive a zmq msg because the tx was broadcast
-        msg = self.zmqSubSocket.recv_multipart()
-        topic = msg[0]
-        body = msg[1]
-        hashZMQ = ""
-        if topic == b"hashtx":
-            hashZMQ = bytes_to_hex_str(body)
+        hashZMQ = bytes_to_hex_str(self.receive_topic(b"hashtx"))
 
         assert_equal(hashRPC, hashZMQ) #blockhash from generate must be equal to the hash received over zmq
 
+        self.run_budget_test()
+        self.run_threads_test()
+
+    def run_budget_test(self):
+        # a new proposal is published with its hash and name; the first budget
+        # cycle block with a budget is past the last proof of work block
+        node = self.nodes[0]
+        start = 1008
+        address = node.getnewaddress()
+        feetx = node.preparebudget("zmq-test", "http://zmq.test", 1, start, address, 10)
+        node.setgenerate(True, 6)
+        self.sync_all()
+        proposal = node.submitbudget("zmq-test", "http://zmq.test", 1, start, address, 10, feetx)
+
+        body = self.receive_topic(b"budgetproposal")
+        assert_equal(hash_to_hex_str(body[:32]), proposal)
+        assert_equal(body[32:33], b"\x08")
+        assert_equal(body[33:41], b"zmq-test")
+        assert_equal(struct.unpack('<iii', body[41:53]), (0, 0, 0))
+
+    def run_threads_test(self):
+        # Transactions relayed to node0 are published from its message handler
+        # while blocks mined by RPC are published from the RPC thread. Every
+        # message must still arrive whole and in sequence.
+        sender = self.nodes[1]
+        address = self.nodes[0].getnewaddress()
+        txids = []
+        def send():
+            for i in range(50):
+                txids.append(sender.sendtoaddress(address, 0.1))
+        thread = threading.Thread(target=send)
+        thread.start()
+        genhashes = []
+        for i in range(10):
+            genhashes += self.nodes[0].setgenerate(True, 1)
+        thread.join()
+        self.sync_all()
+        genhashes += self.nodes[0].setgenerate(True, 1)
+        self.sync_all()
+
+        zmqBlocks = []
+        zmqTxs = set()
+        while len(zmqBlocks) < len(genhashes) or not zmqTxs.issuperset(txids):
+            topic, body = self.receive()
+            if topic == b"hashblock":
+                zmqBlocks.append(bytes_to_hex_str(body))
+            elif topic == b"hashtx":
+                zmqTxs.add(bytes_to_hex_str(body))
+        assert_equal(zmqBlocks, genhashes)
 
 if __name__ == '__main__':
     ZMQTest ().main ()
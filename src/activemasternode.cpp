@@ -12,6 +12,7 @@
 #include "masternodeman.h"
 #include "masternode-helpers.h"
 #include "protocol.h"
+#include "relaycache.h"
 #include "spork.h"
 
 // Keep track of the active Masternode
@@ -42,6 +43,7 @@ void CActiveMasternode::ManageStatus()
         pmn = mnodeman.Find(pubKeyMasternode);
         if (pmn != NULL) {
             pmn->Check();
+            mnodeman.Refresh(*pmn);
             if (pmn->IsEnabled() && pmn->protocolVersion == PROTOCOL_VERSION) EnableHotColdMasterNode(pmn->vin, pmn->addr);
         }
     }
@@ -193,12 +195,16 @@ bool CActiveMasternode::SendMasternodePing(std::string& errorMessage)
         }
 
         pmn->lastPing = mnp;
+        mnodeman.Refresh(*pmn);
         mnodeman.mapSeenMasternodePing.insert(make_pair(mnp.GetHash(), mnp));
 
         //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
         CMasternodeBroadcast mnb(*pmn);
         uint256 hash = mnb.GetHash();
-        if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) mnodeman.mapSeenMasternodeBroadcast[hash].lastPing = mnp;
+        if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
+            mnodeman.mapSeenMasternodeBroadcast[hash].lastPing = mnp;
+            relayCache.Erase(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
+        }
 
         mnp.Relay();
 
@@ -0,0 +1,28 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "random.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+int main(int argc, char** argv)
+{
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::REGTEST);
+
+    // Scratch data directory for benchmarks that touch block files
+    boost::filesystem::path pathTemp = GetTempPath() / strprintf("bench_cbn_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+    boost::filesystem::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+
+    benchmark::BenchRunner::RunAll();
+
+    boost::filesystem::remove_all(pathTemp);
+}
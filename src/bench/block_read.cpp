@@ -0,0 +1,117 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockfilecache.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+
+#include <assert.h>
+
+/** A proof-of-stake block (so reads skip the proof-of-work header check) of about 450kB */
+static CBlock MakeBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1546300800;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(uint256(1), 0);
+    coinstake.vout.resize(2);
+    coinstake.vout[1].nValue = 100 * COIN;
+    block.vtx.push_back(coinstake);
+    assert(block.IsProofOfStake());
+
+    for (int i = 0; i < 2000; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(uint256(i + 2), 1);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, i) << std::vector<unsigned char>(33, i);
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = (i + 1) * CENT;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.vchBlockSig.assign(72, 0x30);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+//! Position of the benchmark block, written to the scratch data directory on first use
+static const CDiskBlockPos& BenchBlockPos()
+{
+    static CDiskBlockPos pos;
+    if (pos.IsNull()) {
+        CBlock block = MakeBlock();
+        pos = CDiskBlockPos(0, 0);
+        bool success = WriteBlockToDisk(block, pos);
+        assert(success);
+    }
+    return pos;
+}
+
+static void ReadBlock(benchmark::State& state, int nMaps)
+{
+    const CDiskBlockPos& pos = BenchBlockPos();
+    int nMaxFiles = blockFileCache.GetMaxFiles();
+    blockFileCache.SetMaxFiles(nMaps);
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        bool success = ReadBlockFromDisk(block, pos);
+        assert(success);
+    }
+    blockFileCache.SetMaxFiles(nMaxFiles);
+}
+
+// What a getdata for a block cost when the block was decoded and encoded again
+static void ServeBlockDecoded(benchmark::State& state, int nMaps)
+{
+    const CDiskBlockPos& pos = BenchBlockPos();
+    int nMaxFiles = blockFileCache.GetMaxFiles();
+    blockFileCache.SetMaxFiles(nMaps);
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        bool success = ReadBlockFromDisk(block, pos);
+        assert(success);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+    }
+    blockFileCache.SetMaxFiles(nMaxFiles);
+}
+
+static void ReadBlockStdio(benchmark::State& state) { ReadBlock(state, 0); }
+static void ReadBlockMapped(benchmark::State& state) { ReadBlock(state, DEFAULT_BLOCKFILE_MAPS); }
+static void ServeBlockDecodedStdio(benchmark::State& state) { ServeBlockDecoded(state, 0); }
+
+// What a getdata for a block costs when the stored bytes are pushed as they are
+static void ServeBlockRawMapped(benchmark::State& state)
+{
+    const CDiskBlockPos& pos = BenchBlockPos();
+    std::vector<char> vchBlock;
+
+    while (state.KeepRunning()) {
+        bool success = ReadRawBlockFromDisk(vchBlock, pos);
+        assert(success);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << CFlatData(vchBlock);
+    }
+}
+
+BENCHMARK(ReadBlockStdio);
+BENCHMARK(ReadBlockMapped);
+BENCHMARK(ServeBlockDecodedStdio);
+BENCHMARK(ServeBlockRawMapped);
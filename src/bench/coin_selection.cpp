@@ -0,0 +1,126 @@
+// Copyright (c) 2012-2015 The Bitcoin Core developers
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "wallet.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+typedef set<pair<const CWalletTx*, unsigned int> > CoinSet;
+
+static void addCoin(const CAmount& nValue, const CWallet& wallet, vector<COutput>& vCoins)
+{
+    static int nextLockTime = 0;
+    CMutableTransaction tx;
+    tx.nLockTime = nextLockTime++; // so all transactions get different hashes
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    CWalletTx* wtx = new CWalletTx(&wallet, tx);
+
+    int nAge = 6 * 24;
+    COutput output(wtx, 0, nAge, true);
+    vCoins.push_back(output);
+}
+
+static void emptyWallet(vector<COutput>& vCoins)
+{
+    BOOST_FOREACH (COutput output, vCoins)
+        delete output.tx;
+    vCoins.clear();
+}
+
+// Deterministic values so runs are comparable
+static CAmount nextValue(uint64_t& nState, CAmount nMax)
+{
+    nState = nState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return 1 + (CAmount)((nState >> 33) % (uint64_t)nMax);
+}
+
+// Synthetic wallet of nCoins outputs between one cent and 100 coins, in whole cents
+static void fillWallet(const CWallet& wallet, vector<COutput>& vCoins, int nCoins)
+{
+    uint64_t nState = 42;
+    for (int i = 0; i < nCoins; i++)
+        addCoin(nextValue(nState, 100 * 100) * CENT, wallet, vCoins);
+}
+
+// Simple benchmark for wallet coin selection. Note that it maybe be necessary
+// to build up more complicated scenarios in order to get meaningful
+// measurements of performance. From laanwj, "Wallet coin selection is probably
+// the hardest, as you need a wider selection of scenarios, just testing the
+// same one over and over isn't too useful. Generating random isn't useful
+// either for measurements."
+// (https://github.com/bitcoin/bitcoin/issues/7883#issuecomment-224807484)
+static void CoinSelection(benchmark::State& state)
+{
+    const CWallet wallet;
+    vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    for (int i = 0; i < 1000; i++)
+        addCoin(1000 * COIN, wallet, vCoins);
+    addCoin(3 * COIN, wallet, vCoins);
+
+    while (state.KeepRunning()) {
+        CoinSet setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(1003 * COIN, 1, 6, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet == 1003 * COIN);
+        assert(setCoinsRet.size() == 2);
+    }
+    emptyWallet(vCoins);
+}
+
+// A large wallet where an exact match exists: branch and bound finds a changeless selection
+static void CoinSelectionExactMatch(benchmark::State& state)
+{
+    const CWallet wallet;
+    vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    fillWallet(wallet, vCoins, 10000);
+    CAmount nTarget = 0;
+    for (int i = 0; i < 5; i++)
+        nTarget += vCoins[i * 1000].tx->vout[0].nValue;
+
+    while (state.KeepRunning()) {
+        CoinSet setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(nTarget, 1, 6, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet == nTarget);
+    }
+    emptyWallet(vCoins);
+}
+
+// A large wallet where no changeless selection exists: branch and bound gives up
+// after MAX_BNB_TRIES and the knapsack solver picks the inputs
+static void CoinSelectionKnapsack(benchmark::State& state)
+{
+    const CWallet wallet;
+    vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    fillWallet(wallet, vCoins, 10000);
+
+    while (state.KeepRunning()) {
+        CoinSet setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(250 * COIN + CENT / 2, 1, 6, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet > 250 * COIN);
+    }
+    emptyWallet(vCoins);
+}
+
+BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelectionExactMatch);
+BENCHMARK(CoinSelectionKnapsack);
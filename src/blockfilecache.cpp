@@ -0,0 +1,155 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilecache.h"
+
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileCache blockFileCache;
+
+CBlockFileMapping::~CBlockFileMapping()
+{
+#ifndef WIN32
+    munmap((void*)pData, nSize);
+#endif
+}
+
+/** Map a whole file read-only. Returns NULL if that isn't possible; on Windows files are never mapped. */
+static CBlockFileMapping* MapBlockFile(const boost::filesystem::path& path)
+{
+#ifdef WIN32
+    return NULL;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    void* pData = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid without the descriptor
+    close(fd);
+    if (pData == MAP_FAILED) {
+        LogPrint("blockfile", "%s : mmap of %s failed\n", __func__, path.string());
+        return NULL;
+    }
+    return new CBlockFileMapping((const char*)pData, st.st_size);
+#endif
+}
+
+CBlockFileCache::MappingRef CBlockFileCache::Get(const std::string& strPrefix, int nFile, size_t nMinSize)
+{
+    LOCK(cs);
+    if (nMaxFiles <= 0)
+        return MappingRef();
+
+    FileKey key(strPrefix, nFile);
+    std::map<FileKey, MappingRef>::iterator it = mapFiles.find(key);
+    if (it != mapFiles.end()) {
+        listRecent.remove(key);
+        listRecent.push_front(key);
+        if (it->second->size() >= nMinSize)
+            return it->second;
+    }
+
+    // Not mapped yet, or the file has grown since. Readers still holding the old
+    // mapping keep it alive until they are done.
+    MappingRef mapping(MapBlockFile(GetBlockPosFilename(CDiskBlockPos(nFile, 0), strPrefix.c_str())));
+    if (!mapping) {
+        if (it != mapFiles.end()) {
+            mapFiles.erase(it);
+            listRecent.remove(key);
+        }
+        return MappingRef();
+    }
+    if (it == mapFiles.end()) {
+        mapFiles.insert(std::make_pair(key, mapping));
+        listRecent.push_front(key);
+    } else {
+        it->second = mapping;
+    }
+
+    while ((int)listRecent.size() > nMaxFiles) {
+        mapFiles.erase(listRecent.back());
+        listRecent.pop_back();
+    }
+
+    if (mapping->size() < nMinSize)
+        return MappingRef();
+    return mapping;
+}
+
+bool CBlockFileCache::GetRecord(const CDiskBlockPos& pos, const char* prefix, size_t nTrailer, CBlockFileSpan& span)
+{
+    if (pos.IsNull() || pos.nPos < BLOCKFILE_RECORD_HEADER_SIZE)
+        return false;
+
+    MappingRef mapping = Get(prefix, pos.nFile, pos.nPos);
+    if (!mapping)
+        return false;
+
+    const unsigned char* pHeader = (const unsigned char*)mapping->data() + pos.nPos - BLOCKFILE_RECORD_HEADER_SIZE;
+    if (memcmp(pHeader, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return false;
+    size_t nEnd = (size_t)pos.nPos + ReadLE32(pHeader + MESSAGE_START_SIZE) + nTrailer;
+    if (nEnd > mapping->size()) {
+        mapping = Get(prefix, pos.nFile, nEnd);
+        if (!mapping)
+            return false;
+    }
+
+    span.mapping = mapping;
+    span.pBegin = mapping->data() + pos.nPos;
+    span.pEnd = mapping->data() + nEnd;
+    return true;
+}
+
+void CBlockFileCache::SetMaxFiles(int nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while ((int)listRecent.size() > std::max(nMaxFiles, 0)) {
+        mapFiles.erase(listRecent.back());
+        listRecent.pop_back();
+    }
+}
+
+int CBlockFileCache::GetMaxFiles() const
+{
+    LOCK(cs);
+    return nMaxFiles;
+}
+
+void CBlockFileCache::Invalidate(int nFile)
+{
+    LOCK(cs);
+    const char* prefixes[] = {"blk", "rev"};
+    for (unsigned int i = 0; i < 2; i++) {
+        FileKey key(prefixes[i], nFile);
+        mapFiles.erase(key);
+        listRecent.remove(key);
+    }
+}
+
+void CBlockFileCache::Clear()
+{
+    LOCK(cs);
+    mapFiles.clear();
+    listRecent.clear();
+}
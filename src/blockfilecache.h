@@ -0,0 +1,101 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILECACHE_H
+#define BITCOIN_BLOCKFILECACHE_H
+
+#include "chain.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <stddef.h>
+#include <string>
+#include <utility>
+
+#include <boost/shared_ptr.hpp>
+
+//! Default for -blockfilemaps, the number of block and undo files kept mapped for reading
+static const int DEFAULT_BLOCKFILE_MAPS = 8;
+//! Size of the message start and length header written in front of every block and undo record
+static const unsigned int BLOCKFILE_RECORD_HEADER_SIZE = 8;
+
+/** A read-only memory mapping of a whole blk?????.dat or rev?????.dat file */
+class CBlockFileMapping
+{
+private:
+    // Disallow copies
+    CBlockFileMapping(const CBlockFileMapping&);
+    CBlockFileMapping& operator=(const CBlockFileMapping&);
+
+    const char* pData;
+    size_t nSize;
+
+public:
+    CBlockFileMapping(const char* pDataIn, size_t nSizeIn) : pData(pDataIn), nSize(nSizeIn) {}
+    ~CBlockFileMapping();
+
+    const char* data() const { return pData; }
+    size_t size() const { return nSize; }
+};
+
+/** One record of a mapped file. Holds a reference to the mapping so it stays valid while it is read. */
+class CBlockFileSpan
+{
+public:
+    boost::shared_ptr<const CBlockFileMapping> mapping;
+    const char* pBegin;
+    const char* pEnd;
+
+    CBlockFileSpan() : pBegin(NULL), pEnd(NULL) {}
+
+    const char* begin() const { return pBegin; }
+    const char* end() const { return pEnd; }
+    size_t size() const { return pEnd - pBegin; }
+};
+
+/**
+ * Keeps the most recently read block and undo files memory-mapped, so reading a
+ * block doesn't create directories, open, seek and buffer its file every time.
+ * Records are deserialized straight from the mapping, or handed out as raw bytes.
+ * A file that has grown past its mapping is remapped on demand; files that are
+ * truncated or removed must be invalidated first.
+ */
+class CBlockFileCache
+{
+private:
+    typedef std::pair<std::string, int> FileKey;
+    typedef boost::shared_ptr<const CBlockFileMapping> MappingRef;
+
+    mutable CCriticalSection cs;
+    std::map<FileKey, MappingRef> mapFiles;
+    //! Most recently used first
+    std::list<FileKey> listRecent;
+    int nMaxFiles;
+
+    MappingRef Get(const std::string& strPrefix, int nFile, size_t nMinSize);
+
+public:
+    CBlockFileCache() : nMaxFiles(DEFAULT_BLOCKFILE_MAPS) {}
+
+    //! Set how many files may be mapped at once; 0 disables mapping
+    void SetMaxFiles(int nMaxFilesIn);
+    int GetMaxFiles() const;
+
+    /**
+     * Find the record written at pos, i.e. after its message start and length header.
+     * The span covers the record plus nTrailer bytes following it (e.g. an undo checksum).
+     * Returns false if the file can't be mapped or the header doesn't match; callers
+     * then fall back to reading through stdio, which reports the actual error.
+     */
+    bool GetRecord(const CDiskBlockPos& pos, const char* prefix, size_t nTrailer, CBlockFileSpan& span);
+
+    //! Drop the mappings of block and undo file nFile, before it is truncated or removed
+    void Invalidate(int nFile);
+    void Clear();
+};
+
+extern CBlockFileCache blockFileCache;
+
+#endif // BITCOIN_BLOCKFILECACHE_H
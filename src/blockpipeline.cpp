@@ -0,0 +1,177 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockpipeline.h"
+
+#include "main.h"
+#include "net.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+CBlockPipeline blockPipeline;
+
+void CBlockPipeline::Start(boost::thread_group& threadGroup, int nThreadsIn, ConnectFn connectIn)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nThreads = nThreadsIn;
+        connect = connectIn;
+    }
+    if (nThreadsIn <= 0)
+        return;
+
+    typedef boost::function<void()> Function;
+    for (int i = 0; i < nThreadsIn; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<Function>, "blockcheck", Function(boost::bind(&CBlockPipeline::CheckThread, this))));
+    threadGroup.create_thread(boost::bind(&TraceThread<Function>, "blockconnect", Function(boost::bind(&CBlockPipeline::ConnectThread, this))));
+}
+
+bool CBlockPipeline::IsRunning() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nThreads > 0;
+}
+
+CBlockPipeline::SubmitResult CBlockPipeline::Submit(const boost::shared_ptr<CBlock>& pblock, const uint256& hash, CNode* pfrom)
+{
+    // Whether signatures are skipped depends only on the index, not on when a worker gets to the block
+    int nHeight = -1;
+    bool fAssumeValid = false;
+    if (!hashAssumeValid.IsNull()) {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
+        if (mi != mapBlockIndex.end()) {
+            nHeight = mi->second->nHeight + 1;
+        } else {
+            // A parent leaves the pipeline only once it is indexed
+            boost::unique_lock<boost::mutex> lock(mutex);
+            std::map<uint256, int>::const_iterator it = mapQueued.find(pblock->hashPrevBlock);
+            if (it != mapQueued.end() && it->second >= 0)
+                nHeight = it->second + 1;
+        }
+        fAssumeValid = nHeight >= 0 && IsBlockAssumedValid(hash, nHeight);
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (nThreads <= 0)
+        return SUBMIT_NOT_RUNNING;
+    if (mapQueued.count(hash))
+        return SUBMIT_QUEUED;
+    if (queueConnect.size() >= MAX_PIPELINE_BLOCKS)
+        return SUBMIT_FULL;
+
+    EntryRef entry(new CEntry());
+    entry->pblock = pblock;
+    entry->hash = hash;
+    entry->pfrom = pfrom;
+    entry->fAssumeValid = fAssumeValid;
+    entry->fChecked = false;
+    entry->nTimeReceived = GetTimeMicros();
+    entry->nTimeCheckStart = 0;
+    entry->nTimeChecked = 0;
+    {
+        // Released by the connect thread once the block is processed
+        LOCK(cs_vNodes);
+        pfrom->AddRef();
+    }
+
+    queueCheck.push_back(entry);
+    queueConnect.push_back(entry);
+    // -1 when the parent was neither indexed nor queued
+    mapQueued.insert(std::make_pair(hash, nHeight));
+    condWorker.notify_one();
+    return SUBMIT_QUEUED;
+}
+
+bool CBlockPipeline::IsQueued(const uint256& hash) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return mapQueued.count(hash) > 0;
+}
+
+CBlockPipelineStats CBlockPipeline::GetStats() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    CBlockPipelineStats ret = stats;
+    ret.nThreads = nThreads;
+    ret.nQueued = queueConnect.size();
+    return ret;
+}
+
+void CBlockPipeline::CheckThread()
+{
+    while (true) {
+        EntryRef entry;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queueCheck.empty())
+                condWorker.wait(lock);
+            entry = queueCheck.front();
+            queueCheck.pop_front();
+        }
+
+        int64_t nTimeStart = GetTimeMicros();
+        // Only the outcome cached in the block matters here: a block that fails is
+        // checked again by ProcessNewBlock, which rejects it and punishes the peer.
+        CValidationState state;
+        if (CheckBlockContextFree(*entry->pblock, state) && !entry->fAssumeValid)
+            entry->pblock->CheckBlockSignature();
+        int64_t nTimeEnd = GetTimeMicros();
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        entry->fChecked = true;
+        entry->nTimeCheckStart = nTimeStart;
+        entry->nTimeChecked = nTimeEnd;
+        if (queueConnect.front() == entry)
+            condConnect.notify_one();
+    }
+}
+
+void CBlockPipeline::ConnectThread()
+{
+    while (true) {
+        EntryRef entry;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queueConnect.empty() || !queueConnect.front()->fChecked)
+                condConnect.wait(lock);
+            entry = queueConnect.front();
+        }
+
+        int64_t nTimeStart = GetTimeMicros();
+        try {
+            connect(entry->pfrom, *entry->pblock);
+        } catch (std::exception& e) {
+            PrintExceptionContinue(&e, "CBlockPipeline::ConnectThread()");
+        }
+        int64_t nTimeEnd = GetTimeMicros();
+
+        size_t nQueued;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            // Only now, so a successor arriving meanwhile still finds its parent queued
+            queueConnect.pop_front();
+            mapQueued.erase(entry->hash);
+            nQueued = queueConnect.size();
+            stats.nBlocks++;
+            stats.nTimeWait += entry->nTimeCheckStart - entry->nTimeReceived;
+            stats.nTimeCheck += entry->nTimeChecked - entry->nTimeCheckStart;
+            stats.nTimeReady += nTimeStart - entry->nTimeChecked;
+            stats.nTimeConnect += nTimeEnd - nTimeStart;
+            if (!queueConnect.empty() && queueConnect.front()->fChecked)
+                condConnect.notify_one();
+        }
+        LogPrint("bench", "- Pipeline %s: wait %.2fms, check %.2fms, ready %.2fms, connect %.2fms [%u queued]\n", entry->hash.ToString(),
+            0.001 * (entry->nTimeCheckStart - entry->nTimeReceived), 0.001 * (entry->nTimeChecked - entry->nTimeCheckStart),
+            0.001 * (nTimeStart - entry->nTimeChecked), 0.001 * (nTimeEnd - nTimeStart), (unsigned int)nQueued);
+
+        {
+            LOCK(cs_vNodes);
+            entry->pfrom->Release();
+        }
+    }
+}
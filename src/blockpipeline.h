@@ -0,0 +1,126 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPIPELINE_H
+#define BITCOIN_BLOCKPIPELINE_H
+
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CNode;
+
+namespace boost
+{
+class thread_group;
+} // namespace boost
+
+//! Default for -blockcheckthreads
+static const int DEFAULT_BLOCK_CHECK_THREADS = 2;
+//! Maximum number of block check threads
+static const int MAX_BLOCK_CHECK_THREADS = 16;
+//! Received blocks that may wait in the pipeline; further ones are dropped, to be requested again
+static const unsigned int MAX_PIPELINE_BLOCKS = 256;
+
+/** Cumulative per-stage timings of the blocks that went through the pipeline, in microseconds */
+struct CBlockPipelineStats {
+    int nThreads;
+    uint64_t nBlocks;
+    size_t nQueued;
+    //! Received until a worker picked it up
+    int64_t nTimeWait;
+    //! Context-free checks and block signature
+    int64_t nTimeCheck;
+    //! Checked until its predecessors were connected
+    int64_t nTimeReady;
+    //! Accepting and connecting it
+    int64_t nTimeConnect;
+
+    CBlockPipelineStats() : nThreads(0), nBlocks(0), nQueued(0), nTimeWait(0), nTimeCheck(0), nTimeReady(0), nTimeConnect(0) {}
+};
+
+/**
+ * Staged validation of blocks received from peers. The checks that need nothing but
+ * the block itself (CheckBlockContextFree, including the merkle root, and the block
+ * signature) run on a pool of worker threads as blocks arrive. A single connect thread
+ * then hands the blocks to ProcessNewBlock in the order they were received, so only
+ * the contextual checks and the UTXO connection remain serialized under cs_main.
+ * A block that fails its checks is simply checked again by ProcessNewBlock, which
+ * rejects it exactly as before. Submitting never waits: while the pipeline is full,
+ * the network thread drops the block instead of stalling every peer.
+ */
+class CBlockPipeline
+{
+public:
+    typedef boost::function<void(CNode*, CBlock&)> ConnectFn;
+
+    enum SubmitResult {
+        SUBMIT_QUEUED,
+        SUBMIT_FULL,
+        SUBMIT_NOT_RUNNING
+    };
+
+private:
+    struct CEntry {
+        boost::shared_ptr<CBlock> pblock;
+        uint256 hash;
+        CNode* pfrom;
+        //! Decided under cs_main at submission, so the check threads never wait for it
+        bool fAssumeValid;
+        bool fChecked;
+        int64_t nTimeReceived;
+        int64_t nTimeCheckStart;
+        int64_t nTimeChecked;
+    };
+    typedef boost::shared_ptr<CEntry> EntryRef;
+
+    mutable boost::mutex mutex;
+    //! Workers wait on this for blocks to check
+    boost::condition_variable condWorker;
+    //! The connect thread waits on this for the oldest block to be checked
+    boost::condition_variable condConnect;
+
+    //! Blocks no worker has picked up yet
+    std::deque<EntryRef> queueCheck;
+    //! All blocks in the pipeline, in the order they were received
+    std::deque<EntryRef> queueConnect;
+    //! Heights of the queued blocks, by hash
+    std::map<uint256, int> mapQueued;
+
+    int nThreads;
+    ConnectFn connect;
+    CBlockPipelineStats stats;
+
+    void CheckThread();
+    void ConnectThread();
+
+public:
+    CBlockPipeline() : nThreads(0) {}
+
+    //! Start nThreadsIn check threads and the connect thread; with no check threads the pipeline stays off
+    void Start(boost::thread_group& threadGroup, int nThreadsIn, ConnectFn connectIn);
+    bool IsRunning() const;
+
+    /**
+     * Queue a block received from pfrom. If the pipeline isn't running the caller
+     * processes the block; if it is full the block isn't queued.
+     */
+    SubmitResult Submit(const boost::shared_ptr<CBlock>& pblock, const uint256& hash, CNode* pfrom);
+    //! Whether a block is waiting in the pipeline or being connected
+    bool IsQueued(const uint256& hash) const;
+
+    CBlockPipelineStats GetStats() const;
+};
+
+extern CBlockPipeline blockPipeline;
+
+#endif // BITCOIN_BLOCKPIPELINE_H
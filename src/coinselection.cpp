@@ -0,0 +1,115 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinselection.h"
+
+#include "random.h"
+
+#include <limits>
+
+bool SelectCoinsBnB(const std::vector<CAmount>& vValue, const CAmount& nTarget, const CAmount& nCostOfChange, const CAmount& nInputCost, std::vector<char>& vfSelected, CAmount& nValueRet)
+{
+    vfSelected.clear();
+    nValueRet = 0;
+
+    // nRemaining is the sum of the values not yet decided on
+    CAmount nRemaining = 0;
+    for (size_t i = 0; i < vValue.size(); i++)
+        nRemaining += vValue[i];
+    if (nRemaining < nTarget)
+        return false;
+
+    std::vector<char> vfCurrent(vValue.size(), false);
+    CAmount nCurrent = 0;
+    unsigned int nCurrentInputs = 0;
+    CAmount nBestWaste = std::numeric_limits<CAmount>::max();
+    size_t nDepth = 0;
+
+    for (size_t nTries = 0; nTries < MAX_BNB_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nCurrent + nRemaining < nTarget || nCurrent > nTarget + nCostOfChange) {
+            // Cannot reach the target any more, or already past the window
+            fBacktrack = true;
+        } else if (nCurrent >= nTarget) {
+            CAmount nWaste = (nCurrent - nTarget) + nCurrentInputs * nInputCost;
+            if (nWaste < nBestWaste) {
+                nBestWaste = nWaste;
+                vfSelected = vfCurrent;
+                nValueRet = nCurrent;
+                if (nWaste == 0)
+                    break;
+            }
+            // Adding more inputs only adds waste
+            fBacktrack = true;
+        } else if (nDepth == vValue.size()) {
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Step back to the last included value and take the branch that excludes it
+            while (nDepth > 0 && !vfCurrent[nDepth - 1]) {
+                nDepth--;
+                nRemaining += vValue[nDepth];
+            }
+            if (nDepth == 0)
+                break;
+            vfCurrent[nDepth - 1] = false;
+            nCurrent -= vValue[nDepth - 1];
+            nCurrentInputs--;
+            continue;
+        }
+
+        // Include the next value, unless an equal one was just excluded: that branch is already covered
+        nRemaining -= vValue[nDepth];
+        if (nDepth > 0 && !vfCurrent[nDepth - 1] && vValue[nDepth] == vValue[nDepth - 1]) {
+            vfCurrent[nDepth] = false;
+        } else {
+            vfCurrent[nDepth] = true;
+            nCurrent += vValue[nDepth];
+            nCurrentInputs++;
+        }
+        nDepth++;
+    }
+
+    return !vfSelected.empty();
+}
+
+void ApproximateBestSubset(const std::vector<CAmount>& vValue, const CAmount& nTotalLower, const CAmount& nTarget, std::vector<char>& vfBest, CAmount& nBest, int nIterations)
+{
+    std::vector<char> vfIncluded;
+
+    vfBest.assign(vValue.size(), true);
+    nBest = nTotalLower;
+
+    seed_insecure_rand();
+
+    for (int nRep = 0; nRep < nIterations && nBest != nTarget; nRep++) {
+        vfIncluded.assign(vValue.size(), false);
+        CAmount nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
+            for (unsigned int i = 0; i < vValue.size(); i++) {
+                //The solver here uses a randomized algorithm,
+                //the randomness serves no real security purpose but is just
+                //needed to prevent degenerate behavior and it is important
+                //that the rng is fast. We do not use a constant random sequence,
+                //because there may be some privacy improvement by making
+                //the selection random.
+                if (nPass == 0 ? insecure_rand() & 1 : !vfIncluded[i]) {
+                    nTotal += vValue[i];
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTarget) {
+                        fReachedTarget = true;
+                        if (nTotal < nBest) {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= vValue[i];
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSELECTION_H
+#define BITCOIN_COINSELECTION_H
+
+#include "amount.h"
+
+#include <stddef.h>
+#include <vector>
+
+class CWalletTx;
+
+//! Maximum number of search steps SelectCoinsBnB takes before settling for the best solution so far
+static const size_t MAX_BNB_TRIES = 100000;
+
+/** A spendable output reduced to what coin selection looks at, computed once for all confirmation tiers */
+struct CSelectionCoin {
+    const CWalletTx* pwtx;
+    unsigned int n;
+    CAmount nValue;
+    int nDepth;
+    bool fFromMe;
+};
+
+/**
+ * Branch-and-bound search for a subset of vValue that sums to at least nTarget and at
+ * most nTarget + nCostOfChange, i.e. one that needs no change output. vValue must be
+ * sorted in descending order. Of the solutions visited, the one with the least waste
+ * (excess over nTarget plus nInputCost for every input) is returned in vfSelected.
+ */
+bool SelectCoinsBnB(const std::vector<CAmount>& vValue, const CAmount& nTarget, const CAmount& nCostOfChange, const CAmount& nInputCost, std::vector<char>& vfSelected, CAmount& nValueRet);
+
+/**
+ * Stochastic approximation of the smallest subset of vValue (sorted in descending order)
+ * summing to at least nTarget. nTotalLower is the sum of vValue; the best subset found in
+ * nIterations random passes is returned in vfBest and its sum in nBest.
+ */
+void ApproximateBestSubset(const std::vector<CAmount>& vValue, const CAmount& nTotalLower, const CAmount& nTarget, std::vector<char>& vfBest, CAmount& nBest, int nIterations = 1000);
+
+#endif // BITCOIN_COINSELECTION_H
@@ -366,8 +366,79 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+// The outputs of a stake input's transaction and the block it was in, from the coins
+// database; the kernel and the signature check need nothing else of the transaction
+static bool GetStakeInputFromCoins(const COutPoint& prevout, const CCoinsViewCache* pcoins, CTransaction& txPrev, uint256& hashBlock)
+{
+    const CCoins* coins = pcoins->AccessCoins(prevout.hash);
+    if (!coins || !coins->IsAvailable(prevout.n) || chainActive[coins->nHeight] == NULL)
+        return false;
+
+    CMutableTransaction tx;
+    tx.nVersion = coins->nVersion;
+    tx.vout = coins->vout;
+    txPrev = CTransaction(tx);
+    hashBlock = chainActive[coins->nHeight]->GetBlockHash();
+    return true;
+}
+
+// A stake input on a fork that the active chain spent since: its output from the undo
+// data of the spending block, which -prune keeps for as long as the input is tracked
+static bool GetStakeInputFromUndo(const COutPoint& prevout, CTransaction& txPrev, uint256& hashBlock)
+{
+    int nSpendHeight;
+    {
+        LOCK(cs_mapstake);
+        std::map<COutPoint, int>::const_iterator it = mapStakeSpent.find(prevout);
+        if (it == mapStakeSpent.end())
+            return false;
+        nSpendHeight = it->second;
+    }
+
+    CBlockIndex* pindexSpend = chainActive[nSpendHeight];
+    if (pindexSpend == NULL || pindexSpend->pprev == NULL || pindexSpend->GetUndoPos().IsNull())
+        return false;
+    CBlock block;
+    CBlockUndo blockUndo;
+    if (!ReadBlockFromDisk(block, pindexSpend) || !blockUndo.ReadFromDisk(pindexSpend->GetUndoPos(), pindexSpend->pprev->GetBlockHash()))
+        return false;
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return false;
+
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            if (tx.vin[j].prevout != prevout || j >= blockUndo.vtxundo[i - 1].vprevout.size())
+                continue;
+
+            const CTxInUndo& undo = blockUndo.vtxundo[i - 1].vprevout[j];
+            int nHeight = undo.nHeight;
+            int nVersion = undo.nVersion;
+            if (nHeight == 0) {
+                // other outputs of the transaction are still unspent, the coins have its height
+                const CCoins* coins = pcoinsTip->AccessCoins(prevout.hash);
+                if (!coins)
+                    return false;
+                nHeight = coins->nHeight;
+                nVersion = coins->nVersion;
+            }
+            if (chainActive[nHeight] == NULL)
+                return false;
+
+            CMutableTransaction txSpent;
+            txSpent.nVersion = nVersion;
+            txSpent.vout.resize(prevout.n + 1);
+            txSpent.vout[prevout.n] = undo.txout;
+            txPrev = CTransaction(txSpent);
+            hashBlock = chainActive[nHeight]->GetBlockHash();
+            return true;
+        }
+    }
+    return false;
+}
+
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
+bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, bool fAssumeValid, const CCoinsViewCache* pcoins)
 {
     const CTransaction tx = block.vtx[1];
     if (!tx.IsCoinStake())
@@ -379,11 +450,14 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
     // First try finding the previous transaction in database
     uint256 hashBlock;
     CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
+    // then the coins, and for a fork of the active chain the spent outputs it tracks
+    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true) &&
+        !GetStakeInputFromCoins(txin.prevout, pcoins ? pcoins : pcoinsTip, txPrev, hashBlock) &&
+        (pcoins != NULL || !GetStakeInputFromUndo(txin.prevout, txPrev, hashBlock)))
         return error("CheckProofOfStake() : INFO: read txPrev failed");
 
     //verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
+    if (!fAssumeValid && !VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
         return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
 
     CBlockIndex* pindex = NULL;
@@ -395,12 +469,15 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
 
     // Read block header
     CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+        blockprev = pindex->GetBlockHeader(); // pruned or below a UTXO snapshot; the kernel only uses the header
+    else if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
         return error("CheckProofOfStake(): INFO: failed to find block");
 
     unsigned int nInterval = 0;
     unsigned int nTime = block.nTime;
-    if (!CheckStakeKernelHash(block.nBits, blockprev, txPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
+    // The proof hash is recorded in the block index either way
+    if (!CheckStakeKernelHash(block.nBits, blockprev, txPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug) && !fAssumeValid)
         return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s \n", tx.GetHash().ToString().c_str(), hashProofOfStake.ToString().c_str()); // may occur during initial download or if behind on block chain sync
 
     return true;
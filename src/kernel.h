@@ -28,8 +28,11 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
 
 // Check kernel hash target and coinstake signature
-// Sets hashProofOfStake on success return
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
+// Sets hashProofOfStake on success return. With fAssumeValid neither is
+// checked; hashProofOfStake is still computed for the block index.
+// Stake inputs whose transaction can't be read are looked up in pcoins
+// (pcoinsTip by default), as happens below a UTXO snapshot.
+bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, bool fAssumeValid = false, const CCoinsViewCache* pcoins = NULL);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
@@ -11,6 +11,8 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilecache.h"
+#include "blockpipeline.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -22,6 +24,8 @@
 #include "merkleblock.h"
 #include "net.h"
 #include "pow.h"
+#include "relaycache.h"
+#include "snapshot.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "swifttx.h"
@@ -84,6 +88,11 @@ bool fReindex = false;
 bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+uint256 hashAssumeValid;
+bool fPruneMode = false;
+bool fHavePruned = false;
+uint64_t nPruneTarget = 0;
+bool fFastPrune = false;
 unsigned int nCoinCacheSize = 5000;
 bool fAlerts = DEFAULT_ALERTS;
 
@@ -190,6 +199,9 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
+
+/** Whether a prune mode flush should look for block files to delete; set on startup and when block files grow */
+bool fCheckForPruning = false;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -535,6 +547,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+CCoinsViewDB* pcoinsdbview = NULL;
 CCoinsViewCache* pcoinsTip = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CSporkDB* pSporkDB = NULL;
@@ -837,10 +850,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
     if (nResult < 0) nResult = 0;
 
     if (nResult < 6) {
-        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-        if (i != mapTxLocks.end()) {
-            sigs = (*i).second.CountSignatures();
-        }
+        sigs = txLockManager.CountSignatures(nTXHash);
         if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
             return nSwiftTXDepth + nResult;
         }
@@ -851,12 +861,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
 
 int GetIXConfirmations(uint256 nTXHash)
 {
-    int sigs = 0;
-
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()) {
-        sigs = (*i).second.CountSignatures();
-    }
+    int sigs = txLockManager.CountSignatures(nTXHash);
     if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
         return nSwiftTXDepth;
     }
@@ -1066,14 +1071,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
     // ----------- swiftTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 hashLock;
+    if (txLockManager.IsConflicting(tx, hashLock)) {
+        return state.DoS(0,
+            error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
+            REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1249,14 +1251,11 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
     // ----------- swiftTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 hashLock;
+    if (txLockManager.IsConflicting(tx, hashLock)) {
+        return state.DoS(0,
+            error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
+            REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1406,6 +1405,15 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     return true;
 }
 
+//! Whether block file nFile was deleted by -prune
+static bool IsBlockFilePruned(int nFile)
+{
+    if (!fHavePruned)
+        return false;
+    LOCK(cs_LastBlockFile);
+    return nFile < (int)vinfoBlockFile.size() && vinfoBlockFile[nFile].nSize == 0;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
@@ -1421,6 +1429,8 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
+                if (IsBlockFilePruned(postx.nFile))
+                    return pblocktree->ReadKeptTransaction(hash, hashBlock, txOut);
                 CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
                 if (file.IsNull())
                     return error("%s: OpenBlockFile failed", __func__);
@@ -1457,6 +1467,8 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
 
     if (pindexSlow) {
         CBlock block;
+        if (!(pindexSlow->nStatus & BLOCK_HAVE_DATA))
+            return fHavePruned && pblocktree->ReadKeptTransaction(hash, hashBlock, txOut);
         if (ReadBlockFromDisk(block, pindexSlow)) {
             BOOST_FOREACH (const CTransaction& tx, block.vtx) {
                 if (tx.GetHash() == hash) {
@@ -1501,14 +1513,18 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read block, straight from the mapped block file when possible
     try {
-        filein >> block;
+        CBlockFileSpan span;
+        if (blockFileCache.GetRecord(pos, "blk", 0, span)) {
+            CSpanReader filein(span.begin(), span.end(), SER_DISK, CLIENT_VERSION);
+            filein >> block;
+        } else {
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk : OpenBlockFile failed");
+            filein >> block;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -1533,6 +1549,59 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<char>& vchBlock, const CDiskBlockPos& pos)
+{
+    vchBlock.clear();
+
+    CBlockFileSpan span;
+    if (blockFileCache.GetRecord(pos, "blk", 0, span)) {
+        vchBlock.assign(span.begin(), span.end());
+        return true;
+    }
+
+    // The length is written in front of the block
+    if (pos.IsNull() || pos.nPos < BLOCKFILE_RECORD_HEADER_SIZE)
+        return error("ReadRawBlockFromDisk : invalid position %d:%u", pos.nFile, pos.nPos);
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - BLOCKFILE_RECORD_HEADER_SIZE), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadRawBlockFromDisk : OpenBlockFile failed");
+    try {
+        MessageStartChars pchMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("ReadRawBlockFromDisk : block header mismatch at %d:%u", pos.nFile, pos.nPos);
+        if (nSize > MAX_BLOCK_SIZE)
+            return error("ReadRawBlockFromDisk : block size %u too large at %d:%u", nSize, pos.nFile, pos.nPos);
+        vchBlock.resize(nSize);
+        filein.read(begin_ptr(vchBlock), nSize);
+    } catch (std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<char>& vchBlock, const CBlockIndex* pindex)
+{
+    if (!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos()))
+        return false;
+
+    // The bytes are relayed as this block, so at least their header must hash to it
+    CBlockHeader header;
+    try {
+        CSpanReader filein(begin_ptr(vchBlock), end_ptr(vchBlock), SER_DISK, CLIENT_VERSION);
+        filein >> header;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize error - %s", __func__, e.what());
+    }
+    if (header.GetHash() != pindex->GetBlockHash()) {
+        LogPrintf("%s : block=%s index=%s\n", __func__, header.GetHash().ToString().c_str(), pindex->GetBlockHash().ToString().c_str());
+        return error("ReadRawBlockFromDisk(vector<char>&, CBlockIndex*) : header hash doesn't match index");
+    }
+    return true;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -1922,7 +1991,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fJustCheck)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -1997,7 +2066,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
 
-                {
+                if (!fJustCheck) {
                     LOCK(cs_mapstake);
                     // erase the spent input
                     mapStakeSpent.erase(out);
@@ -2023,6 +2092,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    // Truncating under a mapping would fault readers past the new end
+    if (fFinalize)
+        blockFileCache.Invalidate(nLastBlockFile);
+
     FILE* fileOld = OpenBlockFile(posOld);
     if (fileOld) {
         if (fFinalize)
@@ -2085,6 +2158,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             REJECT_INVALID, "PoW-ended");
 
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    if (fScriptChecks && IsBlockAssumedValid(pindex->GetBlockHash(), pindex->nHeight))
+        fScriptChecks = false;
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
@@ -2289,7 +2364,158 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     return true;
 }
 
+uint64_t CalculateCurrentUsage()
+{
+    LOCK(cs_LastBlockFile);
+
+    uint64_t nUsage = 0;
+    BOOST_FOREACH (const CBlockFileInfo& info, vinfoBlockFile)
+        nUsage += info.nSize + info.nUndoSize;
+    return nUsage;
+}
+
+int GetPruneHeight()
+{
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Tip();
+    if (pindex == NULL)
+        return 0;
+    while (pindex->pprev && (pindex->pprev->nStatus & BLOCK_HAVE_DATA))
+        pindex = pindex->pprev;
+    return pindex->nHeight;
+}
+
+// Budget proposal and finalization collateral: an OP_RETURN output committing to a hash
+// that burns the fee. The budget code looks these up by txid for as long as the
+// proposal or budget is around, so they have to survive pruning.
+static bool IsKeptTransaction(const CTransaction& tx)
+{
+    BOOST_FOREACH (const CTxOut& out, tx.vout) {
+        const CScript& script = out.scriptPubKey;
+        if (out.nValue > 0 && script.size() == 34 && script[0] == OP_RETURN && script[1] == 32)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Forget the data of vBlocks, the block index entries with data in block file nFile, after
+ * saving the transactions of the active chain that are still looked up by txid. The files
+ * themselves are only removed by UnlinkPrunedFiles, once the block index no longer refers to them.
+ */
+static bool PruneOneBlockFile(int nFile, const std::vector<CBlockIndex*>& vBlocks)
+{
+    std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > vKept;
+    BOOST_FOREACH (CBlockIndex* pindex, vBlocks) {
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !chainActive.Contains(pindex))
+            continue;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex))
+            return error("%s : can't read block %s", __func__, pindex->GetBlockHash().ToString());
+        BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+            if (IsKeptTransaction(tx))
+                vKept.push_back(std::make_pair(tx.GetHash(), std::make_pair(pindex->GetBlockHash(), tx)));
+        }
+    }
+    if (!vKept.empty() && !pblocktree->WriteKeptTransactions(vKept))
+        return error("%s : failed to write kept transactions", __func__);
+
+    BOOST_FOREACH (CBlockIndex* pindex, vBlocks) {
+        pindex->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+        pindex->nFile = 0;
+        pindex->nDataPos = 0;
+        pindex->nUndoPos = 0;
+        setDirtyBlockIndex.insert(pindex);
+
+        // A pruned block has to be downloaded again before its descendants can be connected,
+        // and is then linked up as usual
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+        while (range.first != range.second) {
+            std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first++;
+            if (itUnlinked->second == pindex)
+                mapBlocksUnlinked.erase(itUnlinked);
+        }
+    }
+
+    vinfoBlockFile[nFile].SetNull();
+    setDirtyFileInfo.insert(nFile);
+    LogPrint("prune", "Prune: block file %05u, kept %u transactions\n", nFile, (unsigned int)vKept.size());
+    return true;
+}
+
+/**
+ * Pick the oldest block files to prune until the block and undo files fit -prune again.
+ * Files with blocks less than MIN_BLOCKS_TO_KEEP deep are left alone, which keeps the undo
+ * data of every reorganization we'd accept. Stake inputs and masternode collateral are
+ * unspent outputs, which the coins database has, and budget collateral is kept by
+ * PruneOneBlockFile. Below a UTXO snapshot, blocks stay until the history is validated.
+ */
+static void FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    if (chainActive.Tip() == NULL || nPruneTarget == 0)
+        return;
+
+    int nLastBlockWeCanPrune = chainActive.Height() - std::max((int)MIN_BLOCKS_TO_KEEP, Params().MaxReorganizationDepth());
+    CSnapshotMetadata snapshot;
+    int nValidatedHeight;
+    bool fValidated;
+    if (GetSnapshotStatus(snapshot, nValidatedHeight, fValidated) && !fValidated)
+        nLastBlockWeCanPrune = std::min(nLastBlockWeCanPrune, nValidatedHeight);
+    if (nLastBlockWeCanPrune <= 0)
+        return;
+
+    // The file sizes alone decide which files go
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // Room for the chunks the next blocks pre-allocate
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    std::map<int, std::vector<CBlockIndex*> > mapFileBlocks;
+    for (int nFile = 0; nFile < nLastBlockFile && nCurrentUsage + nBuffer >= nPruneTarget; nFile++) {
+        const CBlockFileInfo& info = vinfoBlockFile[nFile];
+        if (info.nSize == 0 || info.nHeightLast > (unsigned int)nLastBlockWeCanPrune)
+            continue;
+        mapFileBlocks[nFile];
+        nCurrentUsage -= info.nSize + info.nUndoSize;
+    }
+    if (mapFileBlocks.empty())
+        return;
+
+    // One walk over the block index finds the entries of all of them
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (!(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)))
+            continue;
+        std::map<int, std::vector<CBlockIndex*> >::iterator mi = mapFileBlocks.find(pindex->nFile);
+        if (mi != mapFileBlocks.end())
+            mi->second.push_back(pindex);
+    }
+
+    for (std::map<int, std::vector<CBlockIndex*> >::iterator mi = mapFileBlocks.begin(); mi != mapFileBlocks.end(); ++mi) {
+        if (!PruneOneBlockFile(mi->first, mi->second)) {
+            // this file and the later ones stay
+            for (; mi != mapFileBlocks.end(); ++mi)
+                nCurrentUsage += vinfoBlockFile[mi->first].nSize + vinfoBlockFile[mi->first].nUndoSize;
+            break;
+        }
+        setFilesToPrune.insert(mi->first);
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024, nLastBlockWeCanPrune, setFilesToPrune.size());
+}
+
+static void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    BOOST_FOREACH (int nFile, setFilesToPrune) {
+        CDiskBlockPos pos(nFile, 0);
+        blockFileCache.Invalidate(nFile);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: deleted blk/rev (%05u)\n", nFile);
+    }
+}
+
 enum FlushStateMode {
+    FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
     FLUSH_STATE_ALWAYS
@@ -2298,14 +2524,28 @@ enum FlushStateMode {
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
- * fast is not set and it's been a while since the last write.
+ * fast is not set and it's been a while since the last write. In prune mode, block files
+ * are pruned first when they have grown, which forces a flush as well.
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
-    LOCK(cs_main);
+    LOCK2(cs_main, cs_LastBlockFile);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
@@ -2336,11 +2576,14 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 setDirtyBlockIndex.erase(it++);
             }
             pblocktree->Sync();
+            // Only now nothing refers to the pruned files anymore
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Error("Failed to write to coin database");
             // Update best block in wallet (so we can detect restored wallets).
-            if (mode != FLUSH_STATE_IF_NEEDED) {
+            if (mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
             }
             nLastWrite = GetTimeMicros();
@@ -2357,6 +2600,16 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        fCheckForPruning = true;
+    }
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -2534,75 +2787,6 @@ bool DisconnectBlocksAndReprocess(int blocks)
     return true;
 }
 
-/*
-    DisconnectBlockAndInputs
-
-    Remove conflicting blocks for successful SwiftTX transaction locks
-    This should be very rare (Probably will never happen)
-*/
-// ***TODO*** clean up here
-bool DisconnectBlockAndInputs(CValidationState& state, CTransaction txLock)
-{
-    // All modifications to the coin state will be done in this cache.
-    // Only when all have succeeded, we push it to pcoinsTip.
-    //    CCoinsViewCache view(*pcoinsTip, true);
-
-    CBlockIndex* BlockReading = chainActive.Tip();
-    CBlockIndex* pindexNew = NULL;
-
-    bool foundConflictingTx = false;
-
-    //remove anything conflicting in the memory pool
-    list<CTransaction> txConflicted;
-    mempool.removeConflicts(txLock, txConflicted);
-
-    // List of what to disconnect (typically nothing)
-    vector<CBlockIndex*> vDisconnect;
-
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0 && !foundConflictingTx && i < 6; i++) {
-        vDisconnect.push_back(BlockReading);
-        pindexNew = BlockReading->pprev; //new best block
-
-        CBlock block;
-        if (!ReadBlockFromDisk(block, BlockReading))
-            return state.Error(_("Failed to read block"));
-
-        // Queue memory transactions to resurrect.
-        // We only do this for blocks after the last checkpoint (reorganisation before that
-        // point should only happen with -reindex/-loadblock, or a misbehaving peer.
-        BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-            if (!tx.IsCoinBase()) {
-                BOOST_FOREACH (const CTxIn& in1, txLock.vin) {
-                    BOOST_FOREACH (const CTxIn& in2, tx.vin) {
-                        if (in1.prevout == in2.prevout) foundConflictingTx = true;
-                    }
-                }
-            }
-        }
-
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
-    }
-
-    if (!foundConflictingTx) {
-        LogPrintf("DisconnectBlockAndInputs: Can't find a conflicting transaction to inputs\n");
-        return false;
-    }
-
-    if (vDisconnect.size() > 0) {
-        LogPrintf("REORGANIZE: Disconnect Conflicting Blocks %lli blocks; %s..\n", vDisconnect.size(), pindexNew->GetBlockHash().ToString());
-        BOOST_FOREACH (CBlockIndex* pindex, vDisconnect) {
-            LogPrintf(" -- disconnect %s\n", pindex->GetBlockHash().ToString());
-            DisconnectTip(state);
-        }
-    }
-
-    return true;
-}
-
 /**
  * Return the tip of the chain with the most work in it, that isn't
  * known to be invalid (it's however far from certain to be valid).
@@ -3003,8 +3187,10 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         vinfoBlockFile.resize(nFile + 1);
     }
 
+    const unsigned int nMaxFileSize = fFastPrune ? FASTPRUNE_BLOCKFILE_SIZE : MAX_BLOCKFILE_SIZE;
+    const unsigned int nChunkSize = fFastPrune ? FASTPRUNE_BLOCKFILE_SIZE : BLOCKFILE_CHUNK_SIZE;
     if (!fKnown) {
-        while (vinfoBlockFile[nFile].nSize + nAddSize >= MAX_BLOCKFILE_SIZE) {
+        while (vinfoBlockFile[nFile].nSize + nAddSize >= nMaxFileSize) {
             LogPrintf("Leaving block file %i: %s\n", nFile, vinfoBlockFile[nFile].ToString());
             FlushBlockFile(true);
             nFile++;
@@ -3024,14 +3210,16 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         vinfoBlockFile[nFile].nSize += nAddSize;
 
     if (!fKnown) {
-        unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
-        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
+        unsigned int nOldChunks = (pos.nPos + nChunkSize - 1) / nChunkSize;
+        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + nChunkSize - 1) / nChunkSize;
         if (nNewChunks > nOldChunks) {
-            if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
+            if (fPruneMode)
+                fCheckForPruning = true;
+            if (CheckDiskSpace(nNewChunks * nChunkSize - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
+                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * nChunkSize, pos.nFile);
+                    AllocateFileRange(file, pos.nPos, nNewChunks * nChunkSize - pos.nPos);
                     fclose(file);
                 }
             } else
@@ -3054,14 +3242,17 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     nNewSize = vinfoBlockFile[nFile].nUndoSize += nAddSize;
     setDirtyFileInfo.insert(nFile);
 
-    unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
-    unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
+    const unsigned int nChunkSize = fFastPrune ? FASTPRUNE_BLOCKFILE_SIZE : UNDOFILE_CHUNK_SIZE;
+    unsigned int nOldChunks = (pos.nPos + nChunkSize - 1) / nChunkSize;
+    unsigned int nNewChunks = (nNewSize + nChunkSize - 1) / nChunkSize;
     if (nNewChunks > nOldChunks) {
-        if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
+        if (fPruneMode)
+            fCheckForPruning = true;
+        if (CheckDiskSpace(nNewChunks * nChunkSize - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
-                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
-                AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
+                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * nChunkSize, pos.nFile);
+                AllocateFileRange(file, pos.nPos, nNewChunks * nChunkSize - pos.nPos);
                 fclose(file);
             }
         } else
@@ -3081,7 +3272,7 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+bool CheckBlockContextFree(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
 
@@ -3091,12 +3282,6 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("CheckBlock() : CheckBlockHeader failed"),
             REJECT_INVALID, "bad-header", true);
 
-    // Check timestamp
-    LogPrint("debug", "%s: block=%s  is proof of stake=%d\n", __func__, block.GetHash().ToString().c_str(), block.IsProofOfStake());
-    if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? 180 : 7200)) // 3 minute future drift for PoS
-        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"),
-            REJECT_INVALID, "time-too-new");
-
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
@@ -3145,20 +3330,48 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
                 return state.DoS(100, error("CheckBlock() : more than one coinstake"));
     }
 
+    // Check transactions
+    for (const CTransaction& tx : block.vtx)
+        if (!CheckTransaction(tx, state))
+            return error("CheckBlock() : CheckTransaction failed");
+
+    unsigned int nSigOps = 0;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        nSigOps += GetLegacySigOpCount(tx);
+    }
+    if (nSigOps > MAX_BLOCK_SIGOPS)
+        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
+            REJECT_INVALID, "bad-blk-sigops", true);
+
+    if (fCheckPOW && fCheckMerkleRoot)
+        block.fChecked = true;
+
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+{
+    if (!block.fChecked && !CheckBlockContextFree(block, state, fCheckPOW, fCheckMerkleRoot))
+        return false;
+
+    // Check timestamp, every time as it depends on the clock. A block from the
+    // future may become valid, so it isn't marked as failed.
+    LogPrint("debug", "%s: block=%s  is proof of stake=%d\n", __func__, block.GetHash().ToString().c_str(), block.IsProofOfStake());
+    if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? 180 : 7200)) // 3 minute future drift for PoS
+        return state.DoS(0, error("CheckBlock() : block timestamp too far in the future"),
+            REJECT_INVALID, "time-too-new", true);
+
     // ----------- swiftTX transaction scanning -----------
     if (IsSporkActive(SPORK_3_SWIFTTX_BLOCK_FILTERING)) {
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
             if (!tx.IsCoinBase()) {
                 //only reject blocks when it's based on complete consensus
-                BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                    if (mapLockedInputs.count(in.prevout)) {
-                        if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                            mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
-                            LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", mapLockedInputs[in.prevout].ToString(), tx.GetHash().ToString());
-                            return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
-                                REJECT_INVALID, "conflicting-tx-ix");
-                        }
-                    }
+                uint256 hashLock;
+                if (txLockManager.IsConflicting(tx, hashLock)) {
+                    mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
+                    LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", hashLock.ToString(), tx.GetHash().ToString());
+                    return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
+                        REJECT_INVALID, "conflicting-tx-ix");
                 }
             }
         }
@@ -3196,19 +3409,62 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
-    // Check transactions
-    for (const CTransaction& tx : block.vtx)
-        if (!CheckTransaction(tx, state))
-            return error("CheckBlock() : CheckTransaction failed");
+    return true;
+}
 
-    unsigned int nSigOps = 0;
-    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-        nSigOps += GetLegacySigOpCount(tx);
-    }
-    if (nSigOps > MAX_BLOCK_SIGOPS)
-        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
-            REJECT_INVALID, "bad-blk-sigops", true);
+/**
+ * Whether the block at nHeight with the given hash lies on the chain of the -assumevalid
+ * block, and that block is itself on our best header chain. Scripts and stake signatures
+ * of such blocks were already verified by everyone who accepted the assumed-valid block.
+ */
+bool IsBlockAssumedValid(const uint256& hash, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid.IsNull())
+        return false;
+    BlockMap::iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it == mapBlockIndex.end())
+        return false;
+    CBlockIndex* pindexAssumeValid = it->second;
+    if (pindexBestHeader == NULL || pindexBestHeader->GetAncestor(pindexAssumeValid->nHeight) != pindexAssumeValid)
+        return false;
+    if (nHeight > pindexAssumeValid->nHeight)
+        return false;
+    CBlockIndex* pindex = pindexAssumeValid->GetAncestor(nHeight);
+    return pindex != NULL && pindex->GetBlockHash() == hash;
+}
 
+bool IsBlockAssumedValid(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid.IsNull())
+        return false;
+    BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+    if (mi == mapBlockIndex.end())
+        return false;
+    return IsBlockAssumedValid(block.GetHash(), mi->second->nHeight + 1);
+}
+
+bool CheckStakeSpent(const CTransaction& txStake, const CBlockIndex* pindexPrev)
+{
+    AssertLockHeld(cs_main);
+
+    CCoinsViewCache coins(pcoinsTip);
+    if (coins.HaveInputs(txStake))
+        return true;
+
+    LOCK(cs_mapstake);
+
+    // the inputs are spent at the chain tip so we should look at the recently spent outputs
+    for (CTxIn in : txStake.vin) {
+        auto it = mapStakeSpent.find(in.prevout);
+        if (it == mapStakeSpent.end()) {
+            return false;
+        }
+        if (it->second < pindexPrev->nHeight) {
+            return false;
+        }
+    }
     return true;
 }
 
@@ -3236,7 +3492,7 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
         uint256 hashProofOfStake;
         uint256 hash = block.GetHash();
 
-        if(!CheckProofOfStake(block, hashProofOfStake)) {
+        if(!CheckProofOfStake(block, hashProofOfStake, IsBlockAssumedValid(hash, pindexPrev->nHeight + 1))) {
             LogPrintf("WARNING: ProcessBlock(): check proof-of-stake failed for block %s\n", hash.ToString().c_str());
             return false;
         }
@@ -3435,22 +3691,8 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
     if (block.IsProofOfStake()) {
         LOCK(cs_main);
 
-        CCoinsViewCache coins(pcoinsTip);
-
-        if (!coins.HaveInputs(block.vtx[1])) {
-            LOCK(cs_mapstake);
-
-            // the inputs are spent at the chain tip so we should look at the recently spent outputs
-            for (CTxIn in : block.vtx[1].vin) {
-                auto it = mapStakeSpent.find(in.prevout);
-                if (it == mapStakeSpent.end()) {
-                    return false;
-                }
-                if (it->second < pindexPrev->nHeight) {
-                    return false;
-                }
-            }
-        }
+        if (!CheckStakeSpent(block.vtx[1], pindexPrev))
+            return false;
 
         // if this is on a fork
         if (pindexPrev != NULL && !chainActive.Contains(pindexPrev)) {
@@ -3569,8 +3811,44 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+/**
+ * Store a block of the active chain below a loaded UTXO snapshot. Its index entry came
+ * with the snapshot; the background validation of the snapshot checks its contents.
+ */
+static bool AcceptSnapshotHistoryBlock(CBlock& block, CValidationState& state, CDiskBlockPos* dbp)
+{
+    LOCK(cs_main);
+    uint256 hash = block.GetHash();
+    MarkBlockAsReceived(hash);
+    CBlockIndex* pindex = mapBlockIndex[hash];
+    if (pindex->nStatus & BLOCK_HAVE_DATA)
+        return true;
+    if (!CheckBlockContextFree(block, state))
+        return error("%s : CheckBlockContextFree FAILED for block %s", __func__, hash.GetHex());
+
+    try {
+        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        CDiskBlockPos blockPos;
+        if (dbp != NULL)
+            blockPos = *dbp;
+        if (!FindBlockPos(state, blockPos, nBlockSize + 8, pindex->nHeight, block.GetBlockTime(), dbp != NULL))
+            return error("%s : FindBlockPos failed", __func__);
+        if (dbp == NULL)
+            if (!WriteBlockToDisk(block, blockPos))
+                return state.Error("Failed to write block");
+        if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
+            return error("%s : ReceivedBlockTransactions failed", __func__);
+    } catch (std::runtime_error& e) {
+        return state.Error(std::string("System error: ") + e.what());
+    }
+    return true;
+}
+
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
 {
+    if (IsSnapshotHistoryBlock(pblock->GetHash()))
+        return AcceptSnapshotHistoryBlock(*pblock, state, dbp);
+
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
     bool checked = CheckBlock(*pblock, state);
@@ -3582,7 +3860,12 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     //    return error("ProcessNewBlock() : duplicate proof-of-stake (%s, %d) for block %s", pblock->GetProofOfStake().first.ToString().c_str(), pblock->GetProofOfStake().second, pblock->GetHash().ToString().c_str());
 
     // NovaCoin: check proof-of-stake block signature
-    if (!pblock->CheckBlockSignature())
+    bool fAssumeValid = false;
+    if (!hashAssumeValid.IsNull()) {
+        LOCK(cs_main);
+        fAssumeValid = IsBlockAssumedValid(*pblock);
+    }
+    if (!fAssumeValid && !pblock->CheckBlockSignature())
         return error("ProcessNewBlock() : bad proof-of-stake block signature");
 
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
@@ -3617,6 +3900,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         return error("%s : ActivateBestChain failed", __func__);
 
     if (!fLiteMode) {
+        masternodePayments.UpdateSchedule(GetHeight());
         if (masternodeSync.RequestedMasternodeAssets > MASTERNODE_SYNC_LIST) {
             masternodePayments.ProcessBlock(GetHeight() + 10);
             budget.NewBlock();
@@ -3766,7 +4050,8 @@ bool static LoadBlockIndexDB(string& strError)
     BOOST_FOREACH (const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight) {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // Blocks below a UTXO snapshot have their transaction count without the data
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3805,6 +4090,11 @@ bool static LoadBlockIndexDB(string& strError)
         }
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     set<int> setBlkDataFiles;
@@ -3953,6 +4243,10 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrintf("VerifyDB(): block verification stopping at height %d (no data)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -3972,7 +4266,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            if (!DisconnectBlock(block, state, pindex, coins, &fClean, true))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
@@ -4178,6 +4472,12 @@ void static CheckBlockIndex()
         return;
     }
 
+    // Blocks below a UTXO snapshot have no data until its history is downloaded
+    CSnapshotMetadata snapshot;
+    int nValidatedHeight;
+    bool fValidated;
+    const bool fMissingHistory = GetSnapshotStatus(snapshot, nValidatedHeight, fValidated);
+
     // Build forward-pointing map of the entire block tree.
     std::multimap<CBlockIndex*, CBlockIndex*> forward;
     for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); it++) {
@@ -4198,6 +4498,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -4205,6 +4506,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4215,12 +4517,19 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 (we stored the number of transactions in the block). HAVE_DATA is
+        // too, unless block data was pruned or the chain state was loaded from a UTXO snapshot.
+        if (!fHavePruned && !fMissingHistory) {
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having had data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx == 0 is used to signal that all parent block's transaction data was processed.
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4232,8 +4541,10 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates,
+            // unless some parent's data was pruned since. The tip itself always is.
+            if (pindexFirstInvalid == NULL && (pindexFirstMissing == NULL || pindex == chainActive.Tip())) {
                 assert(setBlockIndexCandidates.count(pindex));
             }
         } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
@@ -4250,13 +4561,12 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
-            }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
         }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't have data
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);           // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
 
@@ -4275,6 +4585,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -4373,14 +4684,14 @@ bool static AlreadyHave(const CInv& inv)
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
     case MSG_TXLOCK_REQUEST:
-        return mapTxLockReq.count(inv.hash) ||
-               mapTxLockReqRejected.count(inv.hash);
+        return txLockManager.HasRequest(inv.hash) ||
+               txLockManager.IsRejected(inv.hash);
     case MSG_TXLOCK_VOTE:
-        return mapTxLockVote.count(inv.hash);
+        return txLockManager.HasVote(inv.hash);
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
-        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+        if (masternodePayments.HasPaymentVote(inv.hash)) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
             return true;
         }
@@ -4422,6 +4733,77 @@ bool static AlreadyHave(const CInv& inv)
     return true;
 }
 
+/** Cache an announced object that is not in the relay cache (anymore) from where it is kept */
+static CRelayCache::DataRef CacheRelayObject(const CInv& inv, std::string& strCommand)
+{
+    switch (inv.type) {
+    case MSG_TX: {
+        CTransaction tx;
+        if (!mempool.lookup(inv.hash, tx))
+            break;
+        strCommand = "tx";
+        return relayCache.Add(inv, strCommand, tx);
+    }
+    case MSG_TXLOCK_VOTE: {
+        CConsensusVote vote;
+        if (!txLockManager.GetVote(inv.hash, vote))
+            break;
+        strCommand = "txlvote";
+        return relayCache.Add(inv, strCommand, vote);
+    }
+    case MSG_TXLOCK_REQUEST: {
+        CTransaction tx;
+        if (!txLockManager.GetRequest(inv.hash, tx))
+            break;
+        strCommand = "ix";
+        return relayCache.Add(inv, strCommand, tx);
+    }
+    case MSG_SPORK:
+        if (!mapSporks.count(inv.hash))
+            break;
+        strCommand = "spork";
+        return relayCache.Add(inv, strCommand, mapSporks[inv.hash]);
+    case MSG_MASTERNODE_WINNER: {
+        CMasternodePaymentWinner winner;
+        if (!masternodePayments.GetPaymentVote(inv.hash, winner))
+            break;
+        strCommand = "mnw";
+        return relayCache.Add(inv, strCommand, winner);
+    }
+    case MSG_BUDGET_VOTE:
+        if (!budget.mapSeenMasternodeBudgetVotes.count(inv.hash))
+            break;
+        strCommand = "mvote";
+        return relayCache.Add(inv, strCommand, budget.mapSeenMasternodeBudgetVotes[inv.hash]);
+    case MSG_BUDGET_PROPOSAL:
+        if (!budget.mapSeenMasternodeBudgetProposals.count(inv.hash))
+            break;
+        strCommand = "mprop";
+        return relayCache.Add(inv, strCommand, budget.mapSeenMasternodeBudgetProposals[inv.hash]);
+    case MSG_BUDGET_FINALIZED_VOTE:
+        if (!budget.mapSeenFinalizedBudgetVotes.count(inv.hash))
+            break;
+        strCommand = "fbvote";
+        return relayCache.Add(inv, strCommand, budget.mapSeenFinalizedBudgetVotes[inv.hash]);
+    case MSG_BUDGET_FINALIZED:
+        if (!budget.mapSeenFinalizedBudgets.count(inv.hash))
+            break;
+        strCommand = "fbs";
+        return relayCache.Add(inv, strCommand, budget.mapSeenFinalizedBudgets[inv.hash]);
+    case MSG_MASTERNODE_ANNOUNCE:
+        if (!mnodeman.mapSeenMasternodeBroadcast.count(inv.hash))
+            break;
+        strCommand = "mnb";
+        return relayCache.Add(inv, strCommand, mnodeman.mapSeenMasternodeBroadcast[inv.hash]);
+    case MSG_MASTERNODE_PING:
+        if (!mnodeman.mapSeenMasternodePing.count(inv.hash))
+            break;
+        strCommand = "mnp";
+        return relayCache.Add(inv, strCommand, mnodeman.mapSeenMasternodePing[inv.hash]);
+    }
+    return CRelayCache::DataRef();
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -4460,13 +4842,17 @@ void static ProcessGetData(CNode* pfrom)
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
                     // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    if (inv.type == MSG_BLOCK) {
+                        // The stored bytes are the wire format, so skip decoding and re-encoding the block
+                        std::vector<char> vchBlock;
+                        if (!ReadRawBlockFromDisk(vchBlock, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        pfrom->PushMessage("block", CFlatData(vchBlock));
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -4498,126 +4884,15 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
             } else if (inv.IsKnownType()) {
-                // Send stream from relay memory
-                bool pushed = false;
-                {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("ix", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-                    if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
-                        pfrom->PushMessage("mnw", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_BUDGET_VOTE) {
-                    if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
-                        pfrom->PushMessage("mvote", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
-                    if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
-                        pfrom->PushMessage("mprop", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
-                    if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-                        pfrom->PushMessage("fbvote", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
-                    if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgets[inv.hash];
-                        pfrom->PushMessage("fbs", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
-                        pfrom->PushMessage("mnb", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_MASTERNODE_PING) {
-                    if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
-                        pfrom->PushMessage("mnp", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed) {
+                // Send the bytes from the relay cache, serializing the object only if it dropped out of it
+                std::string strCommand;
+                CRelayCache::DataRef data;
+                if (!relayCache.Get(inv, strCommand, data))
+                    data = CacheRelayObject(inv, strCommand);
+                if (data)
+                    pfrom->PushMessage(strCommand.c_str(), CFlatData(*data));
+                else
                     vNotFound.push_back(inv);
-                }
             }
 
             // Track requests for our stuff.
@@ -4643,6 +4918,23 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+void ProcessReceivedBlock(CNode* pfrom, CBlock& block)
+{
+    CValidationState state;
+    ProcessNewBlock(state, pfrom, &block);
+    int nDoS;
+    if(state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", std::string("block"), state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if(nDoS > 0) {
+            TRY_LOCK(cs_main, lockMain);
+            if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+    //disconnect this node if its old protocol version
+    pfrom->DisconnectOldProtocol(ActiveProtocol(), "block");
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -4932,12 +5224,19 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pindex)
             pindex = chainActive.Next(pindex);
         int nLimit = 500;
+        // Blocks we're likely to still have an hour from now
+        const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / Params().TargetSpacing();
         LogPrint("net", "getblocks %d to %s limit %d from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop == uint256(0) ? "end" : hashStop.ToString(), nLimit, pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex)) {
             if (pindex->GetBlockHash() == hashStop) {
                 LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            // Don't announce blocks we can't serve, or in prune mode may have deleted by the time they're requested
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA) || (fPruneMode && pindex->nHeight <= chainActive.Height() - nPrunedBlocksLikelyToHave)) {
+                LogPrint("net", "  getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0) {
                 // When this block is requested, we'll send an inv that'll make them
@@ -5151,14 +5450,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
-        CBlock block;
+        boost::shared_ptr<CBlock> pblock(new CBlock());
+        CBlock& block = *pblock;
         vRecv >> block;
         uint256 hashBlock = block.GetHash();
         CInv inv(MSG_BLOCK, hashBlock);
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(block.hashPrevBlock)) {
+        if (!mapBlockIndex.count(block.hashPrevBlock) && !blockPipeline.IsQueued(block.hashPrevBlock)) {
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
                 pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
@@ -5171,20 +5471,19 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         } else {
             pfrom->AddInventoryKnown(inv);
 
-            CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
-                ProcessNewBlock(state, pfrom, &block);
-                int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                                       state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
+            if (!mapBlockIndex.count(hashBlock) && !blockPipeline.IsQueued(hashBlock)) {
+                // Context-free checks start right away, the block is connected after the ones received before it
+                CBlockPipeline::SubmitResult result = blockPipeline.Submit(pblock, hashBlock, pfrom);
+                if (result == CBlockPipeline::SUBMIT_NOT_RUNNING) {
+                    ProcessReceivedBlock(pfrom, block);
+                } else if (result == CBlockPipeline::SUBMIT_FULL) {
+                    // No longer in flight, so it is requested again once the pipeline has room
+                    LogPrint("net", "%s : block pipeline full, dropping block %s peer=%d\n", __func__, hashBlock.ToString(), pfrom->id);
+                    LOCK(cs_main);
+                    MarkBlockAsReceived(hashBlock);
                 }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+            } else if (IsSnapshotHistoryBlock(hashBlock)) {
+                ProcessReceivedBlock(pfrom, block);
             } else {
                 LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
             }
@@ -5469,6 +5768,9 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
+    // apply the SwiftTX votes verified since the last round
+    ProcessVerifiedConsensusVotes();
+
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom);
 
@@ -5817,16 +6119,21 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read undo data and its checksum, straight from the mapped undo file when possible
     uint256 hashChecksum;
     try {
-        filein >> *this;
-        filein >> hashChecksum;
+        CBlockFileSpan span;
+        if (blockFileCache.GetRecord(pos, "rev", sizeof(hashChecksum), span)) {
+            CSpanReader filein(span.begin(), span.end(), SER_DISK, CLIENT_VERSION);
+            filein >> *this;
+            filein >> hashChecksum;
+        } else {
+            CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+            filein >> *this;
+            filein >> hashChecksum;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -47,6 +47,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
@@ -80,6 +81,12 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The maximum size and pre-allocation chunk size of block and undo files with -fastprune */
+static const unsigned int FASTPRUNE_BLOCKFILE_SIZE = 0x4000; // 16 KiB
+/** Number of blocks below the tip whose data -prune never deletes; also covers the maximum reorganization depth */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Lowest -prune target, in bytes: a few block files plus what MIN_BLOCKS_TO_KEEP needs */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 /** Coinbase transaction outputs can only be spent after this number of new blocks (network rule) */
 static const int COINBASE_MATURITY = 100;
 /** Threshold for nLockTime: below this value it is interpreted as block number, otherwise as UNIX timestamp. */
@@ -127,6 +134,9 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** Outputs spent in the last MaxReorganizationDepth blocks of the active chain, by the height that spent them */
+extern CCriticalSection cs_mapstake;
+extern std::map<COutPoint, int> mapStakeSpent;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern const std::string strMessageMagic;
@@ -139,6 +149,16 @@ extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+/** Whether old block and undo files are deleted to stay below nPruneTarget (-prune) */
+extern bool fPruneMode;
+/** Whether any block files have ever been pruned from this data directory */
+extern bool fHavePruned;
+/** Number of bytes the block and undo files should stay below in prune mode */
+extern uint64_t nPruneTarget;
+/** Regtest only: small block and undo files, so pruning can be tested without large chains (-fastprune) */
+extern bool fFastPrune;
+/** Block whose ancestors' scripts and stake signatures are assumed valid (-assumevalid); null to verify all */
+extern uint256 hashAssumeValid;
 extern unsigned int nCoinCacheSize;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
@@ -187,6 +207,8 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
  * @return True if state.IsValid()
  */
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp = NULL);
+/** Process a block received from pfrom and send a reject message if it is invalid */
+void ProcessReceivedBlock(CNode* pfrom, CBlock& block);
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -251,6 +273,12 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files if needed and flush the state that refers to them */
+void PruneAndFlush();
+/** Bytes used by the block and undo files we still have */
+uint64_t CalculateCurrentUsage();
+/** Lowest height of the active chain from which on all block data is available */
+int GetPruneHeight();
 
 
 /** (try to) add transaction to memory pool **/
@@ -425,6 +453,9 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the serialized block at pos without decoding it */
+bool ReadRawBlockFromDisk(std::vector<char>& vchBlock, const CDiskBlockPos& pos);
+bool ReadRawBlockFromDisk(std::vector<char>& vchBlock, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -432,8 +463,9 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. With fJustCheck, only coins is
+ *  changed: the block stays in the recently spent stake inputs. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, bool fJustCheck = false);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -443,8 +475,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
+/** The part of CheckBlock that only looks at the block itself, not at the clock; needs no locks. Sets block.fChecked when fully checked. */
+bool CheckBlockContextFree(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
+/** Whether the inputs of txStake are unspent at the tip, or were spent on the active chain no lower than pindexPrev */
+bool CheckStakeSpent(const CTransaction& txStake, const CBlockIndex* pindexPrev);
+/** Whether the block at nHeight with this hash is an ancestor of the -assumevalid block on the best header chain */
+bool IsBlockAssumedValid(const uint256& hash, int nHeight);
+/** Whether a block whose parent is known is an ancestor of the -assumevalid block on the best header chain */
+bool IsBlockAssumedValid(const CBlock& block);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
@@ -610,6 +650,9 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex);
 /** The currently-connected chain of blocks. */
 extern CChain chainActive;
 
+/** Global variable that points to the coins database under pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB* pcoinsdbview;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
@@ -26,8 +26,6 @@ CBudgetManager budget;
 CCriticalSection cs_budget;
 
 std::map<uint256, int64_t> askedForSourceProposalOrBudget;
-std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
-std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
 
 int nSubmittedFinalBudget;
 
@@ -124,31 +122,113 @@ bool IsBudgetCollateralValid(uint256 nTxCollateralHash, uint256 nExpectedHash, s
     }
 }
 
-void CBudgetManager::CheckOrphanVotes()
+void CBudgetManager::AddImmatureProposal(const CBudgetProposalBroadcast& budgetProposalBroadcast, int nConf, NodeId nodeId)
 {
     LOCK(cs);
+    if (immatureBudgetProposals.Add(budgetProposalBroadcast.GetHash(), budgetProposalBroadcast.nFeeTXHash, budgetProposalBroadcast, nodeId, GetTime()))
+        mapImmatureCollateral.insert(make_pair(chainActive.Height() + Params().Budget_Fee_Confirmations() - nConf, budgetProposalBroadcast.nFeeTXHash));
+}
+
+void CBudgetManager::AddImmatureFinalizedBudget(const CFinalizedBudgetBroadcast& finalizedBudgetBroadcast, int nConf, NodeId nodeId)
+{
+    LOCK(cs);
+    if (immatureFinalizedBudgets.Add(finalizedBudgetBroadcast.GetHash(), finalizedBudgetBroadcast.nFeeTXHash, finalizedBudgetBroadcast, nodeId, GetTime()))
+        mapImmatureCollateral.insert(make_pair(chainActive.Height() + Params().Budget_Fee_Confirmations() - nConf, finalizedBudgetBroadcast.nFeeTXHash));
+}
+
+void CBudgetManager::CheckImmatureBudgets()
+{
+    // Only the proposals and budgets waiting on collateral that reached its
+    // confirmations are checked again. Those still short of confirmations,
+    // after a reorg, wait for their new height.
+    std::vector<uint256> vCollateral;
+    while (!mapImmatureCollateral.empty() && mapImmatureCollateral.begin()->first <= chainActive.Height()) {
+        vCollateral.push_back(mapImmatureCollateral.begin()->second);
+        mapImmatureCollateral.erase(mapImmatureCollateral.begin());
+    }
+    if (vCollateral.empty())
+        return;
 
+    LogPrint("mnbudget","CBudgetManager::CheckImmatureBudgets - %d collateral txes confirmed, %d proposals and %d finalized budgets immature\n", vCollateral.size(), immatureBudgetProposals.size(), immatureFinalizedBudgets.size());
+    BOOST_FOREACH (const uint256& nFeeTXHash, vCollateral) {
+        std::vector<CBudgetProposalBroadcast> vImmatureProposals;
+        immatureBudgetProposals.TakeChildren(nFeeTXHash, vImmatureProposals);
+        BOOST_FOREACH (CBudgetProposalBroadcast& budgetProposalBroadcast, vImmatureProposals) {
+            std::string strError = "";
+            int nConf = 0;
+            if (!IsBudgetCollateralValid(budgetProposalBroadcast.nFeeTXHash, budgetProposalBroadcast.GetHash(), strError, budgetProposalBroadcast.nTime, nConf, true)) {
+                if (nConf >= 1)
+                    AddImmatureProposal(budgetProposalBroadcast, nConf, ORPHAN_POOL_NO_PEER);
+                continue;
+            }
+
+            if (!budgetProposalBroadcast.IsValid(strError)) {
+                LogPrint("mnbudget","mprop (immature) - invalid budget proposal - %s\n", strError);
+                continue;
+            }
+
+            CBudgetProposal budgetProposal(budgetProposalBroadcast);
+            if (AddProposal(budgetProposal)) {
+                budgetProposalBroadcast.Relay();
+            }
+
+            LogPrint("mnbudget","mprop (immature) - new budget - %s\n", budgetProposalBroadcast.GetHash().ToString());
+        }
+
+        std::vector<CFinalizedBudgetBroadcast> vImmatureBudgets;
+        immatureFinalizedBudgets.TakeChildren(nFeeTXHash, vImmatureBudgets);
+        BOOST_FOREACH (CFinalizedBudgetBroadcast& finalizedBudgetBroadcast, vImmatureBudgets) {
+            std::string strError = "";
+            int nConf = 0;
+            if (!IsBudgetCollateralValid(finalizedBudgetBroadcast.nFeeTXHash, finalizedBudgetBroadcast.GetHash(), strError, finalizedBudgetBroadcast.nTime, nConf, true)) {
+                if (nConf >= 1)
+                    AddImmatureFinalizedBudget(finalizedBudgetBroadcast, nConf, ORPHAN_POOL_NO_PEER);
+                continue;
+            }
+
+            if (!finalizedBudgetBroadcast.IsValid(strError)) {
+                LogPrint("mnbudget","fbs (immature) - invalid finalized budget - %s\n", strError);
+                continue;
+            }
+
+            LogPrint("mnbudget","fbs (immature) - new finalized budget - %s\n", finalizedBudgetBroadcast.GetHash().ToString());
+
+            CFinalizedBudget finalizedBudget(finalizedBudgetBroadcast);
+            if (AddFinalizedBudget(finalizedBudget)) {
+                finalizedBudgetBroadcast.Relay();
+            }
+        }
+    }
+}
+
+void CBudgetManager::CheckOrphanVotes(const uint256& nHash)
+{
+    LOCK(cs);
 
     std::string strError = "";
-    std::map<uint256, CBudgetVote>::iterator it1 = mapOrphanMasternodeBudgetVotes.begin();
-    while (it1 != mapOrphanMasternodeBudgetVotes.end()) {
-        if (budget.UpdateProposal(((*it1).second), NULL, strError)) {
+    std::vector<CBudgetVote> vVotes;
+    orphanBudgetVotes.TakeChildren(nHash, vVotes);
+    BOOST_FOREACH (CBudgetVote& vote, vVotes) {
+        if (UpdateProposal(vote, NULL, strError))
             LogPrint("mnbudget","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
-            mapOrphanMasternodeBudgetVotes.erase(it1++);
-        } else {
-            ++it1;
-        }
     }
-    std::map<uint256, CFinalizedBudgetVote>::iterator it2 = mapOrphanFinalizedBudgetVotes.begin();
-    while (it2 != mapOrphanFinalizedBudgetVotes.end()) {
-        if (budget.UpdateFinalizedBudget(((*it2).second), NULL, strError)) {
+
+    std::vector<CFinalizedBudgetVote> vFinalizedVotes;
+    orphanFinalizedBudgetVotes.TakeChildren(nHash, vFinalizedVotes);
+    BOOST_FOREACH (CFinalizedBudgetVote& vote, vFinalizedVotes) {
+        if (UpdateFinalizedBudget(vote, NULL, strError))
             LogPrint("mnbudget","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
-            mapOrphanFinalizedBudgetVotes.erase(it2++);
-        } else {
-            ++it2;
-        }
     }
-    LogPrint("mnbudget","CBudgetManager::CheckOrphanVotes - Done\n");
+}
+
+void CBudgetManager::GetOrphanStats(std::map<std::string, COrphanPoolStats>& mapStats) const
+{
+    LOCK(cs);
+
+    mapStats["budgetvotes"] = orphanBudgetVotes.GetStats();
+    mapStats["finalizedbudgetvotes"] = orphanFinalizedBudgetVotes.GetStats();
+    mapStats["immatureproposals"] = immatureBudgetProposals.GetStats();
+    mapStats["immaturefinalizedbudgets"] = immatureFinalizedBudgets.GetStats();
 }
 
 void CBudgetManager::SubmitFinalBudget()
@@ -437,6 +517,7 @@ void DumpBudgets()
 
 bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
 {
+    LOCK(cs);
     std::string strError = "";
     if (!finalizedBudget.IsValid(strError)) return false;
 
@@ -445,6 +526,11 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
     }
 
     mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+    nBudgetUpdated++;
+    GetMainSignals().NotifyFinalizedBudget(finalizedBudget);
+
+    //we might have active votes for this budget that are now valid
+    CheckOrphanVotes(finalizedBudget.GetHash());
     return true;
 }
 
@@ -462,12 +548,19 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
     }
 
     mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+    nBudgetUpdated++;
     LogPrint("mnbudget","CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
+    GetMainSignals().NotifyBudgetProposal(budgetProposal);
+
+    //we might have active votes for this proposal that are valid now
+    CheckOrphanVotes(budgetProposal.GetHash());
     return true;
 }
 
 void CBudgetManager::CheckAndRemove()
 {
+    LOCK(cs);
+
     int nHeight = 0;
 
     // Add some verbosity once loading blocks from files has finished
@@ -532,6 +625,7 @@ void CBudgetManager::CheckAndRemove()
     // Remove invalid entries by overwriting complete map
     mapFinalizedBudgets.swap(tmpMapFinalizedBudgets);
     mapProposals.swap(tmpMapProposals);
+    nBudgetUpdated++;
 
     LogPrint("mnbudget", "CBudgetManager::CheckAndRemove - mapFinalizedBudgets cleanup - size after: %d\n", mapFinalizedBudgets.size());
     LogPrint("mnbudget", "CBudgetManager::CheckAndRemove - mapProposals cleanup - size after: %d\n", mapProposals.size());
@@ -951,6 +1045,8 @@ void CBudgetManager::NewBlock()
         SubmitFinalBudget();
     }
 
+    CheckImmatureBudgets();
+
     //this function should be called 1/14 blocks, allowing up to 100 votes per day on all proposals
     if (chainActive.Height() % 14 != 0) return;
 
@@ -999,56 +1095,11 @@ void CBudgetManager::NewBlock()
         ++it3;
     }
 
-    LogPrint("mnbudget","CBudgetManager::NewBlock - vecImmatureBudgetProposals cleanup - size: %d\n", vecImmatureBudgetProposals.size());
-    std::vector<CBudgetProposalBroadcast>::iterator it4 = vecImmatureBudgetProposals.begin();
-    while (it4 != vecImmatureBudgetProposals.end()) {
-        std::string strError = "";
-        int nConf = 0;
-        if (!IsBudgetCollateralValid((*it4).nFeeTXHash, (*it4).GetHash(), strError, (*it4).nTime, nConf, true)) {
-            ++it4;
-            continue;
-        }
-
-        if (!(*it4).IsValid(strError)) {
-            LogPrint("mnbudget","mprop (immature) - invalid budget proposal - %s\n", strError);
-            it4 = vecImmatureBudgetProposals.erase(it4);
-            continue;
-        }
-
-        CBudgetProposal budgetProposal((*it4));
-        if (AddProposal(budgetProposal)) {
-            (*it4).Relay();
-        }
-
-        LogPrint("mnbudget","mprop (immature) - new budget - %s\n", (*it4).GetHash().ToString());
-        it4 = vecImmatureBudgetProposals.erase(it4);
-    }
+    orphanBudgetVotes.Expire(GetTime());
+    orphanFinalizedBudgetVotes.Expire(GetTime());
+    immatureBudgetProposals.Expire(GetTime());
+    immatureFinalizedBudgets.Expire(GetTime());
 
-    LogPrint("mnbudget","CBudgetManager::NewBlock - vecImmatureFinalizedBudgets cleanup - size: %d\n", vecImmatureFinalizedBudgets.size());
-    std::vector<CFinalizedBudgetBroadcast>::iterator it5 = vecImmatureFinalizedBudgets.begin();
-    while (it5 != vecImmatureFinalizedBudgets.end()) {
-        std::string strError = "";
-        int nConf = 0;
-        if (!IsBudgetCollateralValid((*it5).nFeeTXHash, (*it5).GetHash(), strError, (*it5).nTime, nConf, true)) {
-            ++it5;
-            continue;
-        }
-
-        if (!(*it5).IsValid(strError)) {
-            LogPrint("mnbudget","fbs (immature) - invalid finalized budget - %s\n", strError);
-            it5 = vecImmatureFinalizedBudgets.erase(it5);
-            continue;
-        }
-
-        LogPrint("mnbudget","fbs (immature) - new finalized budget - %s\n", (*it5).GetHash().ToString());
-
-        CFinalizedBudget finalizedBudget((*it5));
-        if (AddFinalizedBudget(finalizedBudget)) {
-            (*it5).Relay();
-        }
-
-        it5 = vecImmatureFinalizedBudgets.erase(it5);
-    }
     LogPrint("mnbudget","CBudgetManager::NewBlock - PASSED\n");
 }
 
@@ -1092,7 +1143,8 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         int nConf = 0;
         if (!IsBudgetCollateralValid(budgetProposalBroadcast.nFeeTXHash, budgetProposalBroadcast.GetHash(), strError, budgetProposalBroadcast.nTime, nConf)) {
             LogPrint("mnbudget","Proposal FeeTX is not valid - %s - %s\n", budgetProposalBroadcast.nFeeTXHash.ToString(), strError);
-            if (nConf >= 1) vecImmatureBudgetProposals.push_back(budgetProposalBroadcast);
+            if (nConf >= 1)
+                AddImmatureProposal(budgetProposalBroadcast, nConf, pfrom->GetId());
             return;
         }
 
@@ -1110,9 +1162,6 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         masternodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash());
 
         LogPrint("mnbudget","mprop - new budget - %s\n", budgetProposalBroadcast.GetHash().ToString());
-
-        //We might have active votes for this proposal that are valid now
-        CheckOrphanVotes();
     }
 
     if (strCommand == "mvote") { //Masternode Vote
@@ -1167,7 +1216,8 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         if (!IsBudgetCollateralValid(finalizedBudgetBroadcast.nFeeTXHash, finalizedBudgetBroadcast.GetHash(), strError, finalizedBudgetBroadcast.nTime, nConf, true)) {
             LogPrint("mnbudget","Finalized Budget FeeTX is not valid - %s - %s\n", finalizedBudgetBroadcast.nFeeTXHash.ToString(), strError);
 
-            if (nConf >= 1) vecImmatureFinalizedBudgets.push_back(finalizedBudgetBroadcast);
+            if (nConf >= 1)
+                AddImmatureFinalizedBudget(finalizedBudgetBroadcast, nConf, pfrom->GetId());
             return;
         }
 
@@ -1185,9 +1235,6 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             finalizedBudgetBroadcast.Relay();
         }
         masternodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash());
-
-        //we might have active votes for this budget that are now valid
-        CheckOrphanVotes();
     }
 
     if (strCommand == "fbvote") { //Finalized Budget Vote
@@ -1325,23 +1372,37 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
 
     */
 
-    int nInvCount = 0;
+    std::vector<CInv> vInvProp;
+    std::vector<CInv> vInvFin;
+    GetSyncInventory(nProp, fPartial, vInvProp, vInvFin);
+
+    BOOST_FOREACH (const CInv& inv, vInvProp)
+        pfrom->PushInventory(inv);
+    pfrom->PushMessage("ssc", MASTERNODE_SYNC_BUDGET_PROP, (int)vInvProp.size());
+    LogPrint("mnbudget", "CBudgetManager::Sync - sent %d items\n", vInvProp.size());
+
+    BOOST_FOREACH (const CInv& inv, vInvFin)
+        pfrom->PushInventory(inv);
+    pfrom->PushMessage("ssc", MASTERNODE_SYNC_BUDGET_FIN, (int)vInvFin.size());
+    LogPrint("mnbudget", "CBudgetManager::Sync - sent %d items\n", vInvFin.size());
+}
+
+void CBudgetManager::GetSyncInventory(uint256 nProp, bool fPartial, std::vector<CInv>& vInvProp, std::vector<CInv>& vInvFin)
+{
+    LOCK(cs);
 
     std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
     while (it1 != mapSeenMasternodeBudgetProposals.end()) {
         CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
         if (pbudgetProposal && pbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, (*it1).second.GetHash()));
-            nInvCount++;
+            vInvProp.push_back(CInv(MSG_BUDGET_PROPOSAL, (*it1).second.GetHash()));
 
             //send votes
             std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
             while (it2 != pbudgetProposal->mapVotes.end()) {
                 if ((*it2).second.fValid) {
-                    if ((fPartial && !(*it2).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, (*it2).second.GetHash()));
-                        nInvCount++;
-                    }
+                    if ((fPartial && !(*it2).second.fSynced) || !fPartial)
+                        vInvProp.push_back(CInv(MSG_BUDGET_VOTE, (*it2).second.GetHash()));
                 }
                 ++it2;
             }
@@ -1349,36 +1410,24 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
         ++it1;
     }
 
-    pfrom->PushMessage("ssc", MASTERNODE_SYNC_BUDGET_PROP, nInvCount);
-
-    LogPrint("mnbudget", "CBudgetManager::Sync - sent %d items\n", nInvCount);
-
-    nInvCount = 0;
-
     std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
     while (it3 != mapSeenFinalizedBudgets.end()) {
         CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
         if (pfinalizedBudget && pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, (*it3).second.GetHash()));
-            nInvCount++;
+            vInvFin.push_back(CInv(MSG_BUDGET_FINALIZED, (*it3).second.GetHash()));
 
             //send votes
             std::map<uint256, CFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
             while (it4 != pfinalizedBudget->mapVotes.end()) {
                 if ((*it4).second.fValid) {
-                    if ((fPartial && !(*it4).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, (*it4).second.GetHash()));
-                        nInvCount++;
-                    }
+                    if ((fPartial && !(*it4).second.fSynced) || !fPartial)
+                        vInvFin.push_back(CInv(MSG_BUDGET_FINALIZED_VOTE, (*it4).second.GetHash()));
                 }
                 ++it4;
             }
         }
         ++it3;
     }
-
-    pfrom->PushMessage("ssc", MASTERNODE_SYNC_BUDGET_FIN, nInvCount);
-    LogPrint("mnbudget", "CBudgetManager::Sync - sent %d items\n", nInvCount);
 }
 
 bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1392,7 +1441,7 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint("mnbudget","CBudgetManager::UpdateProposal - Unknown proposal %d, asking for source proposal\n", vote.nProposalHash.ToString());
-            mapOrphanMasternodeBudgetVotes[vote.nProposalHash] = vote;
+            orphanBudgetVotes.Add(vote.GetHash(), vote.nProposalHash, vote, pfrom->GetId(), GetTime());
 
             if (!askedForSourceProposalOrBudget.count(vote.nProposalHash)) {
                 pfrom->PushMessage("mnvs", vote.nProposalHash);
@@ -1404,8 +1453,13 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
         return false;
     }
 
+    CBudgetProposal& budgetProposal = mapProposals[vote.nProposalHash];
+    if (!budgetProposal.AddOrUpdateVote(vote, strError))
+        return false;
+    nBudgetUpdated++;
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    GetMainSignals().NotifyBudgetProposal(budgetProposal);
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1419,7 +1473,7 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint("mnbudget","CBudgetManager::UpdateFinalizedBudget - Unknown Finalized Proposal %s, asking for source budget\n", vote.nBudgetHash.ToString());
-            mapOrphanFinalizedBudgetVotes[vote.nBudgetHash] = vote;
+            orphanFinalizedBudgetVotes.Add(vote.GetHash(), vote.nBudgetHash, vote, pfrom->GetId(), GetTime());
 
             if (!askedForSourceProposalOrBudget.count(vote.nBudgetHash)) {
                 pfrom->PushMessage("mnvs", vote.nBudgetHash);
@@ -1431,7 +1485,13 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
         return false;
     }
     LogPrint("mnbudget","CBudgetManager::UpdateFinalizedBudget - Finalized Proposal %s added\n", vote.nBudgetHash.ToString());
-    return mapFinalizedBudgets[vote.nBudgetHash].AddOrUpdateVote(vote, strError);
+    CFinalizedBudget& finalizedBudget = mapFinalizedBudgets[vote.nBudgetHash];
+    if (!finalizedBudget.AddOrUpdateVote(vote, strError))
+        return false;
+    nBudgetUpdated++;
+
+    GetMainSignals().NotifyFinalizedBudget(finalizedBudget);
+    return true;
 }
 
 CBudgetProposal::CBudgetProposal()
@@ -1609,11 +1669,11 @@ double CBudgetProposal::GetRatio()
     return ((double)(yeas) / (double)(yeas + nays));
 }
 
-int CBudgetProposal::GetYeas()
+int CBudgetProposal::GetYeas() const
 {
     int ret = 0;
 
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    std::map<uint256, CBudgetVote>::const_iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
         if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
         ++it;
@@ -1622,11 +1682,11 @@ int CBudgetProposal::GetYeas()
     return ret;
 }
 
-int CBudgetProposal::GetNays()
+int CBudgetProposal::GetNays() const
 {
     int ret = 0;
 
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    std::map<uint256, CBudgetVote>::const_iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
         if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
         ++it;
@@ -1635,11 +1695,11 @@ int CBudgetProposal::GetNays()
     return ret;
 }
 
-int CBudgetProposal::GetAbstains()
+int CBudgetProposal::GetAbstains() const
 {
     int ret = 0;
 
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    std::map<uint256, CBudgetVote>::const_iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
         if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
         ++it;
@@ -14,6 +14,7 @@
 #include "main.h"
 #include "masternode.h"
 #include "net.h"
+#include "orphanpool.h"
 #include "sync.h"
 #include "util.h"
 #include <boost/lexical_cast.hpp>
@@ -44,8 +45,14 @@ static const CAmount PROPOSAL_FEE_TX = (50 * COIN);
 static const CAmount BUDGET_FEE_TX = (50 * COIN);
 static const int64_t BUDGET_VOTE_UPDATE_MIN = 60 * 60;
 
-extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
-extern std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
+//! Serialized bytes of votes for unknown proposals and budgets kept in total and per peer
+static const size_t MAX_ORPHAN_BUDGET_VOTE_BYTES = 5 * 1000 * 1000;
+static const size_t MAX_ORPHAN_BUDGET_VOTE_PEER_BYTES = 500 * 1000;
+//! Serialized bytes of proposals and budgets waiting for collateral confirmations, in total and per peer
+static const size_t MAX_IMMATURE_BUDGET_BYTES = 2 * 1000 * 1000;
+static const size_t MAX_IMMATURE_BUDGET_PEER_BYTES = 200 * 1000;
+//! Seconds an orphan vote or immature proposal waits before it is dropped
+static const int64_t ORPHAN_BUDGET_EXPIRY = 24 * 60 * 60;
 
 static map<uint256, int> mapPayment_History;
 
@@ -190,10 +197,17 @@ private:
     //hold txes until they mature enough to use
     // XX42    map<uint256, CTransaction> mapCollateral;
     map<uint256, uint256> mapCollateralTxids;
+    // number of changes to the proposals, budgets and their votes
+    unsigned int nBudgetUpdated;
+    // collateral txids of the immature proposals and budgets, by the height at which they confirm
+    std::multimap<int, uint256> mapImmatureCollateral;
+
+    /// Check again the immature proposals and budgets whose collateral confirmed by now
+    void CheckImmatureBudgets();
 
 public:
     // critical section to protect the inner data structures
-    mutable CCriticalSection cs;
+    mutable CInstrumentedCriticalSection cs;
 
     // keep track of the scanning errors I've seen
     map<uint256, CBudgetProposal> mapProposals;
@@ -201,12 +215,22 @@ public:
 
     std::map<uint256, CBudgetProposalBroadcast> mapSeenMasternodeBudgetProposals;
     std::map<uint256, CBudgetVote> mapSeenMasternodeBudgetVotes;
-    std::map<uint256, CBudgetVote> mapOrphanMasternodeBudgetVotes;
     std::map<uint256, CFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
     std::map<uint256, CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
-    std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
 
-    CBudgetManager()
+    // votes waiting for their proposal or budget, by proposal or budget hash
+    COrphanPool<CBudgetVote> orphanBudgetVotes;
+    COrphanPool<CFinalizedBudgetVote> orphanFinalizedBudgetVotes;
+    // proposals and budgets waiting for their collateral to confirm, by collateral txid
+    COrphanPool<CBudgetProposalBroadcast> immatureBudgetProposals;
+    COrphanPool<CFinalizedBudgetBroadcast> immatureFinalizedBudgets;
+
+    CBudgetManager() : nBudgetUpdated(0),
+                       cs("CBudgetManager::cs"),
+                       orphanBudgetVotes(MAX_ORPHAN_BUDGET_VOTE_BYTES, MAX_ORPHAN_BUDGET_VOTE_PEER_BYTES, ORPHAN_BUDGET_EXPIRY),
+                       orphanFinalizedBudgetVotes(MAX_ORPHAN_BUDGET_VOTE_BYTES, MAX_ORPHAN_BUDGET_VOTE_PEER_BYTES, ORPHAN_BUDGET_EXPIRY),
+                       immatureBudgetProposals(MAX_IMMATURE_BUDGET_BYTES, MAX_IMMATURE_BUDGET_PEER_BYTES, ORPHAN_BUDGET_EXPIRY),
+                       immatureFinalizedBudgets(MAX_IMMATURE_BUDGET_BYTES, MAX_IMMATURE_BUDGET_PEER_BYTES, ORPHAN_BUDGET_EXPIRY)
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
@@ -221,11 +245,19 @@ public:
     }
 
     int sizeFinalized() { return (int)mapFinalizedBudgets.size(); }
+    /// Changes when a proposal, a finalized budget or one of their votes is added, updated or removed
+    unsigned int GetBudgetUpdated() const
+    {
+        LOCK(cs);
+        return nBudgetUpdated;
+    }
     int sizeProposals() { return (int)mapProposals.size(); }
 
     void ResetSync();
     void MarkSynced();
     void Sync(CNode* node, uint256 nProp, bool fPartial = false);
+    /** Proposals, finalized budgets and their votes as announced by Sync */
+    void GetSyncInventory(uint256 nProp, bool fPartial, std::vector<CInv>& vInvProp, std::vector<CInv>& vInvFin);
 
     void Calculate();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
@@ -252,20 +284,30 @@ public:
     std::string GetRequiredPaymentsString(int nBlockHeight);
     void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStake);
 
-    void CheckOrphanVotes();
+    /// Apply the votes that were waiting for the proposal or budget nHash
+    void CheckOrphanVotes(const uint256& nHash);
+    /// Hold a proposal or budget whose collateral has nConf of the required confirmations
+    void AddImmatureProposal(const CBudgetProposalBroadcast& budgetProposalBroadcast, int nConf, NodeId nodeId);
+    void AddImmatureFinalizedBudget(const CFinalizedBudgetBroadcast& finalizedBudgetBroadcast, int nConf, NodeId nodeId);
+    /// Occupancy of the orphan vote and immature proposal pools
+    void GetOrphanStats(std::map<std::string, COrphanPoolStats>& mapStats) const;
     void Clear()
     {
         LOCK(cs);
 
         LogPrintf("Budget object cleared\n");
+        nBudgetUpdated++;
         mapProposals.clear();
         mapFinalizedBudgets.clear();
         mapSeenMasternodeBudgetProposals.clear();
         mapSeenMasternodeBudgetVotes.clear();
         mapSeenFinalizedBudgets.clear();
         mapSeenFinalizedBudgetVotes.clear();
-        mapOrphanMasternodeBudgetVotes.clear();
-        mapOrphanFinalizedBudgetVotes.clear();
+        orphanBudgetVotes.Clear();
+        orphanFinalizedBudgetVotes.Clear();
+        immatureBudgetProposals.Clear();
+        immatureFinalizedBudgets.Clear();
+        mapImmatureCollateral.clear();
     }
     void CheckAndRemove();
     std::string ToString() const;
@@ -280,8 +322,8 @@ public:
         READWRITE(mapSeenMasternodeBudgetVotes);
         READWRITE(mapSeenFinalizedBudgets);
         READWRITE(mapSeenFinalizedBudgetVotes);
-        READWRITE(mapOrphanMasternodeBudgetVotes);
-        READWRITE(mapOrphanFinalizedBudgetVotes);
+        READWRITE(orphanBudgetVotes);
+        READWRITE(orphanFinalizedBudgetVotes);
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
@@ -345,11 +387,11 @@ public:
 
     bool IsValid(std::string& strError, bool fCheckCollateral = true);
 
-    std::string GetName() { return strBudgetName; }
+    std::string GetName() const { return strBudgetName; }
     std::string GetProposals();
-    int GetBlockStart() { return nBlockStart; }
-    int GetBlockEnd() { return nBlockStart + (int)(vecBudgetPayments.size() - 1); }
-    int GetVoteCount() { return (int)mapVotes.size(); }
+    int GetBlockStart() const { return nBlockStart; }
+    int GetBlockEnd() const { return nBlockStart + (int)(vecBudgetPayments.size() - 1); }
+    int GetVoteCount() const { return (int)mapVotes.size(); }
     bool IsPaidAlready(uint256 nProposalHash, int nBlockHeight);
     TrxValidationStatus IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool GetBudgetPaymentByBlock(int64_t nBlockHeight, CTxBudgetPayment& payment)
@@ -384,7 +426,7 @@ public:
     //checks the hashes to make sure we know about them
     string GetStatus();
 
-    uint256 GetHash()
+    uint256 GetHash() const
     {
         CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
         ss << strBudgetName;
@@ -511,7 +553,7 @@ public:
         return (nTime < GetTime() - (60 * 5));
     }
 
-    std::string GetName() { return strProposalName; }
+    std::string GetName() const { return strProposalName; }
     std::string GetURL() { return strURL; }
     int GetBlockStart() { return nBlockStart; }
     int GetBlockEnd() { return nBlockEnd; }
@@ -522,9 +564,9 @@ public:
     int GetBlockCurrentCycle();
     int GetBlockEndCycle();
     double GetRatio();
-    int GetYeas();
-    int GetNays();
-    int GetAbstains();
+    int GetYeas() const;
+    int GetNays() const;
+    int GetAbstains() const;
     CAmount GetAmount() { return nAmount; }
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
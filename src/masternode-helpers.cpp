@@ -38,6 +38,9 @@ void ThreadMasternodePool()
             // start right after sync is considered to be done
             if (c % MASTERNODE_PING_SECONDS == 0) activeMasternode.ManageStatus();
 
+            // expire masternodes in the published list snapshot
+            if (c % MASTERNODE_CHECK_SECONDS == 0) mnodeman.Check();
+
             if (c % 60 == 0) {
                 mnodeman.CheckAndRemove();
                 mnodeman.ProcessMasternodeConnections();
@@ -61,6 +64,17 @@ bool CMasternodeSigner::IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey)
                 if (out.scriptPubKey == payee2) return true;
             }
         }
+        return false;
+    }
+
+    // Collateral in a pruned block, or older than a UTXO snapshot the node was started from: its unspent outputs are still known
+    LOCK(cs_main);
+    const CCoins* coins = pcoinsTip->AccessCoins(vin.prevout.hash);
+    if (coins) {
+        BOOST_FOREACH (const CTxOut& out, coins->vout) {
+            if (!out.IsNull() && out.nValue == GetMasternodeCollateral() * COIN && out.scriptPubKey == payee2)
+                return true;
+        }
     }
 
     return false;
@@ -22,8 +22,8 @@
 CMasternodePayments masternodePayments;
 
 CCriticalSection cs_vecPayments;
-CCriticalSection cs_mapMasternodeBlocks;
-CCriticalSection cs_mapMasternodePayeeVotes;
+CInstrumentedCriticalSection cs_mapMasternodeBlocks("cs_mapMasternodeBlocks");
+CInstrumentedCriticalSection cs_mapMasternodePayeeVotes("cs_mapMasternodePayeeVotes");
 
 //
 // CMasternodePaymentDB
@@ -175,6 +175,113 @@ void DumpMasternodePayments()
     LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+//
+// CMasternodePaymentVoteStore
+//
+
+bool CMasternodePaymentVoteStore::Find(const uint256& hash, const CBucket*& pbucket, const CVote*& pvote) const
+{
+    std::map<uint256, int>::const_iterator it = mapHeights.find(hash);
+    if (it == mapHeights.end())
+        return false;
+
+    pbucket = &buckets[it->second - nFirstHeight];
+    BOOST_FOREACH (const CVote& vote, pbucket->vecVotes) {
+        if (vote.hash == hash) {
+            pvote = &vote;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CMasternodePaymentVoteStore::GetWinner(const CBucket& bucket, const CVote& vote, int nBlockHeight, CMasternodePaymentWinner& winner) const
+{
+    winner.vinMasternode = vote.vinMasternode;
+    winner.nBlockHeight = nBlockHeight;
+    winner.payee = bucket.vecPayees[vote.nPayee];
+    winner.vchSig.assign(bucket.vchSigs.begin() + vote.nSigOffset, bucket.vchSigs.begin() + vote.nSigOffset + vote.nSigSize);
+}
+
+bool CMasternodePaymentVoteStore::Get(const uint256& hash, CMasternodePaymentWinner& winner) const
+{
+    const CBucket* pbucket;
+    const CVote* pvote;
+    if (!Find(hash, pbucket, pvote))
+        return false;
+
+    GetWinner(*pbucket, *pvote, mapHeights.find(hash)->second, winner);
+    return true;
+}
+
+bool CMasternodePaymentVoteStore::Add(const CMasternodePaymentWinner& winner)
+{
+    uint256 hash = winner.GetHash();
+    if (mapHeights.count(hash) || winner.vchSig.size() > std::numeric_limits<uint16_t>::max())
+        return false;
+
+    int nHeight = winner.nBlockHeight;
+    if (buckets.empty()) {
+        nFirstHeight = nHeight;
+    } else if (nHeight < nFirstHeight) {
+        if (nFirstHeight + (int64_t)buckets.size() - nHeight > MNPAYMENTS_VOTE_HEIGHTS_MAX)
+            return false;
+        buckets.insert(buckets.begin(), nFirstHeight - nHeight, CBucket());
+        nFirstHeight = nHeight;
+    } else if ((int64_t)nHeight - nFirstHeight >= MNPAYMENTS_VOTE_HEIGHTS_MAX) {
+        return false;
+    }
+    if (nHeight - nFirstHeight >= (int)buckets.size())
+        buckets.resize(nHeight - nFirstHeight + 1);
+
+    CBucket& bucket = buckets[nHeight - nFirstHeight];
+    std::vector<CScript>::iterator itPayee = std::find(bucket.vecPayees.begin(), bucket.vecPayees.end(), winner.payee);
+    if (itPayee == bucket.vecPayees.end()) {
+        if (bucket.vecPayees.size() > std::numeric_limits<uint16_t>::max())
+            return false;
+        itPayee = bucket.vecPayees.insert(bucket.vecPayees.end(), winner.payee);
+    }
+
+    CVote vote;
+    vote.hash = hash;
+    vote.vinMasternode = winner.vinMasternode;
+    vote.nSigOffset = bucket.vchSigs.size();
+    vote.nSigSize = winner.vchSig.size();
+    vote.nPayee = itPayee - bucket.vecPayees.begin();
+    bucket.vchSigs.insert(bucket.vchSigs.end(), winner.vchSig.begin(), winner.vchSig.end());
+    bucket.vecVotes.push_back(vote);
+    mapHeights.insert(std::make_pair(hash, nHeight));
+    return true;
+}
+
+void CMasternodePaymentVoteStore::GetRange(int nFirst, int nLast, std::vector<uint256>& vHashes) const
+{
+    int nEnd = std::min(nLast - nFirstHeight + 1, (int)buckets.size());
+    for (int i = std::max(nFirst - nFirstHeight, 0); i < nEnd; i++) {
+        BOOST_FOREACH (const CVote& vote, buckets[i].vecVotes)
+            vHashes.push_back(vote.hash);
+    }
+}
+
+void CMasternodePaymentVoteStore::Prune(int nHeight, std::vector<uint256>& vRemoved)
+{
+    while (!buckets.empty() && nFirstHeight < nHeight) {
+        BOOST_FOREACH (const CVote& vote, buckets.front().vecVotes) {
+            mapHeights.erase(vote.hash);
+            vRemoved.push_back(vote.hash);
+        }
+        buckets.pop_front();
+        nFirstHeight++;
+    }
+}
+
+void CMasternodePaymentVoteStore::Clear()
+{
+    buckets.clear();
+    mapHeights.clear();
+    nFirstHeight = 0;
+}
+
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -422,7 +529,7 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
             nHeight = chainActive.Tip()->nHeight;
         }
 
-        if (masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash())) {
+        if (masternodePayments.HasPaymentVote(winner.GetHash())) {
             LogPrint("mnpayments", "mnw - Already seen - %s bestHeight %d\n", winner.GetHash().ToString().c_str(), nHeight);
             masternodeSync.AddedMasternodeWinner(winner.GetHash());
             return;
@@ -492,19 +599,85 @@ bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasterno
 
 bool CMasternodePayments::GetBlockPayee(int nBlockHeight, CScript& payee)
 {
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].GetPayee(payee);
+    CMasternodeScheduledPayee entry;
+    if (GetScheduledPayee(nBlockHeight, entry)) {
+        if (entry.nVotes < 0) return false;
+        payee = entry.payee;
+        return true;
+    }
+
+    LOCK(cs_mapMasternodeBlocks);
+
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if (it != mapMasternodeBlocks.end()) {
+        return it->second.GetPayee(payee);
     }
 
     return false;
 }
 
+/** Move the schedule window to start at nHeight, tallying the blocks that entered it */
+void CMasternodePayments::UpdateSchedule(int nHeight)
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_schedule);
+
+    if (nHeight == nScheduleHeight) return;
+    nScheduleHeight = nHeight;
+
+    for (int h = nHeight; h <= nHeight + MNPAYMENTS_SCHEDULE_BLOCKS; h++) {
+        if (vSchedule[h % (MNPAYMENTS_SCHEDULE_BLOCKS + 1)].nBlockHeight != h)
+            UpdateScheduledPayee(h);
+    }
+}
+
+// Requires cs_mapMasternodeBlocks
+void CMasternodePayments::UpdateScheduledPayee(int nBlockHeight)
+{
+    CMasternodeScheduledPayee entry;
+    entry.nBlockHeight = nBlockHeight;
+
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if (it != mapMasternodeBlocks.end())
+        it->second.GetScheduledPayee(entry);
+
+    LOCK(cs_schedule);
+    if (nScheduleHeight < 0 || nBlockHeight < nScheduleHeight || nBlockHeight > nScheduleHeight + MNPAYMENTS_SCHEDULE_BLOCKS)
+        return;
+    vSchedule[nBlockHeight % (MNPAYMENTS_SCHEDULE_BLOCKS + 1)] = entry;
+}
+
+/** The cached vote tally of nBlockHeight, false if the height is outside the schedule window */
+bool CMasternodePayments::GetScheduledPayee(int nBlockHeight, CMasternodeScheduledPayee& entry)
+{
+    LOCK(cs_schedule);
+
+    if (nScheduleHeight < 0 || nBlockHeight < nScheduleHeight || nBlockHeight > nScheduleHeight + MNPAYMENTS_SCHEDULE_BLOCKS)
+        return false;
+
+    const CMasternodeScheduledPayee& slot = vSchedule[nBlockHeight % (MNPAYMENTS_SCHEDULE_BLOCKS + 1)];
+    if (slot.nBlockHeight != nBlockHeight)
+        return false;
+
+    entry = slot;
+    return true;
+}
+
+void CMasternodePayments::GetSchedule(std::vector<CMasternodeScheduledPayee>& vecSchedule)
+{
+    LOCK(cs_schedule);
+
+    if (nScheduleHeight < 0) return;
+    for (int h = nScheduleHeight; h <= nScheduleHeight + MNPAYMENTS_SCHEDULE_BLOCKS; h++) {
+        const CMasternodeScheduledPayee& slot = vSchedule[h % (MNPAYMENTS_SCHEDULE_BLOCKS + 1)];
+        if (slot.nBlockHeight == h)
+            vecSchedule.push_back(slot);
+    }
+}
+
 // Is this masternode scheduled to get paid soon?
 // -- Only look ahead up to 8 blocks to allow for propagation of the latest 2 winners
 bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
 {
-    LOCK(cs_mapMasternodeBlocks);
-
     int nHeight;
     {
         TRY_LOCK(cs_main, locked);
@@ -518,18 +691,26 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
     CScript payee;
     for (int64_t h = nHeight; h <= nHeight + 8; h++) {
         if (h == nNotBlockHeight) continue;
-        if (mapMasternodeBlocks.count(h)) {
-            if (mapMasternodeBlocks[h].GetPayee(payee)) {
-                if (mnpayee == payee) {
-                    return true;
-                }
-            }
+        if (GetBlockPayee(h, payee) && mnpayee == payee) {
+            return true;
         }
     }
 
     return false;
 }
 
+bool CMasternodePayments::HasPaymentVote(const uint256& hash)
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+    return paymentVotes.Has(hash);
+}
+
+bool CMasternodePayments::GetPaymentVote(const uint256& hash, CMasternodePaymentWinner& winner)
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+    return paymentVotes.Get(hash, winner);
+}
+
 bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerIn)
 {
     uint256 blockHash = 0;
@@ -540,28 +721,27 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
     {
         LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
-        if (mapMasternodePayeeVotes.count(winnerIn.GetHash())) {
+        if (!paymentVotes.Add(winnerIn)) {
             return false;
         }
 
-        mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
-
         if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
             mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
         }
+
+        mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+        UpdateScheduledPayee(winnerIn.nBlockHeight);
     }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    GetMainSignals().NotifyMasternodeWinner(winnerIn);
 
     return true;
 }
 
-bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
+/** Check that txNew pays the treasury and one of the payees that reached MNPAYMENTS_SIGNATURES_REQUIRED votes */
+static bool IsPaymentValid(const CTransaction& txNew, int nBlockHeight, const std::vector<CScript>& vecRequired)
 {
-    LOCK(cs_vecPayments);
-
-    int nMaxSignatures = 0;
     int nMasternode_Drift_Count = 0;
 
     std::string strPayeesPossible = "";
@@ -580,7 +760,7 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
         CAmount requiredTreasuryPayment = GetTreasuryPayment(nBlockHeight, nReward);
 
         bool found = false;
-        BOOST_FOREACH (CTxOut out, txNew.vout) {
+        BOOST_FOREACH (const CTxOut& out, txNew.vout) {
             if (payeeTreasury == out.scriptPubKey) {
                 if (out.nValue >= requiredTreasuryPayment) {
                     found = true;
@@ -595,6 +775,9 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
         }
     }
 
+    // if we don't have at least 6 signatures on a payee, approve whichever is the longest chain
+    if (vecRequired.empty()) return true;
+
     if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
         // Get a stable number of masternodes by ignoring newly activated (< 8000 sec old) masternodes
         nMasternode_Drift_Count = mnodeman.stable_size() + Params().MasternodeCountDrift();
@@ -608,42 +791,54 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 
     CAmount requiredMasternodePayment = GetMasternodePayment(nBlockHeight, nReward, nMasternode_Drift_Count);
 
-    //require at least 6 signatures
-    BOOST_FOREACH (CMasternodePayee& payee, vecPayments)
-        if (payee.nVotes >= nMaxSignatures && payee.nVotes >= MNPAYMENTS_SIGNATURES_REQUIRED)
-            nMaxSignatures = payee.nVotes;
+    BOOST_FOREACH (const CTxOut& out, txNew.vout) {
+        if (std::find(vecRequired.begin(), vecRequired.end(), out.scriptPubKey) == vecRequired.end())
+            continue;
+        if (out.nValue >= requiredMasternodePayment)
+            return true;
+        LogPrint("masternode","Masternode payment is out of drift range. Paid=%s Min=%s\n", FormatMoney(out.nValue).c_str(), FormatMoney(requiredMasternodePayment).c_str());
+    }
 
-    // if we don't have at least 6 signatures on a payee, approve whichever is the longest chain
-    if (nMaxSignatures < MNPAYMENTS_SIGNATURES_REQUIRED) return true;
+    BOOST_FOREACH (const CScript& payee, vecRequired) {
+        CTxDestination address1;
+        ExtractDestination(payee, address1);
+        CBitcoinAddress address2(address1);
 
-    BOOST_FOREACH (CMasternodePayee& payee, vecPayments) {
-        bool found = false;
-        BOOST_FOREACH (CTxOut out, txNew.vout) {
-            if (payee.scriptPubKey == out.scriptPubKey) {
-                if(out.nValue >= requiredMasternodePayment)
-                    found = true;
-                else
-                    LogPrint("masternode","Masternode payment is out of drift range. Paid=%s Min=%s\n", FormatMoney(out.nValue).c_str(), FormatMoney(requiredMasternodePayment).c_str());
-            }
+        if (strPayeesPossible == "") {
+            strPayeesPossible += address2.ToString();
+        } else {
+            strPayeesPossible += "," + address2.ToString();
         }
+    }
 
-        if (payee.nVotes >= MNPAYMENTS_SIGNATURES_REQUIRED) {
-            if (found) return true;
+    LogPrint("masternode","CMasternodePayments::IsTransactionValid - Missing required payment of %s to %s\n", FormatMoney(requiredMasternodePayment).c_str(), strPayeesPossible.c_str());
+    return false;
+}
 
-            CTxDestination address1;
-            ExtractDestination(payee.scriptPubKey, address1);
-            CBitcoinAddress address2(address1);
+bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
+{
+    CMasternodeScheduledPayee entry;
+    GetScheduledPayee(entry);
 
-            if (strPayeesPossible == "") {
-                strPayeesPossible += address2.ToString();
-            } else {
-                strPayeesPossible += "," + address2.ToString();
-            }
+    return IsPaymentValid(txNew, nBlockHeight, entry.vecRequired);
+}
+
+void CMasternodeBlockPayees::GetScheduledPayee(CMasternodeScheduledPayee& entry)
+{
+    LOCK(cs_vecPayments);
+
+    entry = CMasternodeScheduledPayee();
+    entry.nBlockHeight = nBlockHeight;
+    entry.fKnown = true;
+
+    BOOST_FOREACH (const CMasternodePayee& p, vecPayments) {
+        if (p.nVotes > entry.nVotes) {
+            entry.payee = p.scriptPubKey;
+            entry.nVotes = p.nVotes;
         }
+        if (p.nVotes >= MNPAYMENTS_SIGNATURES_REQUIRED)
+            entry.vecRequired.push_back(p.scriptPubKey);
     }
-
-    LogPrint("masternode","CMasternodePayments::IsTransactionValid - Missing required payment of %s to %s\n", FormatMoney(requiredMasternodePayment).c_str(), strPayeesPossible.c_str());
-    return false;
 }
 
 std::string CMasternodeBlockPayees::GetRequiredPaymentsString()
@@ -680,16 +875,24 @@ std::string CMasternodePayments::GetRequiredPaymentsString(int nBlockHeight)
 
 bool CMasternodePayments::IsTransactionValid(const CTransaction& txNew, int nBlockHeight)
 {
-    LOCK(cs_mapMasternodeBlocks);
-
     if (nBlockHeight < Params().LAST_POW_BLOCK())
         return true;
 
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].IsTransactionValid(txNew);
+    CMasternodeScheduledPayee entry;
+    if (GetScheduledPayee(nBlockHeight, entry))
+        return !entry.fKnown || IsPaymentValid(txNew, nBlockHeight, entry.vecRequired);
+
+    // validate against a copy, so vote processing isn't blocked while the masternode count is taken
+    CMasternodeBlockPayees blockPayees;
+    {
+        LOCK2(cs_mapMasternodeBlocks, cs_vecPayments);
+        std::map<int, CMasternodeBlockPayees>::const_iterator it = mapMasternodeBlocks.find(nBlockHeight);
+        if (it == mapMasternodeBlocks.end())
+            return true;
+        blockPayees = it->second;
     }
 
-    return true;
+    return blockPayees.IsTransactionValid(txNew);
 }
 
 void CMasternodePayments::CleanPaymentList()
@@ -706,19 +909,14 @@ void CMasternodePayments::CleanPaymentList()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
 
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
+    std::vector<uint256> vRemoved;
+    paymentVotes.Prune(nHeight - nLimit, vRemoved);
+    mapMasternodeBlocks.erase(mapMasternodeBlocks.begin(), mapMasternodeBlocks.lower_bound(nHeight - nLimit));
 
-        if (nHeight - winner.nBlockHeight > nLimit) {
-            LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
-            mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
-        } else {
-            ++it;
-        }
-    }
+    if (!vRemoved.empty())
+        LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removed %d old Masternode payments below block %d\n", vRemoved.size(), nHeight - nLimit);
+    BOOST_FOREACH (const uint256& hash, vRemoved)
+        masternodeSync.mapSeenSyncMNW.erase(hash);
 }
 
 bool CMasternodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
@@ -853,37 +1051,42 @@ bool CMasternodePaymentWinner::SignatureValid()
 }
 
 void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
+{
+    std::vector<CInv> vInv;
+    if (!GetSyncInventory(nCountNeeded, vInv)) return;
+
+    BOOST_FOREACH (const CInv& inv, vInv)
+        node->PushInventory(inv);
+    node->PushMessage("ssc", MASTERNODE_SYNC_MNW, (int)vInv.size());
+}
+
+/** Votes for the last nCountNeeded blocks and the next 20 */
+bool CMasternodePayments::GetSyncInventory(int nCountNeeded, std::vector<CInv>& vInv)
 {
     LOCK(cs_mapMasternodePayeeVotes);
 
     int nHeight;
     {
         TRY_LOCK(cs_main, locked);
-        if (!locked || chainActive.Tip() == NULL) return;
+        if (!locked || chainActive.Tip() == NULL) return false;
         nHeight = chainActive.Tip()->nHeight;
     }
 
     int nCount = (mnodeman.CountEnabled() * 1.25);
     if (nCountNeeded > nCount) nCountNeeded = nCount;
 
-    int nInvCount = 0;
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
-        if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
-            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
-            nInvCount++;
-        }
-        ++it;
-    }
-    node->PushMessage("ssc", MASTERNODE_SYNC_MNW, nInvCount);
+    std::vector<uint256> vHashes;
+    paymentVotes.GetRange(nHeight - nCountNeeded, nHeight + 20, vHashes);
+    BOOST_FOREACH (const uint256& hash, vHashes)
+        vInv.push_back(CInv(MSG_MASTERNODE_WINNER, hash));
+    return true;
 }
 
 std::string CMasternodePayments::ToString() const
 {
     std::ostringstream info;
 
-    info << "Votes: " << (int)mapMasternodePayeeVotes.size() << ", Blocks: " << (int)mapMasternodeBlocks.size();
+    info << "Votes: " << (int)paymentVotes.size() << ", Blocks: " << (int)mapMasternodeBlocks.size();
 
     return info.str();
 }
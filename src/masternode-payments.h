@@ -12,12 +12,13 @@
 #include "clientversion.h"
 
 #include <boost/lexical_cast.hpp>
+#include <deque>
 
 using namespace std;
 
 extern CCriticalSection cs_vecPayments;
-extern CCriticalSection cs_mapMasternodeBlocks;
-extern CCriticalSection cs_mapMasternodePayeeVotes;
+extern CInstrumentedCriticalSection cs_mapMasternodeBlocks;
+extern CInstrumentedCriticalSection cs_mapMasternodePayeeVotes;
 
 class CMasternodePayments;
 class CMasternodePaymentWinner;
@@ -27,6 +28,9 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+#define MNPAYMENTS_VOTE_SHARDS 16
+#define MNPAYMENTS_SCHEDULE_BLOCKS 10
+#define MNPAYMENTS_VOTE_HEIGHTS_MAX 50000
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -88,6 +92,24 @@ public:
     }
 };
 
+// Vote tally of one upcoming block, kept so block checks and block creation don't walk the votes
+class CMasternodeScheduledPayee
+{
+public:
+    int nBlockHeight;
+    bool fKnown;                       // votes for this block were seen
+    CScript payee;                     // payee with the most votes
+    int nVotes;
+    std::vector<CScript> vecRequired;  // payees with at least MNPAYMENTS_SIGNATURES_REQUIRED votes
+
+    CMasternodeScheduledPayee()
+    {
+        nBlockHeight = -1;
+        fKnown = false;
+        nVotes = -1;
+    }
+};
+
 // Keep track of votes for payees from masternodes
 class CMasternodeBlockPayees
 {
@@ -136,6 +158,8 @@ public:
         return (nVotes > -1);
     }
 
+    void GetScheduledPayee(CMasternodeScheduledPayee& entry);
+
     bool HasPayeeWithVotes(CScript payee, int nVotesReq)
     {
         LOCK(cs_vecPayments);
@@ -184,7 +208,7 @@ public:
         payee = CScript();
     }
 
-    uint256 GetHash()
+    uint256 GetHash() const
     {
         CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
         ss << payee;
@@ -227,6 +251,105 @@ public:
     }
 };
 
+/**
+ * Payment votes grouped by block height. Each height has a bucket in a ring
+ * that starts at the oldest height kept, so old votes are pruned by dropping
+ * whole buckets and a height range is read without scanning other heights.
+ * A bucket stores every distinct payee once and the signatures of its votes
+ * back to back in one byte pool. Votes are found by hash through their height.
+ * Not thread safe, the owner locks.
+ */
+class CMasternodePaymentVoteStore
+{
+private:
+    struct CVote {
+        uint256 hash;
+        CTxIn vinMasternode;
+        uint32_t nSigOffset;
+        uint16_t nSigSize;
+        uint16_t nPayee;
+    };
+
+    struct CBucket {
+        std::vector<CVote> vecVotes;
+        std::vector<CScript> vecPayees;
+        std::vector<unsigned char> vchSigs;
+    };
+
+    //! buckets[i] holds the votes for block nFirstHeight + i
+    std::deque<CBucket> buckets;
+    int nFirstHeight;
+    std::map<uint256, int> mapHeights;
+
+    bool Find(const uint256& hash, const CBucket*& pbucket, const CVote*& pvote) const;
+    void GetWinner(const CBucket& bucket, const CVote& vote, int nBlockHeight, CMasternodePaymentWinner& winner) const;
+
+public:
+    CMasternodePaymentVoteStore() : nFirstHeight(0) {}
+
+    size_t size() const { return mapHeights.size(); }
+    bool Has(const uint256& hash) const { return mapHeights.count(hash); }
+    bool Get(const uint256& hash, CMasternodePaymentWinner& winner) const;
+
+    /// Add winner; false if it is known or its height is too far from the heights kept
+    bool Add(const CMasternodePaymentWinner& winner);
+    /// Hashes of the votes for blocks nFirst to nLast
+    void GetRange(int nFirst, int nLast, std::vector<uint256>& vHashes) const;
+    /// Drop the votes for blocks below nHeight and append their hashes to vRemoved
+    void Prune(int nHeight, std::vector<uint256>& vRemoved);
+    void Clear();
+
+    // serialized as a map from vote hash to vote, as mnpayments.dat used to hold
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(mapHeights.size());
+        for (size_t i = 0; i < buckets.size(); i++) {
+            BOOST_FOREACH (const CVote& vote, buckets[i].vecVotes) {
+                CMasternodePaymentWinner winner;
+                GetWinner(buckets[i], vote, nFirstHeight + (int)i, winner);
+                nSize += ::GetSerializeSize(vote.hash, nType, nVersion) + ::GetSerializeSize(winner, nType, nVersion);
+            }
+        }
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, mapHeights.size());
+        for (size_t i = 0; i < buckets.size(); i++) {
+            BOOST_FOREACH (const CVote& vote, buckets[i].vecVotes) {
+                CMasternodePaymentWinner winner;
+                GetWinner(buckets[i], vote, nFirstHeight + (int)i, winner);
+                ::Serialize(s, vote.hash, nType, nVersion);
+                ::Serialize(s, winner, nType, nVersion);
+            }
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        Clear();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; i++) {
+            uint256 hash;
+            CMasternodePaymentWinner winner;
+            ::Unserialize(s, hash, nType, nVersion);
+            ::Unserialize(s, winner, nType, nVersion);
+            Add(winner);
+        }
+    }
+};
+
+// Last voted block height per masternode, for one slice of the outpoint space
+class CMasternodeVoteShard
+{
+public:
+    CCriticalSection cs;
+    std::map<uint256, int> mapLastVote; //prevout.hash + prevout.n, nBlockHeight
+};
+
 //
 // Masternode Payments Class
 // Keeps track of who should get paid for which blocks
@@ -238,47 +361,72 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // votes of different masternodes don't contend with each other
+    CMasternodeVoteShard voteShards[MNPAYMENTS_VOTE_SHARDS];
+
+    // payees of the blocks from nScheduleHeight to nScheduleHeight + MNPAYMENTS_SCHEDULE_BLOCKS, slot = height % size
+    CCriticalSection cs_schedule;
+    int nScheduleHeight;
+    CMasternodeScheduledPayee vSchedule[MNPAYMENTS_SCHEDULE_BLOCKS + 1];
+
+    // payment votes by block height, guarded by cs_mapMasternodePayeeVotes
+    CMasternodePaymentVoteStore paymentVotes;
+
+    void UpdateScheduledPayee(int nBlockHeight);
+
 public:
-    std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
-    std::map<uint256, int> mapMasternodesLastVote; //prevout.hash + prevout.n, nBlockHeight
 
     CMasternodePayments()
     {
         nSyncedFromPeer = 0;
         nLastBlockHeight = 0;
+        nScheduleHeight = -1;
     }
 
     void Clear()
     {
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
-        mapMasternodePayeeVotes.clear();
+        paymentVotes.Clear();
+
+        LOCK(cs_schedule);
+        nScheduleHeight = -1;
+        for (int i = 0; i <= MNPAYMENTS_SCHEDULE_BLOCKS; i++)
+            vSchedule[i] = CMasternodeScheduledPayee();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
+    bool HasPaymentVote(const uint256& hash);
+    bool GetPaymentVote(const uint256& hash, CMasternodePaymentWinner& winner);
     bool ProcessBlock(int nBlockHeight);
 
     void Sync(CNode* node, int nCountNeeded);
+    bool GetSyncInventory(int nCountNeeded, std::vector<CInv>& vInv);
     void CleanPaymentList();
     int LastPayment(CMasternode& mn);
 
+    void UpdateSchedule(int nHeight);
+    bool GetScheduledPayee(int nBlockHeight, CMasternodeScheduledPayee& entry);
+    void GetSchedule(std::vector<CMasternodeScheduledPayee>& vecSchedule);
+
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight);
 
     bool CanVote(COutPoint outMasternode, int nBlockHeight)
     {
-        LOCK(cs_mapMasternodePayeeVotes);
+        uint256 nVoter = outMasternode.hash + outMasternode.n;
+        CMasternodeVoteShard& shard = voteShards[nVoter.GetLow64() % MNPAYMENTS_VOTE_SHARDS];
+        LOCK(shard.cs);
 
-        if (mapMasternodesLastVote.count(outMasternode.hash + outMasternode.n)) {
-            if (mapMasternodesLastVote[outMasternode.hash + outMasternode.n] == nBlockHeight) {
-                return false;
-            }
+        std::map<uint256, int>::iterator it = shard.mapLastVote.find(nVoter);
+        if (it != shard.mapLastVote.end() && it->second == nBlockHeight) {
+            return false;
         }
 
         //record this masternode voted
-        mapMasternodesLastVote[outMasternode.hash + outMasternode.n] = nBlockHeight;
+        shard.mapLastVote[nVoter] = nBlockHeight;
         return true;
     }
 
@@ -295,7 +443,7 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
-        READWRITE(mapMasternodePayeeVotes);
+        READWRITE(paymentVotes);
         READWRITE(mapMasternodeBlocks);
     }
 };
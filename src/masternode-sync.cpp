@@ -19,6 +19,28 @@
 class CMasternodeSync;
 CMasternodeSync masternodeSync;
 
+CSyncSummary::CSyncSummary() : vCount(SYNC_SUMMARY_BUCKETS, 0), vDigest(SYNC_SUMMARY_BUCKETS, 0)
+{
+}
+
+CSyncSummary::CSyncSummary(const std::vector<CInv>& vInv) : vCount(SYNC_SUMMARY_BUCKETS, 0), vDigest(SYNC_SUMMARY_BUCKETS, 0)
+{
+    BOOST_FOREACH (const CInv& inv, vInv)
+        Add(inv.hash);
+}
+
+void CSyncSummary::Add(const uint256& hash)
+{
+    unsigned int nBucket = Bucket(hash);
+    vCount[nBucket]++;
+    vDigest[nBucket] += hash.Get64(0);
+}
+
+bool CSyncSummary::Matches(unsigned int nBucket, const CSyncSummary& other) const
+{
+    return vCount[nBucket] == other.vCount[nBucket] && vDigest[nBucket] == other.vDigest[nBucket];
+}
+
 CMasternodeSync::CMasternodeSync()
 {
     Reset();
@@ -80,6 +102,7 @@ void CMasternodeSync::Reset()
     countBudgetItemFin = 0;
     RequestedMasternodeAssets = MASTERNODE_SYNC_INITIAL;
     RequestedMasternodeAttempt = 0;
+    RequestedBudgetAttempt = 0;
     nAssetSyncStarted = GetTime();
 }
 
@@ -98,7 +121,7 @@ void CMasternodeSync::AddedMasternodeList(uint256 hash)
 
 void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
 {
-    if (masternodePayments.mapMasternodePayeeVotes.count(hash)) {
+    if (masternodePayments.HasPaymentVote(hash)) {
         if (mapSeenSyncMNW[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeWinner = GetTime();
             mapSeenSyncMNW[hash]++;
@@ -149,7 +172,10 @@ void CMasternodeSync::GetNextAsset()
         break;
     case (MASTERNODE_SYNC_MNW):
         RequestedMasternodeAssets = MASTERNODE_SYNC_BUDGET;
-        break;
+        // budgets were already requested from some peers along with the winners
+        RequestedMasternodeAttempt = RequestedBudgetAttempt;
+        nAssetSyncStarted = GetTime();
+        return;
     case (MASTERNODE_SYNC_BUDGET):
         LogPrintf("CMasternodeSync::GetNextAsset - Sync has finished\n");
         RequestedMasternodeAssets = MASTERNODE_SYNC_FINISHED;
@@ -190,30 +216,138 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
 
         //this means we will receive no further communication
+        //a peer answering a summary may announce nothing when we already have its whole list,
+        //so a non-empty list counts as progress by itself
         switch (nItemID) {
         case (MASTERNODE_SYNC_LIST):
             if (nItemID != RequestedMasternodeAssets) return;
             sumMasternodeList += nCount;
             countMasternodeList++;
+            if (nCount > 0) lastMasternodeList = GetTime();
             break;
         case (MASTERNODE_SYNC_MNW):
             if (nItemID != RequestedMasternodeAssets) return;
             sumMasternodeWinner += nCount;
             countMasternodeWinner++;
+            if (nCount > 0) lastMasternodeWinner = GetTime();
             break;
         case (MASTERNODE_SYNC_BUDGET_PROP):
-            if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
+            if (RequestedMasternodeAssets != MASTERNODE_SYNC_MNW && RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
             sumBudgetItemProp += nCount;
             countBudgetItemProp++;
+            if (nCount > 0) lastBudgetItem = GetTime();
             break;
         case (MASTERNODE_SYNC_BUDGET_FIN):
-            if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
+            if (RequestedMasternodeAssets != MASTERNODE_SYNC_MNW && RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
             sumBudgetItemFin += nCount;
             countBudgetItemFin++;
+            if (nCount > 0) lastBudgetItem = GetTime();
             break;
         }
 
         LogPrint("masternode", "CMasternodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
+    } else if (strCommand == "mnsyncsum") { //Sync summary, announce what the peer is missing
+        int nItemID;
+        int nCountNeeded;
+        CSyncSummary summary;
+        vRecv >> nItemID >> nCountNeeded >> summary;
+
+        if (fLiteMode) return; //disable all Masternode related functionality
+
+        if (!summary.IsValid()) {
+            LogPrint("masternode", "mnsyncsum - invalid summary from peer %i\n", pfrom->GetId());
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+
+        // The same limits as for the full requests, which a peer could otherwise
+        // alternate with these: the list once per MASTERNODES_DSEG_SECONDS and
+        // address, the winners and the budget once per connection
+        if (nItemID == MASTERNODE_SYNC_LIST) {
+            if (!mnodeman.AllowListRequest(pfrom)) return;
+        } else if (nItemID == MASTERNODE_SYNC_MNW || nItemID == MASTERNODE_SYNC_BUDGET) {
+            std::string strRequest = nItemID == MASTERNODE_SYNC_MNW ? "mnget" : "mnvs";
+            if (Params().NetworkID() == CBaseChainParams::MAIN && pfrom->HasFulfilledRequest(strRequest)) {
+                LogPrint("masternode", "mnsyncsum - peer %i already asked me for %d\n", pfrom->GetId(), nItemID);
+                Misbehaving(pfrom->GetId(), 20);
+                return;
+            }
+            pfrom->FulfilledRequest(strRequest);
+        } else {
+            return;
+        }
+
+        ProcessSummary(pfrom, nItemID, nCountNeeded, summary);
+    }
+}
+
+/** Announce our items from the buckets where the peer's summary differs from ours */
+static int PushMissingInventory(CNode* pfrom, const CSyncSummary& summary, const std::vector<CInv>& vInv)
+{
+    CSyncSummary ours(vInv);
+    int nInvCount = 0;
+    BOOST_FOREACH (const CInv& inv, vInv) {
+        if (ours.Matches(CSyncSummary::Bucket(inv.hash), summary)) continue;
+        pfrom->PushInventory(inv);
+        nInvCount++;
+    }
+    return nInvCount;
+}
+
+void CMasternodeSync::ProcessSummary(CNode* pfrom, int nItemID, int nCountNeeded, const CSyncSummary& summary)
+{
+    // ssc keeps reporting the size of the whole list, as for a full sync
+    if (nItemID == MASTERNODE_SYNC_LIST) {
+        std::vector<CInv> vInv;
+        mnodeman.GetSyncInventory(vInv);
+        int nSent = PushMissingInventory(pfrom, summary, vInv);
+        pfrom->PushMessage("ssc", MASTERNODE_SYNC_LIST, (int)vInv.size());
+        LogPrint("masternode", "mnsyncsum - Sent %d of %d Masternode entries to peer %i\n", nSent, vInv.size(), pfrom->GetId());
+    } else if (nItemID == MASTERNODE_SYNC_MNW) {
+        std::vector<CInv> vInv;
+        if (!masternodePayments.GetSyncInventory(nCountNeeded, vInv)) return;
+        int nSent = PushMissingInventory(pfrom, summary, vInv);
+        pfrom->PushMessage("ssc", MASTERNODE_SYNC_MNW, (int)vInv.size());
+        LogPrint("mnpayments", "mnsyncsum - Sent %d of %d Masternode winners to peer %i\n", nSent, vInv.size(), pfrom->GetId());
+    } else if (nItemID == MASTERNODE_SYNC_BUDGET) {
+        if (!IsBlockchainSynced()) return;
+        std::vector<CInv> vInvProp;
+        std::vector<CInv> vInvFin;
+        budget.GetSyncInventory(0, false, vInvProp, vInvFin);
+        // the peer summarizes all budget items together
+        std::vector<CInv> vInv(vInvProp);
+        vInv.insert(vInv.end(), vInvFin.begin(), vInvFin.end());
+        int nSent = PushMissingInventory(pfrom, summary, vInv);
+        pfrom->PushMessage("ssc", MASTERNODE_SYNC_BUDGET_PROP, (int)vInvProp.size());
+        pfrom->PushMessage("ssc", MASTERNODE_SYNC_BUDGET_FIN, (int)vInvFin.size());
+        LogPrint("mnbudget", "mnsyncsum - Sent %d of %d budget items to peer %i\n", nSent, vInv.size(), pfrom->GetId());
+    }
+}
+
+/** Ask for the masternode list, only for what is missing from summary if the peer supports it */
+static void RequestList(CNode* pnode, const CSyncSummary& summary)
+{
+    if (pnode->nVersion >= MNSYNC_SUMMARY_VERSION)
+        pnode->PushMessage("mnsyncsum", MASTERNODE_SYNC_LIST, 0, summary);
+    else
+        mnodeman.DsegUpdate(pnode);
+}
+
+static void RequestWinners(CNode* pnode, int nMnCount, const CSyncSummary& summary)
+{
+    if (pnode->nVersion >= MNSYNC_SUMMARY_VERSION)
+        pnode->PushMessage("mnsyncsum", MASTERNODE_SYNC_MNW, nMnCount, summary);
+    else
+        pnode->PushMessage("mnget", nMnCount); //sync payees
+}
+
+static void RequestBudget(CNode* pnode, const CSyncSummary& summary)
+{
+    if (pnode->nVersion >= MNSYNC_SUMMARY_VERSION) {
+        pnode->PushMessage("mnsyncsum", MASTERNODE_SYNC_BUDGET, 0, summary);
+    } else {
+        uint256 n = 0;
+        pnode->PushMessage("mnvs", n); //sync masternode votes
     }
 }
 
@@ -261,9 +395,37 @@ void CMasternodeSync::Process()
     if (Params().NetworkID() != CBaseChainParams::REGTEST &&
         !IsBlockchainSynced() && RequestedMasternodeAssets > MASTERNODE_SYNC_SPORKS) return;
 
+    // Summaries of what we already have, built before cs_vNodes is taken as the
+    // budget code relays while holding its own lock
+    CSyncSummary summaryList;
+    CSyncSummary summaryWinners;
+    CSyncSummary summaryBudget;
+    int nMnCount = 0;
+    if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
+        std::vector<CInv> vInv;
+        mnodeman.GetSyncInventory(vInv);
+        summaryList = CSyncSummary(vInv);
+    }
+    if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
+        std::vector<CInv> vInv;
+        nMnCount = mnodeman.CountEnabled();
+        masternodePayments.GetSyncInventory(nMnCount, vInv);
+        summaryWinners = CSyncSummary(vInv);
+    }
+    if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW || RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET) {
+        std::vector<CInv> vInvProp;
+        std::vector<CInv> vInvFin;
+        budget.GetSyncInventory(0, false, vInvProp, vInvFin);
+        vInvProp.insert(vInvProp.end(), vInvFin.begin(), vInvFin.end());
+        summaryBudget = CSyncSummary(vInvProp);
+    }
+
     TRY_LOCK(cs_vNodes, lockRecv);
     if (!lockRecv) return;
 
+    // Up to MASTERNODE_SYNC_PEERS peers are asked for the current asset on each tick
+    int nAsked = 0;
+
     BOOST_FOREACH (CNode* pnode, vNodes) {
         if (Params().NetworkID() == CBaseChainParams::REGTEST) {
             if (RequestedMasternodeAttempt <= 2) {
@@ -294,6 +456,8 @@ void CMasternodeSync::Process()
             return;
         }
 
+        if (nAsked >= MASTERNODE_SYNC_PEERS) return;
+
         if (pnode->nVersion >= masternodePayments.GetMinMasternodePaymentsProto()) {
             if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
                 LogPrint("masternode", "CMasternodeSync::Process() - lastMasternodeList %lld (GetTime() - MASTERNODE_SYNC_TIMEOUT) %lld\n", lastMasternodeList, GetTime() - MASTERNODE_SYNC_TIMEOUT);
@@ -322,9 +486,10 @@ void CMasternodeSync::Process()
 
                 if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
 
-                mnodeman.DsegUpdate(pnode);
+                RequestList(pnode, summaryList);
                 RequestedMasternodeAttempt++;
-                return;
+                nAsked++;
+                continue;
             }
 
             if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
@@ -356,11 +521,19 @@ void CMasternodeSync::Process()
                 CBlockIndex* pindexPrev = chainActive.Tip();
                 if (pindexPrev == NULL) return;
 
-                int nMnCount = mnodeman.CountEnabled();
-                pnode->PushMessage("mnget", nMnCount); //sync payees
+                RequestWinners(pnode, nMnCount, summaryWinners);
                 RequestedMasternodeAttempt++;
+                nAsked++;
+
+                // budgets only depend on the masternode list, so fetch them at the same time
+                if (pnode->nVersion >= ActiveProtocol() && !pnode->HasFulfilledRequest("busync") &&
+                    RequestedBudgetAttempt < MASTERNODE_SYNC_THRESHOLD * 3) {
+                    pnode->FulfilledRequest("busync");
+                    RequestBudget(pnode, summaryBudget);
+                    RequestedBudgetAttempt++;
+                }
 
-                return;
+                continue;
             }
         }
 
@@ -393,11 +566,9 @@ void CMasternodeSync::Process()
 
                 if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
 
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync masternode votes
+                RequestBudget(pnode, summaryBudget);
                 RequestedMasternodeAttempt++;
-
-                return;
+                nAsked++;
             }
         }
     }
@@ -18,10 +18,54 @@
 
 #define MASTERNODE_SYNC_TIMEOUT 5
 #define MASTERNODE_SYNC_THRESHOLD 2
+// peers asked for an asset at the same time
+#define MASTERNODE_SYNC_PEERS 3
 
+#include "protocol.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
+class CDataStream;
 class CMasternodeSync;
+class CNode;
 extern CMasternodeSync masternodeSync;
 
+static const unsigned int SYNC_SUMMARY_BUCKETS = 256;
+
+/**
+ * Compact summary of a set of item hashes: the number of items and the sum of
+ * their hashes in each of SYNC_SUMMARY_BUCKETS ranges of the hash space. A peer
+ * that is sent our summary only announces its items from the ranges where its
+ * own summary differs, instead of its whole list.
+ */
+class CSyncSummary
+{
+public:
+    std::vector<uint32_t> vCount;
+    std::vector<uint64_t> vDigest;
+
+    CSyncSummary();
+    CSyncSummary(const std::vector<CInv>& vInv);
+
+    static unsigned int Bucket(const uint256& hash) { return hash.Get64(3) >> 56; }
+
+    void Add(const uint256& hash);
+    bool IsValid() const { return vCount.size() == SYNC_SUMMARY_BUCKETS && vDigest.size() == SYNC_SUMMARY_BUCKETS; }
+    bool Matches(unsigned int nBucket, const CSyncSummary& other) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(vCount);
+        READWRITE(vDigest);
+    }
+};
+
 //
 // CMasternodeSync : Sync masternode assets in stages
 //
@@ -53,6 +97,8 @@ public:
     // Count peers we've requested the list from
     int RequestedMasternodeAssets;
     int RequestedMasternodeAttempt;
+    // Budget requests sent while masternode winners are still syncing
+    int RequestedBudgetAttempt;
 
     // Time when current masternode asset sync started
     int64_t nAssetSyncStarted;
@@ -74,6 +120,9 @@ public:
     bool IsBlockchainSynced();
     bool IsMasternodeListSynced() { return RequestedMasternodeAssets > MASTERNODE_SYNC_LIST; }
     void ClearFulfilledRequest();
+
+private:
+    void ProcessSummary(CNode* pfrom, int nItemID, int nCountNeeded, const CSyncSummary& summary);
 };
 
 #endif
@@ -9,6 +9,7 @@
 #include "masternode-helpers.h"
 #include "addrman.h"
 #include "masternode.h"
+#include "random.h"
 #include "spork.h"
 #include "util.h"
 #include <boost/filesystem.hpp>
@@ -41,6 +42,155 @@ struct CompareScoreMN {
     }
 };
 
+CMasternodeIndexHasher::CMasternodeIndexHasher() : salt(GetRandHash()) {}
+
+size_t CMasternodeIndexHasher::operator()(const CKeyID& keyID) const
+{
+    uint256 hash;
+    memcpy(hash.begin(), keyID.begin(), keyID.size());
+    return hash.GetHash(salt);
+}
+
+//
+// CMasternodeRegistry
+//
+
+void CMasternodeRegistry::MoveIndex(KeyIndex& index, const CKeyID& keyID, size_t nFrom, size_t nTo)
+{
+    std::pair<KeyIndex::iterator, KeyIndex::iterator> range = index.equal_range(keyID);
+    for (KeyIndex::iterator it = range.first; it != range.second; ++it) {
+        if (it->second == nFrom) {
+            if (nTo == npos)
+                index.erase(it);
+            else
+                it->second = nTo;
+            return;
+        }
+    }
+}
+
+CMasternode* CMasternodeRegistry::Add(const CMasternode& mn)
+{
+    size_t i = vEntries.size();
+    if (!mapByOutpoint.insert(std::make_pair(mn.vin.prevout, i)).second)
+        return NULL;
+
+    vEntries.push_back(new CMasternode(mn));
+    vActiveState.push_back(mn.activeState);
+    vProtocolVersion.push_back(mn.protocolVersion);
+    vSigTime.push_back(mn.sigTime);
+    vPayeeKey.push_back(mn.pubKeyCollateralAddress.GetID());
+    vMasternodeKey.push_back(mn.pubKeyMasternode.GetID());
+    mapByPayee.insert(std::make_pair(vPayeeKey[i], i));
+    mapByMasternodeKey.insert(std::make_pair(vMasternodeKey[i], i));
+    return vEntries[i];
+}
+
+void CMasternodeRegistry::Remove(size_t i)
+{
+    size_t nLast = vEntries.size() - 1;
+
+    mapByOutpoint.erase(vEntries[i]->vin.prevout);
+    MoveIndex(mapByPayee, vPayeeKey[i], i, npos);
+    MoveIndex(mapByMasternodeKey, vMasternodeKey[i], i, npos);
+    delete vEntries[i];
+
+    if (i != nLast) {
+        mapByOutpoint[vEntries[nLast]->vin.prevout] = i;
+        MoveIndex(mapByPayee, vPayeeKey[nLast], nLast, i);
+        MoveIndex(mapByMasternodeKey, vMasternodeKey[nLast], nLast, i);
+        vEntries[i] = vEntries[nLast];
+        vActiveState[i] = vActiveState[nLast];
+        vProtocolVersion[i] = vProtocolVersion[nLast];
+        vSigTime[i] = vSigTime[nLast];
+        vPayeeKey[i] = vPayeeKey[nLast];
+        vMasternodeKey[i] = vMasternodeKey[nLast];
+    }
+
+    vEntries.pop_back();
+    vActiveState.pop_back();
+    vProtocolVersion.pop_back();
+    vSigTime.pop_back();
+    vPayeeKey.pop_back();
+    vMasternodeKey.pop_back();
+}
+
+void CMasternodeRegistry::Clear()
+{
+    BOOST_FOREACH (CMasternode* pmn, vEntries)
+        delete pmn;
+    vEntries.clear();
+    vActiveState.clear();
+    vProtocolVersion.clear();
+    vSigTime.clear();
+    vPayeeKey.clear();
+    vMasternodeKey.clear();
+    mapByOutpoint.clear();
+    mapByPayee.clear();
+    mapByMasternodeKey.clear();
+}
+
+size_t CMasternodeRegistry::Find(const COutPoint& outpoint) const
+{
+    boost::unordered_map<COutPoint, size_t, CMasternodeIndexHasher>::const_iterator it = mapByOutpoint.find(outpoint);
+    return it == mapByOutpoint.end() ? npos : it->second;
+}
+
+CMasternode* CMasternodeRegistry::FindByPayee(const CKeyID& keyID) const
+{
+    // masternodes may share a payee; the index keeps them in no particular
+    // order, so take the one with the lowest collateral outpoint
+    CMasternode* pmn = NULL;
+    std::pair<KeyIndex::const_iterator, KeyIndex::const_iterator> range = mapByPayee.equal_range(keyID);
+    for (KeyIndex::const_iterator it = range.first; it != range.second; ++it) {
+        if (pmn == NULL || vEntries[it->second]->vin.prevout < pmn->vin.prevout)
+            pmn = vEntries[it->second];
+    }
+    return pmn;
+}
+
+CMasternode* CMasternodeRegistry::FindByMasternodeKey(const CPubKey& pubKeyMasternode) const
+{
+    // likewise for masternodes sharing a key
+    CMasternode* pmn = NULL;
+    std::pair<KeyIndex::const_iterator, KeyIndex::const_iterator> range = mapByMasternodeKey.equal_range(pubKeyMasternode.GetID());
+    for (KeyIndex::const_iterator it = range.first; it != range.second; ++it) {
+        if (vEntries[it->second]->pubKeyMasternode != pubKeyMasternode) continue;
+        if (pmn == NULL || vEntries[it->second]->vin.prevout < pmn->vin.prevout)
+            pmn = vEntries[it->second];
+    }
+    return pmn;
+}
+
+void CMasternodeRegistry::Refresh(size_t i)
+{
+    const CMasternode& mn = *vEntries[i];
+    vActiveState[i] = mn.activeState;
+    vProtocolVersion[i] = mn.protocolVersion;
+    vSigTime[i] = mn.sigTime;
+
+    CKeyID payeeKey = mn.pubKeyCollateralAddress.GetID();
+    if (payeeKey != vPayeeKey[i]) {
+        MoveIndex(mapByPayee, vPayeeKey[i], i, npos);
+        mapByPayee.insert(std::make_pair(payeeKey, i));
+        vPayeeKey[i] = payeeKey;
+    }
+
+    CKeyID masternodeKey = mn.pubKeyMasternode.GetID();
+    if (masternodeKey != vMasternodeKey[i]) {
+        MoveIndex(mapByMasternodeKey, vMasternodeKey[i], i, npos);
+        mapByMasternodeKey.insert(std::make_pair(masternodeKey, i));
+        vMasternodeKey[i] = masternodeKey;
+    }
+}
+
+void CMasternodeRegistry::GetEntries(std::vector<CMasternode>& vMasternodes) const
+{
+    vMasternodes.reserve(vMasternodes.size() + vEntries.size());
+    BOOST_FOREACH (const CMasternode* pmn, vEntries)
+        vMasternodes.push_back(*pmn);
+}
+
 //
 // CMasternodeDB
 //
@@ -192,8 +342,35 @@ void DumpMasternodes()
     LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
-CMasternodeMan::CMasternodeMan()
+CMasternodeMan::CMasternodeMan() : cs("CMasternodeMan::cs"), pSnapshot(new std::vector<CMasternode>()), nListUpdated(0)
+{
+}
+
+void CMasternodeMan::PublishSnapshot()
+{
+    AssertLockHeld(cs);
+
+    // copy outside cs_snapshot; cs keeps other changes out until it is published
+    std::vector<CMasternode>* pList = new std::vector<CMasternode>();
+    registry.GetEntries(*pList);
+    CMasternodeSnapshotRef pNewSnapshot(pList);
+
+    LOCK(cs_snapshot);
+    pSnapshot = pNewSnapshot;
+    nListUpdated++;
+}
+
+CMasternodeSnapshotRef CMasternodeMan::GetSnapshot(unsigned int* pnListUpdated)
+{
+    LOCK(cs_snapshot);
+    if (pnListUpdated) *pnListUpdated = nListUpdated;
+    return pSnapshot;
+}
+
+unsigned int CMasternodeMan::GetListUpdated()
 {
+    LOCK(cs_snapshot);
+    return nListUpdated;
 }
 
 bool CMasternodeMan::Add(CMasternode& mn)
@@ -203,10 +380,11 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (!mn.IsEnabled())
         return false;
 
-    CMasternode* pmn = Find(mn.vin);
-    if (pmn == NULL) {
+    if (registry.Find(mn.vin.prevout) == CMasternodeRegistry::npos) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
-        vMasternodes.push_back(mn);
+        registry.Add(mn);
+        PublishSnapshot();
+        GetMainSignals().NotifyMasternode(mn, false);
         return true;
     }
 
@@ -215,10 +393,16 @@ bool CMasternodeMan::Add(CMasternode& mn)
 
 void CMasternodeMan::AskForMN(CNode* pnode, CTxIn& vin)
 {
+    LOCK(cs);
+
     std::map<COutPoint, int64_t>::iterator i = mWeAskedForMasternodeListEntry.find(vin.prevout);
     if (i != mWeAskedForMasternodeListEntry.end()) {
         int64_t t = (*i).second;
         if (GetTime() < t) return; // we've asked recently
+    } else if (mWeAskedForMasternodeListEntry.size() >= MASTERNODES_MAX_ASKED_ENTRIES) {
+        // too many pending requests: drop the expired ones, and don't ask if none expired
+        ExpireAskedForEntries(GetTime());
+        if (mWeAskedForMasternodeListEntry.size() >= MASTERNODES_MAX_ASKED_ENTRIES) return;
     }
 
     // ask for the mnb info once from the node that sent mnp
@@ -226,16 +410,68 @@ void CMasternodeMan::AskForMN(CNode* pnode, CTxIn& vin)
     LogPrint("masternode", "CMasternodeMan::AskForMN - Asking node for missing entry, vin: %s\n", vin.prevout.hash.ToString());
     pnode->PushMessage("dseg", vin);
     int64_t askAgain = GetTime() + MASTERNODE_MIN_MNP_SECONDS;
-    mWeAskedForMasternodeListEntry[vin.prevout] = askAgain;
+    SetAskedForEntry(vin.prevout, askAgain);
+}
+
+void CMasternodeMan::SetAskedForEntry(const COutPoint& outpoint, int64_t nAskAgain)
+{
+    EraseAskedForEntry(outpoint);
+    mWeAskedForMasternodeListEntry[outpoint] = nAskAgain;
+    mWeAskedForMasternodeListEntryByTime.insert(std::make_pair(nAskAgain, outpoint));
+}
+
+void CMasternodeMan::EraseAskedForEntry(const COutPoint& outpoint)
+{
+    std::map<COutPoint, int64_t>::iterator it = mWeAskedForMasternodeListEntry.find(outpoint);
+    if (it == mWeAskedForMasternodeListEntry.end())
+        return;
+
+    std::pair<std::multimap<int64_t, COutPoint>::iterator, std::multimap<int64_t, COutPoint>::iterator> range = mWeAskedForMasternodeListEntryByTime.equal_range(it->second);
+    for (std::multimap<int64_t, COutPoint>::iterator itTime = range.first; itTime != range.second; ++itTime) {
+        if (itTime->second == outpoint) {
+            mWeAskedForMasternodeListEntryByTime.erase(itTime);
+            break;
+        }
+    }
+    mWeAskedForMasternodeListEntry.erase(it);
+}
+
+void CMasternodeMan::ExpireAskedForEntries(int64_t nNow)
+{
+    while (!mWeAskedForMasternodeListEntryByTime.empty() && mWeAskedForMasternodeListEntryByTime.begin()->first < nNow) {
+        mWeAskedForMasternodeListEntry.erase(mWeAskedForMasternodeListEntryByTime.begin()->second);
+        mWeAskedForMasternodeListEntryByTime.erase(mWeAskedForMasternodeListEntryByTime.begin());
+    }
+}
+
+int CMasternodeMan::CountAskedEntries()
+{
+    LOCK(cs);
+    return mWeAskedForMasternodeListEntry.size();
 }
 
 void CMasternodeMan::Check()
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
+    bool fChanged = false;
+    for (size_t i = 0; i < registry.size(); i++) {
+        int nState = registry[i].activeState;
+        registry[i].Check();
+        if (registry[i].activeState != nState) fChanged = true;
+        registry.Refresh(i);
     }
+    if (fChanged) PublishSnapshot();
+}
+
+void CMasternodeMan::Refresh(const CMasternode& mn)
+{
+    LOCK(cs);
+
+    size_t i = registry.Find(mn.vin.prevout);
+    if (i != CMasternodeRegistry::npos)
+        registry.Refresh(i);
+    PublishSnapshot();
 }
 
 void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
@@ -245,20 +481,24 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
-    vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
-        if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
-            (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT ||
-            (forceExpiredRemoval && (*it).activeState == CMasternode::MASTERNODE_EXPIRED) ||
-            (*it).protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) {
-            LogPrint("masternode", "CMasternodeMan: Removing inactive Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+    int nMinProtocol = masternodePayments.GetMinMasternodePaymentsProto();
+    bool fRemoved = false;
+    size_t i = 0;
+    while (i < registry.size()) {
+        int nState = registry.GetActiveState(i);
+        if (nState == CMasternode::MASTERNODE_REMOVE ||
+            nState == CMasternode::MASTERNODE_VIN_SPENT ||
+            (forceExpiredRemoval && nState == CMasternode::MASTERNODE_EXPIRED) ||
+            registry.GetProtocolVersion(i) < nMinProtocol) {
+            const CMasternode& mn = registry[i];
+            LogPrint("masternode", "CMasternodeMan: Removing inactive Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() - 1);
 
             //erase all of the broadcasts we've seen from this vin
             // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
             //    sending a brand new mnb
             map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
             while (it3 != mapSeenMasternodeBroadcast.end()) {
-                if ((*it3).second.vin == (*it).vin) {
+                if ((*it3).second.vin == mn.vin) {
                     masternodeSync.mapSeenSyncMNB.erase((*it3).first);
                     mapSeenMasternodeBroadcast.erase(it3++);
                 } else {
@@ -267,20 +507,16 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             // allow us to ask for this masternode again if we see another ping
-            map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
-            while (it2 != mWeAskedForMasternodeListEntry.end()) {
-                if ((*it2).first == (*it).vin.prevout) {
-                    mWeAskedForMasternodeListEntry.erase(it2++);
-                } else {
-                    ++it2;
-                }
-            }
+            EraseAskedForEntry(mn.vin.prevout);
 
-            it = vMasternodes.erase(it);
+            GetMainSignals().NotifyMasternode(mn, true);
+            registry.Remove(i);
+            fRemoved = true;
         } else {
-            ++it;
+            ++i;
         }
     }
+    if (fRemoved) PublishSnapshot();
 
     // check who's asked for the Masternode list
     map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
@@ -303,14 +539,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     }
 
     // check which Masternodes we've asked for
-    map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
-    while (it2 != mWeAskedForMasternodeListEntry.end()) {
-        if ((*it2).second < GetTime()) {
-            mWeAskedForMasternodeListEntry.erase(it2++);
-        } else {
-            ++it2;
-        }
-    }
+    ExpireAskedForEntries(GetTime());
 
     // remove expired mapSeenMasternodeBroadcast
     map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
@@ -337,10 +566,12 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
-    vMasternodes.clear();
+    registry.Clear();
+    PublishSnapshot();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
+    mWeAskedForMasternodeListEntryByTime.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
 }
@@ -352,7 +583,8 @@ int CMasternodeMan::stable_size ()
     int64_t nMasternode_Min_Age = GetSporkValue(SPORK_14_MN_WINNER_MINIMUM_AGE);
     int64_t nMasternode_Age = 0;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    CMasternodeSnapshotRef pList = GetSnapshot();
+    BOOST_FOREACH (const CMasternode& mn, *pList) {
         if (mn.protocolVersion < nMinProtocol) {
             continue; // Skip obsolete versions
         }
@@ -362,7 +594,6 @@ int CMasternodeMan::stable_size ()
                 continue; // Skip masternodes younger than (default) 8000 sec (MUST be > MASTERNODE_REMOVAL_SECONDS)
             }
         }
-        mn.Check ();
         if (!mn.IsEnabled ())
             continue; // Skip not-enabled masternodes
 
@@ -374,24 +605,30 @@ int CMasternodeMan::stable_size ()
 
 int CMasternodeMan::CountEnabled(int protocolVersion)
 {
-    int i = 0;
+    int nCount = 0;
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
-        i++;
+    Check();
+
+    LOCK(cs);
+    for (size_t i = 0; i < registry.size(); i++) {
+        if (registry.GetProtocolVersion(i) < protocolVersion || !registry.IsEnabled(i)) continue;
+        nCount++;
     }
 
-    return i;
+    return nCount;
 }
 
 void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion)
 {
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
+    // checks every entry and refreshes the registry with the states it decided
+    Check();
+
+    LOCK(cs);
+    for (size_t i = 0; i < registry.size(); i++) {
+        const CMasternode& mn = registry[i];
         std::string strHost;
         int port;
         SplitHostPort(mn.addr.ToString(), port, strHost);
@@ -432,40 +669,65 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
-CMasternode* CMasternodeMan::Find(const CScript& payee)
+bool CMasternodeMan::AllowListRequest(CNode* pnode)
 {
+    //local network
+    bool isLocal = (pnode->addr.IsRFC1918() || pnode->addr.IsLocal());
+    if (isLocal || Params().NetworkID() != CBaseChainParams::MAIN) return true;
+
     LOCK(cs);
-    CScript payee2;
+    std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pnode->addr);
+    if (i != mAskedUsForMasternodeList.end() && GetTime() < (*i).second) {
+        Misbehaving(pnode->GetId(), 34);
+        LogPrint("masternode", "dseg - peer already asked me for the list\n");
+        return false;
+    }
+    mAskedUsForMasternodeList[pnode->addr] = GetTime() + MASTERNODES_DSEG_SECONDS;
+    return true;
+}
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
+void CMasternodeMan::GetSyncInventory(std::vector<CInv>& vInv)
+{
+    LOCK(cs);
+
+    for (size_t i = 0; i < registry.size(); i++) {
+        const CMasternode& mn = registry[i];
+        if (mn.addr.IsRFC1918()) continue; //local network
+        if (!mn.IsEnabled()) continue;
+
+        CMasternodeBroadcast mnb = CMasternodeBroadcast(mn);
+        uint256 hash = mnb.GetHash();
+        vInv.push_back(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
+        // keep it available for the peer's getdata, as dseg does
+        if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.insert(make_pair(hash, mnb));
     }
-    return NULL;
+}
+
+CMasternode* CMasternodeMan::Find(const CScript& payee)
+{
+    // masternodes are paid to the pay-to-pubkey-hash script of their collateral key
+    CTxDestination dest;
+    if (!ExtractDestination(payee, dest)) return NULL;
+    const CKeyID* keyID = boost::get<CKeyID>(&dest);
+    if (keyID == NULL || GetScriptForDestination(*keyID) != payee) return NULL;
+
+    LOCK(cs);
+    return registry.FindByPayee(*keyID);
 }
 
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    size_t i = registry.Find(vin.prevout);
+    return i == CMasternodeRegistry::npos ? NULL : &registry[i];
 }
 
 
 CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
-
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+    return registry.FindByMasternodeKey(pubKeyMasternode);
 }
 
 //
@@ -482,20 +744,23 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         Make a vector with all of the last paid times
     */
 
+    // CountEnabled() refreshes the states the registry filters on
     int nMnCount = CountEnabled();
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if (!mn.IsEnabled()) continue;
+    int nMinProtocol = masternodePayments.GetMinMasternodePaymentsProto();
+    for (size_t i = 0; i < registry.size(); i++) {
+        if (!registry.IsEnabled(i)) continue;
 
         // //check protocol version
-        if (mn.protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) continue;
+        if (registry.GetProtocolVersion(i) < nMinProtocol) continue;
+
+        //it's too new, wait for a cycle
+        if (fFilterSigTime && registry.GetSigTime(i) + (nMnCount * 2.6 * 60) > GetAdjustedTime()) continue;
+
+        CMasternode& mn = registry[i];
 
         //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
         if (masternodePayments.IsScheduled(mn, nBlockHeight)) continue;
 
-        //it's too new, wait for a cycle
-        if (fFilterSigTime && mn.sigTime + (nMnCount * 2.6 * 60) > GetAdjustedTime()) continue;
-
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
@@ -546,8 +811,9 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
     LogPrint("masternode", "CMasternodeMan::FindRandomNotInVec - rand %d\n", rand);
     bool found;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
+    for (size_t i = 0; i < registry.size(); i++) {
+        if (registry.GetProtocolVersion(i) < protocolVersion || !registry.IsEnabled(i)) continue;
+        CMasternode& mn = registry[i];
         found = false;
         BOOST_FOREACH (CTxIn& usedVin, vecToExclude) {
             if (mn.vin.prevout == usedVin.prevout) {
@@ -569,10 +835,13 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     int64_t score = 0;
     CMasternode* winner = NULL;
 
+    Check();
+
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
+    LOCK(cs);
+    for (size_t i = 0; i < registry.size(); i++) {
+        if (registry.GetProtocolVersion(i) < minProtocol || !registry.IsEnabled(i)) continue;
+        CMasternode& mn = registry[i];
 
         // calculate the score for each Masternode
         uint256 n = mn.CalculateScore(mod, nBlockHeight);
@@ -598,24 +867,27 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return -1;
 
+    if (fOnlyActive) Check();
+    bool fFilterAge = IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) {
-            LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
+    LOCK(cs);
+    for (size_t i = 0; i < registry.size(); i++) {
+        if (registry.GetProtocolVersion(i) < minProtocol) {
+            LogPrint("masternode","Skipping Masternode with obsolete version %d\n", registry.GetProtocolVersion(i));
             continue;                                                       // Skip obsolete versions
         }
 
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
+        if (fFilterAge) {
+            nMasternode_Age = GetAdjustedTime() - registry.GetSigTime(i);
             if ((nMasternode_Age) < nMasternode_Min_Age) {
                 if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
                 continue;                                                   // Skip masternodes younger than (default) 1 hour
             }
         }
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
+        if (fOnlyActive && !registry.IsEnabled(i)) continue;
+
+        const CMasternode& mn = registry[i];
         uint256 n = mn.CalculateScore(1, nBlockHeight);
         int64_t n2 = n.GetCompact(false);
 
@@ -645,9 +917,8 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-
+    CMasternodeSnapshotRef pList = GetSnapshot();
+    BOOST_FOREACH (const CMasternode& mn, *pList) {
         if (mn.protocolVersion < minProtocol) continue;
 
         if (!mn.IsEnabled()) {
@@ -676,14 +947,15 @@ CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight
 {
     std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
 
+    if (fOnlyActive) Check();
+
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
+    LOCK(cs);
+    for (size_t i = 0; i < registry.size(); i++) {
+        if (registry.GetProtocolVersion(i) < minProtocol) continue;
+        if (fOnlyActive && !registry.IsEnabled(i)) continue;
 
+        const CMasternode& mn = registry[i];
         uint256 n = mn.CalculateScore(1, nBlockHeight);
         int64_t n2 = n.GetCompact(false);
 
@@ -797,28 +1069,15 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vin;
 
         if (vin == CTxIn()) { //only should ask for this once
-            //local network
-            bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
-
-            if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
-                std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
-                if (i != mAskedUsForMasternodeList.end()) {
-                    int64_t t = (*i).second;
-                    if (GetTime() < t) {
-                        Misbehaving(pfrom->GetId(), 34);
-                        LogPrint("masternode","dseg - peer already asked me for the list\n");
-                        return;
-                    }
-                }
-                int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
-                mAskedUsForMasternodeList[pfrom->addr] = askAgain;
-            }
+            if (!AllowListRequest(pfrom)) return;
         } //else, asking for a specific node which is ok
 
 
         int nInvCount = 0;
 
-        BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+        LOCK(cs);
+        for (size_t i = 0; i < registry.size(); i++) {
+            const CMasternode& mn = registry[i];
             if (mn.addr.IsRFC1918()) continue; //local network
 
             if (mn.IsEnabled()) {
@@ -850,14 +1109,12 @@ void CMasternodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
 
-    vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
-        if ((*it).vin == vin) {
-            LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vMasternodes.erase(it);
-            break;
-        }
-        ++it;
+    size_t i = registry.Find(vin.prevout);
+    if (i != CMasternodeRegistry::npos) {
+        LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", vin.prevout.hash.ToString(), size() - 1);
+        GetMainSignals().NotifyMasternode(registry[i], true);
+        registry.Remove(i);
+        PublishSnapshot();
     }
 }
 
@@ -884,7 +1141,7 @@ std::string CMasternodeMan::ToString() const
 {
     std::ostringstream info;
 
-    info << "Masternodes: " << (int)vMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size();
+    info << "Masternodes: " << (int)registry.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size();
 
     return info.str();
 }
@@ -14,8 +14,12 @@
 #include "sync.h"
 #include "util.h"
 
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_MAX_ASKED_ENTRIES 10000
 
 using namespace std;
 
@@ -48,23 +52,151 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
+/** Immutable copy of the masternode list handed out to readers */
+typedef boost::shared_ptr<const std::vector<CMasternode> > CMasternodeSnapshotRef;
+
+/** Salted hasher for the registry indexes, whose keys peers choose */
+class CMasternodeIndexHasher
+{
+private:
+    uint256 salt;
+
+public:
+    CMasternodeIndexHasher();
+
+    size_t operator()(const COutPoint& out) const { return out.hash.GetHash(salt) ^ out.n; }
+    size_t operator()(const CKeyID& keyID) const;
+};
+
+/**
+ * The masternode list. Entries are allocated once and never move, so a
+ * CMasternode* stays valid until its entry is removed. Entries are indexed by
+ * collateral outpoint, payee key and masternode key. The state, protocol
+ * version and sigTime that the list scans filter on are kept in dense arrays
+ * next to the entries, and are brought up to date by Refresh().
+ */
+class CMasternodeRegistry
+{
+private:
+    typedef boost::unordered_multimap<CKeyID, size_t, CMasternodeIndexHasher> KeyIndex;
+
+    std::vector<CMasternode*> vEntries;
+    std::vector<int> vActiveState;
+    std::vector<int> vProtocolVersion;
+    std::vector<int64_t> vSigTime;
+    //! Keys each entry is indexed under, to move it when its keys change
+    std::vector<CKeyID> vPayeeKey;
+    std::vector<CKeyID> vMasternodeKey;
+
+    boost::unordered_map<COutPoint, size_t, CMasternodeIndexHasher> mapByOutpoint;
+    KeyIndex mapByPayee;
+    KeyIndex mapByMasternodeKey;
+
+    static void MoveIndex(KeyIndex& index, const CKeyID& keyID, size_t nFrom, size_t nTo);
+
+    CMasternodeRegistry(const CMasternodeRegistry&);
+    CMasternodeRegistry& operator=(const CMasternodeRegistry&);
+
+public:
+    static const size_t npos = (size_t)-1;
+
+    CMasternodeRegistry() {}
+    ~CMasternodeRegistry() { Clear(); }
+
+    size_t size() const { return vEntries.size(); }
+    CMasternode& operator[](size_t i) { return *vEntries[i]; }
+    const CMasternode& operator[](size_t i) const { return *vEntries[i]; }
+
+    int GetActiveState(size_t i) const { return vActiveState[i]; }
+    int GetProtocolVersion(size_t i) const { return vProtocolVersion[i]; }
+    int64_t GetSigTime(size_t i) const { return vSigTime[i]; }
+    bool IsEnabled(size_t i) const { return vActiveState[i] == CMasternode::MASTERNODE_ENABLED; }
+
+    /// Add a copy of mn, NULL if its outpoint is already in the list
+    CMasternode* Add(const CMasternode& mn);
+    /// Remove entry i; the last entry takes its position
+    void Remove(size_t i);
+    void Clear();
+
+    /// Position of the entry for outpoint, npos if there is none
+    size_t Find(const COutPoint& outpoint) const;
+    /// Entries sharing the key: the one with the lowest collateral outpoint
+    CMasternode* FindByPayee(const CKeyID& keyID) const;
+    /// Entries sharing the key: the one with the lowest collateral outpoint
+    CMasternode* FindByMasternodeKey(const CPubKey& pubKeyMasternode) const;
+
+    /// Copy the filtered fields of entry i and re-index it if its keys changed
+    void Refresh(size_t i);
+
+    void GetEntries(std::vector<CMasternode>& vMasternodes) const;
+
+    // serialized as a vector of masternodes
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(vEntries.size());
+        BOOST_FOREACH (const CMasternode* pmn, vEntries)
+            nSize += ::GetSerializeSize(*pmn, nType, nVersion);
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, vEntries.size());
+        BOOST_FOREACH (const CMasternode* pmn, vEntries)
+            ::Serialize(s, *pmn, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        Clear();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; i++) {
+            CMasternode mn;
+            ::Unserialize(s, mn, nType, nVersion);
+            Add(mn);
+        }
+    }
+};
+
 class CMasternodeMan
 {
 private:
     // critical section to protect the inner data structures
-    mutable CCriticalSection cs;
+    mutable CInstrumentedCriticalSection cs;
+
+    // critical section to protect the published snapshot
+    mutable CCriticalSection cs_snapshot;
 
     // critical section to protect the inner data structures specifically on messaging
     mutable CCriticalSection cs_process_message;
 
-    // map to hold all MNs
-    std::vector<CMasternode> vMasternodes;
+    // all MNs
+    CMasternodeRegistry registry;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
-    // which Masternodes we've asked for
+    // which Masternodes we've asked for and when we may ask again
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
+    // the same entries ordered by the time we may ask again, to expire them from the front
+    std::multimap<int64_t, COutPoint> mWeAskedForMasternodeListEntryByTime;
+
+    // read-only copy of the registry published for RPC, GUI and payee checks,
+    // replaced on every change to the list or to one of its entries
+    CMasternodeSnapshotRef pSnapshot;
+    // number of changes to the list, counted under cs_snapshot with each published copy
+    unsigned int nListUpdated;
+
+    /// Copy the registry and publish it as the snapshot; called with cs held after each change
+    void PublishSnapshot();
+
+    /// Record that we may ask for outpoint again at nAskAgain
+    void SetAskedForEntry(const COutPoint& outpoint, int64_t nAskAgain);
+    void EraseAskedForEntry(const COutPoint& outpoint);
+    /// Drop the entries we may ask for again before nNow
+    void ExpireAskedForEntries(int64_t nNow);
 
 public:
     // Keep track of all broadcasts I've seen
@@ -78,10 +210,16 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
-        READWRITE(vMasternodes);
+        READWRITE(registry);
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
+        if (ser_action.ForRead()) {
+            mWeAskedForMasternodeListEntryByTime.clear();
+            for (std::map<COutPoint, int64_t>::iterator it = mWeAskedForMasternodeListEntry.begin(); it != mWeAskedForMasternodeListEntry.end(); ++it)
+                mWeAskedForMasternodeListEntryByTime.insert(std::make_pair(it->second, it->first));
+            PublishSnapshot();
+        }
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
@@ -95,6 +233,8 @@ public:
 
     /// Ask (source) node for mnb
     void AskForMN(CNode* pnode, CTxIn& vin);
+    /// Number of masternode entries we asked peers for and wait on
+    int CountAskedEntries();
 
     /// Check all Masternodes
     void Check();
@@ -110,6 +250,10 @@ public:
     void CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion);
 
     void DsegUpdate(CNode* pnode);
+    /// Whether pnode may be sent the whole list (dseg, mnsyncsum); a peer asking again too soon is penalized
+    bool AllowListRequest(CNode* pnode);
+    /// Broadcasts of the enabled masternodes, as announced to a syncing peer
+    void GetSyncInventory(std::vector<CInv>& vInv);
 
     /// Find an entry
     CMasternode* Find(const CScript& payee);
@@ -125,11 +269,11 @@ public:
     /// Get the current winner for this block
     CMasternode* GetCurrentMasterNode(int mod = 1, int64_t nBlockHeight = 0, int minProtocol = 0);
 
-    std::vector<CMasternode> GetFullMasternodeVector()
-    {
-        Check();
-        return vMasternodes;
-    }
+    /// Get the published read-only view of the list, optionally with the number
+    /// of list changes it reflects. It is as current as the last Check()
+    CMasternodeSnapshotRef GetSnapshot(unsigned int* pnListUpdated = NULL);
+    /// Number of changes to the list so far
+    unsigned int GetListUpdated();
 
     std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
@@ -140,7 +284,10 @@ public:
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     /// Return the number of (unique) Masternodes
-    int size() { return vMasternodes.size(); }
+    int size() { return registry.size(); }
+
+    /// Bring the registry's copy of mn's state and keys up to date and publish the snapshot after mn changed
+    void Refresh(const CMasternode& mn);
 
     /// Return the number of Masternodes older than (default) 8000 seconds
     int stable_size ();
@@ -83,6 +83,71 @@ public:
     }
 };
 
+CStakeScheduler stakeScheduler;
+
+CStakeScheduler::CStakeScheduler() : fTipChanged(false), fTipAttempted(true), nTipMillis(0)
+{
+    stats.nTips = 0;
+    stats.nAttempts = 0;
+    stats.nDelays = 0;
+    stats.nLastDelayMillis = 0;
+    stats.nMaxDelayMillis = 0;
+    stats.nTotalDelayMillis = 0;
+    stats.nLastAttemptTime = 0;
+}
+
+void CStakeScheduler::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fTipChanged = true;
+        fTipAttempted = false;
+        nTipMillis = GetTimeMillis();
+        stats.nTips++;
+    }
+    cond.notify_all();
+}
+
+bool CStakeScheduler::Wait(int64_t nMillis)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(nMillis);
+    // timed_wait is an interruption point, so shutdown is not held up either
+    while (!fTipChanged) {
+        if (!cond.timed_wait(lock, deadline))
+            break;
+    }
+    bool fChanged = fTipChanged;
+    fTipChanged = false;
+    return fChanged;
+}
+
+bool CStakeScheduler::WaitTick()
+{
+    return Wait(1000 - GetTimeMillis() % 1000);
+}
+
+void CStakeScheduler::AttemptStarted()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    stats.nAttempts++;
+    stats.nLastAttemptTime = GetTime();
+    if (!fTipAttempted) {
+        fTipAttempted = true;
+        int64_t nDelay = GetTimeMillis() - nTipMillis;
+        stats.nDelays++;
+        stats.nLastDelayMillis = nDelay;
+        stats.nMaxDelayMillis = std::max(stats.nMaxDelayMillis, nDelay);
+        stats.nTotalDelayMillis += nDelay;
+    }
+}
+
+CStakingStats CStakeScheduler::GetStats() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return stats;
+}
+
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -484,34 +549,45 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             fMintableCoins = pwallet->MintableCoins();
         }
 
+        // The waits below return as soon as a new tip arrives
         if (fProofOfStake) {
             if (chainActive.Tip()->nHeight < Params().LAST_POW_BLOCK() || fImporting || fReindex) {
-                MilliSleep(5000);
+                stakeScheduler.Wait(5000);
                 continue;
             }
 
             if (chainActive.Tip()->nTime < Params().GenesisBlock().nTime || vNodes.empty() || pwallet->IsLocked() || !fMintableCoins || fReindex || fImporting || nReserveBalance >= pwallet->GetBalance()) {
                 nLastCoinStakeSearchInterval = 0;
-                MilliSleep(30000);
+                stakeScheduler.Wait(30000);
                 continue;
             }
 
             if (mapHashedBlocks.count(chainActive.Tip()->nHeight)) //search our map of hashed blocks, see if bestblock has been hashed yet
             {
-                if (GetTime() - mapHashedBlocks[chainActive.Tip()->nHeight] < max(pwallet->nHashInterval, (unsigned int)1)) // wait half of the nHashDrift with max wait of 3 minutes
+                int64_t nHashedAge = GetTime() - mapHashedBlocks[chainActive.Tip()->nHeight];
+                int64_t nHashInterval = max(pwallet->nHashInterval, (unsigned int)1);
+                if (nHashedAge < nHashInterval) // wait half of the nHashDrift before hashing the same tip again
                 {
-                    MilliSleep(30000);
+                    stakeScheduler.Wait((nHashInterval - nHashedAge) * 1000);
                     continue;
                 }
             }
+
+            // A coinstake must be newer than the tip, so wait for the clock to pass it
+            if (GetAdjustedTime() <= chainActive.Tip()->nTime) {
+                stakeScheduler.WaitTick();
+                continue;
+            }
+
+            stakeScheduler.AttemptStarted();
         } else {
             if (chainActive.Tip()->nHeight >= Params().LAST_POW_BLOCK()) {
                 LogPrintf("POW ended\n");
                 break;
             }
-        }
 
-        MilliSleep( 1000 );
+            MilliSleep( 1000 );
+        }
 
         //
         // Create new block
@@ -522,8 +598,12 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             continue;
 
         unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey(reservekey, pwallet, fProofOfStake));
-        if (!pblocktemplate.get())
+        if (!pblocktemplate.get()) {
+            // No kernel found, try again with the next timestamp unless a new tip comes first
+            if (fProofOfStake)
+                stakeScheduler.WaitTick();
             continue;
+        }
 
         CBlock* pblock = &pblocktemplate->block;
         IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
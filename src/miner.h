@@ -6,8 +6,13 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "validationinterface.h"
+
 #include <stdint.h>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CBlock;
 class CBlockHeader;
 class CBlockIndex;
@@ -29,6 +34,51 @@ void UpdateTime(CBlockHeader* block, const CBlockIndex* pindexPrev);
 
 void BitcoinMiner(CWallet* pwallet, bool fProofOfStake);
 
+/** Timing of the stake minter, as reported by getstakingstatus */
+struct CStakingStats {
+    //! Chain tips seen and kernel searches started since startup
+    uint64_t nTips;
+    uint64_t nAttempts;
+    //! Delay between a tip arriving and the first kernel search on it
+    uint64_t nDelays;
+    int64_t nLastDelayMillis;
+    int64_t nMaxDelayMillis;
+    int64_t nTotalDelayMillis;
+    int64_t nLastAttemptTime;
+};
+
+/**
+ * Wakes the stake minter as soon as the chain tip changes, so that the kernel
+ * search for the next block starts right away instead of after a fixed sleep.
+ */
+class CStakeScheduler : public CValidationInterface
+{
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fTipChanged;
+    bool fTipAttempted;
+    int64_t nTipMillis;
+    CStakingStats stats;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindex);
+
+public:
+    CStakeScheduler();
+
+    /** Sleep for up to nMillis; returns true, and returns early, if the tip changed meanwhile */
+    bool Wait(int64_t nMillis);
+    /** Sleep until the next second of the clock, when the kernel can be hashed for a new timestamp */
+    bool WaitTick();
+    /** Called by the minter before each kernel search */
+    void AttemptStarted();
+
+    CStakingStats GetStats() const;
+};
+
+extern CStakeScheduler stakeScheduler;
+
 extern double dHashesPerSec;
 extern int64_t nHPSTimerStart;
 
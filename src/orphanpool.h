@@ -0,0 +1,231 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ORPHANPOOL_H
+#define BITCOIN_ORPHANPOOL_H
+
+#include "serialize.h"
+#include "uint256.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+//! Node id of entries that were not received from a peer, e.g. read from disk
+static const int ORPHAN_POOL_NO_PEER = -1;
+
+struct COrphanPoolStats {
+    size_t nEntries;
+    size_t nBytes;
+    size_t nMaxBytes;
+    size_t nPeers;
+    uint64_t nRejected;
+
+    COrphanPoolStats() : nEntries(0), nBytes(0), nMaxBytes(0), nPeers(0), nRejected(0) {}
+};
+
+/**
+ * Objects that wait for a parent we don't have yet, e.g. budget votes for an
+ * unknown proposal. Entries are keyed by their own hash and indexed by the
+ * parent hash, so the arrival of a parent takes its k orphans in O(k log n).
+ * Every peer may hold at most nMaxPeerBytes of serialized entries, and the
+ * pool as a whole at most nMaxBytes; beyond that the oldest entries are
+ * dropped. Entries expire nExpiry seconds after they were added.
+ * Not thread safe, the owner locks.
+ */
+template <typename T>
+class COrphanPool
+{
+private:
+    struct CEntry {
+        T obj;
+        uint256 hashParent;
+        int nodeId;
+        int64_t nTime;
+        size_t nSize;
+        uint64_t nSequence;
+    };
+
+    typedef typename std::map<uint256, CEntry>::iterator EntryIter;
+
+    std::map<uint256, CEntry> mapEntries;
+    std::multimap<uint256, uint256> mapByParent;
+    //! Entries in the order they were added, oldest first
+    std::map<uint64_t, uint256> mapBySequence;
+    std::map<int, size_t> mapPeerBytes;
+    size_t nBytes;
+    uint64_t nSequence;
+    uint64_t nRejected;
+    size_t nMaxBytes;
+    size_t nMaxPeerBytes;
+    int64_t nExpiry;
+
+    void Erase(EntryIter it)
+    {
+        const CEntry& entry = it->second;
+        std::pair<std::multimap<uint256, uint256>::iterator, std::multimap<uint256, uint256>::iterator> range = mapByParent.equal_range(entry.hashParent);
+        for (std::multimap<uint256, uint256>::iterator itParent = range.first; itParent != range.second; ++itParent) {
+            if (itParent->second == it->first) {
+                mapByParent.erase(itParent);
+                break;
+            }
+        }
+        mapBySequence.erase(entry.nSequence);
+        if (entry.nodeId != ORPHAN_POOL_NO_PEER) {
+            std::map<int, size_t>::iterator itPeer = mapPeerBytes.find(entry.nodeId);
+            if (itPeer != mapPeerBytes.end() && (itPeer->second -= entry.nSize) == 0)
+                mapPeerBytes.erase(itPeer);
+        }
+        nBytes -= entry.nSize;
+        mapEntries.erase(it);
+    }
+
+public:
+    COrphanPool(size_t nMaxBytesIn, size_t nMaxPeerBytesIn, int64_t nExpiryIn)
+        : nBytes(0), nSequence(0), nRejected(0), nMaxBytes(nMaxBytesIn), nMaxPeerBytes(nMaxPeerBytesIn), nExpiry(nExpiryIn) {}
+
+    /** Add obj waiting for hashParent; false if it is known already or the peer is over its quota */
+    bool Add(const uint256& hash, const uint256& hashParent, const T& obj, int nodeId, int64_t nNow)
+    {
+        if (mapEntries.count(hash))
+            return false;
+
+        size_t nSize = ::GetSerializeSize(obj, SER_NETWORK, PROTOCOL_VERSION);
+        if (nSize > nMaxBytes) {
+            nRejected++;
+            return false;
+        }
+        if (nodeId != ORPHAN_POOL_NO_PEER) {
+            std::map<int, size_t>::const_iterator itPeer = mapPeerBytes.find(nodeId);
+            if (itPeer != mapPeerBytes.end() && itPeer->second + nSize > nMaxPeerBytes) {
+                nRejected++;
+                return false;
+            }
+        }
+
+        while (nBytes + nSize > nMaxBytes)
+            Erase(mapEntries.find(mapBySequence.begin()->second));
+
+        CEntry& entry = mapEntries[hash];
+        entry.obj = obj;
+        entry.hashParent = hashParent;
+        entry.nodeId = nodeId;
+        entry.nTime = nNow;
+        entry.nSize = nSize;
+        entry.nSequence = nSequence++;
+        mapByParent.insert(std::make_pair(hashParent, hash));
+        mapBySequence.insert(std::make_pair(entry.nSequence, hash));
+        if (nodeId != ORPHAN_POOL_NO_PEER)
+            mapPeerBytes[nodeId] += nSize;
+        nBytes += nSize;
+        return true;
+    }
+
+    /** Remove the orphans of hashParent and append them to vObjs, oldest first */
+    void TakeChildren(const uint256& hashParent, std::vector<T>& vObjs)
+    {
+        std::map<uint64_t, uint256> mapChildren;
+        std::pair<std::multimap<uint256, uint256>::iterator, std::multimap<uint256, uint256>::iterator> range = mapByParent.equal_range(hashParent);
+        for (std::multimap<uint256, uint256>::iterator it = range.first; it != range.second; ++it)
+            mapChildren.insert(std::make_pair(mapEntries[it->second].nSequence, it->second));
+
+        for (std::map<uint64_t, uint256>::iterator it = mapChildren.begin(); it != mapChildren.end(); ++it) {
+            EntryIter itEntry = mapEntries.find(it->second);
+            vObjs.push_back(itEntry->second.obj);
+            Erase(itEntry);
+        }
+    }
+
+    bool HasChildren(const uint256& hashParent) const { return mapByParent.count(hashParent); }
+
+    bool Remove(const uint256& hash)
+    {
+        EntryIter it = mapEntries.find(hash);
+        if (it == mapEntries.end())
+            return false;
+        Erase(it);
+        return true;
+    }
+
+    /** Drop the entries that were added more than nExpiry seconds before nNow */
+    void Expire(int64_t nNow)
+    {
+        while (!mapBySequence.empty()) {
+            EntryIter it = mapEntries.find(mapBySequence.begin()->second);
+            if (it->second.nTime + nExpiry >= nNow)
+                break;
+            Erase(it);
+        }
+    }
+
+    /** All entries, oldest first */
+    void GetAll(std::vector<T>& vObjs) const
+    {
+        vObjs.reserve(vObjs.size() + mapEntries.size());
+        for (std::map<uint64_t, uint256>::const_iterator it = mapBySequence.begin(); it != mapBySequence.end(); ++it)
+            vObjs.push_back(mapEntries.find(it->second)->second.obj);
+    }
+
+    void Clear()
+    {
+        mapEntries.clear();
+        mapByParent.clear();
+        mapBySequence.clear();
+        mapPeerBytes.clear();
+        nBytes = 0;
+    }
+
+    size_t size() const { return mapEntries.size(); }
+
+    COrphanPoolStats GetStats() const
+    {
+        COrphanPoolStats stats;
+        stats.nEntries = mapEntries.size();
+        stats.nBytes = nBytes;
+        stats.nMaxBytes = nMaxBytes;
+        stats.nPeers = mapPeerBytes.size();
+        stats.nRejected = nRejected;
+        return stats;
+    }
+
+    // serialized as a map from parent hash to object, as the pools used to be stored
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(mapEntries.size());
+        for (typename std::map<uint256, CEntry>::const_iterator it = mapEntries.begin(); it != mapEntries.end(); ++it)
+            nSize += ::GetSerializeSize(it->second.hashParent, nType, nVersion) + ::GetSerializeSize(it->second.obj, nType, nVersion);
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, mapEntries.size());
+        for (std::map<uint64_t, uint256>::const_iterator it = mapBySequence.begin(); it != mapBySequence.end(); ++it) {
+            const CEntry& entry = mapEntries.find(it->second)->second;
+            ::Serialize(s, entry.hashParent, nType, nVersion);
+            ::Serialize(s, entry.obj, nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        Clear();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; i++) {
+            uint256 hashParent;
+            T obj;
+            ::Unserialize(s, hashParent, nType, nVersion);
+            ::Unserialize(s, obj, nType, nVersion);
+            Add(obj.GetHash(), hashParent, obj, ORPHAN_POOL_NO_PEER, GetTime());
+        }
+    }
+};
+
+#endif // BITCOIN_ORPHANPOOL_H
@@ -143,6 +143,7 @@ bool CBlock::SignBlock(const CKeyStore& keystore)
 {
     std::vector<valtype> vSolutions;
     txnouttype whichType;
+    fSignatureChecked = false;
 
     if(!IsProofOfStake())
     {
@@ -216,6 +217,14 @@ bool CBlock::SignBlock(const CKeyStore& keystore)
 }
 
 bool CBlock::CheckBlockSignature() const
+{
+    if (fSignatureChecked)
+        return true;
+    fSignatureChecked = VerifyBlockSignature();
+    return fSignatureChecked;
+}
+
+bool CBlock::VerifyBlockSignature() const
 {
     if (IsProofOfWork())
         return vchBlockSig.empty();
@@ -90,6 +90,10 @@ public:
     // memory only
     mutable CScript payee;
     mutable std::vector<uint256> vMerkleTree;
+    //! The context-free checks of CheckBlock have passed
+    mutable bool fChecked;
+    //! CheckBlockSignature has succeeded
+    mutable bool fSignatureChecked;
 
     CBlock()
     {
@@ -119,6 +123,8 @@ public:
         vMerkleTree.clear();
         payee = CScript();
         vchBlockSig.clear();
+        fChecked = false;
+        fSignatureChecked = false;
     }
 
     CBlockHeader GetBlockHeader() const
@@ -162,6 +168,9 @@ public:
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
     std::string ToString() const;
     void print() const;
+
+private:
+    bool VerifyBlockSignature() const;
 };
 
 
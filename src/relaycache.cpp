@@ -0,0 +1,94 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "relaycache.h"
+
+#include "utiltime.h"
+
+CRelayCache relayCache;
+
+CRelayCache::CRelayCache() : nGeneration(0), nBytes(0), nMaxBytes(DEFAULT_RELAY_CACHE_SIZE << 20), nHits(0), nMisses(0)
+{
+}
+
+void CRelayCache::SetMaxSize(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Expire(GetTime());
+}
+
+void CRelayCache::Expire(int64_t nNow)
+{
+    while (!queueExpire.empty() && (queueExpire.front().nTime < nNow || nBytes > nMaxBytes)) {
+        // An erased entry may have been added again since, even within the same second;
+        // that one has its own place in the queue
+        const CExpiry& expiry = queueExpire.front();
+        std::map<CInv, CEntry>::iterator it = mapEntries.find(expiry.inv);
+        if (it != mapEntries.end() && it->second.nGeneration == expiry.nGeneration) {
+            nBytes -= it->second.data->size();
+            mapEntries.erase(it);
+        }
+        queueExpire.pop_front();
+    }
+}
+
+CRelayCache::DataRef CRelayCache::AddSerialized(const CInv& inv, const std::string& strCommand, const CDataStream& ss)
+{
+    LOCK(cs);
+    int64_t nNow = GetTime();
+    Expire(nNow);
+
+    // Keep the bytes that were announced first, like the object stores do
+    std::map<CInv, CEntry>::iterator it = mapEntries.find(inv);
+    if (it != mapEntries.end())
+        return it->second.data;
+
+    CEntry& entry = mapEntries[inv];
+    entry.strCommand = strCommand;
+    entry.data = DataRef(new std::vector<char>(ss.begin(), ss.end()));
+    entry.nTimeExpire = nNow + RELAY_CACHE_EXPIRY;
+    entry.nGeneration = ++nGeneration;
+    queueExpire.push_back(CExpiry(entry.nTimeExpire, entry.nGeneration, inv));
+    nBytes += entry.data->size();
+
+    DataRef data = entry.data;
+    Expire(nNow);
+    return data;
+}
+
+bool CRelayCache::Get(const CInv& inv, std::string& strCommand, DataRef& data)
+{
+    LOCK(cs);
+    std::map<CInv, CEntry>::const_iterator it = mapEntries.find(inv);
+    if (it == mapEntries.end() || it->second.nTimeExpire < GetTime()) {
+        nMisses++;
+        return false;
+    }
+    strCommand = it->second.strCommand;
+    data = it->second.data;
+    nHits++;
+    return true;
+}
+
+void CRelayCache::Erase(const CInv& inv)
+{
+    LOCK(cs);
+    std::map<CInv, CEntry>::iterator it = mapEntries.find(inv);
+    if (it == mapEntries.end())
+        return;
+    nBytes -= it->second.data->size();
+    mapEntries.erase(it);
+}
+
+CRelayCacheStats CRelayCache::GetStats() const
+{
+    LOCK(cs);
+    CRelayCacheStats stats;
+    stats.nEntries = mapEntries.size();
+    stats.nBytes = nBytes;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    return stats;
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RELAYCACHE_H
+#define BITCOIN_RELAYCACHE_H
+
+#include "protocol.h"
+#include "streams.h"
+#include "sync.h"
+#include "version.h"
+
+#include <deque>
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+//! Default for -relaycachesize, in megabytes
+static const unsigned int DEFAULT_RELAY_CACHE_SIZE = 16;
+//! Seconds a relayed object stays in the cache
+static const int64_t RELAY_CACHE_EXPIRY = 15 * 60;
+
+struct CRelayCacheStats {
+    size_t nEntries;
+    size_t nBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    CRelayCacheStats() : nEntries(0), nBytes(0), nHits(0), nMisses(0) {}
+};
+
+/**
+ * The serialized form of every object we announce by inventory (transactions, SwiftTX
+ * requests and votes, sporks, masternode and budget messages), keyed by CInv. An object
+ * is serialized once, and every getdata for it pushes the same bytes. Entries are
+ * immutable and shared, so a peer being served keeps its copy alive even if the entry
+ * expires meanwhile. The cache drops entries RELAY_CACHE_EXPIRY seconds after they were
+ * added, and the oldest ones first when it grows beyond its size limit.
+ */
+class CRelayCache
+{
+public:
+    typedef boost::shared_ptr<const std::vector<char> > DataRef;
+
+private:
+    struct CEntry {
+        std::string strCommand;
+        DataRef data;
+        int64_t nTimeExpire;
+        //! Tells this entry apart from earlier ones for the same inv
+        uint64_t nGeneration;
+    };
+
+    struct CExpiry {
+        int64_t nTime;
+        uint64_t nGeneration;
+        CInv inv;
+
+        CExpiry(int64_t nTimeIn, uint64_t nGenerationIn, const CInv& invIn) : nTime(nTimeIn), nGeneration(nGenerationIn), inv(invIn) {}
+    };
+
+    mutable CCriticalSection cs;
+    std::map<CInv, CEntry> mapEntries;
+    //! Expiry times of the entries, in the order they were added
+    std::deque<CExpiry> queueExpire;
+    uint64_t nGeneration;
+    size_t nBytes;
+    size_t nMaxBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void Expire(int64_t nNow);
+
+public:
+    CRelayCache();
+
+    void SetMaxSize(size_t nMaxBytesIn);
+
+    /** Cache the serialized object in ss, to be sent as a strCommand message. Returns the cached bytes. */
+    DataRef AddSerialized(const CInv& inv, const std::string& strCommand, const CDataStream& ss);
+
+    template <typename T>
+    DataRef Add(const CInv& inv, const std::string& strCommand, const T& obj)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss.reserve(1000);
+        ss << obj;
+        return AddSerialized(inv, strCommand, ss);
+    }
+
+    /** Look up an object; its message command is returned in strCommand */
+    bool Get(const CInv& inv, std::string& strCommand, DataRef& data);
+    /** Drop an object that changed without its hash changing, so it is serialized again */
+    void Erase(const CInv& inv);
+
+    CRelayCacheStats GetStats() const;
+};
+
+extern CRelayCache relayCache;
+
+#endif // BITCOIN_RELAYCACHE_H
@@ -3,16 +3,24 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
+#include "coins.h"
+#include "hash.h"
 #include "main.h"
+#include "masternode-budget.h"
+#include "masternodeman.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "random.h"
 #include "rpcserver.h"
 #include "streams.h"
 #include "sync.h"
+#include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/dynamic_bitset.hpp>
 
 #include <univalue.h>
 
@@ -35,6 +43,11 @@ static const struct {
     {RF_JSON, "json"},
 };
 
+//! Most headers returned by one /rest/headers/ request
+static const size_t MAX_REST_HEADERS_RESULTS = 2000;
+//! Most outpoints looked up by one /rest/getutxos/ request
+static const size_t MAX_GETUTXOS_OUTPOINTS = 15;
+
 class RestErr
 {
 public:
@@ -42,8 +55,52 @@ public:
     string message;
 };
 
+//! Unspent output as returned by /rest/getutxos/
+struct CCoin {
+    uint32_t nTxVer; // Don't call this nVersion, that name has a special meaning inside SerializationOp
+    uint32_t nHeight;
+    CTxOut out;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nTxVer);
+        READWRITE(nHeight);
+        READWRITE(out);
+    }
+};
+
+//! Binary form of /rest/chaininfo
+struct CRESTChainInfo {
+    string strChain;
+    int32_t nBlocks;
+    int32_t nHeaders;
+    uint256 hashBestBlock;
+    uint32_t nBits;
+    int64_t nMedianTime;
+    uint256 nChainWork;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(strChain);
+        READWRITE(nBlocks);
+        READWRITE(nHeaders);
+        READWRITE(hashBestBlock);
+        READWRITE(nBits);
+        READWRITE(nMedianTime);
+        READWRITE(nChainWork);
+    }
+};
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern UniValue blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex);
+extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -90,6 +147,72 @@ static bool ParseHashStr(const string& strReq, uint256& v)
     return true;
 }
 
+/**
+ * Entity tag of a reply that only changes with the chain tip and with nExtra,
+ * which covers state that changes between blocks, like the mempool. A client
+ * polling with If-None-Match then gets an empty 304 reply until it changed.
+ * The tag is salted per process, as the change counters in nExtra start over
+ * on restart.
+ */
+static string RESTETag(const string& strRequest, uint256 nExtra = 0)
+{
+    static const uint256 nSalt = GetRandHash();
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << nSalt;
+    {
+        LOCK(cs_main);
+        ss << chainActive.Tip()->GetBlockHash();
+    }
+    ss << strRequest << nExtra;
+    return ss.GetHash().GetHex().substr(0, 32);
+}
+
+/** An empty strETag sends a reply that can't be revalidated */
+static string ETagHeader(const string& strETag)
+{
+    if (strETag.empty())
+        return "Cache-Control: no-cache\r\n";
+    return "ETag: \"" + strETag + "\"\r\nCache-Control: no-cache\r\n";
+}
+
+/** Answer with 304 Not Modified if the client already holds the reply tagged strETag */
+static bool RESTNotModified(AcceptedConnection* conn, map<string, string>& mapHeaders, bool fRun, const string& strETag)
+{
+    map<string, string>::iterator it = mapHeaders.find("if-none-match");
+    if (it == mapHeaders.end() || it->second.find("\"" + strETag + "\"") == string::npos)
+        return false;
+
+    conn->stream() << HTTPReplyHeader(HTTP_NOT_MODIFIED, fRun, 0, "text/plain", ETagHeader(strETag)) << std::flush;
+    return true;
+}
+
+/** Send serialized data as .bin or .hex, tagged with strETag */
+static bool RESTReplyData(AcceptedConnection* conn, bool fRun, const string& strETag, enum RetFormat rf, const CDataStream& ss)
+{
+    if (rf == RF_BINARY) {
+        string strBinary = ss.str();
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strBinary.size(), "application/octet-stream", ETagHeader(strETag)) << strBinary << std::flush;
+    } else {
+        string strHex = HexStr(ss.begin(), ss.end()) + "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strHex.size(), "text/plain", ETagHeader(strETag)) << strHex << std::flush;
+    }
+    return true;
+}
+
+static bool RESTReplyJSON(AcceptedConnection* conn, bool fRun, const string& strETag, const UniValue& val)
+{
+    string strJSON = val.write() + "\n";
+    conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strJSON.size(), "application/json", ETagHeader(strETag)) << strJSON << std::flush;
+    return true;
+}
+
+static void CheckDataFormat(enum RetFormat rf)
+{
+    if (rf == RF_UNDEF)
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+}
+
 static bool rest_block(AcceptedConnection* conn,
     string& strReq,
     map<string, string>& mapHeaders,
@@ -112,6 +235,9 @@ static bool rest_block(AcceptedConnection* conn,
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
         pblockindex = mapBlockIndex[hash];
+        if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+
         if (!ReadBlockFromDisk(block, pblockindex))
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
     }
@@ -215,6 +341,367 @@ static bool rest_tx(AcceptedConnection* conn,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_headers(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    CheckDataFormat(rf);
+
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+    if (path.size() != 2)
+        throw RESTERR(HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
+
+    long count = strtol(path[0].c_str(), NULL, 10);
+    if (count < 1 || count > (long)MAX_REST_HEADERS_RESULTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Header count out of range: %s", path[0]));
+
+    string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    string strETag = RESTETag("headers/" + strReq);
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag))
+        return true;
+
+    // headers of the active chain, starting at hash
+    vector<const CBlockIndex*> headers;
+    headers.reserve(count);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        const CBlockIndex* pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
+        while (pindex != NULL && chainActive.Contains(pindex)) {
+            headers.push_back(pindex);
+            if (headers.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    if (rf == RF_JSON) {
+        UniValue jsonHeaders(UniValue::VARR);
+        LOCK(cs_main);
+        BOOST_FOREACH (const CBlockIndex* pindex, headers) {
+            UniValue objHeader = blockHeaderToJSON(CBlock(pindex->GetBlockHeader()), pindex);
+            objHeader.push_back(Pair("hash", pindex->GetBlockHash().GetHex()));
+            objHeader.push_back(Pair("height", pindex->nHeight));
+            jsonHeaders.push_back(objHeader);
+        }
+        return RESTReplyJSON(conn, fRun, strETag, jsonHeaders);
+    }
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_FOREACH (const CBlockIndex* pindex, headers)
+        ssHeader << pindex->GetBlockHeader();
+    return RESTReplyData(conn, fRun, strETag, rf, ssHeader);
+}
+
+static bool rest_chaininfo(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    CheckDataFormat(rf);
+
+    // The JSON form has the verification progress, which moves with the clock,
+    // and the block pipeline timings, so it is never tagged
+    if (rf == RF_JSON) {
+        UniValue rpcParams(UniValue::VARR);
+        UniValue chainInfoObject;
+        {
+            LOCK(cs_main);
+            chainInfoObject = getblockchaininfo(rpcParams, false);
+        }
+        return RESTReplyJSON(conn, fRun, "", chainInfoObject);
+    }
+
+    // the header count moves ahead of the tip
+    uint256 hashBestHeader = 0;
+    {
+        LOCK(cs_main);
+        if (pindexBestHeader)
+            hashBestHeader = pindexBestHeader->GetBlockHash();
+    }
+    string strETag = RESTETag("chaininfo" + strReq, hashBestHeader);
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag))
+        return true;
+
+    CRESTChainInfo info;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindexTip = chainActive.Tip();
+        info.strChain = Params().NetworkIDString();
+        info.nBlocks = chainActive.Height();
+        info.nHeaders = pindexBestHeader ? pindexBestHeader->nHeight : -1;
+        info.hashBestBlock = pindexTip->GetBlockHash();
+        info.nBits = pindexTip->nBits;
+        info.nMedianTime = pindexTip->GetMedianTimePast();
+        info.nChainWork = pindexTip->nChainWork;
+    }
+    CDataStream ssInfo(SER_NETWORK, PROTOCOL_VERSION);
+    ssInfo << info;
+    return RESTReplyData(conn, fRun, strETag, rf, ssInfo);
+}
+
+static bool rest_mempool_info(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    CheckDataFormat(rf);
+
+    string strETag = RESTETag("mempool/info" + strReq, mempool.GetTransactionsUpdated());
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag))
+        return true;
+
+    if (rf == RF_JSON) {
+        UniValue rpcParams(UniValue::VARR);
+        return RESTReplyJSON(conn, fRun, strETag, getmempoolinfo(rpcParams, false));
+    }
+
+    CDataStream ssInfo(SER_NETWORK, PROTOCOL_VERSION);
+    ssInfo << (uint64_t)mempool.size() << (uint64_t)mempool.GetTotalTxSize();
+    return RESTReplyData(conn, fRun, strETag, rf, ssInfo);
+}
+
+static bool rest_mempool_contents(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    CheckDataFormat(rf);
+
+    string strETag = RESTETag("mempool/contents" + strReq, mempool.GetTransactionsUpdated());
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag))
+        return true;
+
+    if (rf == RF_JSON) {
+        UniValue rpcParams(UniValue::VARR);
+        rpcParams.push_back(true);
+        return RESTReplyJSON(conn, fRun, strETag, getrawmempool(rpcParams, false));
+    }
+
+    // the binary form only lists the txids, the transactions are at /rest/tx/
+    vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
+    CDataStream ssTxids(SER_NETWORK, PROTOCOL_VERSION);
+    ssTxids << vtxid;
+    return RESTReplyData(conn, fRun, strETag, rf, ssTxids);
+}
+
+static bool rest_getutxos(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    CheckDataFormat(rf);
+
+    vector<string> uriParts;
+    boost::split(uriParts, params[0], boost::is_any_of("/"));
+
+    // /rest/getutxos/[checkmempool/]<txid>-<n>/<txid>-<n>/...
+    bool fCheckMemPool = false;
+    size_t nFirst = 0;
+    if (!uriParts.empty() && uriParts[0] == "checkmempool") {
+        fCheckMemPool = true;
+        nFirst = 1;
+    }
+
+    vector<COutPoint> vOutPoints;
+    for (size_t i = nFirst; i < uriParts.size(); i++) {
+        size_t nDash = uriParts[i].find('-');
+        if (nDash == string::npos)
+            throw RESTERR(HTTP_BAD_REQUEST, "Parse error");
+        string strTxid = uriParts[i].substr(0, nDash);
+        string strOutput = uriParts[i].substr(nDash + 1);
+        uint256 txid;
+        if (!ParseHashStr(strTxid, txid) || strOutput.empty() || !ParseInt32(strOutput, NULL))
+            throw RESTERR(HTTP_BAD_REQUEST, "Parse error");
+        vOutPoints.push_back(COutPoint(txid, (uint32_t)atoi(strOutput)));
+    }
+
+    if (vOutPoints.empty())
+        throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+    if (vOutPoints.size() > MAX_GETUTXOS_OUTPOINTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_GETUTXOS_OUTPOINTS, vOutPoints.size()));
+
+    string strETag = RESTETag("getutxos/" + strReq, fCheckMemPool ? mempool.GetTransactionsUpdated() : 0);
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag))
+        return true;
+
+    vector<unsigned char> bitmap;
+    vector<CCoin> outs;
+    string bitmapStringRepresentation;
+    boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
+    int nHeight;
+    uint256 hashTip;
+    {
+        LOCK2(cs_main, mempool.cs);
+
+        CCoinsView viewDummy;
+        CCoinsViewCache view(&viewDummy);
+
+        CCoinsViewCache& viewChain = *pcoinsTip;
+        CCoinsViewMemPool viewMempool(&viewChain, mempool);
+
+        if (fCheckMemPool)
+            view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
+        else
+            view.SetBackend(viewChain);
+
+        for (size_t i = 0; i < vOutPoints.size(); i++) {
+            CCoins coins;
+            uint256 hash = vOutPoints[i].hash;
+            if (view.GetCoins(hash, coins)) {
+                if (fCheckMemPool)
+                    mempool.pruneSpent(hash, coins);
+                if (coins.IsAvailable(vOutPoints[i].n)) {
+                    hits[i] = true;
+                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
+                    // n is valid but points to an already spent output (IsNull).
+                    CCoin coin;
+                    coin.nTxVer = coins.nVersion;
+                    coin.nHeight = coins.nHeight;
+                    coin.out = coins.vout.at(vOutPoints[i].n);
+                    assert(!coin.out.IsNull());
+                    outs.push_back(coin);
+                }
+            }
+
+            bitmapStringRepresentation.append(hits[i] ? "1" : "0"); // form a binary string representation (human-readable for json output)
+        }
+
+        nHeight = chainActive.Height();
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+    boost::to_block_range(hits, std::back_inserter(bitmap));
+
+    if (rf == RF_JSON) {
+        UniValue objGetUTXOResponse(UniValue::VOBJ);
+        objGetUTXOResponse.push_back(Pair("chainHeight", nHeight));
+        objGetUTXOResponse.push_back(Pair("chaintipHash", hashTip.GetHex()));
+        objGetUTXOResponse.push_back(Pair("bitmap", bitmapStringRepresentation));
+
+        UniValue utxos(UniValue::VARR);
+        BOOST_FOREACH (const CCoin& coin, outs) {
+            UniValue utxo(UniValue::VOBJ);
+            utxo.push_back(Pair("txvers", (int32_t)coin.nTxVer));
+            utxo.push_back(Pair("height", (int32_t)coin.nHeight));
+            utxo.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
+
+            // include the script in a json output
+            UniValue o(UniValue::VOBJ);
+            ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
+            utxo.push_back(Pair("scriptPubKey", o));
+            utxos.push_back(utxo);
+        }
+        objGetUTXOResponse.push_back(Pair("utxos", utxos));
+        return RESTReplyJSON(conn, fRun, strETag, objGetUTXOResponse);
+    }
+
+    // serialize data
+    // use exact same output as mentioned in Bip64
+    CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+    ssGetUTXOResponse << nHeight << hashTip << bitmap << outs;
+    return RESTReplyData(conn, fRun, strETag, rf, ssGetUTXOResponse);
+}
+
+static bool rest_masternodes(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    CheckDataFormat(rf);
+
+    // tagged with the number of list changes, so an unchanged list is answered
+    // before anything is serialized
+    unsigned int nListUpdated;
+    CMasternodeSnapshotRef pSnapshot = mnodeman.GetSnapshot(&nListUpdated);
+    string strETag = RESTETag("masternodes" + strReq, nListUpdated);
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag))
+        return true;
+
+    if (rf == RF_JSON) {
+        UniValue rpcParams(UniValue::VARR);
+        return RESTReplyJSON(conn, fRun, strETag, listmasternodes(rpcParams, false));
+    }
+
+    // the list as broadcast on the network
+    vector<CMasternodeBroadcast> vMnb;
+    vMnb.reserve(pSnapshot->size());
+    BOOST_FOREACH (const CMasternode& mn, *pSnapshot)
+        vMnb.push_back(CMasternodeBroadcast(mn));
+    CDataStream ssMasternodes(SER_NETWORK, PROTOCOL_VERSION);
+    ssMasternodes << vMnb;
+    return RESTReplyData(conn, fRun, strETag, rf, ssMasternodes);
+}
+
+static bool rest_budget(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    CheckDataFormat(rf);
+
+    // Votes only count while their masternode is in the list, so the tag takes
+    // the changes to both. They are read before the reply is built, so a change
+    // racing with this request leaves a newer reply under an older tag, which
+    // the next request replaces.
+    unsigned int nBudgetUpdated = budget.GetBudgetUpdated();
+    unsigned int nListUpdated;
+    mnodeman.GetSnapshot(&nListUpdated);
+    CHashWriter ssExtra(SER_GETHASH, 0);
+    ssExtra << nBudgetUpdated << nListUpdated;
+    string strETag = RESTETag("budget" + strReq, ssExtra.GetHash());
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag))
+        return true;
+
+    if (rf == RF_JSON) {
+        UniValue rpcParams(UniValue::VARR);
+        UniValue budgetInfoObject;
+        {
+            LOCK2(cs_main, budget.cs);
+            budgetInfoObject = getbudgetinfo(rpcParams, false);
+        }
+        return RESTReplyJSON(conn, fRun, strETag, budgetInfoObject);
+    }
+
+    // valid proposals as broadcast on the network, each followed by its vote
+    // counts; the proposals returned are only valid while holding budget.cs
+    CDataStream ssBudget(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        LOCK(budget.cs);
+        vector<CBudgetProposal*> vProposals = budget.GetAllProposals();
+        unsigned int nValid = 0;
+        BOOST_FOREACH (CBudgetProposal* pbudgetProposal, vProposals)
+            if (pbudgetProposal->fValid) nValid++;
+        WriteCompactSize(ssBudget, nValid);
+        BOOST_FOREACH (CBudgetProposal* pbudgetProposal, vProposals) {
+            if (!pbudgetProposal->fValid) continue;
+            ssBudget << CBudgetProposalBroadcast(*pbudgetProposal);
+            ssBudget << (int32_t)pbudgetProposal->GetYeas() << (int32_t)pbudgetProposal->GetNays() << (int32_t)pbudgetProposal->GetAbstains();
+        }
+    }
+    return RESTReplyData(conn, fRun, strETag, rf, ssBudget);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(AcceptedConnection* conn,
@@ -225,12 +712,20 @@ static const struct {
     {"/rest/tx/", rest_tx},
     {"/rest/block/notxdetails/", rest_block_notxdetails},
     {"/rest/block/", rest_block_extended},
+    {"/rest/headers/", rest_headers},
+    {"/rest/chaininfo", rest_chaininfo},
+    {"/rest/mempool/info", rest_mempool_info},
+    {"/rest/mempool/contents", rest_mempool_contents},
+    {"/rest/getutxos/", rest_getutxos},
+    {"/rest/masternodes", rest_masternodes},
+    {"/rest/budget", rest_budget},
 };
 
 bool HTTPReq_REST(AcceptedConnection* conn,
     string& strURI,
     map<string, string>& mapHeaders,
-    bool fRun)
+    bool fRun,
+    string* pstrEndpoint)
 {
     try {
         std::string statusmessage;
@@ -240,6 +735,10 @@ bool HTTPReq_REST(AcceptedConnection* conn,
         for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++) {
             unsigned int plen = strlen(uri_prefixes[i].prefix);
             if (strURI.substr(0, plen) == uri_prefixes[i].prefix) {
+                if (pstrEndpoint) {
+                    string strPrefix(uri_prefixes[i].prefix + 6);
+                    *pstrEndpoint = "rest/" + strPrefix.substr(0, strPrefix.find('/'));
+                }
                 string strReq = strURI.substr(plen);
                 return uri_prefixes[i].handler(conn, strReq, mapHeaders, fRun);
             }
@@ -6,10 +6,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockpipeline.h"
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "main.h"
 #include "rpcserver.h"
+#include "snapshot.h"
 #include "sync.h"
 #include "txdb.h"
 #include "util.h"
@@ -18,6 +20,8 @@
 #include <stdint.h>
 #include <univalue.h>
 
+#include <boost/filesystem.hpp>
+
 using namespace std;
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
@@ -177,48 +181,72 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("getrawmempool", "true") + HelpExampleRpc("getrawmempool", "true"));
 
+    JSONTreeWriter writer;
+    getrawmempool(params, writer);
+    return writer.get();
+}
+
+static UniValue MempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    BOOST_FOREACH(const string& dep, setDepends) {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
+void getrawmempool(const UniValue& params, JSONWriter& writer)
+{
     bool fVerbose = false;
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
 
     if (fVerbose) {
-        LOCK(mempool.cs);
-        UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
+        // Batches of entries in txid order, each one built under the locks and
+        // written without them. Transactions that enter or leave the mempool
+        // meanwhile may or may not be listed.
+        writer.beginObject();
+        std::vector<std::pair<uint256, UniValue> > vBatch;
+        do {
+            {
+                LOCK2(cs_main, mempool.cs);
+                std::map<uint256, CTxMemPoolEntry>::const_iterator mi = vBatch.empty() ? mempool.mapTx.begin() : mempool.mapTx.upper_bound(vBatch.back().first);
+                vBatch.clear();
+                for (; mi != mempool.mapTx.end() && vBatch.size() < RPC_STREAM_BATCH_SIZE; ++mi)
+                    vBatch.push_back(std::make_pair(mi->first, MempoolEntryToJSON(mi->second)));
             }
-
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends) {
-                depends.push_back(dep);
+            for (unsigned int i = 0; i < vBatch.size(); i++) {
+                writer.key(vBatch[i].first.ToString());
+                writer.value(vBatch[i].second);
             }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
-        }
-        return o;
+        } while (vBatch.size() == RPC_STREAM_BATCH_SIZE);
+        writer.endObject();
     } else {
         vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
 
-        UniValue a(UniValue::VARR);
+        writer.beginArray();
         BOOST_FOREACH (const uint256& hash, vtxid)
-            a.push_back(hash.ToString());
-
-        return a;
+            writer.value(hash.ToString());
+        writer.endArray();
     }
 }
 
@@ -235,6 +263,8 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
+    LOCK(cs_main);
+
     int nHeight = params[0].get_int();
     if (nHeight < 0 || nHeight > chainActive.Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
@@ -285,13 +315,23 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    // Only the index lookup holds cs_main, so batched calls read blocks from disk in parallel
+    CBlockIndex* pblockindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+        if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        pos = pblockindex->GetBlockPos();
+    }
 
-    if (!ReadBlockFromDisk(block, pblockindex))
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (!fVerbose) {
@@ -301,6 +341,7 @@ UniValue getblock(const UniValue& params, bool fHelp)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex);
 }
 
@@ -341,7 +382,10 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if (!ReadBlockFromDisk(block, pblockindex))
+    // The index still has the header of a block whose data was pruned
+    if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        block = pblockindex->GetBlockHeader();
+    else if (!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (!fVerbose) {
@@ -390,6 +434,57 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue dumpsnapshot(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "dumpsnapshot \"filename\" ( height )\n"
+            "\nWrites the unspent transaction output set as of a block of the active chain, with the\n"
+            "block index up to it, to a snapshot file a new node can be started from with -loadsnapshot.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"filename\"  (string, required) The file to write, relative to the data directory unless absolute\n"
+            "2. height        (numeric, optional) The block height, at most " + strprintf("%d", MAX_SNAPSHOT_REWIND) + " below the tip\n"
+            "                 (default: the maximum reorganization depth below the tip)\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\": n,                (numeric) The height of the snapshot block\n"
+            "  \"bestblock\": \"hash\",       (string) The hash of the snapshot block\n"
+            "  \"transactions\": n,          (numeric) The number of transactions with unspent outputs\n"
+            "  \"hash_serialized\": \"hash\", (string) The hash of the coins, as gettxoutsetinfo reports it at that height\n"
+            "  \"filename\": \"path\"         (string) The file written\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumpsnapshot", "\"utxo.dat\"") + HelpExampleRpc("dumpsnapshot", "\"utxo.dat\", 100000"));
+
+    boost::filesystem::path path(params[0].get_str());
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = std::max(chainActive.Height() - Params().MaxReorganizationDepth(), 0);
+    }
+    if (params.size() > 1)
+        nHeight = params[1].get_int();
+
+    CSnapshotMetadata metadata;
+    std::string strError;
+    if (!DumpSnapshot(path, nHeight, metadata, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", metadata.nHeight));
+    ret.push_back(Pair("bestblock", metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", metadata.nTransactions));
+    ret.push_back(Pair("hash_serialized", metadata.hashSerialized.GetHex()));
+    ret.push_back(Pair("filename", path.string()));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -503,7 +598,25 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"bestblockhash\": \"...\", (string) the hash of the currently best block\n"
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
-            "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"chainwork\": \"xxxx\",    (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": true|false,     (boolean) whether old block files are deleted (-prune)\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest height from which on all blocks are stored, only present if pruning is enabled\n"
+            "  \"blockpipeline\": {        (json object) received blocks checked ahead of connecting them\n"
+            "     \"checkthreads\": n,     (numeric) number of check threads, 0 if blocks are checked while connecting\n"
+            "     \"queued\": n,           (numeric) blocks waiting in the pipeline\n"
+            "     \"blocks\": n,           (numeric) blocks that went through the pipeline\n"
+            "     \"waitms\": x.xxx,       (numeric) average time from receipt until a check thread picked the block up\n"
+            "     \"checkms\": x.xxx,      (numeric) average time spent on context-free checks and the block signature\n"
+            "     \"readyms\": x.xxx,      (numeric) average time a checked block waited for the blocks received before it\n"
+            "     \"connectms\": x.xxx     (numeric) average time spent accepting and connecting a block\n"
+            "  },\n"
+            "  \"snapshot\": {             (json object, only if started from a UTXO snapshot)\n"
+            "     \"height\": n,           (numeric) height of the snapshot block\n"
+            "     \"bestblock\": \"hash\",  (string) hash of the snapshot block\n"
+            "     \"hash_serialized\": \"hash\", (string) hash of the snapshot's coins\n"
+            "     \"validatedheight\": n,  (numeric) height up to which the blocks below the snapshot were validated\n"
+            "     \"validated\": true|false (boolean) whether the snapshot matched the validated blocks\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -516,6 +629,34 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode)
+        obj.push_back(Pair("pruneheight", GetPruneHeight()));
+
+    CBlockPipelineStats stats = blockPipeline.GetStats();
+    double nBlocks = std::max(stats.nBlocks, (uint64_t)1);
+    UniValue pipeline(UniValue::VOBJ);
+    pipeline.push_back(Pair("checkthreads", stats.nThreads));
+    pipeline.push_back(Pair("queued", (uint64_t)stats.nQueued));
+    pipeline.push_back(Pair("blocks", stats.nBlocks));
+    pipeline.push_back(Pair("waitms", 0.001 * stats.nTimeWait / nBlocks));
+    pipeline.push_back(Pair("checkms", 0.001 * stats.nTimeCheck / nBlocks));
+    pipeline.push_back(Pair("readyms", 0.001 * stats.nTimeReady / nBlocks));
+    pipeline.push_back(Pair("connectms", 0.001 * stats.nTimeConnect / nBlocks));
+    obj.push_back(Pair("blockpipeline", pipeline));
+
+    CSnapshotMetadata metadata;
+    int nValidatedHeight;
+    bool fValidated;
+    if (GetSnapshotStatus(metadata, nValidatedHeight, fValidated)) {
+        UniValue snapshot(UniValue::VOBJ);
+        snapshot.push_back(Pair("height", metadata.nHeight));
+        snapshot.push_back(Pair("bestblock", metadata.hashBlock.GetHex()));
+        snapshot.push_back(Pair("hash_serialized", metadata.hashSerialized.GetHex()));
+        snapshot.push_back(Pair("validatedheight", nValidatedHeight));
+        snapshot.push_back(Pair("validated", fValidated));
+        obj.push_back(Pair("snapshot", snapshot));
+    }
     return obj;
 }
 
@@ -73,6 +73,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"listunspent", 0},
         {"listunspent", 1},
         {"listunspent", 2},
+        {"dumpsnapshot", 1},
         {"getblock", 1},
         {"getblockheader", 1},
         {"gettransaction", 1},
@@ -12,6 +12,7 @@
 #include "masternodeconfig.h"
 #include "masternodeman.h"
 #include "rpcserver.h"
+#include "swifttx.h"
 #include "utilmoneystr.h"
 
 #include <univalue.h>
@@ -240,33 +241,32 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
         std::string strTxHash = s.second.vin.prevout.hash.ToString();
         uint32_t oIdx = s.second.vin.prevout.n;
 
-        CMasternode* mn = mnodeman.Find(s.second.vin);
-
-        if (mn != NULL) {
-            if (strFilter != "" && strTxHash.find(strFilter) == string::npos &&
-                mn->Status().find(strFilter) == string::npos &&
-                CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString().find(strFilter) == string::npos) continue;
-
-            std::string strStatus = mn->Status();
-            std::string strHost;
-            int port;
-            SplitHostPort(mn->addr.ToString(), port, strHost);
-            CNetAddr node = CNetAddr(strHost, false);
-            std::string strNetwork = GetNetworkName(node.GetNetwork());
-
-            obj.push_back(Pair("rank", (strStatus == "ENABLED" ? s.first : 0)));
-            obj.push_back(Pair("network", strNetwork));
-            obj.push_back(Pair("txhash", strTxHash));
-            obj.push_back(Pair("outidx", (uint64_t)oIdx));
-            obj.push_back(Pair("status", strStatus));
-            obj.push_back(Pair("addr", CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString()));
-            obj.push_back(Pair("version", mn->protocolVersion));
-            obj.push_back(Pair("lastseen", (int64_t)mn->lastPing.sigTime));
-            obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
-            obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
+        // ranks are computed from the published snapshot, no need to look the entry up again
+        CMasternode* mn = &s.second;
+
+        if (strFilter != "" && strTxHash.find(strFilter) == string::npos &&
+            mn->Status().find(strFilter) == string::npos &&
+            CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString().find(strFilter) == string::npos) continue;
+
+        std::string strStatus = mn->Status();
+        std::string strHost;
+        int port;
+        SplitHostPort(mn->addr.ToString(), port, strHost);
+        CNetAddr node = CNetAddr(strHost, false);
+        std::string strNetwork = GetNetworkName(node.GetNetwork());
+
+        obj.push_back(Pair("rank", (strStatus == "ENABLED" ? s.first : 0)));
+        obj.push_back(Pair("network", strNetwork));
+        obj.push_back(Pair("txhash", strTxHash));
+        obj.push_back(Pair("outidx", (uint64_t)oIdx));
+        obj.push_back(Pair("status", strStatus));
+        obj.push_back(Pair("addr", CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString()));
+        obj.push_back(Pair("version", mn->protocolVersion));
+        obj.push_back(Pair("lastseen", (int64_t)mn->lastPing.sigTime));
+        obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
+        obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
 
-            ret.push_back(obj);
-        }
+        ret.push_back(obj);
     }
 
     return ret;
@@ -847,11 +847,11 @@ UniValue getmasternodescores (const UniValue& params, bool fHelp)
     }
     UniValue obj(UniValue::VOBJ);
 
-    std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
+    CMasternodeSnapshotRef pMasternodes = mnodeman.GetSnapshot();
     for (int nHeight = chainActive.Tip()->nHeight - nLast; nHeight < chainActive.Tip()->nHeight + 20; nHeight++) {
         uint256 nHigh = 0;
-        CMasternode* pBestMasternode = NULL;
-        BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+        const CMasternode* pBestMasternode = NULL;
+        BOOST_FOREACH (const CMasternode& mn, *pMasternodes) {
             uint256 n = mn.CalculateScore(1, nHeight - 100);
             if (n > nHigh) {
                 nHigh = n;
@@ -864,3 +864,142 @@ UniValue getmasternodescores (const UniValue& params, bool fHelp)
 
     return obj;
 }
+
+UniValue getmasternodeschedule(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmasternodeschedule\n"
+            "\nDump the cached payee schedule used to check and create the next blocks.\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"nHeight\": n,           (numeric) block height\n"
+            "    \"address\": \"xxxx\",    (string) CBN MN Address with the most votes, or Unknown\n"
+            "    \"nVotes\": n,            (numeric) Number of votes for that address\n"
+            "    \"required\": [          (json array) Addresses with enough votes to be enforced\n"
+            "      \"xxxx\"\n"
+            "      ,...\n"
+            "    ]\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmasternodeschedule", "") + HelpExampleRpc("getmasternodeschedule", ""));
+
+    std::vector<CMasternodeScheduledPayee> vecSchedule;
+    masternodePayments.GetSchedule(vecSchedule);
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH (const CMasternodeScheduledPayee& entry, vecSchedule) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("nHeight", entry.nBlockHeight));
+
+        std::string strAddress = "Unknown";
+        if (entry.nVotes >= 0) {
+            CTxDestination address1;
+            ExtractDestination(entry.payee, address1);
+            strAddress = CBitcoinAddress(address1).ToString();
+        }
+        obj.push_back(Pair("address", strAddress));
+        obj.push_back(Pair("nVotes", std::max(entry.nVotes, 0)));
+
+        UniValue required(UniValue::VARR);
+        BOOST_FOREACH (const CScript& payee, entry.vecRequired) {
+            CTxDestination address1;
+            ExtractDestination(payee, address1);
+            required.push_back(CBitcoinAddress(address1).ToString());
+        }
+        obj.push_back(Pair("required", required));
+
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
+
+UniValue getswifttxinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getswifttxinfo\n"
+            "\nReturns SwiftTX lock and vote verification statistics.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"locks\": n,                  (numeric) Transaction locks in memory\n"
+            "  \"completelocks\": n,          (numeric) Locks that reached the required signatures\n"
+            "  \"votesverified\": n,          (numeric) Votes checked by the verification threads\n"
+            "  \"votespending\": n,           (numeric) Votes waiting to be checked or applied\n"
+            "  \"locklatency\": {             (json object) Time from a lock request to its last required vote\n"
+            "    \"count\": n,                (numeric) Locks measured\n"
+            "    \"last_ms\": n,              (numeric) Latency of the latest lock in milliseconds\n"
+            "    \"avg_ms\": n,               (numeric) Average latency in milliseconds\n"
+            "    \"max_ms\": n                (numeric) Largest latency in milliseconds\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getswifttxinfo", "") + HelpExampleRpc("getswifttxinfo", ""));
+
+    CSwiftTXStats stats = GetSwiftTXStats();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("locks", (int64_t)txLockManager.CountLocks()));
+    obj.push_back(Pair("completelocks", nCompleteTXLocks));
+    obj.push_back(Pair("votesverified", (int64_t)stats.nVotesVerified));
+    obj.push_back(Pair("votespending", (int64_t)stats.nVotesPending));
+    UniValue latency(UniValue::VOBJ);
+    latency.push_back(Pair("count", (int64_t)stats.nLocksCompleted));
+    latency.push_back(Pair("last_ms", stats.nLastLatencyMillis));
+    latency.push_back(Pair("avg_ms", stats.nLocksCompleted ? stats.nTotalLatencyMillis / (int64_t)stats.nLocksCompleted : 0));
+    latency.push_back(Pair("max_ms", stats.nMaxLatencyMillis));
+    obj.push_back(Pair("locklatency", latency));
+
+    return obj;
+}
+
+UniValue getorphanpoolinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getorphanpoolinfo\n"
+            "\nReturns the occupancy of the pools of masternode and budget objects that wait for a missing parent.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"pool\": {                    (json object) One entry per pool: budgetvotes, finalizedbudgetvotes,\n"
+            "                                 immatureproposals and immaturefinalizedbudgets\n"
+            "    \"entries\": n,              (numeric) Objects in the pool\n"
+            "    \"bytes\": n,                (numeric) Serialized size of the objects\n"
+            "    \"maxbytes\": n,             (numeric) Size limit of the pool\n"
+            "    \"peers\": n,                (numeric) Peers the objects came from\n"
+            "    \"rejected\": n              (numeric) Objects refused because a peer was over its quota\n"
+            "  },\n"
+            "  ...\n"
+            "  \"swifttxunknownvoters\": n,   (numeric) Masternodes tracked for SwiftTX votes on unknown transactions\n"
+            "  \"masternodesasked\": n        (numeric) Masternode entries asked from peers and not expired\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getorphanpoolinfo", "") + HelpExampleRpc("getorphanpoolinfo", ""));
+
+    std::map<std::string, COrphanPoolStats> mapStats;
+    budget.GetOrphanStats(mapStats);
+
+    UniValue obj(UniValue::VOBJ);
+    for (std::map<std::string, COrphanPoolStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        UniValue pool(UniValue::VOBJ);
+        pool.push_back(Pair("entries", (int64_t)it->second.nEntries));
+        pool.push_back(Pair("bytes", (int64_t)it->second.nBytes));
+        pool.push_back(Pair("maxbytes", (int64_t)it->second.nMaxBytes));
+        pool.push_back(Pair("peers", (int64_t)it->second.nPeers));
+        pool.push_back(Pair("rejected", (int64_t)it->second.nRejected));
+        obj.push_back(Pair(it->first, pool));
+    }
+    obj.push_back(Pair("swifttxunknownvoters", (int64_t)txLockManager.CountUnknownVoters()));
+    obj.push_back(Pair("masternodesasked", mnodeman.CountAskedEntries()));
+
+    return obj;
+}
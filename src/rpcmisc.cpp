@@ -10,10 +10,12 @@
 #include "init.h"
 #include "main.h"
 #include "masternode-sync.h"
+#include "miner.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpcserver.h"
 #include "spork.h"
+#include "sync.h"
 #include "timedata.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
@@ -508,6 +510,15 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if masternode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"tips\": n,                        (numeric) chain tips seen by the stake minter\n"
+            "  \"attempts\": n,                    (numeric) kernel searches started\n"
+            "  \"lastattempt\": ttt,               (numeric) time of the last kernel search\n"
+            "  \"firstattempt\": {                 (json object) delay from a new tip to the first kernel search on it\n"
+            "    \"count\": n,                     (numeric) tips searched on\n"
+            "    \"last_ms\": n,                   (numeric) delay for the latest tip in milliseconds\n"
+            "    \"avg_ms\": n,                    (numeric) average delay in milliseconds\n"
+            "    \"max_ms\": n                     (numeric) largest delay in milliseconds\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getstakingstatus", "") + HelpExampleRpc("getstakingstatus", ""));
@@ -529,6 +540,17 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
 
+    CStakingStats stats = stakeScheduler.GetStats();
+    obj.push_back(Pair("tips", stats.nTips));
+    obj.push_back(Pair("attempts", stats.nAttempts));
+    obj.push_back(Pair("lastattempt", stats.nLastAttemptTime));
+    UniValue firstAttempt(UniValue::VOBJ);
+    firstAttempt.push_back(Pair("count", stats.nDelays));
+    firstAttempt.push_back(Pair("last_ms", stats.nLastDelayMillis));
+    firstAttempt.push_back(Pair("avg_ms", stats.nDelays ? stats.nTotalDelayMillis / (int64_t)stats.nDelays : 0));
+    firstAttempt.push_back(Pair("max_ms", stats.nMaxDelayMillis));
+    obj.push_back(Pair("firstattempt", firstAttempt));
+
     return obj;
 }
 #endif // ENABLE_WALLET
@@ -576,3 +598,40 @@ UniValue makekeypair(const UniValue& params, bool fHelp)
 
     return result;
 }
+
+UniValue getlockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getlockstats\n"
+            "\nReturns wait statistics for the instrumented critical sections\n"
+            "(masternode list, masternode payments and budget manager).\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",        (string) Name of the critical section\n"
+            "    \"acquisitions\": n,     (numeric) Number of times the lock was entered\n"
+            "    \"contentions\": n,      (numeric) Number of times a caller had to wait\n"
+            "    \"waitms\": n,           (numeric) Total time spent waiting, in milliseconds\n"
+            "    \"maxwaitms\": n         (numeric) Longest single wait, in milliseconds\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getlockstats", "") + HelpExampleRpc("getlockstats", ""));
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH (const CLockContentionInfo& info, GetLockContentionInfo()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", info.strName));
+        obj.push_back(Pair("acquisitions", (uint64_t)info.nAcquisitions));
+        obj.push_back(Pair("contentions", (uint64_t)info.nContentions));
+        obj.push_back(Pair("waitms", (double)info.nWaitMicros / 1000));
+        obj.push_back(Pair("maxwaitms", (double)info.nMaxWaitMicros / 1000));
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
@@ -11,6 +11,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "protocol.h"
+#include "relaycache.h"
 #include "sync.h"
 #include "timedata.h"
 #include "util.h"
@@ -334,7 +335,13 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"relaycache\": {        (json object) serialized objects kept for answering getdata requests\n"
+            "     \"entries\": n,       (numeric) number of cached objects\n"
+            "     \"bytes\": n,         (numeric) size of the cached objects\n"
+            "     \"hits\": n,          (numeric) requests answered from the cache\n"
+            "     \"misses\": n         (numeric) requests for objects that had to be serialized again, or that we don't have\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getnettotals", "") + HelpExampleRpc("getnettotals", ""));
@@ -343,6 +350,14 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    CRelayCacheStats stats = relayCache.GetStats();
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    cache.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+    cache.push_back(Pair("hits", stats.nHits));
+    cache.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("relaycache", cache));
     return obj;
 }
 
@@ -72,6 +72,8 @@ static const char* httpStatusDescription(int nStatus)
     switch (nStatus) {
     case HTTP_OK:
         return "OK";
+    case HTTP_NOT_MODIFIED:
+        return "Not Modified";
     case HTTP_BAD_REQUEST:
         return "Bad Request";
     case HTTP_FORBIDDEN:
@@ -80,6 +82,8 @@ static const char* httpStatusDescription(int nStatus)
         return "Not Found";
     case HTTP_INTERNAL_SERVER_ERROR:
         return "Internal Server Error";
+    case HTTP_SERVICE_UNAVAILABLE:
+        return "Service Unavailable";
     default:
         return "";
     }
@@ -110,7 +114,7 @@ string HTTPError(int nStatus, bool keepalive, bool headersOnly)
         headersOnly, "text/plain");
 }
 
-string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType)
+string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType, const string& strExtraHeaders)
 {
     return strprintf(
         "HTTP/1.1 %d %s\r\n"
@@ -119,6 +123,7 @@ string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const
         "Content-Length: %u\r\n"
         "Content-Type: %s\r\n"
         "Server: cbn-json-rpc/%s\r\n"
+        "%s"
         "\r\n",
         nStatus,
         httpStatusDescription(nStatus),
@@ -126,6 +131,25 @@ string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const
         keepalive ? "keep-alive" : "close",
         contentLength,
         contentType,
+        FormatFullVersion(),
+        strExtraHeaders);
+}
+
+string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char* contentType)
+{
+    return strprintf(
+        "HTTP/1.1 %d %s\r\n"
+        "Date: %s\r\n"
+        "Connection: %s\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Content-Type: %s\r\n"
+        "Server: cbn-json-rpc/%s\r\n"
+        "\r\n",
+        nStatus,
+        httpStatusDescription(nStatus),
+        rfc1123Time(),
+        keepalive ? "keep-alive" : "close",
+        contentType,
         FormatFullVersion());
 }
 
@@ -212,6 +236,35 @@ int ReadHTTPHeaders(std::basic_istream<char>& stream, map<string, string>& mapHe
 }
 
 
+static int ReadHTTPChunks(std::basic_istream<char>& stream, string& strMessageRet, size_t max_size)
+{
+    string str;
+    while (true) {
+        // Chunk size in hex, possibly followed by extensions we ignore
+        getline(stream, str);
+        if (!stream)
+            return HTTP_INTERNAL_SERVER_ERROR;
+        size_t nLen = strtoul(str.c_str(), NULL, 16);
+        if (nLen == 0)
+            break;
+        if (nLen > max_size - strMessageRet.size())
+            return HTTP_INTERNAL_SERVER_ERROR;
+
+        size_t ptr = strMessageRet.size();
+        strMessageRet.resize(ptr + nLen);
+        stream.read(&strMessageRet[ptr], nLen);
+        getline(stream, str);
+        if (!stream)
+            return HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    // Skip trailers
+    do {
+        getline(stream, str);
+    } while (stream && !str.empty() && str != "\r");
+    return HTTP_OK;
+}
+
 int ReadHTTPMessage(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet, string& strMessageRet, int nProto, size_t max_size)
 {
     mapHeadersRet.clear();
@@ -223,7 +276,11 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, map<string, string>& mapHe
         return HTTP_INTERNAL_SERVER_ERROR;
 
     // Read message
-    if (nLen > 0) {
+    if (boost::iequals(mapHeadersRet["transfer-encoding"], "chunked")) {
+        int nStatus = ReadHTTPChunks(stream, strMessageRet, max_size);
+        if (nStatus != HTTP_OK)
+            return nStatus;
+    } else if (nLen > 0) {
         vector<char> vch;
         size_t ptr = 0;
         while (ptr < (size_t)nLen) {
@@ -294,6 +351,130 @@ UniValue JSONRPCError(int code, const string& message)
     return error;
 }
 
+void JSONTreeWriter::begin(UniValue::VType type)
+{
+    vOpen.push_back(std::make_pair(strKey, UniValue(type)));
+}
+
+void JSONTreeWriter::end()
+{
+    std::pair<std::string, UniValue> closed = vOpen.back();
+    vOpen.pop_back();
+    strKey = closed.first;
+    value(closed.second);
+}
+
+void JSONTreeWriter::value(const UniValue& val)
+{
+    if (vOpen.empty())
+        result = val;
+    else if (vOpen.back().second.isArray())
+        vOpen.back().second.push_back(val);
+    else
+        vOpen.back().second.pushKV(strKey, val);
+}
+
+JSONStreamWriter::JSONStreamWriter(const FlushFn& fnFlushIn, size_t nBufferSizeIn) : fnFlush(fnFlushIn),
+                                                                                     nBufferSize(nBufferSizeIn),
+                                                                                     fAfterKey(false)
+{
+    strBuffer.reserve(nBufferSize + 1024);
+}
+
+void JSONStreamWriter::separator()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            strBuffer += ',';
+        vEmpty.back() = false;
+    }
+}
+
+void JSONStreamWriter::maybeFlush()
+{
+    if (strBuffer.size() >= nBufferSize)
+        flush();
+}
+
+void JSONStreamWriter::beginArray()
+{
+    separator();
+    strBuffer += '[';
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::endArray()
+{
+    vEmpty.pop_back();
+    strBuffer += ']';
+    maybeFlush();
+}
+
+void JSONStreamWriter::beginObject()
+{
+    separator();
+    strBuffer += '{';
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::endObject()
+{
+    vEmpty.pop_back();
+    strBuffer += '}';
+    maybeFlush();
+}
+
+void JSONStreamWriter::key(const std::string& strKey)
+{
+    separator();
+    strBuffer += UniValue(strKey).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::value(const UniValue& val)
+{
+    // Walk containers, so that a large UniValue is not written out as one string either
+    if (val.isArray()) {
+        beginArray();
+        const std::vector<UniValue>& values = val.getValues();
+        for (unsigned int i = 0; i < values.size(); i++)
+            value(values[i]);
+        endArray();
+    } else if (val.isObject()) {
+        beginObject();
+        const std::vector<std::string>& keys = val.getKeys();
+        const std::vector<UniValue>& values = val.getValues();
+        for (unsigned int i = 0; i < keys.size(); i++) {
+            key(keys[i]);
+            value(values[i]);
+        }
+        endObject();
+    } else {
+        separator();
+        strBuffer += val.write();
+        maybeFlush();
+    }
+}
+
+void JSONStreamWriter::write(const std::string& strText)
+{
+    strBuffer += strText;
+    maybeFlush();
+}
+
+void JSONStreamWriter::flush()
+{
+    if (strBuffer.empty())
+        return;
+    fnFlush(strBuffer);
+    strBuffer.clear();
+}
+
 /** Username used when cookie authentication is in use (arbitrary, only for
  * recognizability in debugging/logging purposes)
  */
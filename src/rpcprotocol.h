@@ -10,6 +10,8 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include <boost/function.hpp>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/asio.hpp>
@@ -21,6 +23,7 @@
 //! HTTP status codes
 enum HTTPStatusCode {
     HTTP_OK = 200,
+    HTTP_NOT_MODIFIED = 304,
     HTTP_BAD_REQUEST = 400,
     HTTP_UNAUTHORIZED = 401,
     HTTP_FORBIDDEN = 403,
@@ -96,6 +99,8 @@ public:
         fNeedHandshake = false;
         stream.handshake(role);
     }
+    //! For servers that did the handshake with async_handshake
+    void setHandshakeDone() { fNeedHandshake = false; }
     std::streamsize read(char* s, std::streamsize n)
     {
         handshake(boost::asio::ssl::stream_base::server); // HTTPS servers read first
@@ -147,8 +152,9 @@ private:
 
 std::string HTTPPost(const std::string& strMsg, const std::map<std::string, std::string>& mapRequestHeaders);
 std::string HTTPError(int nStatus, bool keepalive, bool headerOnly = false);
-std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType = "application/json");
+std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType = "application/json", const std::string& strExtraHeaders = "");
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive, bool headerOnly = false, const char* contentType = "application/json");
+std::string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char* contentType = "application/json");
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int& proto, std::string& http_method, std::string& http_uri);
 int ReadHTTPStatus(std::basic_istream<char>& stream, int& proto);
 int ReadHTTPHeaders(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet);
@@ -158,6 +164,85 @@ UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const Un
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id);
 UniValue JSONRPCError(int code, const std::string& message);
 
+/**
+ * Receives a JSON value piece by piece, so that RPC calls with large results can
+ * produce them one element at a time instead of building the whole UniValue first.
+ */
+class JSONWriter
+{
+public:
+    virtual ~JSONWriter() {}
+
+    virtual void beginArray() = 0;
+    virtual void endArray() = 0;
+    virtual void beginObject() = 0;
+    virtual void endObject() = 0;
+    //! Name of the next member of the current object
+    virtual void key(const std::string& strKey) = 0;
+    //! A complete value: an array element, an object member after key(), or the whole result
+    virtual void value(const UniValue& val) = 0;
+};
+
+/** Collects the written value as a UniValue, for callers that need the whole result */
+class JSONTreeWriter : public JSONWriter
+{
+private:
+    UniValue result;
+    //! Open arrays and objects, with the key each one will be stored under
+    std::vector<std::pair<std::string, UniValue> > vOpen;
+    std::string strKey;
+
+    void begin(UniValue::VType type);
+    void end();
+
+public:
+    void beginArray() { begin(UniValue::VARR); }
+    void endArray() { end(); }
+    void beginObject() { begin(UniValue::VOBJ); }
+    void endObject() { end(); }
+    void key(const std::string& strKeyIn) { strKey = strKeyIn; }
+    void value(const UniValue& val);
+
+    const UniValue& get() const { return result; }
+};
+
+/**
+ * Writes the value as compact JSON text, the same as UniValue::write(). The text is
+ * handed to fnFlush in pieces of about nBufferSize bytes, so a large result never
+ * exists as one string.
+ */
+class JSONStreamWriter : public JSONWriter
+{
+public:
+    typedef boost::function<void(const std::string&)> FlushFn;
+
+private:
+    FlushFn fnFlush;
+    size_t nBufferSize;
+    std::string strBuffer;
+    //! For each open array or object, whether nothing was written into it yet
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+
+    void separator();
+    void maybeFlush();
+
+public:
+    JSONStreamWriter(const FlushFn& fnFlushIn, size_t nBufferSizeIn = 64 * 1024);
+
+    void beginArray();
+    void endArray();
+    void beginObject();
+    void endObject();
+    void key(const std::string& strKey);
+    void value(const UniValue& val);
+
+    //! Text outside of the JSON value, like the newline ending a reply
+    void write(const std::string& strText);
+    //! Hand all buffered text to fnFlush
+    void flush();
+};
+
 /** Get name of RPC authentication cookie file */
 boost::filesystem::path GetAuthCookieFile();
 /** Generate a new RPC authentication cookie and write it to disk */
@@ -176,6 +176,10 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = (params[1].get_int() != 0);
 
+    // Thread safe, but not lock free: GetTransaction holds cs_main while it looks the
+    // transaction up, including the read from the block file with -txindex, and the
+    // verbose result is built under cs_main. Only the hex encoding runs without it,
+    // so concurrent calls, like those of a batch, mostly take turns.
     CTransaction tx;
     uint256 hashBlock = 0;
     if (!GetTransaction(hash, tx, hashBlock, true))
@@ -188,11 +192,42 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hex", strHex));
+    LOCK(cs_main);
     TxToJSON(tx, hashBlock, result);
     return result;
 }
 
 #ifdef ENABLE_WALLET
+static UniValue UnspentToJSON(const COutput& out)
+{
+    AssertLockHeld(pwalletMain->cs_wallet);
+    CAmount nValue = out.tx->vout[out.i].nValue;
+    const CScript& pk = out.tx->vout[out.i].scriptPubKey;
+    UniValue entry(UniValue::VOBJ);
+    entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
+    entry.push_back(Pair("vout", out.i));
+    CTxDestination address;
+    if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
+        entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+        if (pwalletMain->mapAddressBook.count(address))
+            entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
+    }
+    entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
+    if (pk.IsPayToScriptHash()) {
+        CTxDestination address;
+        if (ExtractDestination(pk, address)) {
+            const CScriptID& hash = boost::get<CScriptID>(address);
+            CScript redeemScript;
+            if (pwalletMain->GetCScript(hash, redeemScript))
+                entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+        }
+    }
+    entry.push_back(Pair("amount", ValueFromAmount(nValue)));
+    entry.push_back(Pair("confirmations", out.nDepth));
+    entry.push_back(Pair("spendable", out.fSpendable));
+    return entry;
+}
+
 UniValue listunspent(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 3)
@@ -228,6 +263,13 @@ UniValue listunspent(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("listunspent", "") + HelpExampleCli("listunspent", "6 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\"") + HelpExampleRpc("listunspent", "6, 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\""));
 
+    JSONTreeWriter writer;
+    listunspent(params, writer);
+    return writer.get();
+}
+
+void listunspent(const UniValue& params, JSONWriter& writer)
+{
     RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM)(UniValue::VNUM)(UniValue::VARR));
 
     int nMinDepth = 1;
@@ -252,51 +294,44 @@ UniValue listunspent(const UniValue& params, bool fHelp)
         }
     }
 
-    UniValue results(UniValue::VARR);
-    vector<COutput> vecOutputs;
+    // The outputs are picked under the locks first. Their entries are then built
+    // in batches under the locks and written without them; an output whose
+    // transaction left the wallet meanwhile is skipped.
+    std::vector<std::pair<COutPoint, std::pair<int, bool> > > vUnspent;
     assert(pwalletMain != NULL);
-    pwalletMain->AvailableCoins(vecOutputs, false);
-    BOOST_FOREACH (const COutput& out, vecOutputs) {
-        if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
-            continue;
-
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        vector<COutput> vecOutputs;
         if (setAddress.size()) {
-            CTxDestination address;
-            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
-                continue;
-
-            if (!setAddress.count(address))
-                continue;
+            set<CTxDestination> setDest;
+            BOOST_FOREACH (const CBitcoinAddress& address, setAddress)
+                setDest.insert(address.Get());
+            pwalletMain->AvailableCoinsByDestination(vecOutputs, setDest, false);
+        } else {
+            pwalletMain->AvailableCoins(vecOutputs, false);
         }
-
-        CAmount nValue = out.tx->vout[out.i].nValue;
-        const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-        UniValue entry(UniValue::VOBJ);
-        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-        entry.push_back(Pair("vout", out.i));
-        CTxDestination address;
-        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
-            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
-            if (pwalletMain->mapAddressBook.count(address))
-                entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
+        BOOST_FOREACH (const COutput& out, vecOutputs) {
+            if (out.nDepth >= nMinDepth && out.nDepth <= nMaxDepth)
+                vUnspent.push_back(std::make_pair(COutPoint(out.tx->GetHash(), out.i), std::make_pair(out.nDepth, out.fSpendable)));
         }
-        entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
-        if (pk.IsPayToScriptHash()) {
-            CTxDestination address;
-            if (ExtractDestination(pk, address)) {
-                const CScriptID& hash = boost::get<CScriptID>(address);
-                CScript redeemScript;
-                if (pwalletMain->GetCScript(hash, redeemScript))
-                    entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+    }
+
+    writer.beginArray();
+    std::vector<UniValue> vBatch;
+    for (size_t nPos = 0; nPos < vUnspent.size(); nPos += RPC_STREAM_BATCH_SIZE) {
+        vBatch.clear();
+        {
+            LOCK(pwalletMain->cs_wallet);
+            for (size_t i = nPos; i < std::min(vUnspent.size(), nPos + RPC_STREAM_BATCH_SIZE); i++) {
+                const CWalletTx* pwtx = pwalletMain->GetWalletTx(vUnspent[i].first.hash);
+                if (pwtx != NULL)
+                    vBatch.push_back(UnspentToJSON(COutput(pwtx, vUnspent[i].first.n, vUnspent[i].second.first, vUnspent[i].second.second)));
             }
         }
-        entry.push_back(Pair("amount", ValueFromAmount(nValue)));
-        entry.push_back(Pair("confirmations", out.nDepth));
-        entry.push_back(Pair("spendable", out.fSpendable));
-        results.push_back(entry);
+        BOOST_FOREACH (const UniValue& entry, vBatch)
+            writer.value(entry);
     }
-
-    return results;
+    writer.endArray();
 }
 #endif
 
@@ -729,7 +764,7 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
     if (!fHaveMempool && !fHaveChain) {
         // push to local node and sync with wallets
         if (fSwiftTX) {
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            txLockManager.AddRequest(tx);
             CreateNewLock(tx);
             RelayTransactionLockReq(tx, true);
         }
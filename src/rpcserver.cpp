@@ -14,6 +14,7 @@
 #include "sync.h"
 #include "ui_interface.h"
 #include "util.h"
+#include "workqueue.h"
 #ifdef ENABLE_WALLET
 #include "wallet.h"
 #endif
@@ -21,7 +22,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#include <boost/atomic.hpp>
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/iostreams/concepts.hpp>
@@ -29,6 +32,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 #include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
 #include <univalue.h>
@@ -66,6 +70,77 @@ static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work* rpc_dummy_work = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector<boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
+//! Complete requests waiting for an RPC worker thread
+static CWorkQueue* rpc_work_queue = NULL;
+//! Open client connections, and how many there may be (-rpcmaxconnections)
+static boost::atomic<int> nRPCConnections(0);
+static int nRPCMaxConnections = DEFAULT_HTTP_MAX_CONNECTIONS;
+//! Seconds a client may take to send a request, or stay idle between requests (-rpcservertimeout)
+static int nRPCServerTimeout = DEFAULT_HTTP_SERVER_TIMEOUT;
+//! Threads helping to execute the read-only requests of batches
+static CWorkQueue* rpc_batch_queue = NULL;
+
+//! Largest request line plus headers accepted from a client
+static const size_t MAX_HEADERS_SIZE = 8192;
+
+//! Upper bounds of the latency histogram buckets in microseconds; the last bucket has none
+static const int64_t RPC_LATENCY_BOUNDS[] = {1000, 10000, 100000, 1000000, 10000000};
+static const char* const RPC_LATENCY_LABELS[] = {"1ms", "10ms", "100ms", "1s", "10s", "inf"};
+static const unsigned int RPC_LATENCY_BUCKETS = ARRAYLEN(RPC_LATENCY_LABELS);
+
+/** Latencies of one RPC method or REST endpoint */
+struct CRPCLatency {
+    uint64_t nCount;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    uint64_t vBuckets[RPC_LATENCY_BUCKETS];
+
+    CRPCLatency() : nCount(0), nTotalMicros(0), nMaxMicros(0)
+    {
+        for (unsigned int i = 0; i < RPC_LATENCY_BUCKETS; i++)
+            vBuckets[i] = 0;
+    }
+};
+
+static CCriticalSection cs_rpcLatency;
+static std::map<std::string, CRPCLatency> mapRPCLatency;
+
+static void RecordRPCLatency(const std::string& strName, int64_t nMicros)
+{
+    unsigned int nBucket = 0;
+    while (nBucket < RPC_LATENCY_BUCKETS - 1 && nMicros >= RPC_LATENCY_BOUNDS[nBucket])
+        nBucket++;
+
+    LOCK(cs_rpcLatency);
+    CRPCLatency& latency = mapRPCLatency[strName];
+    latency.nCount++;
+    latency.nTotalMicros += nMicros;
+    latency.nMaxMicros = std::max(latency.nMaxMicros, nMicros);
+    latency.vBuckets[nBucket]++;
+}
+
+/**
+ * Records the time until it goes out of scope as a latency of strName. The name may
+ * be filled in meanwhile, like the method of a request that still has to be parsed.
+ * Calls of methods that don't exist, and REST requests that matched no endpoint (no
+ * name), are recorded together as "unknown", so clients can't add entries at will.
+ */
+class CRPCLatencyTimer
+{
+private:
+    const std::string& strName;
+    bool fREST;
+    int64_t nStart;
+
+public:
+    CRPCLatencyTimer(const std::string& strNameIn, bool fRESTIn = false) : strName(strNameIn), fREST(fRESTIn), nStart(GetTimeMicros()) {}
+
+    ~CRPCLatencyTimer()
+    {
+        bool fKnown = fREST ? !strName.empty() : tableRPC[strName] != NULL;
+        RecordRPCLatency(fKnown ? strName : "unknown", GetTimeMicros() - nStart);
+    }
+};
 
 void RPCTypeCheck(const UniValue& params,
                   const list<UniValue::VType>& typesExpected,
@@ -266,164 +341,241 @@ UniValue stop(const UniValue& params, bool fHelp)
     return "CBN server stopping";
 }
 
+UniValue getrpcinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns the state of the RPC server's work queue and the latencies of the calls it served.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"connections\": n,        (numeric) number of open client connections\n"
+            "  \"workqueue\": {           (json object) requests waiting for a worker thread\n"
+            "    \"threads\": n,          (numeric) number of worker threads (-rpcthreads)\n"
+            "    \"depth\": n,            (numeric) number of requests waiting\n"
+            "    \"maxdepth\": n,         (numeric) number of requests that can wait (-rpcworkqueue)\n"
+            "    \"rejected\": n          (numeric) requests answered with 503 because the queue was full\n"
+            "  },\n"
+            "  \"latencies\": {           (json object) per JSON-RPC method or REST endpoint (\"rest/<type>\"), \"unknown\" for the others\n"
+            "    \"name\": {\n"
+            "      \"count\": n,          (numeric) number of calls\n"
+            "      \"total_ms\": n,       (numeric) total time of the calls, including sending the reply\n"
+            "      \"max_ms\": n,         (numeric) longest call\n"
+            "      \"histogram\": {       (json object) number of calls that took less than each bound\n"
+            "        \"1ms\": n, \"10ms\": n, \"100ms\": n, \"1s\": n, \"10s\": n, \"inf\": n\n"
+            "      }\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcinfo", "") + HelpExampleRpc("getrpcinfo", ""));
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("connections", nRPCConnections.load()));
+    if (rpc_work_queue != NULL) {
+        UniValue queue(UniValue::VOBJ);
+        queue.push_back(Pair("threads", rpc_work_queue->Threads()));
+        queue.push_back(Pair("depth", (uint64_t)rpc_work_queue->Depth()));
+        queue.push_back(Pair("maxdepth", (uint64_t)rpc_work_queue->MaxDepth()));
+        queue.push_back(Pair("rejected", rpc_work_queue->Rejected()));
+        ret.push_back(Pair("workqueue", queue));
+    }
+
+    UniValue latencies(UniValue::VOBJ);
+    {
+        LOCK(cs_rpcLatency);
+        BOOST_FOREACH (const PAIRTYPE(std::string, CRPCLatency) & item, mapRPCLatency) {
+            const CRPCLatency& latency = item.second;
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("count", latency.nCount));
+            entry.push_back(Pair("total_ms", latency.nTotalMicros / 1000));
+            entry.push_back(Pair("max_ms", latency.nMaxMicros / 1000));
+            UniValue histogram(UniValue::VOBJ);
+            for (unsigned int i = 0; i < RPC_LATENCY_BUCKETS; i++)
+                histogram.push_back(Pair(RPC_LATENCY_LABELS[i], latency.vBuckets[i]));
+            entry.push_back(Pair("histogram", histogram));
+            latencies.push_back(Pair(item.first, entry));
+        }
+    }
+    ret.push_back(Pair("latencies", latencies));
+    return ret;
+}
+
 
 /**
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
     {
-        //  category              name                      actor (function)         okSafeMode threadSafe reqWallet
-        //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
+        //  category              name                      actor (function)         okSafeMode threadSafe reqWallet readOnly
+        //  --------------------- ------------------------  -----------------------  ---------- ---------- --------- --------
         /* Overall control/query calls */
-        {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
-        {"control", "help", &help, true, true, false},
-        {"control", "stop", &stop, true, true, false},
+        {"control", "getinfo", &getinfo, true, false, false, true}, /* uses wallet if enabled */
+        {"control", "getlockstats", &getlockstats, true, true, false, true},
+        {"control", "getrpcinfo", &getrpcinfo, true, true, false, true},
+        {"control", "help", &help, true, true, false, true},
+        {"control", "stop", &stop, true, true, false, false},
 
         /* P2P networking */
-        {"network", "getnetworkinfo", &getnetworkinfo, true, false, false},
-        {"network", "addnode", &addnode, true, true, false},
-        {"network", "disconnectnode", &disconnectnode, true, true, false},
-        {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false},
-        {"network", "getconnectioncount", &getconnectioncount, true, false, false},
-        {"network", "getnettotals", &getnettotals, true, true, false},
-        {"network", "getpeerinfo", &getpeerinfo, true, false, false},
-        {"network", "ping", &ping, true, false, false},
-        {"network", "setban", &setban, true, false, false},
-        {"network", "listbanned", &listbanned, true, false, false},
-        {"network", "clearbanned", &clearbanned, true, false, false},
+        {"network", "getnetworkinfo", &getnetworkinfo, true, false, false, true},
+        {"network", "addnode", &addnode, true, true, false, false},
+        {"network", "disconnectnode", &disconnectnode, true, true, false, false},
+        {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false, true},
+        {"network", "getconnectioncount", &getconnectioncount, true, false, false, true},
+        {"network", "getnettotals", &getnettotals, true, true, false, true},
+        {"network", "getpeerinfo", &getpeerinfo, true, false, false, true},
+        {"network", "ping", &ping, true, false, false, false},
+        {"network", "setban", &setban, true, false, false, false},
+        {"network", "listbanned", &listbanned, true, false, false, true},
+        {"network", "clearbanned", &clearbanned, true, false, false, false},
 
         /* Block chain and UTXO */
-        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
-        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
-        {"blockchain", "getblockcount", &getblockcount, true, false, false},
-        {"blockchain", "getblock", &getblock, true, false, false},
-        {"blockchain", "getblockhash", &getblockhash, true, false, false},
-        {"blockchain", "getblockheader", &getblockheader, false, false, false},
-        {"blockchain", "getchaintips", &getchaintips, true, false, false},
-        {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
-        {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false},
-        {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
-        {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
-        {"blockchain", "gettxout", &gettxout, true, false, false},
-        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
-        {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
-        {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
-        {"blockchain", "verifychain", &verifychain, true, false, false},
+        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false, true},
+        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false, true},
+        {"blockchain", "getblockcount", &getblockcount, true, false, false, true},
+        {"blockchain", "dumpsnapshot", &dumpsnapshot, true, true, false, false},
+        {"blockchain", "getblock", &getblock, true, true, false, true},
+        {"blockchain", "getblockhash", &getblockhash, true, true, false, true},
+        {"blockchain", "getblockheader", &getblockheader, false, false, false, true},
+        {"blockchain", "getchaintips", &getchaintips, true, false, false, true},
+        {"blockchain", "getdifficulty", &getdifficulty, true, false, false, true},
+        {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false, true},
+        {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false, true},
+        {"blockchain", "getrawmempool", &getrawmempool, true, false, false, true},
+        {"blockchain", "gettxout", &gettxout, true, false, false, true},
+        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false, true},
+        {"blockchain", "invalidateblock", &invalidateblock, true, true, false, false},
+        {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false, false},
+        {"blockchain", "verifychain", &verifychain, true, false, false, false},
 
         /* Mining */
-        {"mining", "getblocktemplate", &getblocktemplate, true, false, false},
-        {"mining", "getmininginfo", &getmininginfo, true, false, false},
-        {"mining", "getnetworkhashps", &getnetworkhashps, true, false, false},
-        {"mining", "prioritisetransaction", &prioritisetransaction, true, false, false},
-        {"mining", "submitblock", &submitblock, true, true, false},
-        {"mining", "reservebalance", &reservebalance, true, true, false},
+        {"mining", "getblocktemplate", &getblocktemplate, true, false, false, false},
+        {"mining", "getmininginfo", &getmininginfo, true, false, false, true},
+        {"mining", "getnetworkhashps", &getnetworkhashps, true, false, false, true},
+        {"mining", "prioritisetransaction", &prioritisetransaction, true, false, false, false},
+        {"mining", "submitblock", &submitblock, true, true, false, false},
+        {"mining", "reservebalance", &reservebalance, true, true, false, false},
 
 #ifdef ENABLE_WALLET
         /* Coin generation */
-        {"generating", "getgenerate", &getgenerate, true, false, false},
-        {"generating", "gethashespersec", &gethashespersec, true, false, false},
-        {"generating", "setgenerate", &setgenerate, true, true, false},
+        {"generating", "getgenerate", &getgenerate, true, false, false, true},
+        {"generating", "gethashespersec", &gethashespersec, true, false, false, true},
+        {"generating", "setgenerate", &setgenerate, true, true, false, false},
 #endif
 
         /* Raw transactions */
-        {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false},
-        {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false},
-        {"rawtransactions", "decodescript", &decodescript, true, false, false},
-        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false},
-        {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
-        {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
+        {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false, true},
+        {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false, true},
+        {"rawtransactions", "decodescript", &decodescript, true, false, false, true},
+        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, true, false, true},
+        {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false, false},
+        {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false, false}, /* uses wallet if enabled */
 
         /* Utility functions */
-        {"util", "createmultisig", &createmultisig, true, true, false},
-        {"util", "validateaddress", &validateaddress, true, false, false}, /* uses wallet if enabled */
-        {"util", "verifymessage", &verifymessage, true, false, false},
-        {"util", "estimatefee", &estimatefee, true, true, false},
-        {"util", "estimatepriority", &estimatepriority, true, true, false},
+        {"util", "createmultisig", &createmultisig, true, true, false, true},
+        {"util", "validateaddress", &validateaddress, true, false, false, true}, /* uses wallet if enabled */
+        {"util", "verifymessage", &verifymessage, true, false, false, true},
+        {"util", "estimatefee", &estimatefee, true, true, false, true},
+        {"util", "estimatepriority", &estimatepriority, true, true, false, true},
 
         /* Not shown in help */
-        {"hidden", "invalidateblock", &invalidateblock, true, true, false},
-        {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
-        {"hidden", "setmocktime", &setmocktime, true, false, false},
-        {"hidden", "makekeypair", &makekeypair, true, true, false},
+        {"hidden", "invalidateblock", &invalidateblock, true, true, false, false},
+        {"hidden", "reconsiderblock", &reconsiderblock, true, true, false, false},
+        {"hidden", "setmocktime", &setmocktime, true, false, false, false},
+        {"hidden", "makekeypair", &makekeypair, true, true, false, false},
 
         /* CBN features */
-        {"cbn", "masternode", &masternode, true, true, false},
-        {"cbn", "listmasternodes", &listmasternodes, true, true, false},
-        {"cbn", "getmasternodecount", &getmasternodecount, true, true, false},
-        {"cbn", "masternodeconnect", &masternodeconnect, true, true, false},
-        {"cbn", "masternodecurrent", &masternodecurrent, true, true, false},
-        {"cbn", "masternodedebug", &masternodedebug, true, true, false},
-        {"cbn", "startmasternode", &startmasternode, true, true, false},
-        {"cbn", "createmasternodekey", &createmasternodekey, true, true, false},
-        {"cbn", "getmasternodeoutputs", &getmasternodeoutputs, true, true, false},
-        {"cbn", "listmasternodeconf", &listmasternodeconf, true, true, false},
-        {"cbn", "getmasternodestatus", &getmasternodestatus, true, true, false},
-        {"cbn", "getmasternodewinners", &getmasternodewinners, true, true, false},
-        {"cbn", "getmasternodescores", &getmasternodescores, true, true, false},
-        {"cbn", "mnbudget", &mnbudget, true, true, false},
-        {"cbn", "preparebudget", &preparebudget, true, true, false},
-        {"cbn", "submitbudget", &submitbudget, true, true, false},
-        {"cbn", "mnbudgetvote", &mnbudgetvote, true, true, false},
-        {"cbn", "getbudgetvotes", &getbudgetvotes, true, true, false},
-        {"cbn", "getnextsuperblock", &getnextsuperblock, true, true, false},
-        {"cbn", "getbudgetprojection", &getbudgetprojection, true, true, false},
-        {"cbn", "getbudgetinfo", &getbudgetinfo, true, true, false},
-        {"cbn", "mnbudgetrawvote", &mnbudgetrawvote, true, true, false},
-        {"cbn", "mnfinalbudget", &mnfinalbudget, true, true, false},
-        {"cbn", "checkbudgets", &checkbudgets, true, true, false},
-        {"cbn", "mnsync", &mnsync, true, true, false},
-        {"cbn", "spork", &spork, true, true, false},
+        {"cbn", "masternode", &masternode, true, true, false, false},
+        {"cbn", "listmasternodes", &listmasternodes, true, true, false, true},
+        {"cbn", "getmasternodecount", &getmasternodecount, true, true, false, true},
+        {"cbn", "masternodeconnect", &masternodeconnect, true, true, false, false},
+        {"cbn", "masternodecurrent", &masternodecurrent, true, true, false, true},
+        {"cbn", "masternodedebug", &masternodedebug, true, true, false, false},
+        {"cbn", "startmasternode", &startmasternode, true, true, false, false},
+        {"cbn", "createmasternodekey", &createmasternodekey, true, true, false, false},
+        {"cbn", "getmasternodeoutputs", &getmasternodeoutputs, true, true, false, false},
+        {"cbn", "listmasternodeconf", &listmasternodeconf, true, true, false, false},
+        {"cbn", "getmasternodestatus", &getmasternodestatus, true, true, false, true},
+        {"cbn", "getmasternodewinners", &getmasternodewinners, true, true, false, true},
+        {"cbn", "getmasternodescores", &getmasternodescores, true, true, false, true},
+        {"cbn", "getmasternodeschedule", &getmasternodeschedule, true, true, false, true},
+        {"cbn", "getswifttxinfo", &getswifttxinfo, true, true, false, true},
+        {"cbn", "getorphanpoolinfo", &getorphanpoolinfo, true, true, false, true},
+        {"cbn", "mnbudget", &mnbudget, true, true, false, false},
+        {"cbn", "preparebudget", &preparebudget, true, true, false, false},
+        {"cbn", "submitbudget", &submitbudget, true, true, false, false},
+        {"cbn", "mnbudgetvote", &mnbudgetvote, true, true, false, false},
+        {"cbn", "getbudgetvotes", &getbudgetvotes, true, true, false, true},
+        {"cbn", "getnextsuperblock", &getnextsuperblock, true, true, false, true},
+        {"cbn", "getbudgetprojection", &getbudgetprojection, true, true, false, true},
+        {"cbn", "getbudgetinfo", &getbudgetinfo, true, true, false, true},
+        {"cbn", "mnbudgetrawvote", &mnbudgetrawvote, true, true, false, false},
+        {"cbn", "mnfinalbudget", &mnfinalbudget, true, true, false, false},
+        {"cbn", "checkbudgets", &checkbudgets, true, true, false, false},
+        {"cbn", "mnsync", &mnsync, true, true, false, false},
+        {"cbn", "spork", &spork, true, true, false, false},
 #ifdef ENABLE_WALLET
 
         /* Wallet */
-        {"wallet", "burn", &burn, true, false, false}, /* uses wallet if enabled */
-        {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true},
-        {"wallet", "autocombinerewards", &autocombinerewards, false, false, true},
-        {"wallet", "backupwallet", &backupwallet, true, false, true},
-        {"wallet", "dumpprivkey", &dumpprivkey, true, false, true},
-        {"wallet", "dumpwallet", &dumpwallet, true, false, true},
-        {"wallet", "bip38encrypt", &bip38encrypt, true, false, true},
-        {"wallet", "bip38decrypt", &bip38decrypt, true, false, true},
-        {"wallet", "encryptwallet", &encryptwallet, true, false, true},
-        {"wallet", "getaccountaddress", &getaccountaddress, true, false, true},
-        {"wallet", "getaccount", &getaccount, true, false, true},
-        {"wallet", "getaddressesbyaccount", &getaddressesbyaccount, true, false, true},
-        {"wallet", "getbalance", &getbalance, false, false, true},
-        {"wallet", "getnewaddress", &getnewaddress, true, false, true},
-        {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, false, true},
-        {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, false, true},
-        {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, false, true},
-        {"wallet", "getstakingstatus", &getstakingstatus, false, false, true},
-        {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true},
-        {"wallet", "gettransaction", &gettransaction, false, false, true},
-        {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
-        {"wallet", "getwalletinfo", &getwalletinfo, false, false, true},
-        {"wallet", "importprivkey", &importprivkey, true, false, true},
-        {"wallet", "importwallet", &importwallet, true, false, true},
-        {"wallet", "importaddress", &importaddress, true, false, true},
-        {"wallet", "keypoolrefill", &keypoolrefill, true, false, true},
-        {"wallet", "listaccounts", &listaccounts, false, false, true},
-        {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true},
-        {"wallet", "listlockunspent", &listlockunspent, false, false, true},
-        {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true},
-        {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true},
-        {"wallet", "listsinceblock", &listsinceblock, false, false, true},
-        {"wallet", "listtransactions", &listtransactions, false, false, true},
-        {"wallet", "listunspent", &listunspent, false, false, true},
-        {"wallet", "lockunspent", &lockunspent, true, false, true},
-        {"wallet", "move", &movecmd, false, false, true},
-        {"wallet", "multisend", &multisend, false, false, true},
-        {"wallet", "sendfrom", &sendfrom, false, false, true},
-        {"wallet", "sendmany", &sendmany, false, false, true},
-        {"wallet", "sendtoaddress", &sendtoaddress, false, false, true},
-        {"wallet", "sendtoaddressix", &sendtoaddressix, false, false, true},
-        {"wallet", "setaccount", &setaccount, true, false, true},
-        {"wallet", "setstakesplitthreshold", &setstakesplitthreshold, false, false, true},
-        {"wallet", "settxfee", &settxfee, true, false, true},
-        {"wallet", "signmessage", &signmessage, true, false, true},
-        {"wallet", "walletlock", &walletlock, true, false, true},
-        {"wallet", "walletpassphrasechange", &walletpassphrasechange, true, false, true},
-        {"wallet", "walletpassphrase", &walletpassphrase, true, false, true},
+        {"wallet", "burn", &burn, true, false, false, false}, /* uses wallet if enabled */
+        {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true, false},
+        {"wallet", "autocombinerewards", &autocombinerewards, false, false, true, false},
+        {"wallet", "backupwallet", &backupwallet, true, false, true, false},
+        {"wallet", "dumpprivkey", &dumpprivkey, true, false, true, false},
+        {"wallet", "dumpwallet", &dumpwallet, true, false, true, false},
+        {"wallet", "bip38encrypt", &bip38encrypt, true, false, true, false},
+        {"wallet", "bip38decrypt", &bip38decrypt, true, false, true, false},
+        {"wallet", "encryptwallet", &encryptwallet, true, false, true, false},
+        {"wallet", "getaccountaddress", &getaccountaddress, true, false, true, false},
+        {"wallet", "getaccount", &getaccount, true, false, true, true},
+        {"wallet", "getaddressesbyaccount", &getaddressesbyaccount, true, false, true, true},
+        {"wallet", "getbalance", &getbalance, false, false, true, true},
+        {"wallet", "getnewaddress", &getnewaddress, true, false, true, false},
+        {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, false, true, false},
+        {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, false, true, true},
+        {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, false, true, true},
+        {"wallet", "getstakingstatus", &getstakingstatus, false, false, true, true},
+        {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true, true},
+        {"wallet", "gettransaction", &gettransaction, false, false, true, true},
+        {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true, true},
+        {"wallet", "getwalletinfo", &getwalletinfo, false, false, true, true},
+        {"wallet", "importprivkey", &importprivkey, true, true, true, false},
+        {"wallet", "importwallet", &importwallet, true, false, true, false},
+        {"wallet", "importaddress", &importaddress, true, true, true, false},
+        {"wallet", "keypoolrefill", &keypoolrefill, true, false, true, false},
+        {"wallet", "listaccounts", &listaccounts, false, false, true, true},
+        {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true, true},
+        {"wallet", "listlockunspent", &listlockunspent, false, false, true, true},
+        {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true, true},
+        {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true, true},
+        {"wallet", "listsinceblock", &listsinceblock, false, false, true, true},
+        {"wallet", "listtransactions", &listtransactions, false, false, true, true},
+        {"wallet", "listunspent", &listunspent, false, false, true, true},
+        {"wallet", "lockunspent", &lockunspent, true, false, true, false},
+        {"wallet", "move", &movecmd, false, false, true, false},
+        {"wallet", "multisend", &multisend, false, false, true, false},
+        {"wallet", "sendfrom", &sendfrom, false, false, true, false},
+        {"wallet", "sendmany", &sendmany, false, false, true, false},
+        {"wallet", "sendtoaddress", &sendtoaddress, false, false, true, false},
+        {"wallet", "sendtoaddressix", &sendtoaddressix, false, false, true, false},
+        {"wallet", "setaccount", &setaccount, true, false, true, false},
+        {"wallet", "setstakesplitthreshold", &setstakesplitthreshold, false, false, true, false},
+        {"wallet", "settxfee", &settxfee, true, false, true, false},
+        {"wallet", "signmessage", &signmessage, true, false, true, false},
+        {"wallet", "walletlock", &walletlock, true, false, true, false},
+        {"wallet", "walletpassphrasechange", &walletpassphrasechange, true, false, true, false},
+        {"wallet", "walletpassphrase", &walletpassphrase, true, false, true, false},
+#endif // ENABLE_WALLET
+};
+
+static const CRPCStreamCommand vRPCStreamCommands[] =
+    {
+        //  name                      actor (function)         max params
+        //  ------------------------  -----------------------  ----------
+        {"getrawmempool", &getrawmempool, 1},
+#ifdef ENABLE_WALLET
+        {"listtransactions", &listtransactions, 4},
+        {"listunspent", &listunspent, 3},
 #endif // ENABLE_WALLET
 };
 
@@ -436,6 +588,8 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0])); vcidx++)
+        mapStreamCommands[vRPCStreamCommands[vcidx].name] = &vRPCStreamCommands[vcidx];
 }
 
 const CRPCCommand* CRPCTable::operator[](string name) const
@@ -497,19 +651,39 @@ bool ClientAllowed(const boost::asio::ip::address& address)
     return false;
 }
 
+static bool HTTPReq_JSONRPC(AcceptedConnection* conn, string& strRequest, map<string, string>& mapHeaders, int nProto, bool fRun);
+
+/**
+ * A client connection. Requests are read asynchronously by the RPC I/O thread, so
+ * idle and slow clients don't occupy a worker; each complete request is queued for
+ * the worker threads, which write the reply and have the I/O thread read the next
+ * request. A client that takes longer than -rpcservertimeout to send a request, or
+ * stays idle that long, is disconnected. Everything but serving the request runs
+ * on the I/O thread, and never blocks.
+ */
 template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
+class AcceptedConnectionImpl : public AcceptedConnection, public boost::enable_shared_from_this<AcceptedConnectionImpl<Protocol> >
 {
 public:
     AcceptedConnectionImpl(
         asio::io_service& io_service,
         ssl::context& context,
-        bool fUseSSL) : sslStream(io_service, context),
-                        _d(sslStream, fUseSSL),
-                        _stream(_d)
+        bool fUseSSLIn) : sslStream(io_service, context),
+                          _d(sslStream, fUseSSLIn),
+                          _stream(_d),
+                          fUseSSL(fUseSSLIn),
+                          fCounted(false),
+                          timerIdle(io_service),
+                          bufRead(MAX_HEADERS_SIZE)
     {
     }
 
+    ~AcceptedConnectionImpl()
+    {
+        if (fCounted)
+            nRPCConnections--;
+    }
+
     virtual std::iostream& stream()
     {
         return _stream;
@@ -525,22 +699,201 @@ public:
         _stream.close();
     }
 
+    void Start()
+    {
+        nRPCConnections++;
+        fCounted = true;
+        if (fUseSSL) {
+            ArmTimer();
+            sslStream.async_handshake(ssl::stream_base::server,
+                boost::bind(&AcceptedConnectionImpl::HandleHandshake, this->shared_from_this(), _1));
+        } else
+            ReadRequest();
+    }
+
+    /**
+     * Answer with an HTTP error and drop the connection, without waiting for the
+     * client. With SSL, only after the handshake.
+     */
+    void Reject(int nStatus)
+    {
+        StopTimer();
+        strError = HTTPError(nStatus, false);
+        if (fUseSSL)
+            asio::async_write(sslStream, asio::buffer(strError),
+                boost::bind(&AcceptedConnectionImpl::HandleRejected, this->shared_from_this(), _1));
+        else
+            asio::async_write(sslStream.next_layer(), asio::buffer(strError),
+                boost::bind(&AcceptedConnectionImpl::HandleRejected, this->shared_from_this(), _1));
+    }
+
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
 private:
     SSLIOStreamDevice<Protocol> _d;
     iostreams::stream<SSLIOStreamDevice<Protocol> > _stream;
-};
+    bool fUseSSL;
+    //! Whether this connection is in nRPCConnections
+    bool fCounted;
+
+    //! Expires when the client took too long to send the next request
+    deadline_timer timerIdle;
+    std::string strError;
+
+    //! The request being read or served
+    asio::streambuf bufRead;
+    std::vector<char> vchBody;
+    int nProto;
+    std::string strMethod;
+    std::string strURI;
+    std::string strRequest;
+    map<string, string> mapHeaders;
+    bool fRun;
+
+    void ArmTimer()
+    {
+        timerIdle.expires_from_now(boost::posix_time::seconds(nRPCServerTimeout));
+        // A pending wait doesn't keep the connection alive
+        timerIdle.async_wait(boost::bind(&AcceptedConnectionImpl::HandleTimeout,
+            boost::weak_ptr<AcceptedConnectionImpl>(this->shared_from_this()), _1));
+    }
+
+    void StopTimer()
+    {
+        // Also tells a wait that already completed that the request arrived in time
+        timerIdle.expires_at(boost::posix_time::pos_infin);
+    }
+
+    static void HandleTimeout(boost::weak_ptr<AcceptedConnectionImpl> connWeak, const boost::system::error_code& error)
+    {
+        boost::shared_ptr<AcceptedConnectionImpl> conn = connWeak.lock();
+        if (!conn || error == asio::error::operation_aborted || conn->timerIdle.expires_at() > deadline_timer::traits_type::now())
+            return;
+        // Fails the pending read, which drops the last reference
+        boost::system::error_code ec;
+        conn->sslStream.lowest_layer().close(ec);
+    }
+
+    void HandleRejected(const boost::system::error_code& error)
+    {
+        boost::system::error_code ec;
+        sslStream.lowest_layer().close(ec);
+    }
+
+    void HandleHandshake(const boost::system::error_code& error)
+    {
+        if (error)
+            return;
+        _stream->setHandshakeDone();
+        ReadRequest();
+    }
+
+    void ReadRequest()
+    {
+        ArmTimer();
+        if (fUseSSL)
+            asio::async_read_until(sslStream, bufRead, "\r\n\r\n",
+                boost::bind(&AcceptedConnectionImpl::HandleHeaders, this->shared_from_this(), _1));
+        else
+            asio::async_read_until(sslStream.next_layer(), bufRead, "\r\n\r\n",
+                boost::bind(&AcceptedConnectionImpl::HandleHeaders, this->shared_from_this(), _1));
+    }
+
+    void HandleHeaders(const boost::system::error_code& error)
+    {
+        // Closed by the client, or headers larger than MAX_HEADERS_SIZE
+        if (error)
+            return;
+
+        std::istream streamHeaders(&bufRead);
+        nProto = 0;
+        if (!ReadHTTPRequestLine(streamHeaders, nProto, strMethod, strURI))
+            return;
+        mapHeaders.clear();
+        int nLen = ReadHTTPHeaders(streamHeaders, mapHeaders);
+        if (nLen < 0 || (size_t)nLen > MAX_SIZE) {
+            Reject(HTTP_BAD_REQUEST);
+            return;
+        }
+
+        // Part of the body may have been read along with the headers
+        size_t nBuffered = std::min(bufRead.size(), (size_t)nLen);
+        strRequest.assign(asio::buffers_begin(bufRead.data()), asio::buffers_begin(bufRead.data()) + nBuffered);
+        bufRead.consume(nBuffered);
+        if (nBuffered == (size_t)nLen) {
+            QueueRequest();
+            return;
+        }
 
-void ServiceConnection(AcceptedConnection* conn);
+        vchBody.resize(nLen - nBuffered);
+        if (fUseSSL)
+            asio::async_read(sslStream, asio::buffer(vchBody),
+                boost::bind(&AcceptedConnectionImpl::HandleBody, this->shared_from_this(), _1));
+        else
+            asio::async_read(sslStream.next_layer(), asio::buffer(vchBody),
+                boost::bind(&AcceptedConnectionImpl::HandleBody, this->shared_from_this(), _1));
+    }
+
+    void HandleBody(const boost::system::error_code& error)
+    {
+        if (error)
+            return;
+        strRequest.append(vchBody.begin(), vchBody.end());
+        std::vector<char>().swap(vchBody);
+        QueueRequest();
+    }
+
+    void QueueRequest()
+    {
+        string sConHdr = mapHeaders["connection"];
+        if ((sConHdr != "close") && (sConHdr != "keep-alive"))
+            mapHeaders["connection"] = nProto >= 1 ? "keep-alive" : "close";
+
+        // HTTP Keep-Alive is false; close connection immediately
+        fRun = (mapHeaders["connection"] != "close") && GetBoolArg("-rpckeepalive", true);
+
+        StopTimer();
+        if (!rpc_work_queue->Enqueue(boost::bind(&AcceptedConnectionImpl::ServiceRequest, this->shared_from_this()))) {
+            LogPrint("rpc", "ThreadRPCServer work queue full, rejecting request from %s\n", peer_address_to_string());
+            Reject(HTTP_SERVICE_UNAVAILABLE);
+        }
+    }
+
+    //! Runs on a worker thread
+    void ServiceRequest()
+    {
+        bool fKeep = false;
+        if (ShutdownRequested()) {
+            // No reply, the connection is dropped
+
+        // Process via JSON-RPC API
+        } else if (strURI == "/") {
+            fKeep = HTTPReq_JSONRPC(this, strRequest, mapHeaders, nProto, fRun);
+
+        // Process via HTTP REST API
+        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
+            // Endpoints are timed by their first path component, like "rest/tx", once matched
+            std::string strEndpoint;
+            CRPCLatencyTimer timer(strEndpoint, true);
+            fKeep = HTTPReq_REST(this, strURI, mapHeaders, fRun, &strEndpoint);
+
+        } else {
+            _stream << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+        }
+
+        // The timer and the reads belong to the I/O thread
+        if (fKeep && fRun && _stream.good())
+            sslStream.get_io_service().post(boost::bind(&AcceptedConnectionImpl::ReadRequest, this->shared_from_this()));
+    }
+};
 
 //! Forward declaration required for RPCListen
 template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
     ssl::context& context,
     bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
+    boost::shared_ptr<AcceptedConnectionImpl<Protocol> > conn,
     const boost::system::error_code& error);
 
 /**
@@ -573,7 +926,7 @@ template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
     ssl::context& context,
     const bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
+    boost::shared_ptr<AcceptedConnectionImpl<Protocol> > conn,
     const boost::system::error_code& error)
 {
     // Immediately start accepting new connections, except when we're cancelled or our socket is closed.
@@ -594,9 +947,16 @@ static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, S
         if (!fUseSSL)
             conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
         conn->close();
+    } else if (nRPCConnections >= nRPCMaxConnections) {
+        LogPrint("rpc", "ThreadRPCServer %d connections open, rejecting connection from %s\n", nRPCConnections.load(), conn->peer_address_to_string());
+        // As above, no reply before an SSL handshake
+        if (!fUseSSL)
+            conn->Reject(HTTP_SERVICE_UNAVAILABLE);
+        else
+            conn->close();
     } else {
-        ServiceConnection(conn.get());
-        conn->close();
+        // The connection lives as long as a pending read or a queued request refers to it
+        conn->Start();
     }
 }
 
@@ -745,9 +1105,26 @@ void StartRPCThreads()
         return;
     }
 
+    int nThreads = std::max((int)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1);
+    int nWorkQueueDepth = std::max((int)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1);
+    nRPCMaxConnections = std::max((int)GetArg("-rpcmaxconnections", DEFAULT_HTTP_MAX_CONNECTIONS), 1);
+    nRPCServerTimeout = std::max((int)GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT), 1);
+    LogPrintf("RPC server started with %d worker threads and a work queue of %d requests\n", nThreads, nWorkQueueDepth);
+    rpc_work_queue = new CWorkQueue(nWorkQueueDepth);
+    rpc_work_queue->Start(nThreads, "rpcworker");
+
+    int nBatchThreads = GetArg("-rpcbatchthreads", DEFAULT_HTTP_BATCH_THREADS);
+    if (nBatchThreads <= 0)
+        nBatchThreads = boost::thread::hardware_concurrency();
+    if (nBatchThreads > 1) {
+        // One group per worker thread can be waiting for help
+        rpc_batch_queue = new CWorkQueue(nThreads * nBatchThreads);
+        rpc_batch_queue->Start(nBatchThreads, "rpcbatch");
+    }
+
+    // A single thread reads all requests and runs the timers, the workers do the rest
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
     fRPCRunning = true;
 }
 
@@ -790,10 +1167,19 @@ void StopRPCThreads()
 
     DeleteAuthCookie();
 
-    rpc_io_service->stop();
     cvBlockChange.notify_all();
+    // Workers may be waiting for a batch group, which they finish themselves once the helpers are gone
+    if (rpc_batch_queue != NULL)
+        rpc_batch_queue->Stop();
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Stop();
+    rpc_io_service->stop();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
+    delete rpc_work_queue;
+    rpc_work_queue = NULL;
+    delete rpc_batch_queue;
+    rpc_batch_queue = NULL;
     delete rpc_dummy_work;
     rpc_dummy_work = NULL;
     delete rpc_worker_group;
@@ -883,6 +1269,7 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     UniValue rpc_result(UniValue::VOBJ);
 
     JSONRequest jreq;
+    CRPCLatencyTimer timer(jreq.strMethod);
     try {
         jreq.parse(req);
 
@@ -898,18 +1285,168 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+static bool IsReadOnlyRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req, "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand* pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->readOnly;
+}
+
+/**
+ * A run of read-only requests in a batch. The thread serving the batch and any idle
+ * batch threads take requests from it until none are left.
+ */
+class CRPCBatchGroup
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    const UniValue& vReq;
+    std::vector<UniValue>& vResults;
+    unsigned int nBegin;
+    unsigned int nNext;
+    unsigned int nEnd;
+    //! Requests taken by a thread that are not finished yet
+    unsigned int nRunning;
+
+public:
+    CRPCBatchGroup(const UniValue& vReqIn, unsigned int nBeginIn, unsigned int nEndIn, std::vector<UniValue>& vResultsIn) : vReq(vReqIn), vResults(vResultsIn), nBegin(nBeginIn), nNext(nBeginIn), nEnd(nEndIn), nRunning(0) {}
+
+    void Work()
+    {
+        while (true) {
+            unsigned int reqIdx;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                // Once the group is done, vReq and vResults may be gone already
+                if (nNext == nEnd)
+                    return;
+                reqIdx = nNext++;
+                nRunning++;
+            }
+            UniValue result = JSONRPCExecOne(vReq[reqIdx]);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                vResults[reqIdx - nBegin] = result;
+                nRunning--;
+            }
+            cond.notify_all();
+        }
+    }
+
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nNext < nEnd || nRunning > 0)
+            cond.wait(lock);
+    }
+};
+
+static void JSONRPCExecBatch(const UniValue& vReq, JSONWriter& writer)
+{
+    writer.beginArray();
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        unsigned int nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsReadOnlyRequest(vReq[nEnd]))
+            nEnd++;
+
+        // Other requests run alone and in order
+        if (nEnd - reqIdx < 2 || rpc_batch_queue == NULL) {
+            writer.value(JSONRPCExecOne(vReq[reqIdx]));
+            reqIdx++;
+            continue;
+        }
+
+        // Runs of read-only requests are spread over the batch threads, and the
+        // results are written in request order once all of them are done
+        std::vector<UniValue> vResults(nEnd - reqIdx);
+        boost::shared_ptr<CRPCBatchGroup> group(new CRPCBatchGroup(vReq, reqIdx, nEnd, vResults));
+        int nHelpers = std::min(rpc_batch_queue->Threads(), (int)(nEnd - reqIdx) - 1);
+        for (int i = 0; i < nHelpers; i++) {
+            if (!rpc_batch_queue->Enqueue(boost::bind(&CRPCBatchGroup::Work, group)))
+                break;
+        }
+        group->Work();
+        group->Wait();
+        BOOST_FOREACH (const UniValue& result, vResults)
+            writer.value(result);
+        reqIdx = nEnd;
+    }
+    writer.endArray();
+}
+
 static string JSONRPCExecBatch(const UniValue& vReq)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    JSONTreeWriter writer;
+    JSONRPCExecBatch(vReq, writer);
+    return writer.get().write() + "\n";
+}
 
-    return ret.write() + "\n";
+/** Writes the reply to valRequest as it is produced, instead of building it first */
+static void JSONRPCExecStream(const UniValue& valRequest, JSONRequest& jreq, JSONWriter& writer)
+{
+    // singleton request
+    if (valRequest.isObject()) {
+        jreq.parse(valRequest);
+
+        writer.beginObject();
+        writer.key("result");
+        tableRPC.execute(jreq.strMethod, jreq.params, writer);
+        writer.key("error");
+        writer.value(NullUniValue);
+        writer.key("id");
+        writer.value(jreq.id);
+        writer.endObject();
+
+    // array of requests, replies are written once they are complete
+    } else if (valRequest.isArray()) {
+        JSONRPCExecBatch(valRequest.get_array(), writer);
+    } else
+        throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 }
 
+/**
+ * A 200 reply sent with chunked transfer encoding. Nothing is sent before the first
+ * chunk, so an error raised before that can still be answered with an error reply.
+ */
+class HTTPChunkedReply
+{
+private:
+    std::iostream& stream;
+    bool fKeepAlive;
+    bool fStarted;
+
+public:
+    HTTPChunkedReply(std::iostream& streamIn, bool fKeepAliveIn) : stream(streamIn), fKeepAlive(fKeepAliveIn), fStarted(false) {}
+
+    bool IsStarted() const { return fStarted; }
+
+    void Write(const std::string& strChunk)
+    {
+        if (!fStarted) {
+            stream << HTTPReplyHeaderChunked(HTTP_OK, fKeepAlive);
+            fStarted = true;
+        }
+        stream << strprintf("%x\r\n", strChunk.size()) << strChunk << "\r\n" << std::flush;
+        if (!stream)
+            throw std::runtime_error("connection lost while sending reply");
+    }
+
+    void Finish()
+    {
+        stream << "0\r\n\r\n" << std::flush;
+    }
+};
+
 static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
     string& strRequest,
     map<string, string>& mapHeaders,
+    int nProto,
     bool fRun)
 {
     // Check authorization
@@ -930,6 +1467,7 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
     }
 
     JSONRequest jreq;
+    CRPCLatencyTimer timer(jreq.strMethod);
     try {
         // Parse request
         UniValue valRequest;
@@ -943,6 +1481,25 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
                 throw JSONRPCError(RPC_IN_WARMUP, rpcWarmupStatus);
         }
 
+        // HTTP/1.1 clients get the reply in chunks while it is being written
+        if (nProto >= 1) {
+            HTTPChunkedReply reply(conn->stream(), fRun);
+            JSONStreamWriter writer(boost::bind(&HTTPChunkedReply::Write, &reply, _1));
+            try {
+                JSONRPCExecStream(valRequest, jreq, writer);
+                writer.write("\n");
+                writer.flush();
+            } catch (...) {
+                if (!reply.IsStarted())
+                    throw;
+                // Too late for an error reply, cut the connection so the client sees the reply is incomplete
+                LogPrintf("ThreadRPCServer method=%s failed while sending its reply\n", SanitizeString(jreq.strMethod));
+                return false;
+            }
+            reply.Finish();
+            return true;
+        }
+
         string strReply;
 
         // singleton request
@@ -971,43 +1528,7 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
     return true;
 }
 
-void ServiceConnection(AcceptedConnection* conn)
-{
-    bool fRun = true;
-    while (fRun && !ShutdownRequested()) {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
-
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
-
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
-
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
-
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
-
-            // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
-
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
-    }
-}
-
-UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+const CRPCCommand* CRPCTable::checkCommand(const std::string& strMethod) const
 {
     // Find method
     const CRPCCommand* pcmd = tableRPC[strMethod];
@@ -1024,6 +1545,13 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    return pcmd;
+}
+
+UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+{
+    const CRPCCommand* pcmd = checkCommand(strMethod);
+
     try {
         // Execute
         UniValue result;
@@ -1066,6 +1594,24 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     }
 }
 
+void CRPCTable::execute(const std::string& strMethod, const UniValue& params, JSONWriter& writer) const
+{
+    std::map<std::string, const CRPCStreamCommand*>::const_iterator it = mapStreamCommands.find(strMethod);
+    if (it == mapStreamCommands.end() || params.size() > it->second->nMaxParams) {
+        writer.value(execute(strMethod, params));
+        return;
+    }
+
+    checkCommand(strMethod);
+    // Streaming commands take the locks they need themselves, and release them
+    // before writing, as every write may send a chunk to the client
+    try {
+        it->second->actor(params, writer);
+    } catch (std::exception& e) {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
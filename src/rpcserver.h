@@ -24,6 +24,17 @@
 class CBlockIndex;
 class CNetAddr;
 
+//! Default for -rpcthreads
+static const int DEFAULT_HTTP_THREADS = 4;
+//! Default for -rpcworkqueue
+static const int DEFAULT_HTTP_WORKQUEUE = 16;
+//! Default for -rpcservertimeout, in seconds
+static const int DEFAULT_HTTP_SERVER_TIMEOUT = 30;
+//! Default for -rpcmaxconnections
+static const int DEFAULT_HTTP_MAX_CONNECTIONS = 128;
+//! Default for -rpcbatchthreads, 0 means one per core
+static const int DEFAULT_HTTP_BATCH_THREADS = 0;
+
 class AcceptedConnection
 {
 public:
@@ -124,8 +135,32 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! Takes the locks it needs itself, instead of running under cs_main and the wallet lock
     bool threadSafe;
     bool reqWallet;
+    //! Changes no state, so batched calls of it may run concurrently and out of order
+    bool readOnly;
+};
+
+typedef void(*rpcstreamfn_type)(const UniValue& params, JSONWriter& writer);
+
+/**
+ * Entries a streaming command builds per lock acquisition. They are written out
+ * once the locks are released, so a slow client never holds up the node.
+ */
+static const unsigned int RPC_STREAM_BATCH_SIZE = 1000;
+
+/**
+ * A command that can also write its result incrementally. Large results of these
+ * are streamed to HTTP clients instead of being built in memory first.
+ */
+class CRPCStreamCommand
+{
+public:
+    std::string name;
+    rpcstreamfn_type actor;
+    //! Calls with more parameters take the regular path, which replies with the help text
+    unsigned int nMaxParams;
 };
 
 /**
@@ -135,6 +170,9 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, const CRPCStreamCommand*> mapStreamCommands;
+
+    const CRPCCommand* checkCommand(const std::string& strMethod) const;
 
 public:
     CRPCTable();
@@ -150,6 +188,14 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method, passing its result to writer. Commands that support it
+     * write their result incrementally, the others write the whole UniValue.
+     * @throws an exception (UniValue) when an error happens, possibly after
+     * part of the result was written.
+     */
+    void execute(const std::string& method, const UniValue& params, JSONWriter& writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -234,6 +280,7 @@ extern UniValue addmultisigaddress(const UniValue& params, bool fHelp);
 extern UniValue listreceivedbyaddress(const UniValue& params, bool fHelp);
 extern UniValue listreceivedbyaccount(const UniValue& params, bool fHelp);
 extern UniValue listtransactions(const UniValue& params, bool fHelp);
+extern void listtransactions(const UniValue& params, JSONWriter& writer);
 extern UniValue listaddressgroupings(const UniValue& params, bool fHelp);
 extern UniValue listaccounts(const UniValue& params, bool fHelp);
 extern UniValue listsinceblock(const UniValue& params, bool fHelp);
@@ -255,6 +302,7 @@ extern UniValue autocombinerewards(const UniValue& params, bool fHelp);
 
 extern UniValue getrawtransaction(const UniValue& params, bool fHelp); // in rcprawtransaction.cpp
 extern UniValue listunspent(const UniValue& params, bool fHelp);
+extern void listunspent(const UniValue& params, JSONWriter& writer);
 extern UniValue lockunspent(const UniValue& params, bool fHelp);
 extern UniValue listlockunspent(const UniValue& params, bool fHelp);
 extern UniValue createrawtransaction(const UniValue& params, bool fHelp);
@@ -269,11 +317,13 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern void getrawmempool(const UniValue& params, JSONWriter& writer);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getfeeinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue dumpsnapshot(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
@@ -293,6 +343,9 @@ extern UniValue listmasternodeconf(const UniValue& params, bool fHelp);
 extern UniValue getmasternodestatus(const UniValue& params, bool fHelp);
 extern UniValue getmasternodewinners(const UniValue& params, bool fHelp);
 extern UniValue getmasternodescores(const UniValue& params, bool fHelp);
+extern UniValue getmasternodeschedule(const UniValue& params, bool fHelp);
+extern UniValue getswifttxinfo(const UniValue& params, bool fHelp);
+extern UniValue getorphanpoolinfo(const UniValue& params, bool fHelp);
 
 extern UniValue mnbudget(const UniValue& params, bool fHelp); // in rpcmasternode-budget.cpp
 extern UniValue preparebudget(const UniValue& params, bool fHelp);
@@ -314,13 +367,15 @@ extern UniValue createmultisig(const UniValue& params, bool fHelp);
 extern UniValue verifymessage(const UniValue& params, bool fHelp);
 extern UniValue setmocktime(const UniValue& params, bool fHelp);
 extern UniValue getstakingstatus(const UniValue& params, bool fHelp);
+extern UniValue getlockstats(const UniValue& params, bool fHelp);
 
 extern UniValue makekeypair(const UniValue& params, bool fHelp);
 
-// in rest.cpp
+// in rest.cpp; *pstrEndpoint is set to the endpoint that strURI matched, like "rest/tx"
 extern bool HTTPReq_REST(AcceptedConnection* conn,
     std::string& strURI,
     std::map<std::string, std::string>& mapHeaders,
-    bool fRun);
+    bool fRun,
+    std::string* pstrEndpoint = NULL);
 
 #endif // BITCOIN_RPCSERVER_H
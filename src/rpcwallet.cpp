@@ -1265,6 +1265,25 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Un
     }
 }
 
+/** A wallet transaction or accounting entry selected by listtransactions, and the number of entries it lists */
+struct ListTxRef {
+    uint256 hashTx;
+    CAccountingEntry* pacentry;
+    int nEntries;
+
+    ListTxRef() : pacentry(0), nEntries(0) {}
+};
+
+static void ListTxItem(const CWallet::TxPair& item, const string& strAccount, bool fLong, UniValue& ret, const isminefilter& filter)
+{
+    CWalletTx* const pwtx = item.first;
+    if (pwtx != 0)
+        ListTransactions(*pwtx, strAccount, 0, fLong, ret, filter);
+    CAccountingEntry* const pacentry = item.second;
+    if (pacentry != 0)
+        AcentryToJSON(*pacentry, strAccount, ret);
+}
+
 UniValue listtransactions(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 4)
@@ -1320,6 +1339,13 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             "\nList transactions 100 to 120 from the tabby account\n" + HelpExampleCli("listtransactions", "\"tabby\" 20 100") +
             "\nAs a json rpc call\n" + HelpExampleRpc("listtransactions", "\"tabby\", 20, 100"));
 
+    JSONTreeWriter writer;
+    listtransactions(params, writer);
+    return writer.get();
+}
+
+void listtransactions(const UniValue& params, JSONWriter& writer)
+{
     string strAccount = "*";
     if (params.size() > 0)
         strAccount = params[0].get_str();
@@ -1339,46 +1365,69 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
-    UniValue ret(UniValue::VARR);
-
+    // Accounting entries are copies owned by this list, wallet transactions are
+    // looked up again by txid after the locks were released
     std::list<CAccountingEntry> acentries;
-    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
-        CWalletTx* const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        CAccountingEntry* const pacentry = (*it).second.second;
-        if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
-
-        if ((int)ret.size() >= (nCount + nFrom)) break;
+    std::vector<ListTxRef> vItems;
+    int nEntries = 0;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
+
+        // iterate backwards until we have nCount + nFrom entries, only counting them:
+        // the selected ones are built again below, in batches
+        for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
+            UniValue entries(UniValue::VARR);
+            ListTxItem((*it).second, strAccount, false, entries, filter);
+            if (entries.empty())
+                continue;
+            ListTxRef ref;
+            if ((*it).second.first != 0)
+                ref.hashTx = (*it).second.first->GetHash();
+            ref.pacentry = (*it).second.second;
+            ref.nEntries = entries.size();
+            vItems.push_back(ref);
+            nEntries += entries.size();
+
+            if (nEntries >= (nCount + nFrom)) break;
+        }
     }
-    // ret is newest to oldest
 
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
-
-    vector<UniValue> arrTmp = ret.getValues();
-
-    vector<UniValue>::iterator first = arrTmp.begin();
-    std::advance(first, nFrom);
-    vector<UniValue>::iterator last = arrTmp.begin();
-    std::advance(last, nFrom+nCount);
-
-    if (last != arrTmp.end()) arrTmp.erase(last, arrTmp.end());
-    if (first != arrTmp.begin()) arrTmp.erase(arrTmp.begin(), first);
-
-    std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
-
-    ret.clear();
-    ret.setArray();
-    ret.push_backV(arrTmp);
-
-    return ret;
+    // Counting from the newest entry, return entries nFrom up to nEnd, oldest to newest.
+    // Each batch of items is built under the locks and written without them.
+    int nEnd = std::min(nEntries, nFrom + nCount);
+    int nStart = nEntries;
+    std::vector<ListTxRef>::reverse_iterator item = vItems.rbegin();
+    std::vector<UniValue> vBatch;
+    writer.beginArray();
+    while (item != vItems.rend()) {
+        vBatch.clear();
+        {
+            LOCK2(cs_main, pwalletMain->cs_wallet);
+            for (unsigned int nItems = 0; item != vItems.rend() && nItems < RPC_STREAM_BATCH_SIZE; ++item, ++nItems) {
+                nStart -= item->nEntries;
+                if (nStart >= nEnd || nStart + item->nEntries <= nFrom)
+                    continue;
+
+                CWallet::TxPair pair((CWalletTx*)0, item->pacentry);
+                if (item->pacentry == 0) {
+                    std::map<uint256, CWalletTx>::iterator mi = pwalletMain->mapWallet.find(item->hashTx);
+                    if (mi == pwalletMain->mapWallet.end())
+                        continue;
+                    pair.first = &mi->second;
+                }
+                UniValue entries(UniValue::VARR);
+                ListTxItem(pair, strAccount, true, entries, filter);
+                for (int i = std::min((int)entries.size(), item->nEntries) - 1; i >= 0; i--) {
+                    if (nStart + i >= nFrom && nStart + i < nEnd)
+                        vBatch.push_back(entries[i]);
+                }
+            }
+        }
+        BOOST_FOREACH (const UniValue& entry, vBatch)
+            writer.value(entry);
+    }
+    writer.endArray();
 }
 
 UniValue listaccounts(const UniValue& params, bool fHelp)
@@ -1650,7 +1699,7 @@ UniValue keypoolrefill(const UniValue& params, bool fHelp)
 
 static void LockWallet(CWallet* pWallet)
 {
-    LOCK(cs_nWalletUnlockTime);
+    LOCK2(pWallet->cs_wallet, cs_nWalletUnlockTime);
     nWalletUnlockTime = 0;
     pWallet->Lock();
 }
@@ -0,0 +1,630 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chainparams.h"
+#include "checkpoints.h"
+#include "hash.h"
+#include "kernel.h"
+#include "main.h"
+#include "net.h"
+#include "streams.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "utilmoneystr.h"
+#include "utiltime.h"
+
+#include <map>
+#include <set>
+#include <string.h>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+static const char SNAPSHOT_MAGIC[4] = {'u', 't', 'x', 'o'};
+//! Coins written to the database per batch while loading a snapshot
+static const size_t SNAPSHOT_LOAD_BATCH = 100000;
+//! Blocks below the snapshot requested from peers ahead of the validation
+static const int SNAPSHOT_REQUEST_WINDOW = 128;
+//! Seconds without progress after which missing history blocks are requested again
+static const int64_t SNAPSHOT_REQUEST_TIMEOUT = 20;
+//! Coin cache of the background validation, in bytes
+static const size_t SNAPSHOT_CHECK_DB_CACHE = 8 << 20;
+
+static CCriticalSection cs_snapshot;
+static CSnapshotMetadata snapshotLoaded;
+static int nSnapshotValidatedHeight = -1;
+static bool fSnapshotValidated = false;
+
+namespace
+{
+/** Orders txids the way the coin database keys are: bytewise */
+struct CTxidKeyOrder {
+    bool operator()(const uint256& a, const uint256& b) const
+    {
+        return memcmp(a.begin(), b.begin(), a.size()) < 0;
+    }
+};
+
+/** Writes to a file and hashes everything written */
+class CHashingFileWriter
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    int nType;
+    int nVersion;
+
+    explicit CHashingFileWriter(CAutoFile& fileIn) : file(fileIn), hasher(SER_GETHASH, 0), nType(fileIn.GetType()), nVersion(fileIn.GetVersion()) {}
+
+    CHashingFileWriter& write(const char* pch, size_t nSize)
+    {
+        file.write(pch, nSize);
+        hasher.write(pch, nSize);
+        return (*this);
+    }
+
+    template <typename T>
+    CHashingFileWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/** Reads from a file and hashes everything read */
+class CHashingFileReader
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    int nType;
+    int nVersion;
+
+    explicit CHashingFileReader(CAutoFile& fileIn) : file(fileIn), hasher(SER_GETHASH, 0), nType(fileIn.GetType()), nVersion(fileIn.GetVersion()) {}
+
+    CHashingFileReader& read(char* pch, size_t nSize)
+    {
+        file.read(pch, nSize);
+        hasher.write(pch, nSize);
+        return (*this);
+    }
+
+    template <typename T>
+    CHashingFileReader& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+} // anon namespace
+
+//! Add one transaction's coins to a hash_serialized computation, as CCoinsViewDB::GetStats does
+static void HashCoins(CHashWriter& ss, const uint256& txid, const CCoins& coins)
+{
+    ss << txid;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& out = coins.vout[i];
+        if (!out.IsNull()) {
+            ss << VARINT(i + 1);
+            ss << out;
+        }
+    }
+    ss << VARINT(0);
+}
+
+static void WriteCoins(CHashingFileWriter& writer, CHashWriter& ss, const uint256& txid, const CCoins& coins, CSnapshotMetadata& metadata)
+{
+    writer << 'c' << txid << coins;
+    HashCoins(ss, txid, coins);
+    metadata.nTransactions++;
+}
+
+bool DumpSnapshot(const boost::filesystem::path& path, int nHeight, CSnapshotMetadata& metadata, std::string& strError)
+{
+    boost::scoped_ptr<CCoinsViewDBCursor> pcursor;
+    // Coins of the transactions touched above nHeight, as they were at nHeight (pruned if there were none)
+    std::map<uint256, CCoins, CTxidKeyOrder> mapRewound;
+    std::vector<CBlockIndex*> vIndex;
+    metadata.SetNull();
+    {
+        LOCK(cs_main);
+        if (nHeight < 0 || nHeight > chainActive.Height()) {
+            strError = "Block height out of range";
+            return false;
+        }
+        if (chainActive.Height() - nHeight > MAX_SNAPSHOT_REWIND) {
+            strError = strprintf("Snapshots can be taken at most %d blocks below the tip", MAX_SNAPSHOT_REWIND);
+            return false;
+        }
+
+        FlushStateToDisk();
+
+        CCoinsViewCache view(pcoinsTip);
+        std::set<uint256> setTouched;
+        for (CBlockIndex* pindex = chainActive.Tip(); pindex->nHeight > nHeight; pindex = pindex->pprev) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex)) {
+                strError = strprintf("Can't read block %s", pindex->GetBlockHash().ToString());
+                return false;
+            }
+            BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+                setTouched.insert(tx.GetHash());
+                if (!tx.IsCoinBase()) {
+                    BOOST_FOREACH (const CTxIn& txin, tx.vin)
+                        setTouched.insert(txin.prevout.hash);
+                }
+            }
+            CValidationState state;
+            bool fClean = true;
+            // the scratch view is rolled back, the stake inputs spent on the active chain are kept
+            if (!DisconnectBlock(block, state, pindex, view, &fClean, true) || !fClean) {
+                strError = strprintf("Can't roll back block %s", pindex->GetBlockHash().ToString());
+                return false;
+            }
+        }
+        BOOST_FOREACH (const uint256& txid, setTouched) {
+            const CCoins* coins = view.AccessCoins(txid);
+            mapRewound[txid] = coins ? *coins : CCoins();
+        }
+
+        // Entries this deep in the active chain no longer change, so they are serialized without the lock
+        vIndex.reserve(nHeight + 1);
+        for (int i = 0; i <= nHeight; i++)
+            vIndex.push_back(chainActive[i]);
+        metadata.hashBlock = chainActive[nHeight]->GetBlockHash();
+        metadata.nHeight = nHeight;
+
+        // The cursor keeps seeing the database as of the tip while blocks are connected meanwhile
+        pcursor.reset(pcoinsdbview->Cursor());
+    }
+
+    boost::filesystem::path pathTemp = path.string() + ".incomplete";
+    FILE* file = fopen(pathTemp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        strError = strprintf("Can't open %s for writing", pathTemp.string());
+        return false;
+    }
+
+    try {
+        CHashingFileWriter writer(fileout);
+        writer << FLATDATA(SNAPSHOT_MAGIC) << FLATDATA(Params().MessageStart()) << SNAPSHOT_VERSION << metadata.nHeight;
+
+        BOOST_FOREACH (CBlockIndex* pindex, vIndex) {
+            CDiskBlockIndex diskindex(pindex);
+            diskindex.nStatus &= ~BLOCK_HAVE_MASK;
+            diskindex.nFile = 0;
+            diskindex.nDataPos = 0;
+            diskindex.nUndoPos = 0;
+            writer << diskindex;
+        }
+
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << metadata.hashBlock;
+        std::map<uint256, CCoins, CTxidKeyOrder>::const_iterator it = mapRewound.begin();
+        while (pcursor->Valid() || it != mapRewound.end()) {
+            boost::this_thread::interruption_point();
+            if (it == mapRewound.end() || (pcursor->Valid() && CTxidKeyOrder()(pcursor->GetTxid(), it->first))) {
+                WriteCoins(writer, ss, pcursor->GetTxid(), pcursor->GetCoins(), metadata);
+                pcursor->Next();
+            } else {
+                // The rolled back state replaces the one at the tip
+                if (pcursor->Valid() && pcursor->GetTxid() == it->first)
+                    pcursor->Next();
+                if (!it->second.IsPruned())
+                    WriteCoins(writer, ss, it->first, it->second, metadata);
+                ++it;
+            }
+        }
+        writer << 'e';
+
+        metadata.hashSerialized = ss.GetHash();
+        writer << metadata;
+        uint256 hashChecksum = writer.GetHash();
+        fileout << hashChecksum;
+        FileCommit(fileout.Get());
+        fileout.fclose();
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTemp);
+        strError = strprintf("Error writing snapshot: %s", e.what());
+        return false;
+    }
+
+    if (!RenameOver(pathTemp, path)) {
+        strError = strprintf("Can't rename %s to %s", pathTemp.string(), path.string());
+        return false;
+    }
+    LogPrintf("Wrote UTXO snapshot of block %s at height %d to %s (%u transactions, hash_serialized %s)\n",
+        metadata.hashBlock.ToString(), metadata.nHeight, path.string(), metadata.nTransactions, metadata.hashSerialized.ToString());
+    return true;
+}
+
+/**
+ * Read and check a whole snapshot file. Only with pcoinsdb set are the block index
+ * entries and coins written out, so a file is fully verified before anything is.
+ */
+static bool ReadSnapshotFile(const boost::filesystem::path& path, CCoinsViewDB* pcoinsdb, CSnapshotMetadata& metadata, std::string& strError)
+{
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf(_("Cannot open UTXO snapshot %s"), path.string());
+        return false;
+    }
+
+    try {
+        CHashingFileReader reader(filein);
+        char pchMagic[4];
+        unsigned char pchMessageStart[4];
+        int nVersion, nHeight;
+        reader >> FLATDATA(pchMagic) >> FLATDATA(pchMessageStart) >> nVersion >> nHeight;
+        if (memcmp(pchMagic, SNAPSHOT_MAGIC, sizeof(pchMagic)) || nVersion != SNAPSHOT_VERSION || nHeight < 0) {
+            strError = strprintf(_("%s is not a UTXO snapshot of a supported version"), path.string());
+            return false;
+        }
+        if (memcmp(pchMessageStart, Params().MessageStart(), sizeof(pchMessageStart))) {
+            strError = strprintf(_("UTXO snapshot %s is for a different network"), path.string());
+            return false;
+        }
+
+        uint256 hashPrev = 0;
+        for (int i = 0; i <= nHeight; i++) {
+            boost::this_thread::interruption_point();
+            CDiskBlockIndex diskindex;
+            reader >> diskindex;
+            uint256 hash = diskindex.GetBlockHash();
+            if (diskindex.nHeight != i || diskindex.hashPrev != hashPrev || (i == 0 && hash != Params().HashGenesisBlock()) ||
+                diskindex.nTx == 0 || (diskindex.nStatus & (BLOCK_HAVE_MASK | BLOCK_FAILED_MASK)) || !diskindex.IsValid(BLOCK_VALID_TRANSACTIONS)) {
+                strError = strprintf(_("UTXO snapshot %s has an invalid block index at height %d"), path.string(), i);
+                return false;
+            }
+            if (!Checkpoints::CheckBlock(i, hash)) {
+                strError = strprintf(_("UTXO snapshot %s conflicts with the checkpoint at height %d"), path.string(), i);
+                return false;
+            }
+            if (pcoinsdb && !pblocktree->WriteBlockIndex(diskindex)) {
+                strError = _("Failed to write to block index database");
+                return false;
+            }
+            hashPrev = hash;
+        }
+
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << hashPrev;
+        CCoinsMap mapCoins;
+        uint64_t nTransactions = 0;
+        uint256 txidPrev;
+        while (true) {
+            char chType;
+            reader >> chType;
+            if (chType == 'e')
+                break;
+            uint256 txid;
+            CCoins coins;
+            reader >> txid >> coins;
+            if (chType != 'c' || coins.IsPruned() || (nTransactions > 0 && !CTxidKeyOrder()(txidPrev, txid))) {
+                strError = strprintf(_("UTXO snapshot %s has invalid coins after %u transactions"), path.string(), nTransactions);
+                return false;
+            }
+            HashCoins(ss, txid, coins);
+            nTransactions++;
+            txidPrev = txid;
+
+            if (pcoinsdb) {
+                CCoinsCacheEntry& entry = mapCoins[txid];
+                entry.coins.swap(coins);
+                entry.flags = CCoinsCacheEntry::DIRTY;
+                // The best block is only written with the last batch, so an interrupted load is never mistaken for a chain state
+                if (mapCoins.size() >= SNAPSHOT_LOAD_BATCH && !pcoinsdb->BatchWrite(mapCoins, uint256(0))) {
+                    strError = _("Failed to write to coin database");
+                    return false;
+                }
+                if (nTransactions % SNAPSHOT_LOAD_BATCH == 0)
+                    boost::this_thread::interruption_point();
+            }
+        }
+
+        reader >> metadata;
+        uint256 hashChecksum;
+        uint256 hashComputed = reader.GetHash();
+        filein >> hashChecksum;
+        if (hashChecksum != hashComputed) {
+            strError = strprintf(_("UTXO snapshot %s is corrupt (checksum mismatch)"), path.string());
+            return false;
+        }
+        if (metadata.hashBlock != hashPrev || metadata.nHeight != nHeight || metadata.nTransactions != nTransactions || metadata.hashSerialized != ss.GetHash()) {
+            strError = strprintf(_("UTXO snapshot %s does not match its own metadata"), path.string());
+            return false;
+        }
+
+        if (pcoinsdb) {
+            if (!pblocktree->WriteSnapshot(metadata) || !pblocktree->WriteFlag("txindex", GetBoolArg("-txindex", true))) {
+                strError = _("Failed to write to block index database");
+                return false;
+            }
+            if (!pcoinsdb->BatchWrite(mapCoins, metadata.hashBlock)) {
+                strError = _("Failed to write to coin database");
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf(_("UTXO snapshot %s is truncated or corrupt: %s"), path.string(), e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadSnapshot(const boost::filesystem::path& path, CCoinsViewDB* pcoinsdb, std::string& strError)
+{
+    int64_t nStart = GetTimeMillis();
+    CSnapshotMetadata metadata;
+    LogPrintf("Verifying UTXO snapshot %s...\n", path.string());
+    if (!ReadSnapshotFile(path, NULL, metadata, strError))
+        return false;
+    LogPrintf("Loading UTXO snapshot of block %s at height %d (%u transactions, hash_serialized %s)\n",
+        metadata.hashBlock.ToString(), metadata.nHeight, metadata.nTransactions, metadata.hashSerialized.ToString());
+    if (!ReadSnapshotFile(path, pcoinsdb, metadata, strError))
+        return false;
+    LogPrintf("Loaded UTXO snapshot in %dms\n", GetTimeMillis() - nStart);
+    return true;
+}
+
+bool IsSnapshotHistoryBlock(const uint256& hash)
+{
+    int nHeight;
+    {
+        LOCK(cs_snapshot);
+        if (snapshotLoaded.IsNull() || fSnapshotValidated)
+            return false;
+        nHeight = snapshotLoaded.nHeight;
+    }
+
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+        return false;
+    CBlockIndex* pindex = mi->second;
+    return !(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nHeight <= nHeight && chainActive.Contains(pindex);
+}
+
+bool GetSnapshotStatus(CSnapshotMetadata& metadata, int& nValidatedHeight, bool& fValidated)
+{
+    LOCK(cs_snapshot);
+    if (snapshotLoaded.IsNull())
+        return false;
+    metadata = snapshotLoaded;
+    nValidatedHeight = fSnapshotValidated ? snapshotLoaded.nHeight : nSnapshotValidatedHeight;
+    fValidated = fSnapshotValidated;
+    return true;
+}
+
+//! Ask one peer, in turn, for the blocks between nFrom and nTo we don't have yet
+static void RequestSnapshotHistory(int nFrom, int nTo)
+{
+    std::vector<CInv> vInv;
+    {
+        LOCK(cs_main);
+        for (int n = nFrom; n <= nTo && n <= chainActive.Height(); n++) {
+            CBlockIndex* pindex = chainActive[n];
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                vInv.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+        }
+    }
+    if (vInv.empty())
+        return;
+
+    static unsigned int nNextPeer = 0;
+    LOCK(cs_vNodes);
+    std::vector<CNode*> vPeers;
+    BOOST_FOREACH (CNode* pnode, vNodes) {
+        if (pnode->fSuccessfullyConnected && !pnode->fDisconnect && !pnode->fClient && (pnode->nServices & NODE_NETWORK))
+            vPeers.push_back(pnode);
+    }
+    if (vPeers.empty())
+        return;
+    CNode* pnode = vPeers[nNextPeer++ % vPeers.size()];
+    LogPrint("net", "requesting %u blocks below the UTXO snapshot (height %d to %d) from peer=%d\n", vInv.size(), nFrom, nTo, pnode->id);
+    pnode->PushMessage("getdata", vInv);
+}
+
+/** Connect one block of the snapshot history to the validation's own coins */
+static bool ValidateHistoryBlock(const CBlock& block, CBlockIndex* pindex, CCoinsViewCache& view, CValidationState& state)
+{
+    LOCK(cs_main);
+    bool fAssumeValid = pindex->pprev && IsBlockAssumedValid(block);
+    if (!fAssumeValid && !block.CheckBlockSignature())
+        return state.DoS(100, error("%s : bad block signature", __func__));
+    if (block.IsProofOfStake()) {
+        uint256 hashProofOfStake;
+        if (!CheckProofOfStake(block, hashProofOfStake, fAssumeValid, &view))
+            return state.DoS(100, error("%s : check proof-of-stake failed", __func__));
+    }
+    // ConnectBlock recomputes the money supply and mint from the parent's, which the
+    // snapshot loaded along with these
+    CAmount nMoneySupply = pindex->nMoneySupply;
+    CAmount nMint = pindex->nMint;
+    if (!ConnectBlock(block, state, pindex, view, true, true))
+        return false;
+    if (pindex->nMoneySupply != nMoneySupply || pindex->nMint != nMint)
+        return state.DoS(100, error("%s : money supply %s and mint %s, snapshot has %s and %s", __func__,
+                                  FormatMoney(pindex->nMoneySupply), FormatMoney(pindex->nMint), FormatMoney(nMoneySupply), FormatMoney(nMint)),
+                         REJECT_INVALID, "bad-money-supply");
+    view.SetBestBlock(pindex->GetBlockHash());
+
+    // The stake and collateral lookups of transactions below the snapshot work from here on
+    if (fTxIndex) {
+        std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+        CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+        BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+            vPos.push_back(std::make_pair(tx.GetHash(), pos));
+            pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+        if (!pblocktree->WriteTxIndex(vPos))
+            return state.Abort("Failed to write transaction index");
+    }
+    return true;
+}
+
+//! The hash_serialized of a coin database, computed without holding any lock
+static uint256 GetCoinsHash(const CCoinsViewDB& db, const uint256& hashBlock)
+{
+    boost::scoped_ptr<CCoinsViewDBCursor> pcursor(db.Cursor());
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBlock;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        HashCoins(ss, pcursor->GetTxid(), pcursor->GetCoins());
+    }
+    return ss.GetHash();
+}
+
+static void SnapshotValidationFailed(const std::string& strReason)
+{
+    LogPrintf("*** UTXO snapshot validation failed: %s\n", strReason);
+    strMiscWarning = _("Warning: The UTXO snapshot this node was started from does not match the block chain! Rebuild the data directory from the network.");
+    uiInterface.ThreadSafeMessageBox(strMiscWarning, "", CClientUIInterface::MSG_ERROR);
+}
+
+/**
+ * Fetch the blocks below the snapshot, from peers or -loadblock imports, and connect them
+ * in order to a separate coin database. The money supply and mint of each block must
+ * match the ones the snapshot loaded, and once at the snapshot block, its coins must hash
+ * to the snapshot's hash_serialized.
+ */
+static void ThreadSnapshotValidation()
+{
+    CSnapshotMetadata metadata;
+    {
+        LOCK(cs_snapshot);
+        metadata = snapshotLoaded;
+    }
+    boost::filesystem::path pathCheck = GetDataDir() / "snapshotcheck";
+    bool fMatch = false;
+    {
+        CCoinsViewDB dbCheck(pathCheck, SNAPSHOT_CHECK_DB_CACHE);
+        CCoinsViewCache viewCheck(&dbCheck);
+
+        int nHeight = 0;
+        uint256 hashBest = viewCheck.GetBestBlock();
+        if (!hashBest.IsNull()) {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+            if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+                SnapshotValidationFailed(strprintf("validation state at unknown block %s", hashBest.ToString()));
+                return;
+            }
+            nHeight = mi->second->nHeight + 1;
+        }
+        LogPrintf("Validating the blocks below the UTXO snapshot at height %d, from height %d\n", metadata.nHeight, nHeight);
+
+        int nRequestedTo = nHeight - 1;
+        int64_t nLastProgress = GetTime();
+        while (nHeight <= metadata.nHeight) {
+            boost::this_thread::interruption_point();
+
+            if (nRequestedTo < nHeight + SNAPSHOT_REQUEST_WINDOW / 2) {
+                int nTo = std::min(nHeight + SNAPSHOT_REQUEST_WINDOW - 1, metadata.nHeight);
+                RequestSnapshotHistory(std::max(nHeight, nRequestedTo + 1), nTo);
+                nRequestedTo = nTo;
+            }
+
+            CBlockIndex* pindex;
+            {
+                LOCK(cs_main);
+                pindex = chainActive[nHeight];
+                if (pindex && !(pindex->nStatus & BLOCK_HAVE_DATA))
+                    pindex = NULL;
+            }
+            if (!pindex) {
+                if (GetTime() - nLastProgress > SNAPSHOT_REQUEST_TIMEOUT) {
+                    // Ask someone else
+                    nRequestedTo = nHeight - 1;
+                    nLastProgress = GetTime();
+                }
+                MilliSleep(100);
+                continue;
+            }
+
+            CBlock block;
+            CValidationState state;
+            if (!ReadBlockFromDisk(block, pindex) || !ValidateHistoryBlock(block, pindex, viewCheck, state)) {
+                SnapshotValidationFailed(strprintf("block %s at height %d is invalid: %s", pindex->GetBlockHash().ToString(), nHeight, state.GetRejectReason()));
+                return;
+            }
+            nLastProgress = GetTime();
+
+            if (nHeight == metadata.nHeight || viewCheck.GetCacheSize() > std::max(nCoinCacheSize / 4, (unsigned int)1000)) {
+                if (!viewCheck.Flush()) {
+                    SnapshotValidationFailed("can't write the validation state");
+                    return;
+                }
+            }
+            {
+                LOCK(cs_snapshot);
+                nSnapshotValidatedHeight = nHeight;
+            }
+            if (nHeight % 10000 == 0)
+                LogPrintf("UTXO snapshot validation at height %d of %d\n", nHeight, metadata.nHeight);
+            nHeight++;
+        }
+
+        uint256 hashSerialized = GetCoinsHash(dbCheck, metadata.hashBlock);
+        if (hashSerialized != metadata.hashSerialized) {
+            SnapshotValidationFailed(strprintf("coins hash %s at height %d, snapshot has %s", hashSerialized.ToString(), metadata.nHeight, metadata.hashSerialized.ToString()));
+            return;
+        }
+        fMatch = true;
+    }
+
+    if (fMatch) {
+        {
+            LOCK(cs_main);
+            pblocktree->WriteFlag("snapshotvalidated", true);
+        }
+        {
+            LOCK(cs_snapshot);
+            fSnapshotValidated = true;
+        }
+        boost::filesystem::remove_all(pathCheck);
+        LogPrintf("UTXO snapshot at height %d validated against the block chain\n", metadata.nHeight);
+    }
+}
+
+void StartSnapshotValidation(boost::thread_group& threadGroup)
+{
+    CSnapshotMetadata metadata;
+    bool fValidated = false;
+    {
+        LOCK(cs_main);
+        if (!pblocktree->ReadSnapshot(metadata))
+            return;
+        pblocktree->ReadFlag("snapshotvalidated", fValidated);
+    }
+    {
+        LOCK(cs_snapshot);
+        snapshotLoaded = metadata;
+        fSnapshotValidated = fValidated;
+    }
+    if (fValidated)
+        return;
+
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "snapshotcheck", &ThreadSnapshotValidation));
+}
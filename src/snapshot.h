@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SNAPSHOT_H
+#define BITCOIN_SNAPSHOT_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+#include <stdint.h>
+
+#include <boost/filesystem/path.hpp>
+
+class CCoinsViewDB;
+
+namespace boost
+{
+class thread_group;
+} // namespace boost
+
+//! Format version of UTXO snapshot files
+static const int SNAPSHOT_VERSION = 1;
+//! How far below the tip a snapshot may be taken; older states would need too much undo data in memory
+static const int MAX_SNAPSHOT_REWIND = 1000;
+
+/**
+ * Describes a UTXO snapshot: the block its coins are the state after, and the hash of
+ * those coins. hashSerialized is computed exactly like gettxoutsetinfo's hash_serialized,
+ * so a snapshot can be compared against any fully validating node at the same height.
+ */
+class CSnapshotMetadata
+{
+public:
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nTransactions;
+    uint256 hashSerialized;
+
+    CSnapshotMetadata() { SetNull(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nTransactions);
+        READWRITE(hashSerialized);
+    }
+
+    void SetNull()
+    {
+        hashBlock = 0;
+        nHeight = -1;
+        nTransactions = 0;
+        hashSerialized = 0;
+    }
+
+    bool IsNull() const { return hashBlock == 0; }
+};
+
+/**
+ * Write the coins of the active chain as of nHeight, together with the block index of the
+ * chain up to there (headers, stake modifiers, money supply), to a checksummed snapshot
+ * file. States below the tip are rebuilt in memory from the undo data.
+ */
+bool DumpSnapshot(const boost::filesystem::path& path, int nHeight, CSnapshotMetadata& metadata, std::string& strError);
+
+/**
+ * Build the block index and chain state of an empty data directory from a snapshot file,
+ * before the block index is loaded. Blocks below the snapshot have no data until the
+ * background validation fetches them.
+ */
+bool LoadSnapshot(const boost::filesystem::path& path, CCoinsViewDB* pcoinsdb, std::string& strError);
+
+/** Whether hash is a block of the active chain below a loaded snapshot whose data we don't have yet */
+bool IsSnapshotHistoryBlock(const uint256& hash);
+
+/** Start validating the history of a loaded snapshot in the background, unless that is done already */
+void StartSnapshotValidation(boost::thread_group& threadGroup);
+
+/** Snapshot the chain state was loaded from, and how far its history has been validated (-1 for none) */
+bool GetSnapshotStatus(CSnapshotMetadata& metadata, int& nValidatedHeight, bool& fValidated);
+
+#endif // BITCOIN_SNAPSHOT_H
@@ -95,6 +95,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
         mapSporks[hash] = spork;
         mapSporksActive[spork.nSporkID] = spork;
         sporkManager.Relay(spork);
+        GetMainSignals().NotifySpork(spork);
 
         // CBN: add to spork database.
         pSporkDB->WriteSpork(spork.nSporkID, spork);
@@ -232,6 +233,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
         Relay(msg);
         mapSporks[msg.GetHash()] = msg;
         mapSporksActive[nSporkID] = msg;
+        GetMainSignals().NotifySpork(msg);
         return true;
     }
 
@@ -289,6 +289,62 @@ public:
 };
 
 
+/** Stream that deserializes from a read-only byte range it does not own.
+ *
+ * Unlike CDataStream nothing is copied, so the range (e.g. a memory-mapped
+ * block file) must outlive the reader.
+ */
+class CSpanReader
+{
+private:
+    int nType;
+    int nVersion;
+
+    const char* pBegin;
+    const char* pEnd;
+
+public:
+    CSpanReader(const char* pBeginIn, const char* pEndIn, int nTypeIn, int nVersionIn)
+        : nType(nTypeIn), nVersion(nVersionIn), pBegin(pBeginIn), pEnd(pEndIn) {}
+
+    size_t size() const { return pEnd - pBegin; }
+    bool empty() const { return pBegin == pEnd; }
+    const char* data() const { return pBegin; }
+
+    //
+    // Stream subset
+    //
+    void SetType(int n) { nType = n; }
+    int GetType() { return nType; }
+    void SetVersion(int n) { nVersion = n; }
+    int GetVersion() { return nVersion; }
+
+    CSpanReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read() : end of data");
+        memcpy(pch, pBegin, nSize);
+        pBegin += nSize;
+        return (*this);
+    }
+
+    CSpanReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore() : end of data");
+        pBegin += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
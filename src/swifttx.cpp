@@ -12,22 +12,69 @@
 #include "masternodeconfig.h"
 #include "net.h"
 #include "protocol.h"
+#include "random.h"
 #include "spork.h"
 #include "sync.h"
+#include "txdb.h"
 #include "util.h"
+#include "workqueue.h"
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
 
 using namespace std;
 using namespace boost;
 
-std::map<uint256, CTransaction> mapTxLockReq;
-std::map<uint256, CTransaction> mapTxLockReqRejected;
-std::map<uint256, CConsensusVote> mapTxLockVote;
-std::map<uint256, CTransactionLock> mapTxLocks;
-std::map<COutPoint, uint256> mapLockedInputs;
-std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
+CTransactionLockManager txLockManager;
+
+CSwiftTXHasher::CSwiftTXHasher() : salt(GetRandHash()) {}
 int nCompleteTXLocks;
 
+/** Masternode ranks at one block height, shared by all votes for that height */
+class CSwiftTXRanks
+{
+public:
+    uint256 hashBlock;
+    int64_t nMinAge;
+    int64_t nTime;
+    unsigned int nListUpdated;
+    std::map<COutPoint, std::pair<int, CPubKey> > mapRanks;
+};
+
+/** Highest score first; equal scores are ordered by collateral, the same on every node */
+struct CompareSwiftTXScore {
+    bool operator()(const std::pair<int64_t, const CMasternode*>& t1,
+        const std::pair<int64_t, const CMasternode*>& t2) const
+    {
+        if (t1.first != t2.first)
+            return t1.first > t2.first;
+        return t2.second->vin.prevout < t1.second->vin.prevout;
+    }
+};
+typedef boost::shared_ptr<const CSwiftTXRanks> CSwiftTXRanksRef;
+
+/** A received vote on its way through the verification threads */
+struct CPendingVote {
+    CConsensusVote vote;
+    CNode* pfrom; // referenced until the vote is applied
+    bool fBlockKnown;
+    uint256 hashBlock;
+    int64_t nMinAge; // -1 while SPORK_8 is off
+    int nRank;
+    bool fSignatureValid;
+};
+
+static CCriticalSection cs_swifttxvotes;
+static CWorkQueue* pSwiftTXQueue = NULL;
+//! Votes waiting for a verification thread, batched per lock
+static std::map<uint256, std::vector<CPendingVote> > mapPendingVotes;
+//! Verified votes waiting for the message handler
+static std::vector<CPendingVote> vVerifiedVotes;
+static std::map<int, CSwiftTXRanksRef> mapRankCache;
+//! When each lock was requested, for the completion latency
+static std::map<uint256, int64_t> mapLockRequestTimes;
+static CSwiftTXStats swiftTXStats;
+
 //txlock - Locks transaction
 //
 //step 1.) Broadcast intention to lock transaction inputs, "txlreg", CTransaction
@@ -35,6 +82,62 @@ int nCompleteTXLocks;
 //         Send "txvote", CTransaction, Signature, Approve
 //step 3.) Top 1 masternode, waits for SWIFTTX_SIGNATURES_REQUIRED messages. Upon success, sends "txlock'
 
+/**
+ * A complete lock wins over the transactions that spend the same inputs. Those
+ * in the mempool are found through its spent-outpoint index and evicted, so the
+ * locked transaction can take their place. Only an input that is already spent
+ * in a block makes us reprocess the recent blocks. An input we don't know yet,
+ * like the output of a parent we haven't received, is no conflict: the lock
+ * waits for it like any transaction with missing inputs.
+ */
+static void ResolveLockConflicts(const CTransaction& tx)
+{
+    bool fSpentInChain = false;
+    bool fMissingInputs = false;
+    {
+        LOCK(cs_main);
+        list<CTransaction> removed;
+        mempool.removeConflicts(tx, removed);
+        BOOST_FOREACH (const CTransaction& txConflict, removed)
+            LogPrintf("SwiftTX::ResolveLockConflicts - removed %s conflicting with lock %s\n", txConflict.GetHash().ToString(), tx.GetHash().ToString());
+
+        BOOST_FOREACH (const CTxIn& in, tx.vin) {
+            const CCoins* coins = pcoinsTip->AccessCoins(in.prevout.hash);
+            if (coins != NULL) {
+                if (!coins->IsAvailable(in.prevout.n)) {
+                    fSpentInChain = true;
+                    break;
+                }
+                continue;
+            }
+            if (mempool.exists(in.prevout.hash))
+                continue;
+
+            // without coins left, a confirmed parent had all its outputs spent
+            CDiskTxPos postx;
+            if (fTxIndex && pblocktree->ReadTxIndex(in.prevout.hash, postx)) {
+                fSpentInChain = true;
+                break;
+            }
+            fMissingInputs = true;
+        }
+
+        if (!fSpentInChain && fMissingInputs)
+            LogPrint("swifttx", "SwiftTX::ResolveLockConflicts - inputs of lock %s are not known yet\n", tx.GetHash().ToString());
+
+        if (!fSpentInChain && !fMissingInputs && !mempool.exists(tx.GetHash())) {
+            CValidationState state;
+            if (AcceptToMemoryPool(mempool, state, tx, false, NULL))
+                RelayTransaction(tx);
+        }
+    }
+
+    if (fSpentInChain) {
+        //reprocess the last 15 blocks
+        ReprocessBlocks(15);
+    }
+}
+
 void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (fLiteMode) return; //disable all masternode related functionality
@@ -50,7 +153,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
+        if (txLockManager.HasRequest(tx.GetHash()) || txLockManager.IsRejected(tx.GetHash())) {
             return;
         }
 
@@ -82,7 +185,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            txLockManager.AddRequest(tx);
 
             LogPrintf("ProcessMessageSwiftTX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -91,7 +194,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             return;
 
         } else {
-            mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            txLockManager.AddRejectedRequest(tx);
 
             // can we get the conflicting transaction as proof?
 
@@ -99,24 +202,16 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
                 tx.GetHash().ToString().c_str());
 
-            BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                if (!mapLockedInputs.count(in.prevout)) {
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
-                }
-            }
+            txLockManager.LockInputs(tx);
 
             // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()) {
-                //we only care if we have a complete tx lock
-                if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-                    if (!CheckForConflictingLocks(tx)) {
-                        LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        ReprocessBlocks(15);
-                        mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
-                    }
+            //we only care if we have a complete tx lock
+            if (txLockManager.CountSignatures(tx.GetHash()) >= SWIFTTX_SIGNATURES_REQUIRED) {
+                if (!txLockManager.CheckForConflictingLocks(tx)) {
+                    LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
+
+                    ResolveLockConflicts(tx);
+                    txLockManager.AddRequest(tx);
                 }
             }
 
@@ -130,39 +225,205 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockVote.count(ctx.GetHash())) {
+        if (!txLockManager.AddVote(ctx)) {
             return;
         }
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
-
-        if (ProcessConsensusVote(pfrom, ctx)) {
-            //Spam/Dos protection
-            /*
-                Masternodes will sometimes propagate votes before the transaction is known to the client.
-                This tracks those messages and allows it at the same rate of the rest of the network, if
-                a peer violates it, it will simply be ignored
-            */
-            if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
-                if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
+        // rank and signature are checked by the SwiftTX threads, the vote is
+        // applied and relayed from ProcessVerifiedConsensusVotes
+        QueueConsensusVote(pfrom, ctx);
 
-                if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
-                    LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
-                        ctx.vinMasternode.ToString().c_str(),
-                        ctx.txHash.ToString().c_str());
-                    return;
-                } else {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
-            }
-            RelayInv(inv);
+        return;
+    }
+}
+
+static void RelayConsensusVote(const CConsensusVote& ctx)
+{
+    if (!txLockManager.HasRequest(ctx.txHash) && !txLockManager.IsRejected(ctx.txHash)) {
+        if (!txLockManager.CheckUnknownVote(ctx)) {
+            LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
+                ctx.vinMasternode.ToString().c_str(),
+                ctx.txHash.ToString().c_str());
+            return;
         }
+    }
 
-        return;
+    CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
+    RelayInv(inv);
+}
+
+/**
+ * Rank the masternodes for a block height the way GetMasternodeRank does, but
+ * once for all votes at that height and from a list snapshot, so that the
+ * verification threads never hold the masternode manager lock. The ranks are
+ * dropped with any change to the list. Masternodes only expire when the list
+ * is checked, which happens every MASTERNODE_CHECK_SECONDS, so the ranks are
+ * also taken again after that time.
+ */
+static CSwiftTXRanksRef GetSwiftTXRanks(int nBlockHeight, const uint256& hashBlock, int64_t nMinAge)
+{
+    unsigned int nListUpdated = mnodeman.GetListUpdated();
+    {
+        LOCK(cs_swifttxvotes);
+        std::map<int, CSwiftTXRanksRef>::iterator it = mapRankCache.find(nBlockHeight);
+        if (it != mapRankCache.end() && it->second->hashBlock == hashBlock && it->second->nMinAge == nMinAge &&
+            it->second->nListUpdated == nListUpdated && GetTime() - it->second->nTime < MASTERNODE_CHECK_SECONDS)
+            return it->second;
+    }
+
+    boost::shared_ptr<CSwiftTXRanks> pRanks(new CSwiftTXRanks());
+    pRanks->hashBlock = hashBlock;
+    pRanks->nMinAge = nMinAge;
+    pRanks->nTime = GetTime();
+
+    std::vector<std::pair<int64_t, const CMasternode*> > vecScores;
+    CMasternodeSnapshotRef pList = mnodeman.GetSnapshot(&pRanks->nListUpdated);
+    BOOST_FOREACH (const CMasternode& mn, *pList) {
+        if (mn.protocolVersion < MIN_SWIFTTX_PROTO_VERSION) continue;
+        if (nMinAge >= 0 && GetAdjustedTime() - mn.sigTime < nMinAge) continue;
+        if (!mn.IsEnabled()) continue;
+        vecScores.push_back(std::make_pair(mn.CalculateScore(hashBlock).GetCompact(false), &mn));
+    }
+    sort(vecScores.begin(), vecScores.end(), CompareSwiftTXScore());
+
+    for (unsigned int i = 0; i < vecScores.size(); i++)
+        pRanks->mapRanks[vecScores[i].second->vin.prevout] = std::make_pair(i + 1, vecScores[i].second->pubKeyMasternode);
+
+    LOCK(cs_swifttxvotes);
+    mapRankCache[nBlockHeight] = pRanks;
+    // only recent heights are voted on
+    while (mapRankCache.size() > SWIFTTX_RANK_HEIGHTS)
+        mapRankCache.erase(mapRankCache.begin());
+    return pRanks;
+}
+
+// verification thread: check rank and signature of the votes pending for one lock
+static void VerifyConsensusVotes(uint256 txHash)
+{
+    std::vector<CPendingVote> vBatch;
+    {
+        LOCK(cs_swifttxvotes);
+        std::map<uint256, std::vector<CPendingVote> >::iterator it = mapPendingVotes.find(txHash);
+        if (it == mapPendingVotes.end()) return;
+        vBatch.swap(it->second);
+        mapPendingVotes.erase(it);
+    }
+
+    BOOST_FOREACH (CPendingVote& pending, vBatch) {
+        pending.nRank = -1;
+        pending.fSignatureValid = false;
+        if (!pending.fBlockKnown) continue;
+
+        CSwiftTXRanksRef pRanks = GetSwiftTXRanks(pending.vote.nBlockHeight, pending.hashBlock, pending.nMinAge);
+        std::map<COutPoint, std::pair<int, CPubKey> >::const_iterator it = pRanks->mapRanks.find(pending.vote.vinMasternode.prevout);
+        if (it == pRanks->mapRanks.end()) continue;
+
+        pending.nRank = it->second.first;
+        if (pending.nRank <= SWIFTTX_SIGNATURES_TOTAL)
+            pending.fSignatureValid = pending.vote.SignatureValid(it->second.second);
+    }
+
+    LOCK(cs_swifttxvotes);
+    swiftTXStats.nVotesVerified += vBatch.size();
+    vVerifiedVotes.insert(vVerifiedVotes.end(), vBatch.begin(), vBatch.end());
+}
+
+void QueueConsensusVote(CNode* pfrom, const CConsensusVote& ctx)
+{
+    CPendingVote pending;
+    pending.vote = ctx;
+    pending.pfrom = pfrom;
+    pending.fBlockKnown = GetBlockHash(pending.hashBlock, ctx.nBlockHeight);
+    pending.nMinAge = IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) ? GetSporkValue(SPORK_14_MN_WINNER_MINIMUM_AGE) : -1;
+    pending.nRank = -1;
+    pending.fSignatureValid = false;
+    {
+        // Released once the verified vote is processed
+        LOCK(cs_vNodes);
+        pfrom->AddRef();
+    }
+
+    bool fNewBatch;
+    {
+        LOCK(cs_swifttxvotes);
+        std::vector<CPendingVote>& vBatch = mapPendingVotes[ctx.txHash];
+        fNewBatch = vBatch.empty();
+        vBatch.push_back(pending);
+    }
+
+    // later votes for the same lock join the batch until a thread picks it up
+    if (!fNewBatch) return;
+
+    bool fQueued = false;
+    {
+        LOCK(cs_swifttxvotes);
+        fQueued = pSwiftTXQueue && mapPendingVotes.size() <= MAX_SWIFTTX_VOTE_BATCHES &&
+                  pSwiftTXQueue->Enqueue(boost::bind(&VerifyConsensusVotes, ctx.txHash));
+    }
+    if (!fQueued) {
+        VerifyConsensusVotes(ctx.txHash);
+        ProcessVerifiedConsensusVotes();
+    }
+}
+
+void ProcessVerifiedConsensusVotes()
+{
+    std::vector<CPendingVote> vVerified;
+    {
+        LOCK(cs_swifttxvotes);
+        if (vVerifiedVotes.empty()) return;
+        vVerified.swap(vVerifiedVotes);
+    }
+
+    BOOST_FOREACH (CPendingVote& pending, vVerified) {
+        CNode* pnode = pending.pfrom->fDisconnect ? NULL : pending.pfrom;
+        if (ProcessConsensusVote(pnode, pending.vote, pending.nRank, pending.fSignatureValid))
+            RelayConsensusVote(pending.vote);
+    }
+
+    LOCK(cs_vNodes);
+    BOOST_FOREACH (CPendingVote& pending, vVerified)
+        pending.pfrom->Release();
+}
+
+void StartSwiftTXThreads(int nThreads)
+{
+    if (nThreads <= 0) return;
+
+    LOCK(cs_swifttxvotes);
+    pSwiftTXQueue = new CWorkQueue(MAX_SWIFTTX_VOTE_BATCHES);
+    pSwiftTXQueue->Start(nThreads, "swifttx");
+}
+
+void StopSwiftTXThreads()
+{
+    CWorkQueue* pQueue;
+    {
+        LOCK(cs_swifttxvotes);
+        pQueue = pSwiftTXQueue;
+        pSwiftTXQueue = NULL;
     }
+    if (pQueue == NULL) return;
+
+    pQueue->Stop();
+    delete pQueue;
+
+    // drop the batches that were still queued
+    LOCK2(cs_vNodes, cs_swifttxvotes);
+    for (std::map<uint256, std::vector<CPendingVote> >::iterator it = mapPendingVotes.begin(); it != mapPendingVotes.end(); ++it)
+        BOOST_FOREACH (CPendingVote& pending, it->second)
+            pending.pfrom->Release();
+    mapPendingVotes.clear();
+}
+
+CSwiftTXStats GetSwiftTXStats()
+{
+    LOCK(cs_swifttxvotes);
+    CSwiftTXStats stats = swiftTXStats;
+    stats.nVotesPending = vVerifiedVotes.size();
+    for (std::map<uint256, std::vector<CPendingVote> >::iterator it = mapPendingVotes.begin(); it != mapPendingVotes.end(); ++it)
+        stats.nVotesPending += it->second.size();
+    return stats;
 }
 
 bool IsIXTXValid(const CTransaction& txCollateral)
@@ -231,20 +492,13 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (chainActive.Tip()->nHeight - nTxAge) + 4;
 
-    if (!mapTxLocks.count(tx.GetHash())) {
-        LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
-    } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
-        LogPrint("swifttx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
+    {
+        LOCK(cs_swifttxvotes);
+        if (!mapLockRequestTimes.count(tx.GetHash()))
+            mapLockRequestTimes[tx.GetHash()] = GetTimeMillis();
     }
 
+    txLockManager.CreateLock(tx.GetHash(), nBlockHeight);
 
     return nBlockHeight;
 }
@@ -284,25 +538,21 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    txLockManager.AddVote(ctx);
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
 }
 
-//received a consensus vote
-bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
+//received a consensus vote, nRank and fSignatureValid come from the verification threads
+bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx, int n, bool fSignatureValid)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
-
-    CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
-    if (pmn != NULL)
-        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Masternode ADDR %s %d\n", pmn->addr.ToString().c_str(), n);
+    LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Masternode %s %d\n", ctx.vinMasternode.prevout.ToStringShort(), n);
 
     if (n == -1) {
         //can be caused by past versions trying to vote with an invalid protocol
         LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Unknown Masternode\n");
-        mnodeman.AskForMN(pnode, ctx.vinMasternode);
+        if (pnode) mnodeman.AskForMN(pnode, ctx.vinMasternode);
         return false;
     }
 
@@ -311,143 +561,71 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!ctx.SignatureValid()) {
+    if (!fSignatureValid) {
         LogPrintf("SwiftTX::ProcessConsensusVote - Signature invalid\n");
         // don't ban, it could just be a non-synced masternode
-        mnodeman.AskForMN(pnode, ctx.vinMasternode);
+        if (pnode) mnodeman.AskForMN(pnode, ctx.vinMasternode);
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)) {
-        LogPrintf("SwiftTX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
-    } else
-        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
-
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()) {
-        (*i).second.AddSignature(ctx);
+    int nSigs = txLockManager.AddLockSignature(ctx);
 
 #ifdef ENABLE_WALLET
-        if (pwalletMain) {
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if (pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
-#endif
-
-        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
-
-        if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-            LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
-
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
-            if (!CheckForConflictingLocks(tx)) {
-#ifdef ENABLE_WALLET
-                if (pwalletMain) {
-                    if (pwalletMain->UpdatedTransaction((*i).second.txHash)) {
-                        nCompleteTXLocks++;
-                    }
-                }
+    if (pwalletMain) {
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        if (pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+    }
 #endif
 
-                if (mapTxLockReq.count(ctx.txHash)) {
-                    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                        if (!mapLockedInputs.count(in.prevout)) {
-                            mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
-                        }
-                    }
-                }
+    LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSigs, ctx.GetHash().ToString().c_str());
 
-                // resolve conflicts
+    if (nSigs >= SWIFTTX_SIGNATURES_REQUIRED) {
+        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", ctx.txHash.ToString().c_str());
 
-                //if this tx lock was rejected, we need to remove the conflicting blocks
-                if (mapTxLockReqRejected.count((*i).second.txHash)) {
-                    //reprocess the last 15 blocks
-                    ReprocessBlocks(15);
-                }
+        {
+            LOCK(cs_swifttxvotes);
+            std::map<uint256, int64_t>::iterator it = mapLockRequestTimes.find(ctx.txHash);
+            if (it != mapLockRequestTimes.end()) {
+                int64_t nLatency = GetTimeMillis() - it->second;
+                swiftTXStats.nLocksCompleted++;
+                swiftTXStats.nLastLatencyMillis = nLatency;
+                swiftTXStats.nMaxLatencyMillis = std::max(swiftTXStats.nMaxLatencyMillis, nLatency);
+                swiftTXStats.nTotalLatencyMillis += nLatency;
+                mapLockRequestTimes.erase(it);
             }
         }
-        return true;
-    }
-
-
-    return false;
-}
-
-bool CheckForConflictingLocks(CTransaction& tx)
-{
-    /*
-        It's possible (very unlikely though) to get 2 conflicting transaction locks approved by the network.
-        In that case, they will cancel each other out.
 
-        Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
-        rescan the blocks and find they're acceptable and then take the chain with the most work.
-    */
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                LogPrintf("SwiftTX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
+        CTransaction tx;
+        if (txLockManager.GetRequest(ctx.txHash, tx) && !txLockManager.CheckForConflictingLocks(tx)) {
+#ifdef ENABLE_WALLET
+            if (pwalletMain) {
+                if (pwalletMain->UpdatedTransaction(ctx.txHash)) {
+                    nCompleteTXLocks++;
+                }
             }
-        }
-    }
-
-    return false;
-}
+#endif
 
-int64_t GetAverageVoteTime()
-{
-    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
-    int64_t total = 0;
-    int64_t count = 0;
+            txLockManager.LockInputs(tx);
 
-    while (it != mapUnknownVotes.end()) {
-        total += it->second;
-        count++;
-        it++;
+            //if this tx lock was rejected, its conflicts need to be resolved
+            if (txLockManager.IsRejected(ctx.txHash))
+                ResolveLockConflicts(tx);
+        }
     }
-
-    return total / count;
+    return true;
 }
 
 void CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
-
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    std::vector<uint256> vRemoved;
+    txLockManager.RemoveExpired(vRemoved);
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
-
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
-
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
-
-                BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
-
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
-        }
-    }
+    LOCK(cs_swifttxvotes);
+    BOOST_FOREACH (const uint256& txHash, vRemoved)
+        mapLockRequestTimes.erase(txHash);
 }
 
 uint256 CConsensusVote::GetHash() const
@@ -458,10 +636,6 @@ uint256 CConsensusVote::GetHash() const
 
 bool CConsensusVote::SignatureValid()
 {
-    std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
-    //LogPrintf("verify strMessage %s \n", strMessage.c_str());
-
     CMasternode* pmn = mnodeman.Find(vinMasternode);
 
     if (pmn == NULL) {
@@ -469,7 +643,15 @@ bool CConsensusVote::SignatureValid()
         return false;
     }
 
-    if (!masternodeSigner.VerifyMessage(pmn->pubKeyMasternode, vchMasterNodeSignature, strMessage, errorMessage)) {
+    return SignatureValid(pmn->pubKeyMasternode);
+}
+
+bool CConsensusVote::SignatureValid(const CPubKey& pubKeyMasternode)
+{
+    std::string errorMessage;
+    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+
+    if (!masternodeSigner.VerifyMessage(pubKeyMasternode, vchMasterNodeSignature, strMessage, errorMessage)) {
         LogPrintf("SwiftTX::CConsensusVote::SignatureValid() - Verify message failed\n");
         return false;
     }
@@ -530,12 +712,12 @@ bool CTransactionLock::SignaturesValid()
     return true;
 }
 
-void CTransactionLock::AddSignature(CConsensusVote& cv)
+void CTransactionLock::AddSignature(const CConsensusVote& cv)
 {
     vecConsensusVotes.push_back(cv);
 }
 
-int CTransactionLock::CountSignatures()
+int CTransactionLock::CountSignatures() const
 {
     /*
         Only count signatures where the BlockHeight matches the transaction's blockheight.
@@ -545,10 +727,249 @@ int CTransactionLock::CountSignatures()
     if (nBlockHeight == 0) return -1;
 
     int n = 0;
-    BOOST_FOREACH (CConsensusVote v, vecConsensusVotes) {
+    BOOST_FOREACH (const CConsensusVote& v, vecConsensusVotes) {
         if (v.nBlockHeight == nBlockHeight) {
             n++;
         }
     }
     return n;
 }
+
+bool CTransactionLockManager::HasRequest(const uint256& txHash) const
+{
+    LOCK(cs);
+    return mapRequests.count(txHash);
+}
+
+bool CTransactionLockManager::GetRequest(const uint256& txHash, CTransaction& tx) const
+{
+    LOCK(cs);
+    RequestMap::const_iterator it = mapRequests.find(txHash);
+    if (it == mapRequests.end())
+        return false;
+    tx = it->second;
+    return true;
+}
+
+bool CTransactionLockManager::IsRejected(const uint256& txHash) const
+{
+    LOCK(cs);
+    return mapRejectedRequests.count(txHash);
+}
+
+void CTransactionLockManager::AddRequest(const CTransaction& tx)
+{
+    LOCK(cs);
+    mapRequests.insert(make_pair(tx.GetHash(), tx));
+}
+
+void CTransactionLockManager::AddRejectedRequest(const CTransaction& tx)
+{
+    LOCK(cs);
+    mapRejectedRequests.insert(make_pair(tx.GetHash(), tx));
+}
+
+bool CTransactionLockManager::HasVote(const uint256& nVoteHash) const
+{
+    LOCK(cs);
+    return mapVotes.count(nVoteHash);
+}
+
+bool CTransactionLockManager::GetVote(const uint256& nVoteHash, CConsensusVote& vote) const
+{
+    LOCK(cs);
+    boost::unordered_map<uint256, CConsensusVote, CSwiftTXHasher>::const_iterator it = mapVotes.find(nVoteHash);
+    if (it == mapVotes.end())
+        return false;
+    vote = it->second;
+    return true;
+}
+
+bool CTransactionLockManager::AddVote(const CConsensusVote& vote)
+{
+    LOCK(cs);
+    return mapVotes.insert(make_pair(vote.GetHash(), vote)).second;
+}
+
+void CTransactionLockManager::SetExpiration(CTransactionLock& lock, int64_t nExpiration)
+{
+    lock.nExpiration = nExpiration;
+    heapExpiry.push(make_pair(nExpiration, lock.txHash));
+}
+
+void CTransactionLockManager::CreateLock(const uint256& txHash, int nBlockHeight)
+{
+    LOCK(cs);
+    boost::unordered_map<uint256, CTransactionLock, CSwiftTXHasher>::iterator it = mapLocks.find(txHash);
+    if (it != mapLocks.end()) {
+        it->second.nBlockHeight = nBlockHeight;
+        LogPrint("swifttx", "CreateNewLock - Transaction Lock Exists %s !\n", txHash.ToString().c_str());
+        return;
+    }
+
+    LogPrintf("CreateNewLock - New Transaction Lock %s !\n", txHash.ToString().c_str());
+
+    CTransactionLock& lock = mapLocks[txHash];
+    lock.nBlockHeight = nBlockHeight;
+    lock.nTimeout = GetTime() + (60 * 5);
+    lock.txHash = txHash;
+    SetExpiration(lock, GetTime() + (60 * 60)); //locks expire after 60 minutes (24 confirmations)
+}
+
+int CTransactionLockManager::AddLockSignature(const CConsensusVote& vote)
+{
+    LOCK(cs);
+    boost::unordered_map<uint256, CTransactionLock, CSwiftTXHasher>::iterator it = mapLocks.find(vote.txHash);
+    if (it == mapLocks.end()) {
+        LogPrintf("SwiftTX::ProcessConsensusVote - New Transaction Lock %s !\n", vote.txHash.ToString().c_str());
+
+        CTransactionLock& lock = mapLocks[vote.txHash];
+        lock.nBlockHeight = 0;
+        lock.nTimeout = GetTime() + (60 * 5);
+        lock.txHash = vote.txHash;
+        SetExpiration(lock, GetTime() + (60 * 60));
+        it = mapLocks.find(vote.txHash);
+    } else
+        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", vote.txHash.ToString().c_str());
+
+    it->second.AddSignature(vote);
+    return it->second.CountSignatures();
+}
+
+int CTransactionLockManager::CountSignatures(const uint256& txHash) const
+{
+    LOCK(cs);
+    boost::unordered_map<uint256, CTransactionLock, CSwiftTXHasher>::const_iterator it = mapLocks.find(txHash);
+    if (it == mapLocks.end())
+        return -1;
+    return it->second.CountSignatures();
+}
+
+bool CTransactionLockManager::IsLockTimedOut(const uint256& txHash) const
+{
+    LOCK(cs);
+    boost::unordered_map<uint256, CTransactionLock, CSwiftTXHasher>::const_iterator it = mapLocks.find(txHash);
+    return it != mapLocks.end() && GetTime() > it->second.nTimeout;
+}
+
+size_t CTransactionLockManager::CountLocks() const
+{
+    LOCK(cs);
+    return mapLocks.size();
+}
+
+void CTransactionLockManager::LockInputs(const CTransaction& tx)
+{
+    LOCK(cs);
+    BOOST_FOREACH (const CTxIn& in, tx.vin)
+        mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
+}
+
+bool CTransactionLockManager::IsConflicting(const CTransaction& tx, uint256& hashLock) const
+{
+    LOCK(cs);
+    BOOST_FOREACH (const CTxIn& in, tx.vin) {
+        boost::unordered_map<COutPoint, uint256, CSwiftTXHasher>::const_iterator it = mapLockedInputs.find(in.prevout);
+        if (it != mapLockedInputs.end() && it->second != tx.GetHash()) {
+            hashLock = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CTransactionLockManager::CheckForConflictingLocks(const CTransaction& tx)
+{
+    /*
+        It's possible (very unlikely though) to get 2 conflicting transaction locks approved by the network.
+        In that case, they will cancel each other out.
+
+        Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
+        rescan the blocks and find they're acceptable and then take the chain with the most work.
+    */
+    LOCK(cs);
+    uint256 hashLock;
+    if (!IsConflicting(tx, hashLock))
+        return false;
+
+    LogPrintf("SwiftTX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), hashLock.ToString().c_str());
+    boost::unordered_map<uint256, CTransactionLock, CSwiftTXHasher>::iterator it = mapLocks.find(tx.GetHash());
+    if (it != mapLocks.end()) SetExpiration(it->second, GetTime());
+    it = mapLocks.find(hashLock);
+    if (it != mapLocks.end()) SetExpiration(it->second, GetTime());
+    return true;
+}
+
+bool CTransactionLockManager::CheckUnknownVote(const CConsensusVote& vote)
+{
+    //Spam/Dos protection
+    /*
+        Masternodes will sometimes propagate votes before the transaction is known to the client.
+        This tracks those messages and allows it at the same rate of the rest of the network, if
+        a peer violates it, it will simply be ignored
+    */
+    LOCK(cs);
+    const uint256& hashMasternode = vote.vinMasternode.prevout.hash;
+    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.find(hashMasternode);
+    if (it == mapUnknownVotes.end()) {
+        it = mapUnknownVotes.insert(make_pair(hashMasternode, GetTime() + (60 * 10))).first;
+        nUnknownVoteTimeTotal += it->second;
+    }
+
+    int64_t nAverage = nUnknownVoteTimeTotal / (int64_t)mapUnknownVotes.size();
+    if (it->second > GetTime() && it->second - nAverage > 60 * 10)
+        return false;
+
+    nUnknownVoteTimeTotal += GetTime() + (60 * 10) - it->second;
+    it->second = GetTime() + (60 * 10);
+    return true;
+}
+
+void CTransactionLockManager::RemoveExpired(std::vector<uint256>& vRemoved)
+{
+    LOCK(cs);
+    int64_t nNow = GetTime();
+    while (!heapExpiry.empty() && heapExpiry.top().first < nNow) {
+        uint256 txHash = heapExpiry.top().second;
+        int64_t nExpiration = heapExpiry.top().first;
+        heapExpiry.pop();
+
+        boost::unordered_map<uint256, CTransactionLock, CSwiftTXHasher>::iterator it = mapLocks.find(txHash);
+        if (it == mapLocks.end() || it->second.nExpiration != nExpiration)
+            continue;
+
+        LogPrintf("Removing old transaction lock %s\n", txHash.ToString().c_str());
+
+        RequestMap::iterator itRequest = mapRequests.find(txHash);
+        if (itRequest != mapRequests.end()) {
+            BOOST_FOREACH (const CTxIn& in, itRequest->second.vin)
+                mapLockedInputs.erase(in.prevout);
+
+            mapRequests.erase(itRequest);
+            mapRejectedRequests.erase(txHash);
+
+            BOOST_FOREACH (const CConsensusVote& v, it->second.vecConsensusVotes)
+                mapVotes.erase(v.GetHash());
+        }
+
+        mapLocks.erase(it);
+        vRemoved.push_back(txHash);
+    }
+
+    // a masternode whose deadline passed is treated like one we never saw
+    std::map<uint256, int64_t>::iterator itVote = mapUnknownVotes.begin();
+    while (itVote != mapUnknownVotes.end()) {
+        if (itVote->second < nNow) {
+            nUnknownVoteTimeTotal -= itVote->second;
+            mapUnknownVotes.erase(itVote++);
+        } else {
+            ++itVote;
+        }
+    }
+}
+
+size_t CTransactionLockManager::CountUnknownVoters() const
+{
+    LOCK(cs);
+    return mapUnknownVotes.size();
+}
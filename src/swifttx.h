@@ -14,6 +14,10 @@
 #include "sync.h"
 #include "util.h"
 
+#include <queue>
+
+#include <boost/unordered_map.hpp>
+
 /*
     At 15 signatures, 1/2 of the masternode network can be owned by
     one party without comprimising the security of SwiftTX
@@ -32,14 +36,17 @@ using namespace boost;
 class CConsensusVote;
 class CTransaction;
 class CTransactionLock;
+class CTransactionLockManager;
 
 static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
-
-extern map<uint256, CTransaction> mapTxLockReq;
-extern map<uint256, CTransaction> mapTxLockReqRejected;
-extern map<uint256, CConsensusVote> mapTxLockVote;
-extern map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
+//! Default for -swifttxthreads, threads verifying consensus votes off the message handler
+static const int DEFAULT_SWIFTTX_THREADS = 2;
+//! Most vote batches waiting for a verification thread before votes are verified inline
+static const unsigned int MAX_SWIFTTX_VOTE_BATCHES = 1000;
+//! Block heights whose masternode ranks are kept for vote verification
+static const unsigned int SWIFTTX_RANK_HEIGHTS = 10;
+
+extern CTransactionLockManager txLockManager;
 extern int nCompleteTXLocks;
 
 
@@ -47,21 +54,40 @@ int64_t CreateNewLock(CTransaction tx);
 
 bool IsIXTXValid(const CTransaction& txCollateral);
 
-// if two conflicting locks are approved by the network, they will cancel out
-bool CheckForConflictingLocks(CTransaction& tx);
-
 void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
 //check if we need to vote on this transaction
 void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
 
-//process consensus vote message
-bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
+//process consensus vote message, with the rank and signature checks already done
+bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx, int nRank, bool fSignatureValid);
+
+//hand a received consensus vote to the SwiftTX threads, or verify and apply it
+//right away when they don't run or are busy
+void QueueConsensusVote(CNode* pfrom, const CConsensusVote& ctx);
+
+//apply the consensus votes verified by the SwiftTX threads, called by the message handler
+void ProcessVerifiedConsensusVotes();
+
+void StartSwiftTXThreads(int nThreads);
+void StopSwiftTXThreads();
 
 // keep transaction locks in memory for an hour
 void CleanTransactionLocksList();
 
-int64_t GetAverageVoteTime();
+/** Vote verification and lock completion counters */
+struct CSwiftTXStats {
+    uint64_t nVotesVerified;
+    uint64_t nVotesPending;
+    uint64_t nLocksCompleted;
+    int64_t nLastLatencyMillis;
+    int64_t nMaxLatencyMillis;
+    int64_t nTotalLatencyMillis;
+
+    CSwiftTXStats() : nVotesVerified(0), nVotesPending(0), nLocksCompleted(0), nLastLatencyMillis(0), nMaxLatencyMillis(0), nTotalLatencyMillis(0) {}
+};
+
+CSwiftTXStats GetSwiftTXStats();
 
 class CConsensusVote
 {
@@ -74,6 +100,7 @@ public:
     uint256 GetHash() const;
 
     bool SignatureValid();
+    bool SignatureValid(const CPubKey& pubKeyMasternode);
     bool Sign();
 
     ADD_SERIALIZE_METHODS;
@@ -98,8 +125,8 @@ public:
     int nTimeout;
 
     bool SignaturesValid();
-    int CountSignatures();
-    void AddSignature(CConsensusVote& cv);
+    int CountSignatures() const;
+    void AddSignature(const CConsensusVote& cv);
 
     uint256 GetHash()
     {
@@ -107,5 +134,87 @@ public:
     }
 };
 
+/**
+ * Hashes for the lock manager maps. Peers choose the txids and vote hashes
+ * that go into them, so the hash is salted per map to keep them from filling
+ * a single bucket.
+ */
+class CSwiftTXHasher
+{
+private:
+    uint256 salt;
+
+public:
+    CSwiftTXHasher();
+
+    size_t operator()(const uint256& hash) const { return hash.GetHash(salt); }
+    size_t operator()(const COutPoint& out) const { return out.hash.GetHash(salt) ^ out.n; }
+};
+
+/**
+ * All SwiftTX lock state: the lock requests and votes seen, the locks being
+ * voted on and the inputs of complete locks. Everything is indexed by txid,
+ * vote hash or outpoint, and locks expire from a heap ordered by expiry time
+ * instead of a scan over all of them.
+ */
+class CTransactionLockManager
+{
+private:
+    typedef boost::unordered_map<uint256, CTransaction, CSwiftTXHasher> RequestMap;
+    typedef std::pair<int64_t, uint256> ExpiryEntry;
+
+    mutable CCriticalSection cs;
+    RequestMap mapRequests;
+    RequestMap mapRejectedRequests;
+    boost::unordered_map<uint256, CConsensusVote, CSwiftTXHasher> mapVotes;
+    boost::unordered_map<uint256, CTransactionLock, CSwiftTXHasher> mapLocks;
+    boost::unordered_map<COutPoint, uint256, CSwiftTXHasher> mapLockedInputs;
+    //! Locks by expiry time; an entry is stale when the lock expiry changed since
+    std::priority_queue<ExpiryEntry, std::vector<ExpiryEntry>, std::greater<ExpiryEntry> > heapExpiry;
+    //! Vote deadline per masternode for votes on unknown transactions, and their sum
+    std::map<uint256, int64_t> mapUnknownVotes;
+    int64_t nUnknownVoteTimeTotal;
+
+    void SetExpiration(CTransactionLock& lock, int64_t nExpiration);
+
+public:
+    CTransactionLockManager() : nUnknownVoteTimeTotal(0) {}
+
+    bool HasRequest(const uint256& txHash) const;
+    bool GetRequest(const uint256& txHash, CTransaction& tx) const;
+    bool IsRejected(const uint256& txHash) const;
+    void AddRequest(const CTransaction& tx);
+    void AddRejectedRequest(const CTransaction& tx);
+
+    bool HasVote(const uint256& nVoteHash) const;
+    bool GetVote(const uint256& nVoteHash, CConsensusVote& vote) const;
+    //! Remember a vote, false if it was seen before
+    bool AddVote(const CConsensusVote& vote);
+
+    //! Start the lock for txHash, or move an existing one to nBlockHeight
+    void CreateLock(const uint256& txHash, int nBlockHeight);
+    //! Add a vote to its lock and return the lock's signature count
+    int AddLockSignature(const CConsensusVote& vote);
+    //! Signatures of the lock for txHash, -1 if there is none
+    int CountSignatures(const uint256& txHash) const;
+    bool IsLockTimedOut(const uint256& txHash) const;
+    size_t CountLocks() const;
+
+    void LockInputs(const CTransaction& tx);
+    //! Whether an input of tx is locked by another transaction, which is returned in hashLock
+    bool IsConflicting(const CTransaction& tx, uint256& hashLock) const;
+    //! If two conflicting locks are approved by the network, they cancel out
+    bool CheckForConflictingLocks(const CTransaction& tx);
+
+    //! Track votes for unknown transactions, false if the masternode is spamming them
+    bool CheckUnknownVote(const CConsensusVote& vote);
+
+    //! Masternodes tracked for votes on unknown transactions
+    size_t CountUnknownVoters() const;
+
+    //! Remove the expired locks with their request, votes and locked inputs, and passed unknown-vote deadlines
+    void RemoveExpired(std::vector<uint256>& vRemoved);
+};
+
 
 #endif
@@ -6,12 +6,84 @@
 
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 
+#include <algorithm>
 #include <stdio.h>
 
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+//
+// Lock-wait accounting
+//
+
+static boost::mutex& LockStatsRegistryMutex()
+{
+    static boost::mutex mutex;
+    return mutex;
+}
+
+static std::vector<const CInstrumentedCriticalSection*>& LockStatsRegistry()
+{
+    static std::vector<const CInstrumentedCriticalSection*> vRegistry;
+    return vRegistry;
+}
+
+CInstrumentedCriticalSection::CInstrumentedCriticalSection(const std::string& strNameIn) : strName(strNameIn),
+                                                                                            nAcquisitions(0),
+                                                                                            nContentions(0),
+                                                                                            nWaitMicros(0),
+                                                                                            nMaxWaitMicros(0)
+{
+    boost::lock_guard<boost::mutex> guard(LockStatsRegistryMutex());
+    LockStatsRegistry().push_back(this);
+}
+
+CInstrumentedCriticalSection::~CInstrumentedCriticalSection()
+{
+    boost::lock_guard<boost::mutex> guard(LockStatsRegistryMutex());
+    std::vector<const CInstrumentedCriticalSection*>& vRegistry = LockStatsRegistry();
+    vRegistry.erase(std::remove(vRegistry.begin(), vRegistry.end(), this), vRegistry.end());
+}
+
+void CInstrumentedCriticalSection::lock()
+{
+    nAcquisitions.fetch_add(1, boost::memory_order_relaxed);
+    if (CCriticalSection::try_lock())
+        return;
+
+    int64_t nStart = GetTimeMicros();
+    CCriticalSection::lock();
+    uint64_t nWait = GetTimeMicros() - nStart;
+
+    nContentions.fetch_add(1, boost::memory_order_relaxed);
+    nWaitMicros.fetch_add(nWait, boost::memory_order_relaxed);
+    // only the lock holder writes the maximum, so a plain compare is enough
+    if (nWait > nMaxWaitMicros.load(boost::memory_order_relaxed))
+        nMaxWaitMicros.store(nWait, boost::memory_order_relaxed);
+}
+
+CLockContentionInfo CInstrumentedCriticalSection::GetContentionInfo() const
+{
+    CLockContentionInfo info;
+    info.strName = strName;
+    info.nAcquisitions = nAcquisitions.load(boost::memory_order_relaxed);
+    info.nContentions = nContentions.load(boost::memory_order_relaxed);
+    info.nWaitMicros = nWaitMicros.load(boost::memory_order_relaxed);
+    info.nMaxWaitMicros = nMaxWaitMicros.load(boost::memory_order_relaxed);
+    return info;
+}
+
+std::vector<CLockContentionInfo> GetLockContentionInfo()
+{
+    std::vector<CLockContentionInfo> vInfo;
+    boost::lock_guard<boost::mutex> guard(LockStatsRegistryMutex());
+    BOOST_FOREACH (const CInstrumentedCriticalSection* pcs, LockStatsRegistry())
+        vInfo.push_back(pcs->GetContentionInfo());
+    return vInfo;
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
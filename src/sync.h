@@ -8,6 +8,12 @@
 
 #include "threadsafety.h"
 
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/atomic.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -83,6 +89,41 @@ typedef AnnotatedMixin<boost::recursive_mutex> CCriticalSection;
 /** Wrapped boost mutex: supports waiting but not recursive locking */
 typedef AnnotatedMixin<boost::mutex> CWaitableCriticalSection;
 
+/** Point-in-time copy of the wait counters of one instrumented critical section */
+struct CLockContentionInfo {
+    std::string strName;
+    uint64_t nAcquisitions;
+    uint64_t nContentions;
+    uint64_t nWaitMicros;
+    uint64_t nMaxWaitMicros;
+};
+
+/**
+ * Recursive critical section that measures how long callers wait to enter it.
+ * Every live instance is registered by name and reported by getlockstats.
+ * The uncontended path costs a single try_lock.
+ */
+class CInstrumentedCriticalSection : public CCriticalSection
+{
+private:
+    std::string strName;
+    boost::atomic<uint64_t> nAcquisitions;
+    boost::atomic<uint64_t> nContentions;
+    boost::atomic<uint64_t> nWaitMicros;
+    boost::atomic<uint64_t> nMaxWaitMicros;
+
+public:
+    explicit CInstrumentedCriticalSection(const std::string& strNameIn);
+    ~CInstrumentedCriticalSection();
+
+    void lock() EXCLUSIVE_LOCK_FUNCTION();
+
+    CLockContentionInfo GetContentionInfo() const;
+};
+
+/** Wait counters of all registered instrumented critical sections */
+std::vector<CLockContentionInfo> GetLockContentionInfo();
+
 /** Just a typedef for boost::condition_variable, can be wrapped later if desired */
 typedef boost::condition_variable CConditionVariable;
 
@@ -156,9 +197,28 @@ public:
 
 typedef CMutexLock<CCriticalSection> CCriticalBlock;
 
-#define LOCK(cs) CCriticalBlock criticalblock(cs, #cs, __FILE__, __LINE__)
-#define LOCK2(cs1, cs2) CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__), criticalblock2(cs2, #cs2, __FILE__, __LINE__)
-#define TRY_LOCK(cs, name) CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true)
+/** Two lock guards in one declaration, taken in argument order, so LOCK2 stays a single statement. */
+template <typename Mutex1, typename Mutex2>
+class CMutexLock2
+{
+private:
+    CMutexLock<Mutex1> lock1;
+    CMutexLock<Mutex2> lock2;
+
+public:
+    CMutexLock2(Mutex1& mutex1, const char* pszName1, Mutex2& mutex2, const char* pszName2, const char* pszFile, int nLine)
+        : lock1(mutex1, pszName1, pszFile, nLine), lock2(mutex2, pszName2, pszFile, nLine) {}
+};
+
+//! Lock guard matching the static type of the locked object, so that critical
+//! sections derived from CCriticalSection keep their own lock() behaviour.
+#define CRITICAL_BLOCK_TYPE(cs) CMutexLock<std::remove_reference<decltype(cs)>::type>
+
+#define LOCK(cs) CRITICAL_BLOCK_TYPE(cs) criticalblock(cs, #cs, __FILE__, __LINE__)
+#define LOCK2(cs1, cs2)                                                                                                           \
+    CMutexLock2<std::remove_reference<decltype(cs1)>::type, std::remove_reference<decltype(cs2)>::type> criticalblock12(cs1, #cs1, \
+        cs2, #cs2, __FILE__, __LINE__)
+#define TRY_LOCK(cs, name) CRITICAL_BLOCK_TYPE(cs) name(cs, #cs, __FILE__, __LINE__, true)
 
 #define ENTER_CRITICAL_SECTION(cs)                            \
     {                                                         \
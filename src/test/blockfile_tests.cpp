@@ -0,0 +1,114 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilecache.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfile_tests)
+
+static std::vector<char> Serialized(const CBlock& block)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    return std::vector<char>(ss.begin(), ss.end());
+}
+
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    const CBlock& genesis = Params().GenesisBlock();
+    std::vector<char> vch = Serialized(genesis);
+
+    CSpanReader reader(begin_ptr(vch), begin_ptr(vch) + vch.size(), SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    reader >> block;
+    BOOST_CHECK(block.GetHash() == genesis.GetHash());
+    BOOST_CHECK(reader.empty());
+
+    uint32_t n;
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(mapped_and_stdio_reads_agree)
+{
+    const CBlock& genesis = Params().GenesisBlock();
+    std::vector<char> vchExpected = Serialized(genesis);
+
+    // A file that grows after it was first mapped
+    CDiskBlockPos pos1(99, 0);
+    CBlock block(genesis);
+    BOOST_CHECK(WriteBlockToDisk(block, pos1));
+
+    int nMaxFiles = blockFileCache.GetMaxFiles();
+    for (int nMaps = 0; nMaps <= 1; nMaps++) {
+        blockFileCache.SetMaxFiles(nMaps);
+
+        CBlock blockRead;
+        BOOST_CHECK(ReadBlockFromDisk(blockRead, pos1));
+        BOOST_CHECK(blockRead.GetHash() == genesis.GetHash());
+
+        std::vector<char> vchRaw;
+        BOOST_CHECK(ReadRawBlockFromDisk(vchRaw, pos1));
+        BOOST_CHECK(vchRaw == vchExpected);
+    }
+
+    CDiskBlockPos pos2(99, pos1.nPos + vchExpected.size());
+    BOOST_CHECK(WriteBlockToDisk(block, pos2));
+    BOOST_CHECK(pos2.nPos == pos1.nPos + vchExpected.size() + BLOCKFILE_RECORD_HEADER_SIZE);
+
+    CBlockFileSpan span;
+    BOOST_CHECK(blockFileCache.GetRecord(pos2, "blk", 0, span));
+    BOOST_CHECK(std::vector<char>(span.begin(), span.end()) == vchExpected);
+
+    std::vector<char> vchRaw;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchRaw, pos2));
+    BOOST_CHECK(vchRaw == vchExpected);
+
+    // Positions that aren't preceded by a record header are not served from the mapping
+    BOOST_CHECK(!blockFileCache.GetRecord(CDiskBlockPos(99, pos1.nPos + 1), "blk", 0, span));
+    BOOST_CHECK(!blockFileCache.GetRecord(CDiskBlockPos(99, 4), "blk", 0, span));
+
+    blockFileCache.Invalidate(99);
+    blockFileCache.SetMaxFiles(0);
+    BOOST_CHECK(!blockFileCache.GetRecord(pos2, "blk", 0, span));
+    BOOST_CHECK(ReadRawBlockFromDisk(vchRaw, pos2));
+    BOOST_CHECK(vchRaw == vchExpected);
+
+    blockFileCache.SetMaxFiles(nMaxFiles);
+    boost::filesystem::remove(GetBlockPosFilename(pos1, "blk"));
+}
+
+BOOST_AUTO_TEST_CASE(raw_block_matches_index)
+{
+    const CBlock& genesis = Params().GenesisBlock();
+    CDiskBlockPos pos(98, 0);
+    CBlock block(genesis);
+    BOOST_CHECK(WriteBlockToDisk(block, pos));
+
+    uint256 hash = genesis.GetHash();
+    CBlockIndex index(genesis);
+    index.phashBlock = &hash;
+    index.nFile = pos.nFile;
+    index.nDataPos = pos.nPos;
+    index.nStatus |= BLOCK_HAVE_DATA;
+
+    std::vector<char> vchRaw;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchRaw, &index));
+    BOOST_CHECK(vchRaw == Serialized(genesis));
+
+    // Bytes that belong to another block are not handed out as this one
+    uint256 hashOther = 1;
+    index.phashBlock = &hashOther;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchRaw, &index));
+
+    blockFileCache.Invalidate(98);
+    boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 
 
 
+#include "chainparams.h"
 #include "clientversion.h"
 #include "main.h"
 #include "utiltime.h"
@@ -66,4 +67,32 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(context_free_checks_are_cached)
+{
+    CBlock block(Params().GenesisBlock());
+    block.fChecked = block.fSignatureChecked = false;
+    CValidationState state;
+
+    // Only a full check marks the block
+    BOOST_CHECK(CheckBlockContextFree(block, state, false, true));
+    BOOST_CHECK(!block.fChecked);
+    BOOST_CHECK(CheckBlockContextFree(block, state));
+    BOOST_CHECK(block.fChecked);
+
+    BOOST_CHECK(!block.fSignatureChecked);
+    BOOST_CHECK(block.CheckBlockSignature());
+    BOOST_CHECK(block.fSignatureChecked);
+
+    block.SetNull();
+    BOOST_CHECK(!block.fChecked);
+    BOOST_CHECK(!block.fSignatureChecked);
+
+    // A failing block is not marked
+    CBlock bad(Params().GenesisBlock());
+    bad.fChecked = false;
+    bad.hashMerkleRoot = uint256(1);
+    BOOST_CHECK(!CheckBlockContextFree(bad, state, false, true));
+    BOOST_CHECK(!bad.fChecked);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
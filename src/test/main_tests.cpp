@@ -6,6 +6,7 @@
 
 #include "primitives/transaction.h"
 #include "main.h"
+#include "random.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -26,4 +27,51 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 50000000000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(assumevalid_test)
+{
+    LOCK(cs_main);
+    uint256 hashAssumeValidOld = hashAssumeValid;
+    CBlockIndex* pindexBestHeaderOld = pindexBestHeader;
+
+    // a chain of 10 blocks and a fork off it at height 3
+    std::vector<uint256> vHash(15);
+    std::vector<CBlockIndex> vIndex(15);
+    for (int i = 0; i < 15; i++) {
+        vHash[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].pprev = i == 0 ? NULL : i == 10 ? &vIndex[3] : &vIndex[i - 1];
+        vIndex[i].nHeight = vIndex[i].pprev ? vIndex[i].pprev->nHeight + 1 : 0;
+        vIndex[i].BuildSkip();
+        mapBlockIndex[vHash[i]] = &vIndex[i];
+    }
+    pindexBestHeader = &vIndex[9];
+
+    // no -assumevalid: nothing is skipped
+    hashAssumeValid = 0;
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[2], 2));
+
+    // ancestors of the assumed-valid block are skipped, the block itself too, later blocks are not
+    hashAssumeValid = vHash[6];
+    BOOST_CHECK(IsBlockAssumedValid(vHash[2], 2));
+    BOOST_CHECK(IsBlockAssumedValid(vHash[6], 6));
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[7], 7));
+    // a block on a fork, or a hash at the wrong height, is checked
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[10], 4));
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[2], 3));
+
+    // the assumed-valid block must be on the best header chain
+    pindexBestHeader = &vIndex[14];
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[2], 2));
+
+    // an unknown assumed-valid block skips nothing
+    pindexBestHeader = &vIndex[9];
+    hashAssumeValid = GetRandHash();
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[2], 2));
+
+    for (int i = 0; i < 15; i++)
+        mapBlockIndex.erase(vHash[i]);
+    hashAssumeValid = hashAssumeValidOld;
+    pindexBestHeader = pindexBestHeaderOld;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
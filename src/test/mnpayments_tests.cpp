@@ -0,0 +1,121 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-payments.h"
+#include "streams.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(mnpayments_tests)
+
+static CScript MakePayee(unsigned char n)
+{
+    return CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+static CMasternodePaymentWinner MakeVote(int nVoter, int nBlockHeight, unsigned char nPayee)
+{
+    CMasternodePaymentWinner winner(CTxIn(COutPoint(uint256(nVoter + 1), nVoter)));
+    winner.nBlockHeight = nBlockHeight;
+    winner.AddPayee(MakePayee(nPayee));
+    winner.vchSig = std::vector<unsigned char>(65, nVoter);
+    return winner;
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_votes)
+{
+    CMasternodePaymentVoteStore votes;
+    std::map<uint256, CMasternodePaymentWinner> mapVotes;
+    for (int h = 110; h >= 100; h -= 2) {
+        for (int n = 0; n < 3; n++) {
+            CMasternodePaymentWinner winner = MakeVote(n, h, n == 2 ? 2 : 1);
+            BOOST_CHECK(votes.Add(winner));
+            mapVotes[winner.GetHash()] = winner;
+        }
+    }
+    BOOST_CHECK(!votes.Add(MakeVote(0, 100, 1)));
+    BOOST_CHECK(!votes.Add(MakeVote(0, 100 + MNPAYMENTS_VOTE_HEIGHTS_MAX, 1)));
+    BOOST_CHECK_EQUAL(votes.size(), 18U);
+
+    // Payee and signature come back from the bucket pools
+    CMasternodePaymentWinner winner;
+    BOOST_REQUIRE(votes.Get(MakeVote(2, 104, 2).GetHash(), winner));
+    BOOST_CHECK_EQUAL(winner.nBlockHeight, 104);
+    BOOST_CHECK(winner.payee == MakePayee(2));
+    BOOST_CHECK(winner.vchSig == std::vector<unsigned char>(65, 2));
+    BOOST_CHECK(winner.vinMasternode == MakeVote(2, 104, 2).vinMasternode);
+
+    std::vector<uint256> vHashes;
+    votes.GetRange(103, 106, vHashes);
+    BOOST_CHECK_EQUAL(vHashes.size(), 6U);
+
+    // Same format as the map mnpayments.dat used to hold
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << votes;
+    CDataStream ssMap(SER_DISK, CLIENT_VERSION);
+    ssMap << mapVotes;
+    BOOST_CHECK_EQUAL(ss.size(), ssMap.size());
+    std::map<uint256, CMasternodePaymentWinner> mapRead;
+    ss >> mapRead;
+    BOOST_CHECK(mapRead.size() == mapVotes.size());
+    CMasternodePaymentVoteStore votesRead;
+    ssMap >> votesRead;
+    BOOST_CHECK_EQUAL(votesRead.size(), 18U);
+
+    // Pruning drops whole heights
+    std::vector<uint256> vRemoved;
+    votes.Prune(104, vRemoved);
+    BOOST_CHECK_EQUAL(vRemoved.size(), 6U);
+    BOOST_CHECK_EQUAL(votes.size(), 12U);
+    BOOST_CHECK(!votes.Has(MakeVote(0, 102, 1).GetHash()));
+    BOOST_CHECK(votes.Has(MakeVote(0, 104, 1).GetHash()));
+    vHashes.clear();
+    votes.GetRange(0, 1000, vHashes);
+    BOOST_CHECK_EQUAL(vHashes.size(), 12U);
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_schedule)
+{
+    CMasternodePayments payments;
+    payments.mapMasternodeBlocks[101] = CMasternodeBlockPayees(101);
+    payments.mapMasternodeBlocks[101].AddPayee(MakePayee(1), 2);
+    payments.mapMasternodeBlocks[101].AddPayee(MakePayee(2), MNPAYMENTS_SIGNATURES_REQUIRED);
+    payments.mapMasternodeBlocks[120] = CMasternodeBlockPayees(120);
+    payments.mapMasternodeBlocks[120].AddPayee(MakePayee(3), 1);
+
+    CMasternodeScheduledPayee entry;
+    BOOST_CHECK(!payments.GetScheduledPayee(101, entry));
+
+    payments.UpdateSchedule(100);
+    BOOST_REQUIRE(payments.GetScheduledPayee(101, entry));
+    BOOST_CHECK(entry.fKnown);
+    BOOST_CHECK(entry.payee == MakePayee(2));
+    BOOST_CHECK_EQUAL(entry.nVotes, MNPAYMENTS_SIGNATURES_REQUIRED);
+    BOOST_REQUIRE_EQUAL(entry.vecRequired.size(), 1U);
+    BOOST_CHECK(entry.vecRequired[0] == MakePayee(2));
+
+    // Heights without votes are cached too, heights past the window are not
+    BOOST_REQUIRE(payments.GetScheduledPayee(102, entry));
+    BOOST_CHECK(!entry.fKnown);
+    BOOST_CHECK(!payments.GetScheduledPayee(120, entry));
+
+    std::vector<CMasternodeScheduledPayee> vecSchedule;
+    payments.GetSchedule(vecSchedule);
+    BOOST_CHECK_EQUAL(vecSchedule.size(), (size_t)MNPAYMENTS_SCHEDULE_BLOCKS + 1);
+
+    // Moving the window reuses the slots of the heights that left it
+    payments.UpdateSchedule(110);
+    BOOST_CHECK(!payments.GetScheduledPayee(101, entry));
+    BOOST_REQUIRE(payments.GetScheduledPayee(120, entry));
+    BOOST_CHECK(entry.payee == MakePayee(3));
+    BOOST_CHECK(entry.vecRequired.empty());
+
+    CScript payee;
+    BOOST_CHECK(payments.GetBlockPayee(120, payee));
+    BOOST_CHECK(payee == MakePayee(3));
+    BOOST_CHECK(payments.GetBlockPayee(101, payee));
+    BOOST_CHECK(payee == MakePayee(2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
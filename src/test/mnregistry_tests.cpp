@@ -0,0 +1,181 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "streams.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(mnregistry_tests)
+
+static CPubKey MakePubKey(unsigned char n)
+{
+    std::vector<unsigned char> vch(33, n);
+    vch[0] = 0x02;
+    return CPubKey(vch.begin(), vch.end());
+}
+
+static CMasternode MakeMasternode(int n)
+{
+    CMasternode mn;
+    mn.vin = CTxIn(COutPoint(uint256(n + 1), n));
+    mn.pubKeyCollateralAddress = MakePubKey(n + 1);
+    mn.pubKeyMasternode = MakePubKey(n + 101);
+    mn.sigTime = n;
+    return mn;
+}
+
+BOOST_AUTO_TEST_CASE(mnregistry_indexes)
+{
+    CMasternodeRegistry registry;
+    for (int n = 0; n < 10; n++)
+        BOOST_CHECK(registry.Add(MakeMasternode(n)) != NULL);
+    BOOST_CHECK(registry.Add(MakeMasternode(3)) == NULL);
+    BOOST_CHECK_EQUAL(registry.size(), 10U);
+
+    CMasternode* pmn = registry.FindByPayee(MakePubKey(5).GetID());
+    BOOST_REQUIRE(pmn != NULL);
+    BOOST_CHECK(pmn->vin.prevout == COutPoint(uint256(5), 4));
+    BOOST_CHECK(registry.FindByMasternodeKey(MakePubKey(105)) == pmn);
+
+    // The last entry takes the removed one's place and can still be found
+    registry.Remove(0);
+    BOOST_CHECK_EQUAL(registry.size(), 9U);
+    BOOST_CHECK_EQUAL(registry.Find(COutPoint(uint256(1), 0)), CMasternodeRegistry::npos);
+    BOOST_CHECK(registry.FindByPayee(MakePubKey(1).GetID()) == NULL);
+    BOOST_CHECK_EQUAL(registry.Find(COutPoint(uint256(10), 9)), 0U);
+    BOOST_CHECK(registry.FindByMasternodeKey(MakePubKey(110)) == &registry[0]);
+    BOOST_CHECK(registry.FindByPayee(MakePubKey(5).GetID()) == pmn);
+
+    // A changed key moves the entry in the index
+    pmn->pubKeyMasternode = MakePubKey(200);
+    pmn->protocolVersion = 1;
+    registry.Refresh(registry.Find(pmn->vin.prevout));
+    BOOST_CHECK(registry.FindByMasternodeKey(MakePubKey(105)) == NULL);
+    BOOST_CHECK(registry.FindByMasternodeKey(MakePubKey(200)) == pmn);
+    BOOST_CHECK_EQUAL(registry.GetProtocolVersion(registry.Find(pmn->vin.prevout)), 1);
+}
+
+BOOST_AUTO_TEST_CASE(mnregistry_shared_keys)
+{
+    // Masternodes sharing payee and masternode keys, added in an order that
+    // differs from their outpoints: the lookups return the lowest outpoint
+    // whatever the order in the index
+    int vOrder[] = {7, 2, 9, 4, 5};
+    CMasternodeRegistry registry;
+    for (int i = 0; i < 5; i++) {
+        CMasternode mn = MakeMasternode(vOrder[i]);
+        mn.pubKeyCollateralAddress = MakePubKey(1);
+        mn.pubKeyMasternode = MakePubKey(101);
+        registry.Add(mn);
+    }
+
+    CMasternode* pmn = registry.FindByPayee(MakePubKey(1).GetID());
+    BOOST_REQUIRE(pmn != NULL);
+    BOOST_CHECK(pmn->vin.prevout == COutPoint(uint256(3), 2));
+    BOOST_CHECK(registry.FindByMasternodeKey(MakePubKey(101)) == pmn);
+
+    registry.Remove(registry.Find(pmn->vin.prevout));
+    pmn = registry.FindByPayee(MakePubKey(1).GetID());
+    BOOST_REQUIRE(pmn != NULL);
+    BOOST_CHECK(pmn->vin.prevout == COutPoint(uint256(5), 4));
+    BOOST_CHECK(registry.FindByMasternodeKey(MakePubKey(101)) == pmn);
+}
+
+BOOST_AUTO_TEST_CASE(mnregistry_serialize)
+{
+    CMasternodeRegistry registry;
+    std::vector<CMasternode> vMasternodes;
+    for (int n = 0; n < 5; n++) {
+        registry.Add(MakeMasternode(n));
+        vMasternodes.push_back(MakeMasternode(n));
+    }
+
+    // Same format as the vector mncache.dat used to hold
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << registry;
+    CDataStream ssVector(SER_DISK, CLIENT_VERSION);
+    ssVector << vMasternodes;
+    BOOST_CHECK(ss.str() == ssVector.str());
+
+    CMasternodeRegistry registryRead;
+    ss >> registryRead;
+    BOOST_CHECK_EQUAL(registryRead.size(), 5U);
+    BOOST_CHECK(registryRead.FindByPayee(MakePubKey(3).GetID()) != NULL);
+}
+
+BOOST_AUTO_TEST_CASE(mnman_snapshot_invalidation)
+{
+    CMasternodeMan mnman;
+    CMasternode mn = MakeMasternode(1);
+    BOOST_REQUIRE(mnman.Add(mn));
+
+    // The snapshot is published with the change; reading it doesn't check the list
+    CMasternodeSnapshotRef pFirst = mnman.GetSnapshot();
+    BOOST_REQUIRE_EQUAL(pFirst->size(), 1U);
+    BOOST_CHECK((*pFirst)[0].IsEnabled());
+    BOOST_CHECK(mnman.GetSnapshot() == pFirst);
+
+    // Check(): without pings the entry is no longer enabled
+    mnman.Check();
+    CMasternodeSnapshotRef pChecked = mnman.GetSnapshot();
+    BOOST_CHECK(pChecked != pFirst);
+    BOOST_REQUIRE_EQUAL(pChecked->size(), 1U);
+    BOOST_CHECK(!(*pChecked)[0].IsEnabled());
+
+    // A change made through a Find() pointer is published after Refresh()
+    CMasternode* pmn = mnman.Find(mn.vin);
+    BOOST_REQUIRE(pmn != NULL);
+    pmn->protocolVersion = 12345;
+    mnman.Refresh(*pmn);
+    CMasternodeSnapshotRef pSecond = mnman.GetSnapshot();
+    BOOST_CHECK(pSecond != pChecked);
+    BOOST_CHECK_EQUAL((*pSecond)[0].protocolVersion, 12345);
+
+    mnman.Remove(mn.vin);
+    BOOST_CHECK(mnman.GetSnapshot()->empty());
+}
+
+BOOST_AUTO_TEST_CASE(mnman_asked_entries)
+{
+    CMasternodeMan mnman;
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+    int64_t nStart = 1500000000;
+
+    // a full list of entries we asked for takes no more until one may be asked again
+    SetMockTime(nStart);
+    for (int n = 0; n < MASTERNODES_MAX_ASKED_ENTRIES - 1; n++) {
+        CTxIn vin = MakeMasternode(n).vin;
+        mnman.AskForMN(&node, vin);
+    }
+    SetMockTime(nStart + 1);
+    CTxIn vinLater = MakeMasternode(MASTERNODES_MAX_ASKED_ENTRIES - 1).vin;
+    mnman.AskForMN(&node, vinLater);
+    CTxIn vinNew = MakeMasternode(MASTERNODES_MAX_ASKED_ENTRIES).vin;
+    mnman.AskForMN(&node, vinNew);
+    BOOST_CHECK_EQUAL(mnman.CountAskedEntries(), MASTERNODES_MAX_ASKED_ENTRIES);
+
+    // the entries asked for first are dropped, the one asked for later is kept
+    SetMockTime(nStart + MASTERNODE_MIN_MNP_SECONDS + 1);
+    mnman.AskForMN(&node, vinNew);
+    BOOST_CHECK_EQUAL(mnman.CountAskedEntries(), 2);
+
+    // and still expires before the new one after a round trip through mncache.dat
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mnman;
+    CMasternodeMan mnmanRead;
+    ss >> mnmanRead;
+    mnmanRead.CheckAndRemove();
+    BOOST_CHECK_EQUAL(mnmanRead.CountAskedEntries(), 2);
+    SetMockTime(nStart + MASTERNODE_MIN_MNP_SECONDS + 2);
+    mnmanRead.CheckAndRemove();
+    BOOST_CHECK_EQUAL(mnmanRead.CountAskedEntries(), 1);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-sync.h"
+#include "hash.h"
+#include "streams.h"
+#include "utilstrencodings.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(mnsync_tests)
+
+static std::vector<CInv> MakeInventory(int nBegin, int nEnd)
+{
+    std::vector<CInv> vInv;
+    for (int i = nBegin; i < nEnd; i++)
+        vInv.push_back(CInv(MSG_MASTERNODE_ANNOUNCE, Hash(BEGIN(i), END(i))));
+    return vInv;
+}
+
+BOOST_AUTO_TEST_CASE(mnsync_summary_missing)
+{
+    // We hold 990 of the peer's 1000 entries
+    std::vector<CInv> vTheirs = MakeInventory(0, 1000);
+    std::vector<CInv> vOurs = MakeInventory(10, 1000);
+    CSyncSummary ours(vOurs);
+    CSyncSummary theirs(vTheirs);
+
+    // Every missing entry is in a bucket that differs, and only few buckets do
+    int nDiffering = 0;
+    for (unsigned int i = 0; i < SYNC_SUMMARY_BUCKETS; i++)
+        if (!theirs.Matches(i, ours)) nDiffering++;
+    BOOST_CHECK(nDiffering > 0 && nDiffering <= 10);
+
+    int nAnnounced = 0;
+    for (unsigned int i = 0; i < vTheirs.size(); i++) {
+        bool fAnnounce = !theirs.Matches(CSyncSummary::Bucket(vTheirs[i].hash), ours);
+        if (i < 10) BOOST_CHECK(fAnnounce);
+        if (fAnnounce) nAnnounced++;
+    }
+    BOOST_CHECK(nAnnounced < 100);
+
+    // Identical sets announce nothing
+    CSyncSummary same(vTheirs);
+    for (unsigned int i = 0; i < SYNC_SUMMARY_BUCKETS; i++)
+        BOOST_CHECK(theirs.Matches(i, same));
+}
+
+BOOST_AUTO_TEST_CASE(mnsync_summary_serialize)
+{
+    CSyncSummary summary(MakeInventory(0, 50));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << summary;
+
+    CSyncSummary summary2;
+    ss >> summary2;
+    BOOST_CHECK(summary2.IsValid());
+    for (unsigned int i = 0; i < SYNC_SUMMARY_BUCKETS; i++)
+        BOOST_CHECK(summary2.Matches(i, summary));
+
+    summary2.vCount.resize(10);
+    BOOST_CHECK(!summary2.IsValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
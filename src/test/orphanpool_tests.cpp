@@ -0,0 +1,70 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "orphanpool.h"
+#include "primitives/transaction.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(orphanpool_tests)
+
+static CTransaction MakeObject(int n)
+{
+    CMutableTransaction tx;
+    tx.nLockTime = n;
+    return CTransaction(tx);
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_parents)
+{
+    size_t nSize = ::GetSerializeSize(MakeObject(0), SER_NETWORK, PROTOCOL_VERSION);
+    COrphanPool<CTransaction> pool(100 * nSize, 100 * nSize, 60);
+
+    // Three children of parent 1, one of parent 2
+    for (int n = 0; n < 3; n++)
+        BOOST_CHECK(pool.Add(MakeObject(n).GetHash(), uint256(1), MakeObject(n), 0, 1000));
+    BOOST_CHECK(pool.Add(MakeObject(3).GetHash(), uint256(2), MakeObject(3), 0, 1000));
+    BOOST_CHECK(!pool.Add(MakeObject(3).GetHash(), uint256(2), MakeObject(3), 1, 1000));
+    BOOST_CHECK_EQUAL(pool.size(), 4U);
+
+    std::vector<CTransaction> vObjs;
+    pool.TakeChildren(uint256(1), vObjs);
+    BOOST_REQUIRE_EQUAL(vObjs.size(), 3U);
+    BOOST_CHECK_EQUAL(vObjs[0].nLockTime, 0U);
+    BOOST_CHECK_EQUAL(vObjs[2].nLockTime, 2U);
+    BOOST_CHECK(!pool.HasChildren(uint256(1)));
+    BOOST_CHECK(pool.HasChildren(uint256(2)));
+    BOOST_CHECK_EQUAL(pool.GetStats().nBytes, nSize);
+
+    pool.Expire(1060);
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+    pool.Expire(1061);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nBytes, 0U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nPeers, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_limits)
+{
+    size_t nSize = ::GetSerializeSize(MakeObject(0), SER_NETWORK, PROTOCOL_VERSION);
+    COrphanPool<CTransaction> pool(4 * nSize, 2 * nSize, 60);
+
+    // A peer over its quota is refused, others are not
+    BOOST_CHECK(pool.Add(MakeObject(0).GetHash(), uint256(1), MakeObject(0), 0, 1000));
+    BOOST_CHECK(pool.Add(MakeObject(1).GetHash(), uint256(1), MakeObject(1), 0, 1000));
+    BOOST_CHECK(!pool.Add(MakeObject(2).GetHash(), uint256(1), MakeObject(2), 0, 1000));
+    BOOST_CHECK(pool.Add(MakeObject(3).GetHash(), uint256(1), MakeObject(3), 1, 1000));
+    BOOST_CHECK(pool.Add(MakeObject(4).GetHash(), uint256(1), MakeObject(4), ORPHAN_POOL_NO_PEER, 1000));
+    BOOST_CHECK_EQUAL(pool.GetStats().nRejected, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nPeers, 2U);
+
+    // A full pool makes room by dropping the oldest entry
+    BOOST_CHECK(pool.Add(MakeObject(5).GetHash(), uint256(2), MakeObject(5), 2, 1000));
+    BOOST_CHECK_EQUAL(pool.size(), 4U);
+    BOOST_CHECK(!pool.Remove(MakeObject(0).GetHash()));
+    BOOST_CHECK(pool.Remove(MakeObject(1).GetHash()));
+    BOOST_CHECK_EQUAL(pool.GetStats().nBytes, 3 * nSize);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,96 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "relaycache.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(relaycache_tests)
+
+static CInv MakeInv(int n)
+{
+    return CInv(MSG_TX, uint256(n));
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_add_get)
+{
+    CRelayCache cache;
+    std::string strCommand;
+    CRelayCache::DataRef data;
+
+    BOOST_CHECK(!cache.Get(MakeInv(1), strCommand, data));
+
+    std::vector<unsigned char> vch(100, 0x01);
+    CRelayCache::DataRef added = cache.Add(MakeInv(1), "tx", vch);
+    BOOST_CHECK(cache.Get(MakeInv(1), strCommand, data));
+    BOOST_CHECK_EQUAL(strCommand, "tx");
+    BOOST_CHECK(data == added);
+
+    // The first serialization is kept
+    std::vector<unsigned char> vchOther(50, 0x02);
+    BOOST_CHECK(cache.Add(MakeInv(1), "tx", vchOther) == added);
+
+    cache.Erase(MakeInv(1));
+    BOOST_CHECK(!cache.Get(MakeInv(1), strCommand, data));
+    // A reader still holding the bytes is not affected
+    BOOST_CHECK_EQUAL(added->size(), 101U);
+
+    CRelayCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 0U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 0U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_limits)
+{
+    SetMockTime(1000000);
+    CRelayCache cache;
+    cache.SetMaxSize(1000);
+    std::string strCommand;
+    CRelayCache::DataRef data;
+
+    // Each entry is 101 bytes, so only the last nine fit
+    std::vector<unsigned char> vch(100);
+    for (int i = 0; i < 20; i++)
+        cache.Add(MakeInv(i), "tx", vch);
+    BOOST_CHECK(!cache.Get(MakeInv(10), strCommand, data));
+    BOOST_CHECK(cache.Get(MakeInv(11), strCommand, data));
+    BOOST_CHECK(cache.Get(MakeInv(19), strCommand, data));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 9U);
+
+    SetMockTime(1000000 + RELAY_CACHE_EXPIRY + 1);
+    BOOST_CHECK(!cache.Get(MakeInv(19), strCommand, data));
+    cache.Add(MakeInv(20), "tx", vch);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 1U);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_erase_readd)
+{
+    SetMockTime(1000000);
+    CRelayCache cache;
+    cache.SetMaxSize(1000);
+    std::string strCommand;
+    CRelayCache::DataRef data;
+
+    std::vector<unsigned char> vch(100);
+    for (int i = 0; i < 9; i++)
+        cache.Add(MakeInv(i), "tx", vch);
+
+    // Erased and added again within the same second: the new entry is now the
+    // youngest, and the queue record of the erased one must not evict it
+    cache.Erase(MakeInv(0));
+    cache.Add(MakeInv(0), "tx", vch);
+    cache.Add(MakeInv(9), "tx", vch);
+    BOOST_CHECK(cache.Get(MakeInv(0), strCommand, data));
+    BOOST_CHECK(!cache.Get(MakeInv(1), strCommand, data));
+    BOOST_CHECK(cache.Get(MakeInv(2), strCommand, data));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 9U);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 909U);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
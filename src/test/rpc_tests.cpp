@@ -9,6 +9,7 @@
 #include "netbase.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
 
 #include <univalue.h>
@@ -195,4 +196,75 @@ BOOST_AUTO_TEST_CASE(rpc_boostasiotocnetaddr)
     BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("::ffff:127.0.0.1")).ToString(), "127.0.0.1");
 }
 
+static void AppendText(std::string* pstr, const std::string& strText)
+{
+    BOOST_CHECK(!strText.empty());
+    *pstr += strText;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_writers)
+{
+    UniValue val = ParseNonRFCJSONValue("{\"a\":[1,-2.5,\"x\\\"y\",true,null,[],{}],\"b\":{\"c\":{\"d\":[[]]}},\"e\":\"\"}");
+
+    // Any buffer size gives the same text as UniValue::write
+    for (size_t nBufferSize = 1; nBufferSize < 64; nBufferSize *= 2) {
+        std::string str;
+        JSONStreamWriter writer(boost::bind(&AppendText, &str, _1), nBufferSize);
+        writer.value(val);
+        writer.flush();
+        BOOST_CHECK_EQUAL(str, val.write());
+    }
+
+    // Written piece by piece
+    std::string str;
+    JSONStreamWriter stream(boost::bind(&AppendText, &str, _1), 4);
+    JSONTreeWriter tree;
+    JSONWriter* writers[] = {&stream, &tree};
+    for (unsigned int i = 0; i < 2; i++) {
+        JSONWriter* writer = writers[i];
+        writer->beginObject();
+        writer->key("list");
+        writer->beginArray();
+        for (int n = 0; n < 3; n++)
+            writer->value(n);
+        writer->value(val["b"]);
+        writer->endArray();
+        writer->key("empty");
+        writer->beginObject();
+        writer->endObject();
+        writer->endObject();
+    }
+    stream.flush();
+    std::string strExpected = "{\"list\":[0,1,2,{\"c\":{\"d\":[[]]}}],\"empty\":{}}";
+    BOOST_CHECK_EQUAL(str, strExpected);
+    BOOST_CHECK_EQUAL(tree.get().write(), strExpected);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_http_chunked)
+{
+    std::map<std::string, std::string> mapHeaders;
+    std::string strMessage;
+
+    std::istringstream chunked("Transfer-Encoding: chunked\r\n\r\n"
+                               "5\r\n[1,2,\r\n"
+                               "b;ext=1\r\n3,4,5,6,7]\n\r\n"
+                               "0\r\n"
+                               "\r\n");
+    BOOST_CHECK_EQUAL(ReadHTTPMessage(chunked, mapHeaders, strMessage, 1, 1000), HTTP_OK);
+    BOOST_CHECK_EQUAL(strMessage, "[1,2,3,4,5,6,7]\n");
+
+    // The size limit holds for the sum of the chunks
+    std::istringstream tooLarge("Transfer-Encoding: chunked\r\n\r\n"
+                                "5\r\n[1,2,\r\n"
+                                "b\r\n3,4,5,6,7]\n\r\n"
+                                "0\r\n"
+                                "\r\n");
+    BOOST_CHECK(ReadHTTPMessage(tooLarge, mapHeaders, strMessage, 1, 10) != HTTP_OK);
+
+    // Connection lost before the last chunk
+    std::istringstream truncated("Transfer-Encoding: chunked\r\n\r\n"
+                                 "5\r\n[1,2,\r\n");
+    BOOST_CHECK(ReadHTTPMessage(truncated, mapHeaders, strMessage, 1, 1000) != HTTP_OK);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "checkpoints.h"
+#include "main.h"
+#include "pow.h"
+#include "snapshot.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(snapshot_tests)
+
+// Connect a block with the transactions vtx on the tip, paying nothing to an anyone-can-spend coinbase
+static CTransaction ConnectTestBlock(const std::vector<CMutableTransaction>& vtx)
+{
+    LOCK(cs_main);
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.nTime = chainActive.Tip()->GetMedianTimePast() + 1;
+    block.nBits = GetNextWorkRequired(chainActive.Tip(), &block);
+
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].prevout.SetNull();
+    txCoinbase.vin[0].scriptSig = CScript() << chainActive.Height() + 1 << OP_0;
+    txCoinbase.vout.push_back(CTxOut(0, CScript() << OP_TRUE));
+    block.vtx.push_back(CTransaction(txCoinbase));
+    BOOST_FOREACH (const CMutableTransaction& tx, vtx)
+        block.vtx.push_back(CTransaction(tx));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlock(state, NULL, &block));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    return block.vtx[0];
+}
+
+BOOST_AUTO_TEST_CASE(dump_and_load)
+{
+    boost::filesystem::path path = GetDataDir() / "snapshot_tests.dat";
+    CSnapshotMetadata metadata;
+    std::string strError;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+    }
+
+    BOOST_CHECK(!DumpSnapshot(path, nHeight + 1, metadata, strError));
+    BOOST_CHECK(DumpSnapshot(path, nHeight, metadata, strError));
+    BOOST_CHECK_EQUAL(metadata.nHeight, nHeight);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(metadata.hashBlock == chainActive.Tip()->GetBlockHash());
+    }
+
+    // The snapshot hash is the one gettxoutsetinfo reports
+    CCoinsStats stats;
+    BOOST_CHECK(pcoinsdbview->GetStats(stats));
+    BOOST_CHECK(stats.hashSerialized == metadata.hashSerialized);
+    BOOST_CHECK_EQUAL(stats.nTransactions, metadata.nTransactions);
+
+    CBlockTreeDB* pblocktreeSaved = pblocktree;
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    {
+        CCoinsViewDB coinsdb(1 << 20, true);
+        BOOST_CHECK(LoadSnapshot(path, &coinsdb, strError));
+        BOOST_CHECK(coinsdb.GetBestBlock() == metadata.hashBlock);
+
+        CCoinsStats statsLoaded;
+        BOOST_CHECK(coinsdb.GetStats(statsLoaded));
+        BOOST_CHECK(statsLoaded.hashSerialized == metadata.hashSerialized);
+
+        CSnapshotMetadata metadataStored;
+        BOOST_CHECK(pblocktree->ReadSnapshot(metadataStored));
+        BOOST_CHECK(metadataStored.hashBlock == metadata.hashBlock);
+        BOOST_CHECK(metadataStored.hashSerialized == metadata.hashSerialized);
+    }
+
+    // A damaged file is rejected before anything is written
+    std::vector<char> vch;
+    {
+        std::ifstream in(path.string().c_str(), std::ios::binary);
+        vch.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    BOOST_REQUIRE(vch.size() > 100);
+    vch[vch.size() / 2] ^= 1;
+    {
+        std::ofstream out(path.string().c_str(), std::ios::binary | std::ios::trunc);
+        out.write(&vch[0], vch.size());
+    }
+    {
+        CCoinsViewDB coinsdb(1 << 20, true);
+        BOOST_CHECK(!LoadSnapshot(path, &coinsdb, strError));
+        BOOST_CHECK(coinsdb.GetBestBlock() == uint256(0));
+    }
+
+    delete pblocktree;
+    pblocktree = pblocktreeSaved;
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(dump_keeps_stake_spent)
+{
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    Checkpoints::fEnabled = false;
+
+    // a coinbase spent two blocks below the tip
+    CTransaction txCoinbase = ConnectTestBlock(std::vector<CMutableTransaction>());
+    for (int i = 0; i < Params().COINBASE_MATURITY(); i++)
+        ConnectTestBlock(std::vector<CMutableTransaction>());
+    CMutableTransaction txSpend;
+    txSpend.vin.push_back(CTxIn(COutPoint(txCoinbase.GetHash(), 0)));
+    txSpend.vout.push_back(CTxOut(0, CScript() << OP_TRUE));
+    ConnectTestBlock(std::vector<CMutableTransaction>(1, txSpend));
+    ConnectTestBlock(std::vector<CMutableTransaction>());
+    ConnectTestBlock(std::vector<CMutableTransaction>());
+
+    // A stake of the spent coinbase is accepted on a fork from below the
+    // spend, and rejected on the tip. Rolling the spend back for a snapshot
+    // below it doesn't change that.
+    CMutableTransaction txStake;
+    txStake.vin.push_back(txSpend.vin[0]);
+    txStake.vout.push_back(CTxOut(0, CScript()));
+    txStake.vout.push_back(CTxOut(0, CScript() << OP_TRUE));
+    boost::filesystem::path path = GetDataDir() / "snapshot_tests.dat";
+    CSnapshotMetadata metadata;
+    std::string strError;
+    for (int i = 0; i < 2; i++) {
+        if (i == 1) {
+            int nHeight;
+            {
+                LOCK(cs_main);
+                nHeight = chainActive.Height() - 3;
+            }
+            BOOST_CHECK(DumpSnapshot(path, nHeight, metadata, strError));
+        }
+        LOCK(cs_main);
+        CBlockIndex* pindexSpend = chainActive[chainActive.Height() - 2];
+        BOOST_CHECK(CheckStakeSpent(txStake, pindexSpend->pprev));
+        BOOST_CHECK(!CheckStakeSpent(txStake, chainActive.Tip()));
+    }
+
+    boost::filesystem::remove(path);
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+    Checkpoints::fEnabled = true;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,159 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "swifttx.h"
+#include "hash.h"
+#include "net.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(swifttx_tests)
+
+static CConsensusVote MakeVote(int n, int nBlockHeight)
+{
+    CConsensusVote vote;
+    vote.txHash = Hash(BEGIN(n), END(n));
+    vote.vinMasternode = CTxIn(COutPoint(vote.txHash, n));
+    vote.nBlockHeight = nBlockHeight;
+    return vote;
+}
+
+static CTransaction MakeSpend(const COutPoint& prevout, int nLockTime)
+{
+    CMutableTransaction mtx;
+    mtx.vin.push_back(CTxIn(prevout));
+    mtx.vout.push_back(CTxOut(1 * COIN, CScript()));
+    mtx.nLockTime = nLockTime;
+    return CTransaction(mtx);
+}
+
+static bool WaitForVerified(uint64_t nVerified)
+{
+    for (int i = 0; i < 1000; i++) {
+        if (GetSwiftTXStats().nVotesVerified >= nVerified) return true;
+        MilliSleep(10);
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_verify_apply)
+{
+    CAddress addr(CService("127.0.0.1", 0));
+    CNode node(INVALID_SOCKET, addr, "", true);
+    int nRefs = node.GetRefCount();
+    CSwiftTXStats stats = GetSwiftTXStats();
+
+    // Votes are verified by the threads, then wait for the message handler,
+    // holding a reference on the node they came from. Votes at a known and
+    // at an unknown height are both verified, and none of them has a rank.
+    StartSwiftTXThreads(2);
+    for (int i = 0; i < 10; i++)
+        QueueConsensusVote(&node, MakeVote(i, i % 2 ? 0 : 1000000));
+    BOOST_CHECK(WaitForVerified(stats.nVotesVerified + 10));
+    BOOST_CHECK_EQUAL(GetSwiftTXStats().nVotesPending, 10U);
+    BOOST_CHECK_EQUAL(node.GetRefCount(), nRefs + 10);
+
+    ProcessVerifiedConsensusVotes();
+    BOOST_CHECK_EQUAL(GetSwiftTXStats().nVotesPending, 0U);
+    BOOST_CHECK_EQUAL(node.GetRefCount(), nRefs);
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK_EQUAL(txLockManager.CountSignatures(MakeVote(i, 0).txHash), -1);
+
+    // without the threads a vote is verified and applied right away
+    StopSwiftTXThreads();
+    QueueConsensusVote(&node, MakeVote(10, 0));
+    BOOST_CHECK_EQUAL(GetSwiftTXStats().nVotesVerified, stats.nVotesVerified + 11);
+    BOOST_CHECK_EQUAL(GetSwiftTXStats().nVotesPending, 0U);
+    BOOST_CHECK_EQUAL(node.GetRefCount(), nRefs);
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_lock_expiry)
+{
+    CTransactionLockManager manager;
+    int64_t nStart = 1500000000;
+    SetMockTime(nStart);
+
+    // tx1 holds a complete lock on the input that tx2 spends as well
+    COutPoint prevout(Hash(BEGIN(nStart), END(nStart)), 0);
+    CTransaction tx1 = MakeSpend(prevout, 1);
+    CTransaction tx2 = MakeSpend(prevout, 2);
+    CTransaction tx3 = MakeSpend(COutPoint(prevout.hash, 1), 3);
+    uint256 hashOther = MakeVote(0, 0).txHash;
+    manager.CreateLock(hashOther, 1);
+    manager.AddRequest(tx1);
+    manager.CreateLock(tx1.GetHash(), 1);
+    manager.LockInputs(tx1);
+    manager.CreateLock(tx2.GetHash(), 1);
+    BOOST_CHECK_EQUAL(manager.CountLocks(), 3U);
+
+    uint256 hashLock;
+    BOOST_CHECK(manager.IsConflicting(tx2, hashLock));
+    BOOST_CHECK(hashLock == tx1.GetHash());
+    BOOST_CHECK(!manager.IsConflicting(tx1, hashLock));
+    BOOST_CHECK(!manager.IsConflicting(tx3, hashLock));
+
+    // conflicting locks cancel out and expire right away
+    BOOST_CHECK(manager.CheckForConflictingLocks(tx2));
+    std::vector<uint256> vRemoved;
+    manager.RemoveExpired(vRemoved);
+    BOOST_CHECK(vRemoved.empty());
+    SetMockTime(nStart + 1);
+    manager.RemoveExpired(vRemoved);
+    BOOST_CHECK_EQUAL(vRemoved.size(), 2U);
+    BOOST_CHECK(std::find(vRemoved.begin(), vRemoved.end(), tx1.GetHash()) != vRemoved.end());
+    BOOST_CHECK(std::find(vRemoved.begin(), vRemoved.end(), tx2.GetHash()) != vRemoved.end());
+    BOOST_CHECK_EQUAL(manager.CountLocks(), 1U);
+    BOOST_CHECK(!manager.HasRequest(tx1.GetHash()));
+    BOOST_CHECK(!manager.IsConflicting(tx2, hashLock));
+
+    // their first expiry time is stale and doesn't remove them twice
+    vRemoved.clear();
+    SetMockTime(nStart + 60 * 60 + 1);
+    manager.RemoveExpired(vRemoved);
+    BOOST_CHECK_EQUAL(vRemoved.size(), 1U);
+    BOOST_CHECK(vRemoved[0] == hashOther);
+    BOOST_CHECK_EQUAL(manager.CountLocks(), 0U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_unknown_votes)
+{
+    CTransactionLockManager manager;
+    int64_t nStart = 1500000000;
+    std::vector<uint256> vRemoved;
+
+    SetMockTime(nStart);
+    BOOST_CHECK(manager.CheckUnknownVote(MakeVote(1, 0)));
+    BOOST_CHECK(manager.CheckUnknownVote(MakeVote(2, 0)));
+    BOOST_CHECK_EQUAL(manager.CountUnknownVoters(), 2U);
+
+    // passed deadlines leave the running sum with their masternode
+    SetMockTime(nStart + 10 * 60 + 1);
+    manager.RemoveExpired(vRemoved);
+    BOOST_CHECK_EQUAL(manager.CountUnknownVoters(), 0U);
+
+    // Masternode 3 votes twice, moving its deadline to 10 minutes after
+    // nTime + 10. Masternode 4 may then vote until its deadline is 10 minutes
+    // past the average of both.
+    int64_t nTime = nStart + 1000;
+    SetMockTime(nTime);
+    BOOST_CHECK(manager.CheckUnknownVote(MakeVote(3, 0)));
+    SetMockTime(nTime + 10);
+    BOOST_CHECK(manager.CheckUnknownVote(MakeVote(3, 0)));
+    SetMockTime(nTime + 1209);
+    BOOST_CHECK(manager.CheckUnknownVote(MakeVote(4, 0)));
+
+    // a masternode far ahead of the others is spamming
+    SetMockTime(nTime + 2410);
+    BOOST_CHECK(!manager.CheckUnknownVote(MakeVote(5, 0)));
+    BOOST_CHECK_EQUAL(manager.CountUnknownVoters(), 3U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+#include "utiltime.h"
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(sync_tests)
+
+template <typename Mutex>
+static void TryLockFromOtherThread(Mutex* pmutex, bool* pfLocked)
+{
+    *pfLocked = pmutex->try_lock();
+    if (*pfLocked)
+        pmutex->unlock();
+}
+
+template <typename Mutex>
+static bool IsLockedElsewhere(Mutex& mutex)
+{
+    bool fLocked = false;
+    boost::thread t(TryLockFromOtherThread<Mutex>, &mutex, &fLocked);
+    t.join();
+    return !fLocked;
+}
+
+BOOST_AUTO_TEST_CASE(lock2_single_statement)
+{
+    CCriticalSection cs1;
+    CInstrumentedCriticalSection cs2("sync_tests::cs2");
+
+    // Under an unbraced if, neither lock may be taken at function scope
+    bool fTake = false;
+    if (fTake)
+        LOCK2(cs1, cs2);
+    BOOST_CHECK(!IsLockedElsewhere(cs1));
+    BOOST_CHECK(!IsLockedElsewhere(cs2));
+
+    {
+        LOCK2(cs1, cs2);
+        BOOST_CHECK(IsLockedElsewhere(cs1));
+        BOOST_CHECK(IsLockedElsewhere(cs2));
+    }
+    BOOST_CHECK(!IsLockedElsewhere(cs1));
+    BOOST_CHECK(!IsLockedElsewhere(cs2));
+}
+
+static void HoldLock(CInstrumentedCriticalSection* pcs, boost::mutex* pmutexStarted, boost::condition_variable* pcondStarted, bool* pfStarted)
+{
+    LOCK(*pcs);
+    {
+        boost::unique_lock<boost::mutex> lock(*pmutexStarted);
+        *pfStarted = true;
+    }
+    pcondStarted->notify_one();
+    MilliSleep(50);
+}
+
+BOOST_AUTO_TEST_CASE(instrumented_contention)
+{
+    CInstrumentedCriticalSection cs("sync_tests::cs");
+    boost::mutex mutexStarted;
+    boost::condition_variable condStarted;
+    bool fStarted = false;
+
+    boost::thread t(HoldLock, &cs, &mutexStarted, &condStarted, &fStarted);
+    {
+        boost::unique_lock<boost::mutex> lock(mutexStarted);
+        while (!fStarted)
+            condStarted.wait(lock);
+    }
+    {
+        LOCK(cs);
+    }
+    t.join();
+
+    CLockContentionInfo info = cs.GetContentionInfo();
+    BOOST_CHECK_EQUAL(info.strName, "sync_tests::cs");
+    BOOST_CHECK_EQUAL(info.nAcquisitions, 2U);
+    BOOST_CHECK_EQUAL(info.nContentions, 1U);
+    BOOST_CHECK(info.nWaitMicros > 0);
+
+    bool fRegistered = false;
+    BOOST_FOREACH (const CLockContentionInfo& entry, GetLockContentionInfo())
+        fRegistered |= entry.strName == "sync_tests::cs";
+    BOOST_CHECK(fRegistered);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
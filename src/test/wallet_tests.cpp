@@ -4,6 +4,10 @@
 
 #include "wallet.h"
 
+#include "coinselection.h"
+#include "main.h"
+#include "txmempool.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -305,4 +309,182 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(scan_filter_tests)
+{
+    CWallet keystore;
+    CKey key[4];
+    for (int i = 0; i < 4; i++)
+        key[i].MakeNewKey(i % 2 == 0);
+    LOCK(keystore.cs_wallet);
+    keystore.AddKeyPubKey(key[0], key[0].GetPubKey());
+
+    CScript scriptRedeem = GetScriptForDestination(key[0].GetPubKey().GetID());
+    keystore.AddCScript(scriptRedeem);
+    CScript scriptWatch = GetScriptForDestination(key[1].GetPubKey().GetID());
+    keystore.AddWatchOnly(scriptWatch);
+
+    CWalletScanFilter filter;
+    keystore.GetScanFilter(filter);
+
+    CTxOut txout;
+    txout.scriptPubKey = GetScriptForDestination(key[0].GetPubKey().GetID());
+    BOOST_CHECK(filter.IsRelevant(txout));
+    txout.scriptPubKey = CScript() << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG;
+    BOOST_CHECK(filter.IsRelevant(txout));
+    txout.scriptPubKey = GetScriptForDestination(CScriptID(scriptRedeem));
+    BOOST_CHECK(filter.IsRelevant(txout));
+    txout.scriptPubKey = scriptWatch;
+    BOOST_CHECK(filter.IsRelevant(txout));
+
+    // everything IsMine() accepts must pass the filter
+    std::vector<CPubKey> keys;
+    keys.push_back(key[0].GetPubKey());
+    keys.push_back(key[2].GetPubKey());
+    txout.scriptPubKey = GetScriptForMultisig(1, keys);
+    BOOST_CHECK(filter.IsRelevant(txout));
+
+    txout.scriptPubKey = GetScriptForDestination(key[2].GetPubKey().GetID());
+    BOOST_CHECK(!filter.IsRelevant(txout));
+    BOOST_CHECK(keystore.IsMine(txout) == ISMINE_NO);
+    txout.scriptPubKey = CScript() << ToByteVector(key[3].GetPubKey()) << OP_CHECKSIG;
+    BOOST_CHECK(!filter.IsRelevant(txout));
+    txout.scriptPubKey = CScript() << OP_RETURN;
+    BOOST_CHECK(!filter.IsRelevant(txout));
+}
+
+BOOST_AUTO_TEST_CASE(balance_ledger_tests)
+{
+    CWallet keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    LOCK2(cs_main, keystore.cs_wallet);
+    keystore.AddKeyPubKey(key, key.GetPubKey());
+
+    CMutableTransaction txReceive;
+    txReceive.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txReceive.vout.push_back(CTxOut(5 * COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    keystore.AddToWallet(CWalletTx(&keystore, txReceive), true);
+    BOOST_CHECK_EQUAL(keystore.GetUnconfirmedBalance(), 5 * COIN);
+    BOOST_CHECK_EQUAL(keystore.GetBalance(), 0);
+
+    // spending the output takes it out of the unconfirmed balance
+    CMutableTransaction txSpend;
+    txSpend.vin.push_back(CTxIn(COutPoint(txReceive.GetHash(), 0)));
+    txSpend.vout.push_back(CTxOut(4 * COIN, CScript() << OP_TRUE));
+    keystore.AddToWallet(CWalletTx(&keystore, txSpend), true);
+    BOOST_CHECK_EQUAL(keystore.GetUnconfirmedBalance(), 0);
+
+    keystore.MarkDirty();
+    BOOST_CHECK_EQUAL(keystore.GetUnconfirmedBalance(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(unspent_index_tests)
+{
+    CWallet keystore;
+    CKey key[3];
+    for (int i = 0; i < 3; i++)
+        key[i].MakeNewKey(true);
+    LOCK2(cs_main, keystore.cs_wallet);
+    keystore.AddKeyPubKey(key[0], key[0].GetPubKey());
+    keystore.AddKeyPubKey(key[1], key[1].GetPubKey());
+
+    // build the index while the wallet is empty, so the outputs below are added incrementally
+    vector<COutput> vAvailable;
+    keystore.AvailableCoins(vAvailable, false);
+    BOOST_CHECK(vAvailable.empty());
+
+    CMutableTransaction txReceive;
+    txReceive.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txReceive.vout.push_back(CTxOut(5 * COIN, GetScriptForDestination(key[0].GetPubKey().GetID())));
+    txReceive.vout.push_back(CTxOut(1 * COIN, GetScriptForDestination(key[1].GetPubKey().GetID())));
+    txReceive.vout.push_back(CTxOut(2 * COIN, GetScriptForDestination(key[2].GetPubKey().GetID())));
+    mempool.addUnchecked(txReceive.GetHash(), CTxMemPoolEntry(txReceive, 0, 0, 0.0, 1));
+    keystore.AddToWallet(CWalletTx(&keystore, txReceive), true);
+
+    // only the outputs the wallet owns are indexed
+    keystore.AvailableCoins(vAvailable, false);
+    BOOST_REQUIRE_EQUAL(vAvailable.size(), 2U);
+    BOOST_CHECK_EQUAL(vAvailable[0].i, 0);
+    BOOST_CHECK_EQUAL(vAvailable[1].i, 1);
+
+    std::set<CTxDestination> setDest;
+    setDest.insert(key[1].GetPubKey().GetID());
+    keystore.AvailableCoinsByDestination(vAvailable, setDest, false);
+    BOOST_REQUIRE_EQUAL(vAvailable.size(), 1U);
+    BOOST_CHECK_EQUAL(vAvailable[0].i, 1);
+
+    // a value cap only returns the outputs below it
+    map<CBitcoinAddress, vector<COutput> > mapCoins = keystore.AvailableCoinsByAddress(false, 2 * COIN);
+    BOOST_CHECK_EQUAL(mapCoins.size(), 1U);
+    BOOST_CHECK(mapCoins.count(CBitcoinAddress(key[1].GetPubKey().GetID())));
+
+    // a spent output is no longer available
+    CMutableTransaction txSpend;
+    txSpend.vin.push_back(CTxIn(COutPoint(txReceive.GetHash(), 0)));
+    txSpend.vout.push_back(CTxOut(4 * COIN, CScript() << OP_TRUE));
+    mempool.addUnchecked(txSpend.GetHash(), CTxMemPoolEntry(txSpend, 0, 0, 0.0, 1));
+    keystore.AddToWallet(CWalletTx(&keystore, txSpend), true);
+    keystore.AvailableCoins(vAvailable, false);
+    BOOST_REQUIRE_EQUAL(vAvailable.size(), 1U);
+    BOOST_CHECK_EQUAL(vAvailable[0].i, 1);
+
+    // rebuilding the index from mapWallet gives the same coins
+    keystore.MarkDirty();
+    keystore.AvailableCoins(vAvailable, false);
+    BOOST_REQUIRE_EQUAL(vAvailable.size(), 1U);
+    BOOST_CHECK_EQUAL(vAvailable[0].i, 1);
+
+    mempool.clear();
+}
+
+static CAmount SelectBnB(const CAmount* pValues, size_t nValues, CAmount nTarget, CAmount nCostOfChange, CAmount nInputCost, std::vector<CAmount>& vSelected)
+{
+    std::vector<CAmount> vValue(pValues, pValues + nValues);
+    std::vector<char> vfSelected;
+    CAmount nValueRet = -1;
+    vSelected.clear();
+    if (!SelectCoinsBnB(vValue, nTarget, nCostOfChange, nInputCost, vfSelected, nValueRet)) {
+        BOOST_CHECK(vfSelected.empty());
+        return -1;
+    }
+
+    CAmount nSum = 0;
+    for (size_t i = 0; i < vfSelected.size(); i++) {
+        if (vfSelected[i]) {
+            vSelected.push_back(vValue[i]);
+            nSum += vValue[i];
+        }
+    }
+    BOOST_CHECK_EQUAL(nSum, nValueRet);
+    return nValueRet;
+}
+
+BOOST_AUTO_TEST_CASE(bnb_search_tests)
+{
+    std::vector<CAmount> vSelected;
+
+    // an exact match is found without change
+    const CAmount vExact[] = {5 * CENT, 4 * CENT, 3 * CENT, 2 * CENT, 1 * CENT};
+    BOOST_CHECK_EQUAL(SelectBnB(vExact, 5, 7 * CENT, 0, 0, vSelected), 7 * CENT);
+    BOOST_CHECK_EQUAL(SelectBnB(vExact, 5, 15 * CENT, 0, 0, vSelected), 15 * CENT);
+    BOOST_CHECK_EQUAL(vSelected.size(), 5U);
+
+    // nothing in the window, or not enough in total
+    const CAmount vNone[] = {5 * CENT, 5 * CENT};
+    BOOST_CHECK_EQUAL(SelectBnB(vNone, 2, 7 * CENT, 1 * CENT, 0, vSelected), -1);
+    BOOST_CHECK_EQUAL(SelectBnB(vNone, 2, 11 * CENT, 1 * CENT, 0, vSelected), -1);
+
+    // equal values excluded in one branch are not searched again, but still used together
+    const CAmount vEqual[] = {3 * CENT, 3 * CENT, 3 * CENT, 1 * CENT};
+    BOOST_CHECK_EQUAL(SelectBnB(vEqual, 4, 7 * CENT, 0, 0, vSelected), 7 * CENT);
+    BOOST_CHECK_EQUAL(vSelected.size(), 3U);
+
+    // the input cost decides between excess and more inputs
+    const CAmount vWaste[] = {10 * CENT, 4 * CENT, 3 * CENT};
+    BOOST_CHECK_EQUAL(SelectBnB(vWaste, 3, 7 * CENT, 3 * CENT, 1 * CENT, vSelected), 7 * CENT);
+    BOOST_CHECK_EQUAL(vSelected.size(), 2U);
+    BOOST_CHECK_EQUAL(SelectBnB(vWaste, 3, 7 * CENT, 3 * CENT, 5 * CENT, vSelected), 10 * CENT);
+    BOOST_CHECK_EQUAL(vSelected.size(), 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
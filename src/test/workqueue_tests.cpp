@@ -0,0 +1,66 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "workqueue.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(workqueue_tests)
+
+struct Gate {
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fOpen;
+    int nStarted;
+    int nDone;
+
+    Gate() : fOpen(false), nStarted(0), nDone(0) {}
+
+    void Pass()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nStarted++;
+        cond.notify_all();
+        while (!fOpen)
+            cond.wait(lock);
+        nDone++;
+        cond.notify_all();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(workqueue_bounded)
+{
+    Gate gate;
+    CWorkQueue queue(2);
+    queue.Start(1, "workqueuetest");
+
+    // One item runs and blocks the only thread, two more fit in the queue
+    BOOST_CHECK(queue.Enqueue(boost::bind(&Gate::Pass, &gate)));
+    {
+        boost::unique_lock<boost::mutex> lock(gate.mutex);
+        while (gate.nStarted < 1)
+            gate.cond.wait(lock);
+    }
+    BOOST_CHECK(queue.Enqueue(boost::bind(&Gate::Pass, &gate)));
+    BOOST_CHECK(queue.Enqueue(boost::bind(&Gate::Pass, &gate)));
+    BOOST_CHECK_EQUAL(queue.Depth(), 2U);
+    BOOST_CHECK(!queue.Enqueue(boost::bind(&Gate::Pass, &gate)));
+    BOOST_CHECK_EQUAL(queue.Rejected(), 1U);
+
+    {
+        boost::unique_lock<boost::mutex> lock(gate.mutex);
+        gate.fOpen = true;
+        gate.cond.notify_all();
+        while (gate.nDone < 3)
+            gate.cond.wait(lock);
+    }
+    BOOST_CHECK_EQUAL(queue.Depth(), 0U);
+
+    queue.Stop();
+    BOOST_CHECK(!queue.Enqueue(boost::bind(&Gate::Pass, &gate)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
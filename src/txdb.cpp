@@ -8,6 +8,7 @@
 
 #include "main.h"
 #include "pow.h"
+#include "snapshot.h"
 #include "uint256.h"
 
 #include <stdint.h>
@@ -33,6 +34,10 @@ CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(Get
 {
 }
 
+CCoinsViewDB::CCoinsViewDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe) : db(path, nCacheSize, fMemory, fWipe)
+{
+}
+
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
     return db.Read(make_pair('c', txid), coins);
@@ -115,6 +120,44 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
+CCoinsViewDBCursor::CCoinsViewDBCursor(leveldb::Iterator* pcursorIn) : pcursor(pcursorIn), fValid(false)
+{
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('c', uint256(0));
+    pcursor->Seek(ssKeySet.str());
+    Load();
+}
+
+void CCoinsViewDBCursor::Load()
+{
+    fValid = false;
+    if (!pcursor->Valid())
+        return;
+    leveldb::Slice slKey = pcursor->key();
+    CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+    char chType;
+    ssKey >> chType;
+    if (chType != 'c')
+        return;
+    ssKey >> txid;
+    leveldb::Slice slValue = pcursor->value();
+    CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+    ssValue >> coins;
+    fValid = true;
+}
+
+void CCoinsViewDBCursor::Next()
+{
+    pcursor->Next();
+    Load();
+}
+
+CCoinsViewDBCursor* CCoinsViewDB::Cursor() const
+{
+    // Same const-cast as in GetStats: LevelDB has no const iterators
+    return new CCoinsViewDBCursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
@@ -206,6 +249,34 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+bool CBlockTreeDB::WriteSnapshot(const CSnapshotMetadata& metadata)
+{
+    return Write('S', metadata);
+}
+
+bool CBlockTreeDB::ReadSnapshot(CSnapshotMetadata& metadata)
+{
+    return Read('S', metadata);
+}
+
+bool CBlockTreeDB::WriteKeptTransactions(const std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(make_pair('K', it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadKeptTransaction(const uint256& txid, uint256& hashBlock, CTransaction& tx)
+{
+    std::pair<uint256, CTransaction> value;
+    if (!Read(make_pair('K', txid), value))
+        return false;
+    hashBlock = value.first;
+    tx = value.second;
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -15,7 +15,10 @@
 #include <utility>
 #include <vector>
 
+#include <boost/scoped_ptr.hpp>
+
 class CCoins;
+class CSnapshotMetadata;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -25,6 +28,29 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
+/**
+ * Walks the unspent transactions of a CCoinsViewDB in database key order. It sees the
+ * database as it was when the cursor was created, whatever is written to it meanwhile.
+ */
+class CCoinsViewDBCursor
+{
+private:
+    boost::scoped_ptr<leveldb::Iterator> pcursor;
+    uint256 txid;
+    CCoins coins;
+    bool fValid;
+
+    void Load();
+
+public:
+    explicit CCoinsViewDBCursor(leveldb::Iterator* pcursorIn);
+
+    bool Valid() const { return fValid; }
+    const uint256& GetTxid() const { return txid; }
+    const CCoins& GetCoins() const { return coins; }
+    void Next();
+};
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
@@ -33,12 +59,16 @@ protected:
 
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    //! A coin database in another directory, such as the one a UTXO snapshot is validated with
+    CCoinsViewDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+    //! Caller owns the returned cursor
+    CCoinsViewDBCursor* Cursor() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -65,6 +95,11 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    bool WriteSnapshot(const CSnapshotMetadata& metadata);
+    bool ReadSnapshot(CSnapshotMetadata& metadata);
+    //! Transactions still looked up after their block file was pruned, with the block they are in
+    bool WriteKeptTransactions(const std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > >& list);
+    bool ReadKeptTransaction(const uint256& txid, uint256& hashBlock, CTransaction& tx);
     bool LoadBlockIndexGuts();
 };
 
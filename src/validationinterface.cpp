@@ -23,9 +23,19 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.BlockFound.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+    g_signals.NotifyMasternode.connect(boost::bind(&CValidationInterface::NotifyMasternode, pwalletIn, _1, _2));
+    g_signals.NotifyMasternodeWinner.connect(boost::bind(&CValidationInterface::NotifyMasternodeWinner, pwalletIn, _1));
+    g_signals.NotifyBudgetProposal.connect(boost::bind(&CValidationInterface::NotifyBudgetProposal, pwalletIn, _1));
+    g_signals.NotifyFinalizedBudget.connect(boost::bind(&CValidationInterface::NotifyFinalizedBudget, pwalletIn, _1));
+    g_signals.NotifySpork.connect(boost::bind(&CValidationInterface::NotifySpork, pwalletIn, _1));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    g_signals.NotifySpork.disconnect(boost::bind(&CValidationInterface::NotifySpork, pwalletIn, _1));
+    g_signals.NotifyFinalizedBudget.disconnect(boost::bind(&CValidationInterface::NotifyFinalizedBudget, pwalletIn, _1));
+    g_signals.NotifyBudgetProposal.disconnect(boost::bind(&CValidationInterface::NotifyBudgetProposal, pwalletIn, _1));
+    g_signals.NotifyMasternodeWinner.disconnect(boost::bind(&CValidationInterface::NotifyMasternodeWinner, pwalletIn, _1));
+    g_signals.NotifyMasternode.disconnect(boost::bind(&CValidationInterface::NotifyMasternode, pwalletIn, _1, _2));
     g_signals.BlockFound.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
     g_signals.ScriptForMining.disconnect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
@@ -39,6 +49,11 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
 }
 
 void UnregisterAllValidationInterfaces() {
+    g_signals.NotifySpork.disconnect_all_slots();
+    g_signals.NotifyFinalizedBudget.disconnect_all_slots();
+    g_signals.NotifyBudgetProposal.disconnect_all_slots();
+    g_signals.NotifyMasternodeWinner.disconnect_all_slots();
+    g_signals.NotifyMasternode.disconnect_all_slots();
     g_signals.BlockFound.disconnect_all_slots();
     g_signals.ScriptForMining.disconnect_all_slots();
     g_signals.BlockChecked.disconnect_all_slots();
@@ -12,7 +12,12 @@
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
+class CBudgetProposal;
+class CFinalizedBudget;
+class CMasternode;
+class CMasternodePaymentWinner;
 class CReserveScript;
+class CSporkMessage;
 class CTransaction;
 class CValidationInterface;
 class CValidationState;
@@ -42,6 +47,11 @@ protected:
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
     virtual void GetScriptForMining(boost::shared_ptr<CReserveScript>&) {};
     virtual void ResetRequestCount(const uint256 &hash) {};
+    virtual void NotifyMasternode(const CMasternode &mn, bool fRemoved) {}
+    virtual void NotifyMasternodeWinner(const CMasternodePaymentWinner &winner) {}
+    virtual void NotifyBudgetProposal(const CBudgetProposal &proposal) {}
+    virtual void NotifyFinalizedBudget(const CFinalizedBudget &finalizedBudget) {}
+    virtual void NotifySpork(const CSporkMessage &spork) {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -69,6 +79,16 @@ struct CMainSignals {
     boost::signals2::signal<void (boost::shared_ptr<CReserveScript>&)> ScriptForMining;
     /** Notifies listeners that a block has been successfully mined */
     boost::signals2::signal<void (const uint256 &)> BlockFound;
+    /** Notifies listeners of a masternode added to, updated in or removed from the list */
+    boost::signals2::signal<void (const CMasternode &, bool)> NotifyMasternode;
+    /** Notifies listeners of a new masternode payment winner vote */
+    boost::signals2::signal<void (const CMasternodePaymentWinner &)> NotifyMasternodeWinner;
+    /** Notifies listeners of a new budget proposal or a new vote on one */
+    boost::signals2::signal<void (const CBudgetProposal &)> NotifyBudgetProposal;
+    /** Notifies listeners of a new finalized budget or a new vote on one */
+    boost::signals2::signal<void (const CFinalizedBudget &)> NotifyFinalizedBudget;
+    /** Notifies listeners of a new active spork value */
+    boost::signals2::signal<void (const CSporkMessage &)> NotifySpork;
 };
 
 CMainSignals& GetMainSignals();
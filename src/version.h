@@ -13,7 +13,7 @@
  */
 
 //! Current Protocol Version
-static const int PROTOCOL_VERSION = 70900;
+static const int PROTOCOL_VERSION = 70901;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 200;
@@ -21,6 +21,9 @@ static const int INIT_PROTO_VERSION = 200;
 //! In this version, 'getheaders' was introduced.
 static const int GETHEADERS_VERSION = 70077;
 
+//! In this version, 'mnsyncsum' was introduced.
+static const int MNSYNC_SUMMARY_VERSION = 70901;
+
 //! disconnect from peers older than this proto version
 static const int MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT_1 = 70900;
 static const int MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT_2 = 70910;
@@ -56,14 +56,6 @@ int64_t nStartupTime = GetAdjustedTime();
  * @{
  */
 
-struct CompareValueOnly {
-    bool operator()(const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t1,
-        const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->vout[i].nValue));
@@ -163,6 +155,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    MarkCachesStale();
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -187,6 +180,7 @@ bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    MarkCachesStale();
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -199,6 +193,7 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    MarkCachesStale();
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
@@ -217,6 +212,7 @@ bool CWallet::AddMultiSig(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddMultiSig(dest))
         return false;
+    MarkCachesStale();
     nTimeFirstKey = 1; // No birthday information
     NotifyMultiSigChanged(true);
     if (!fFileBacked)
@@ -229,6 +225,7 @@ bool CWallet::RemoveMultiSig(const CScript& dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveMultiSig(dest))
         return false;
+    MarkCachesStale();
     if (!HaveMultiSig())
         NotifyMultiSigChanged(false);
     if (fFileBacked)
@@ -650,9 +647,26 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
             item.second.MarkDirty();
+        MarkCachesStale();
     }
 }
 
+void CWallet::MarkBalanceDirty(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    if (!fBalancesStale)
+        setBalancePending.insert(hash);
+}
+
+/** Force the balance ledger and the unspent-output index to be rebuilt on next use */
+void CWallet::MarkCachesStale()
+{
+    LOCK(cs_wallet);
+    fBalancesStale = true;
+    setBalancePending.clear();
+    fUnspentStale = true;
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 {
     uint256 hash = wtxIn.GetHash();
@@ -661,6 +675,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         AddToSpends(hash);
+        MarkBalanceDirty(hash);
+        if (!fUnspentStale)
+            AddUnspentOutputs(mapWallet[hash]);
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -741,6 +758,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        MarkBalanceDirty(hash);
+        if (fInsertedNew && !fUnspentStale)
+            AddUnspentOutputs(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -799,8 +819,11 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            MarkBalanceDirty(hash);
+            fUnspentStale = true;
+        }
     }
     return;
 }
@@ -988,17 +1011,192 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+bool CWalletScanFilter::IsRelevant(const CTxOut& txout) const
+{
+    if (setScripts.count(txout.scriptPubKey))
+        return true;
+
+    std::vector<valtype> vSolutions;
+    txnouttype whichType;
+    if (!Solver(txout.scriptPubKey, whichType, vSolutions))
+        return false;
+
+    switch (whichType) {
+    case TX_PUBKEY:
+        return setIDs.count(CPubKey(vSolutions[0]).GetID()) != 0;
+    case TX_PUBKEYHASH:
+    case TX_SCRIPTHASH:
+        return setIDs.count(uint160(vSolutions[0])) != 0;
+    case TX_MULTISIG:
+        for (unsigned int i = 1; i + 1 < vSolutions.size(); i++) {
+            if (setIDs.count(CPubKey(vSolutions[i]).GetID()))
+                return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+bool CWalletScanFilter::IsRelevant(const CTransaction& tx) const
+{
+    BOOST_FOREACH (const CTxOut& txout, tx.vout) {
+        if (IsRelevant(txout))
+            return true;
+    }
+    return false;
+}
+
+void CWallet::GetScanFilter(CWalletScanFilter& filter) const
+{
+    std::set<CKeyID> setKeys;
+    GetKeys(setKeys);
+
+    LOCK(cs_KeyStore);
+    filter.setIDs.clear();
+    filter.setScripts.clear();
+    BOOST_FOREACH (const CKeyID& keyid, setKeys)
+        filter.setIDs.insert(keyid);
+    BOOST_FOREACH (const PAIRTYPE(CScriptID, CScript) & item, mapScripts)
+        filter.setIDs.insert(item.first);
+    filter.setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+    filter.setScripts.insert(setMultiSig.begin(), setMultiSig.end());
+}
+
+namespace
+{
+/** A block read ahead of the rescan commit stage */
+struct CRescanBlock {
+    CBlock block;
+    bool fCandidate; // at least one output matched the scan filter
+};
+
+/**
+ * Hands the blocks of a rescan to a pool of reader threads, which load and filter
+ * them without holding any lock, and returns them in chain order to the committing
+ * thread. Readers stay at most nWindow blocks ahead of the commit stage.
+ */
+class CRescanQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    const std::vector<CBlockIndex*>& vIndex;
+    const CWalletScanFilter& filter;
+    const size_t nWindow;
+    size_t nNextRead;
+    size_t nNextCommit;
+    bool fStop;
+    std::map<size_t, boost::shared_ptr<CRescanBlock> > mapReady;
+
+public:
+    CRescanQueue(const std::vector<CBlockIndex*>& vIndexIn, const CWalletScanFilter& filterIn, size_t nWindowIn)
+        : vIndex(vIndexIn), filter(filterIn), nWindow(nWindowIn), nNextRead(0), nNextCommit(0), fStop(false) {}
+
+    void Reader()
+    {
+        while (true) {
+            size_t n;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNextRead < vIndex.size() && nNextRead >= nNextCommit + nWindow)
+                    cond.wait(lock);
+                if (fStop || nNextRead >= vIndex.size())
+                    return;
+                n = nNextRead++;
+            }
+
+            boost::shared_ptr<CRescanBlock> pblock(new CRescanBlock());
+            pblock->fCandidate = false;
+            // Blocks below a UTXO snapshot may not have been fetched yet
+            if ((vIndex[n]->nStatus & BLOCK_HAVE_DATA) && ReadBlockFromDisk(pblock->block, vIndex[n])) {
+                BOOST_FOREACH (const CTransaction& tx, pblock->block.vtx) {
+                    if (filter.IsRelevant(tx)) {
+                        pblock->fCandidate = true;
+                        break;
+                    }
+                }
+            }
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                mapReady[n] = pblock;
+            }
+            cond.notify_all();
+        }
+    }
+
+    boost::shared_ptr<CRescanBlock> Next()
+    {
+        boost::shared_ptr<CRescanBlock> pblock;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            std::map<size_t, boost::shared_ptr<CRescanBlock> >::iterator it;
+            while ((it = mapReady.find(nNextCommit)) == mapReady.end())
+                cond.wait(lock);
+            pblock = it->second;
+            mapReady.erase(it);
+            nNextCommit++;
+        }
+        cond.notify_all();
+        return pblock;
+    }
+
+    void Stop()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+    }
+};
+
+/** Stops and joins the reader threads however the commit loop is left */
+class CRescanReaders
+{
+private:
+    CRescanQueue& queue;
+    boost::thread_group threads;
+
+public:
+    CRescanReaders(CRescanQueue& queueIn, int nThreads) : queue(queueIn)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CRescanQueue::Reader, &queue));
+    }
+
+    ~CRescanReaders()
+    {
+        queue.Stop();
+        threads.join_all();
+    }
+};
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and matched against the wallet's keys and scripts by
+ * -rescanthreads reader threads; cs_main and cs_wallet are only taken to
+ * commit blocks that may involve the wallet.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
 
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    nThreads = std::max(1, std::min(MAX_RESCAN_THREADS, nThreads));
+
+    CWalletScanFilter filter;
+    GetScanFilter(filter);
+
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1007,27 +1205,75 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
-            }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    while (pindex) {
+        // Snapshot the remaining range; blocks connected meanwhile are picked up by the next pass
+        std::vector<CBlockIndex*> vIndex;
+        {
+            LOCK(cs_main);
+            for (CBlockIndex* pindexNext = pindex; pindexNext; pindexNext = chainActive.Next(pindexNext))
+                vIndex.push_back(pindexNext);
+        }
+        if (vIndex.empty())
+            break;
+
+        CRescanQueue queue(vIndex, filter, nThreads * 16);
+        {
+            CRescanReaders readers(queue, nThreads);
+            for (size_t i = 0; i < vIndex.size(); i++) {
+                CBlockIndex* pindexBlock = vIndex[i];
+                boost::shared_ptr<CRescanBlock> pblock = queue.Next();
+                const CBlock& block = pblock->block;
+
+                if (pindexBlock->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindexBlock, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                bool fCandidate = pblock->fCandidate;
+                if (!fCandidate) {
+                    // Nothing pays us, but the block may still spend or re-include wallet transactions
+                    LOCK(cs_wallet);
+                    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+                        if (mapWallet.count(tx.GetHash()))
+                            fCandidate = true;
+                        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+                            if (mapWallet.count(txin.prevout.hash))
+                                fCandidate = true;
+                        }
+                        if (fCandidate)
+                            break;
+                    }
+                }
+
+                if (fCandidate) {
+                    LOCK2(cs_main, cs_wallet);
+                    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+                        if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                            ret++;
+                    }
+                }
+
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexBlock->nHeight, Checkpoints::GuessVerificationProgress(pindexBlock));
+                }
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+        {
+            LOCK(cs_main);
+            CBlockIndex* pindexLast = vIndex.back();
+            if (chainActive.Contains(pindexLast))
+                pindex = chainActive.Next(pindexLast);
+            else
+                pindex = chainActive.Next(chainActive.FindFork(pindexLast));
+        }
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
     return ret;
 }
 
@@ -1067,7 +1313,7 @@ void CWalletTx::RelayWalletTransaction(std::string strCommand)
             LogPrintf("Relaying wtx %s\n", hash.ToString());
 
             if (strCommand == "ix") {
-                mapTxLockReq.insert(make_pair(hash, (CTransaction) * this));
+                txLockManager.AddRequest(*this);
                 CreateNewLock(((CTransaction) * this));
                 RelayTransactionLockReq((CTransaction) * this, true);
             } else {
@@ -1132,152 +1378,277 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+CWalletBalances& CWalletBalances::operator+=(const CWalletBalances& b)
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
+    nBalance += b.nBalance;
+    nUnconfirmed += b.nUnconfirmed;
+    nImmature += b.nImmature;
+    nLocked += b.nLocked;
+    nUnlocked += b.nUnlocked;
+    nWatchOnly += b.nWatchOnly;
+    nUnconfirmedWatchOnly += b.nUnconfirmedWatchOnly;
+    nImmatureWatchOnly += b.nImmatureWatchOnly;
+    nLockedWatchOnly += b.nLockedWatchOnly;
+    return *this;
+}
 
-    return nTotal;
+CWalletBalances& CWalletBalances::operator-=(const CWalletBalances& b)
+{
+    nBalance -= b.nBalance;
+    nUnconfirmed -= b.nUnconfirmed;
+    nImmature -= b.nImmature;
+    nLocked -= b.nLocked;
+    nUnlocked -= b.nUnlocked;
+    nWatchOnly -= b.nWatchOnly;
+    nUnconfirmedWatchOnly -= b.nUnconfirmedWatchOnly;
+    nImmatureWatchOnly -= b.nImmatureWatchOnly;
+    nLockedWatchOnly -= b.nLockedWatchOnly;
+    return *this;
 }
 
-CAmount CWallet::GetUnlockedCoins() const
+/** Recompute the ledger entry of one transaction, dropping it if it left the wallet */
+void CWallet::UpdateBalanceEntry(const uint256& hash) const
 {
-    if (fLiteMode) return 0;
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+    std::map<uint256, CWalletBalances>::iterator it = mapBalanceEntries.find(hash);
+    if (it != mapBalanceEntries.end()) {
+        balancesTotal -= it->second;
+        mapBalanceEntries.erase(it);
+    }
+    setBalanceVolatile.erase(hash);
+
+    map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+    if (mi == mapWallet.end())
+        return;
+    const CWalletTx& wtx = mi->second;
+
+    CWalletBalances entry;
+    bool fFinal = IsFinalTx(wtx);
+    bool fTrusted = wtx.IsTrusted();
+    int nDepth = wtx.GetDepthInMainChain();
+    if (fTrusted) {
+        entry.nBalance = wtx.GetAvailableCredit(false);
+        entry.nWatchOnly = wtx.GetAvailableWatchOnlyCredit(false);
+    }
+    if (!fFinal || (!fTrusted && nDepth == 0)) {
+        entry.nUnconfirmed = wtx.GetAvailableCredit(false);
+        entry.nUnconfirmedWatchOnly = wtx.GetAvailableWatchOnlyCredit(false);
+    }
+    entry.nImmature = wtx.GetImmatureCredit(false);
+    entry.nImmatureWatchOnly = wtx.GetImmatureWatchOnlyCredit(false);
+    if (fTrusted && nDepth > 0) {
+        entry.nUnlocked = wtx.GetUnlockedCredit();
+        entry.nLocked = wtx.GetLockedCredit();
+        entry.nLockedWatchOnly = wtx.GetLockedWatchOnlyCredit();
+    }
+
+    mapBalanceEntries.insert(make_pair(hash, entry));
+    balancesTotal += entry;
+
+    if (!fFinal || !wtx.IsInMainChain() || ((wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.GetBlocksToMaturity() > 0))
+        setBalanceVolatile.insert(hash);
+}
 
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetUnlockedCredit();
+/** Bring the balance ledger up to date with the wallet, chain tip, mempool and SwiftTX locks */
+void CWallet::RefreshBalances() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // A tip that does not extend the one the ledger was built on means a reorg,
+    // which can take confirmed coins back below maturity: start over
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (!fBalancesStale && pindexBalances && pindexTip != pindexBalances &&
+        (!pindexTip || pindexTip->GetAncestor(pindexBalances->nHeight) != pindexBalances))
+        fBalancesStale = true;
+
+    if (fBalancesStale) {
+        mapBalanceEntries.clear();
+        setBalancePending.clear();
+        setBalanceVolatile.clear();
+        balancesTotal.SetNull();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            UpdateBalanceEntry(it->first);
+        fBalancesStale = false;
+    } else {
+        std::set<uint256> setUpdate;
+        setUpdate.swap(setBalancePending);
+        if (pindexTip != pindexBalances || mempool.GetTransactionsUpdated() != nBalancesMempoolUpdated || nCompleteTXLocks != nBalancesTXLocks)
+            setUpdate.insert(setBalanceVolatile.begin(), setBalanceVolatile.end());
+
+        // Whether an output counts as spent depends on the state of its spender
+        std::set<uint256> setParents;
+        BOOST_FOREACH (const uint256& hash, setUpdate) {
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+            if (mi == mapWallet.end())
+                continue;
+            BOOST_FOREACH (const CTxIn& txin, mi->second.vin) {
+                if (mapWallet.count(txin.prevout.hash))
+                    setParents.insert(txin.prevout.hash);
+            }
         }
+        setUpdate.insert(setParents.begin(), setParents.end());
+
+        BOOST_FOREACH (const uint256& hash, setUpdate)
+            UpdateBalanceEntry(hash);
     }
 
-    return nTotal;
+    pindexBalances = pindexTip;
+    nBalancesMempoolUpdated = mempool.GetTransactionsUpdated();
+    nBalancesTXLocks = nCompleteTXLocks;
 }
 
-CAmount CWallet::GetLockedCoins() const
+CWalletBalances CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+    RefreshBalances();
+    return balancesTotal;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nBalance;
+}
+
+CAmount CWallet::GetUnlockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+    return GetBalances().nUnlocked;
+}
 
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedCredit();
-        }
-    }
+CAmount CWallet::GetLockedCoins() const
+{
+    if (fLiteMode) return 0;
 
-    return nTotal;
+    return GetBalances().nLocked;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmatureWatchOnly;
 }
 
 CAmount CWallet::GetLockedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedWatchOnlyCredit();
+    return GetBalances().nLockedWatchOnly;
+}
+
+void CWallet::AddUnspentOutputs(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        const CTxOut& txout = wtx.vout[i];
+        isminetype mine = IsMine(txout);
+        if (mine == ISMINE_NO)
+            continue;
+
+        COutPoint outpoint(hash, i);
+        CWalletUnspent unspent;
+        unspent.pwtx = &wtx;
+        unspent.nValue = txout.nValue;
+        unspent.mine = mine;
+        if (!ExtractDestination(txout.scriptPubKey, unspent.dest))
+            unspent.dest = CNoDestination();
+        if (!mapUnspent.insert(make_pair(outpoint, unspent)).second)
+            continue;
+        mapUnspentByValue.insert(make_pair(unspent.nValue, outpoint));
+        mapUnspentByDest[unspent.dest].insert(outpoint);
+    }
+}
+
+void CWallet::EraseUnspent(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_wallet);
+    UnspentMap::iterator it = mapUnspent.find(outpoint);
+    if (it == mapUnspent.end())
+        return;
+
+    std::pair<std::multimap<CAmount, COutPoint>::iterator, std::multimap<CAmount, COutPoint>::iterator> range = mapUnspentByValue.equal_range(it->second.nValue);
+    for (std::multimap<CAmount, COutPoint>::iterator vit = range.first; vit != range.second; ++vit) {
+        if (vit->second == outpoint) {
+            mapUnspentByValue.erase(vit);
+            break;
         }
     }
-    return nTotal;
+
+    std::map<CTxDestination, std::set<COutPoint> >::iterator dit = mapUnspentByDest.find(it->second.dest);
+    if (dit != mapUnspentByDest.end()) {
+        dit->second.erase(outpoint);
+        if (dit->second.empty())
+            mapUnspentByDest.erase(dit);
+    }
+
+    mapUnspent.erase(it);
+}
+
+void CWallet::RefreshUnspentIndex() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Outputs were dropped on the strength of confirmations a reorg may have undone
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (!fUnspentStale && pindexUnspent && pindexTip != pindexUnspent &&
+        (!pindexTip || pindexTip->GetAncestor(pindexUnspent->nHeight) != pindexUnspent))
+        fUnspentStale = true;
+
+    if (fUnspentStale) {
+        mapUnspent.clear();
+        mapUnspentByValue.clear();
+        mapUnspentByDest.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            AddUnspentOutputs(it->second);
+        fUnspentStale = false;
+    }
+    pindexUnspent = pindexTip;
 }
 
 /**
- * populate vCoins with vector of available COutputs.
+ * Append the available coins among vCandidates, which must be in outpoint order
+ * (the order a walk over mapWallet produces), to vCoins.
  */
-void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX) const
+void CWallet::AvailableCoinsFrom(const std::vector<UnspentMap::const_iterator>& vCandidates, vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX) const
 {
-    vCoins.clear();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
 
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+    std::vector<COutPoint> vConfirmedSpent;
+    const CWalletTx* pcoinLast = NULL;
+    bool fAvailableTx = false;
+    int nDepth = 0;
+    BOOST_FOREACH (const UnspentMap::const_iterator& it, vCandidates) {
+        const uint256& wtxid = it->first.hash;
+        unsigned int i = it->first.n;
+        const CWalletTx* pcoin = it->second.pwtx;
+
+        // Transaction level checks, evaluated once per transaction
+        if (pcoin != pcoinLast) {
+            pcoinLast = pcoin;
+            fAvailableTx = false;
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1288,7 +1659,7 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
                 continue;
 
-            int nDepth = pcoin->GetDepthInMainChain(false);
+            nDepth = pcoin->GetDepthInMainChain(false);
             // do not use IX for inputs that have less then 6 blockchain confirmations
             if (fUseIX && nDepth < 6)
                 continue;
@@ -1298,53 +1669,135 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                bool found = false;
-                if (nCoinType == ONLY_NOT10000IFMN) {
-                    found = !(fMasterNode && pcoin->vout[i].nValue == GetMasternodeCollateral() * COIN);
-                } if (nCoinType == ONLY_10000) {
-                    found = pcoin->vout[i].nValue == GetMasternodeCollateral() * COIN;
-                } else {
-                    found = true;
+            fAvailableTx = true;
+        }
+        if (!fAvailableTx)
+            continue;
+
+        bool found = false;
+        if (nCoinType == ONLY_NOT10000IFMN) {
+            found = !(fMasterNode && pcoin->vout[i].nValue == GetMasternodeCollateral() * COIN);
+        } if (nCoinType == ONLY_10000) {
+            found = pcoin->vout[i].nValue == GetMasternodeCollateral() * COIN;
+        } else {
+            found = true;
+        }
+        if (!found) continue;
+
+        isminetype mine = it->second.mine;
+        if (IsSpent(wtxid, i)) {
+            // Once the spender is in the chain the output only comes back through a reorg
+            std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(it->first);
+            for (TxSpends::const_iterator sit = range.first; sit != range.second; ++sit) {
+                map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(sit->second);
+                if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > 0) {
+                    vConfirmedSpent.push_back(it->first);
+                    break;
                 }
-                if (!found) continue;
+            }
+            continue;
+        }
+        if (mine == ISMINE_WATCH_ONLY)
+            continue;
 
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (IsSpent(wtxid, i))
-                    continue;
-                if (mine == ISMINE_NO)
-                    continue;
-                if (mine == ISMINE_WATCH_ONLY)
-                    continue;
+        if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
+            continue;
+        if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
+            continue;
+        if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
+            continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
-                    continue;
-                if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
-                    continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
-                    continue;
+        bool fIsSpendable = false;
+        if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
+            fIsSpendable = true;
+        if ((mine & ISMINE_MULTISIG) != ISMINE_NO)
+            fIsSpendable = true;
+        vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
+    }
 
-                bool fIsSpendable = false;
-                if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
-                    fIsSpendable = true;
-                if ((mine & ISMINE_MULTISIG) != ISMINE_NO)
-                    fIsSpendable = true;
-                vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
-            }
+    BOOST_FOREACH (const COutPoint& outpoint, vConfirmedSpent)
+        EraseUnspent(outpoint);
+}
+
+static bool CompareUnspentByOutpoint(const std::map<COutPoint, CWalletUnspent>::const_iterator& a, const std::map<COutPoint, CWalletUnspent>::const_iterator& b)
+{
+    return a->first < b->first;
+}
+
+/**
+ * populate vCoins with vector of available COutputs.
+ */
+void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX) const
+{
+    vCoins.clear();
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        RefreshUnspentIndex();
+
+        std::vector<UnspentMap::const_iterator> vCandidates;
+        if (nCoinType == ONLY_10000) {
+            // Masternode collaterals can be looked up by value
+            std::pair<std::multimap<CAmount, COutPoint>::const_iterator, std::multimap<CAmount, COutPoint>::const_iterator> range = mapUnspentByValue.equal_range(GetMasternodeCollateral() * COIN);
+            for (std::multimap<CAmount, COutPoint>::const_iterator it = range.first; it != range.second; ++it)
+                vCandidates.push_back(mapUnspent.find(it->second));
+            std::sort(vCandidates.begin(), vCandidates.end(), CompareUnspentByOutpoint);
+        } else {
+            vCandidates.reserve(mapUnspent.size());
+            for (UnspentMap::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it)
+                vCandidates.push_back(it);
+        }
+
+        AvailableCoinsFrom(vCandidates, vCoins, fOnlyConfirmed, coinControl, fIncludeZeroValue, nCoinType, fUseIX);
+    }
+}
+
+/**
+ * populate vCoins with the available COutputs paying to one of setDest.
+ */
+void CWallet::AvailableCoinsByDestination(vector<COutput>& vCoins, const std::set<CTxDestination>& setDest, bool fOnlyConfirmed) const
+{
+    vCoins.clear();
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        RefreshUnspentIndex();
+
+        std::vector<UnspentMap::const_iterator> vCandidates;
+        BOOST_FOREACH (const CTxDestination& dest, setDest) {
+            std::map<CTxDestination, std::set<COutPoint> >::const_iterator dit = mapUnspentByDest.find(dest);
+            if (dit == mapUnspentByDest.end())
+                continue;
+            BOOST_FOREACH (const COutPoint& outpoint, dit->second)
+                vCandidates.push_back(mapUnspent.find(outpoint));
         }
+        std::sort(vCandidates.begin(), vCandidates.end(), CompareUnspentByOutpoint);
+
+        AvailableCoinsFrom(vCandidates, vCoins, fOnlyConfirmed, NULL, false, ALL_COINS, false);
     }
 }
 
 map<CBitcoinAddress, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue)
 {
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, fConfirmed);
+    if (maxCoinValue > 0) {
+        // Only walk the outputs small enough to qualify
+        LOCK2(cs_main, cs_wallet);
+        RefreshUnspentIndex();
+
+        std::vector<UnspentMap::const_iterator> vCandidates;
+        std::multimap<CAmount, COutPoint>::const_iterator itEnd = mapUnspentByValue.upper_bound(maxCoinValue);
+        for (std::multimap<CAmount, COutPoint>::const_iterator it = mapUnspentByValue.begin(); it != itEnd; ++it)
+            vCandidates.push_back(mapUnspent.find(it->second));
+        std::sort(vCandidates.begin(), vCandidates.end(), CompareUnspentByOutpoint);
+
+        AvailableCoinsFrom(vCandidates, vCoins, fConfirmed, NULL, false, ALL_COINS, false);
+    } else {
+        AvailableCoins(vCoins, fConfirmed);
+    }
 
     map<CBitcoinAddress, vector<COutput> > mapCoins;
     BOOST_FOREACH (COutput out, vCoins) {
-        if (maxCoinValue > 0 && out.tx->vout[out.i].nValue > maxCoinValue)
-            continue;
-
         CTxDestination address;
         if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
             continue;
@@ -1355,45 +1808,6 @@ map<CBitcoinAddress, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fCo
     return mapCoins;
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
-{
-    vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    seed_insecure_rand();
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++) {
-        vfIncluded.assign(vValue.size(), false);
-        CAmount nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
-            for (unsigned int i = 0; i < vValue.size(); i++) {
-                //The solver here uses a randomized algorithm,
-                //the randomness serves no real security purpose but is just
-                //needed to prevent degenerate behavior and it is important
-                //that the rng is fast. We do not use a constant random sequence,
-                //because there may be some privacy improvement by making
-                //the selection random.
-                if (nPass == 0 ? insecure_rand() & 1 : !vfIncluded[i]) {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue) {
-                        fReachedTarget = true;
-                        if (nTotal < nBest) {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
-    }
-}
-
 bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const
 {
     vector<COutput> vCoins;
@@ -1441,101 +1855,117 @@ bool CWallet::MintableCoins()
     return false;
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+/** Reduce the spendable outputs among vCoins to the compact form coin selection works on */
+static void GetSelectionCoins(const vector<COutput>& vCoins, vector<CSelectionCoin>& vSelectionCoins)
 {
-    setCoinsRet.clear();
-    nValueRet = 0;
-
-    // List of values less than target
-    pair<CAmount, pair<const CWalletTx*, unsigned int> > coinLowestLarger;
-    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
-    coinLowestLarger.second.first = NULL;
-    vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue;
-    CAmount nTotalLower = 0;
-
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
-    // try to find nondenom first to prevent unneeded spending of mixed coins
-    for (unsigned int tryDenom = 0; tryDenom < 2; tryDenom++) {
-        if (fDebug) LogPrint("selectcoins", "tryDenom: %d\n", tryDenom);
-        vValue.clear();
-        nTotalLower = 0;
-        BOOST_FOREACH (const COutput& output, vCoins) {
-            if (!output.fSpendable)
-                continue;
-
-            const CWalletTx* pcoin = output.tx;
-
-            //            if (fDebug) LogPrint("selectcoins", "value %s confirms %d\n", FormatMoney(pcoin->vout[output.i].nValue), output.nDepth);
-            if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
-                continue;
+    vSelectionCoins.clear();
+    vSelectionCoins.reserve(vCoins.size());
+    BOOST_FOREACH (const COutput& output, vCoins) {
+        if (!output.fSpendable)
+            continue;
 
-            int i = output.i;
-            CAmount n = pcoin->vout[i].nValue;
+        CSelectionCoin coin;
+        coin.pwtx = output.tx;
+        coin.n = output.i;
+        coin.nValue = output.tx->vout[output.i].nValue;
+        coin.nDepth = output.nDepth;
+        coin.fFromMe = output.tx->IsFromMe(ISMINE_ALL);
+        vSelectionCoins.push_back(coin);
+    }
+}
 
-            pair<CAmount, pair<const CWalletTx*, unsigned int> > coin = make_pair(n, make_pair(pcoin, i));
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    vector<CSelectionCoin> vSelectionCoins;
+    GetSelectionCoins(vCoins, vSelectionCoins);
+    return SelectCoinsMinConf(nTargetValue, nConfMine, nConfTheirs, vSelectionCoins, setCoinsRet, nValueRet);
+}
 
-            if (n == nTargetValue) {
-                setCoinsRet.insert(coin.second);
-                nValueRet += coin.first;
-                return true;
-            } else if (n < nTargetValue + CENT) {
-                vValue.push_back(coin);
-                nTotalLower += n;
-            } else if (n < coinLowestLarger.first) {
-                coinLowestLarger = coin;
-            }
-        }
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const vector<CSelectionCoin>& vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
 
-        if (nTotalLower == nTargetValue) {
-            for (unsigned int i = 0; i < vValue.size(); ++i) {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
-            }
-            return true;
-        }
+    // Coins deep enough for this tier, in random order
+    vector<const CSelectionCoin*> vEligible;
+    vEligible.reserve(vCoins.size());
+    BOOST_FOREACH (const CSelectionCoin& coin, vCoins) {
+        if (coin.nDepth >= (coin.fFromMe ? nConfMine : nConfTheirs))
+            vEligible.push_back(&coin);
+    }
+    random_shuffle(vEligible.begin(), vEligible.end(), GetRandInt);
 
-        if (nTotalLower < nTargetValue) {
-            if (coinLowestLarger.second.first == NULL) // there is no input larger than nTargetValue
-            {
-                if (tryDenom == 0)
-                    // we didn't look at denom yet, let's do it
-                    continue;
-                else
-                    // we looked at everything possible and didn't find anything, no luck
-                    return false;
-            }
-            setCoinsRet.insert(coinLowestLarger.second);
-            nValueRet += coinLowestLarger.first;
+    // Values less than target + CENT, keyed by their position in the shuffled order so that ties stay random
+    vector<pair<CAmount, size_t> > vLower;
+    CAmount nTotalLower = 0;
+    const CSelectionCoin* pcoinLowestLarger = NULL;
+    for (size_t i = 0; i < vEligible.size(); i++) {
+        const CSelectionCoin* pcoin = vEligible[i];
+        if (pcoin->nValue == nTargetValue) {
+            setCoinsRet.insert(make_pair(pcoin->pwtx, pcoin->n));
+            nValueRet += pcoin->nValue;
             return true;
+        } else if (pcoin->nValue < nTargetValue + CENT) {
+            vLower.push_back(make_pair(pcoin->nValue, i));
+            nTotalLower += pcoin->nValue;
+        } else if (pcoinLowestLarger == NULL || pcoin->nValue < pcoinLowestLarger->nValue) {
+            pcoinLowestLarger = pcoin;
         }
+    }
 
-        // nTotalLower > nTargetValue
-        break;
+    if (nTotalLower < nTargetValue) {
+        // there is no input larger than nTargetValue: we looked at everything possible and didn't find anything, no luck
+        if (pcoinLowestLarger == NULL)
+            return false;
+        setCoinsRet.insert(make_pair(pcoinLowestLarger->pwtx, pcoinLowestLarger->n));
+        nValueRet += pcoinLowestLarger->nValue;
+        return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+    sort(vLower.rbegin(), vLower.rend());
+    vector<CAmount> vValue;
+    vValue.reserve(vLower.size());
+    for (size_t i = 0; i < vLower.size(); i++)
+        vValue.push_back(vLower[i].first);
+
+    // First look for a subset that needs no change output: CreateTransaction adds change below
+    // the dust threshold to the fee, so anything up to that much over the target will do
+    CTxOut txoutChange(0, GetScriptForDestination(CKeyID()));
+    CAmount nCostOfChange = std::max((CAmount)0, 3 * ::minRelayTxFee.GetFee(txoutChange.GetSerializeSize(SER_DISK, 0) + 148) - 1);
+    CAmount nInputCost = (payTxFee.GetFeePerK() > 0 ? payTxFee : minTxFee).GetFee(148);
     vector<char> vfBest;
     CAmount nBest;
+    if (SelectCoinsBnB(vValue, nTargetValue, nCostOfChange, nInputCost, vfBest, nBest)) {
+        for (size_t i = 0; i < vValue.size(); i++) {
+            if (vfBest[i]) {
+                const CSelectionCoin* pcoin = vEligible[vLower[i].second];
+                setCoinsRet.insert(make_pair(pcoin->pwtx, pcoin->n));
+                nValueRet += pcoin->nValue;
+            }
+        }
+        LogPrint("selectcoins", "CWallet::SelectCoinsMinConf branch and bound: %d inputs - total %s\n", setCoinsRet.size(), FormatMoney(nBest));
+        return true;
+    }
 
+    // Solve subset sum by stochastic approximation
     ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger.second.first &&
-        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest)) {
-        setCoinsRet.insert(coinLowestLarger.second);
-        nValueRet += coinLowestLarger.first;
+    if (pcoinLowestLarger &&
+        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || pcoinLowestLarger->nValue <= nBest)) {
+        setCoinsRet.insert(make_pair(pcoinLowestLarger->pwtx, pcoinLowestLarger->n));
+        nValueRet += pcoinLowestLarger->nValue;
     } else {
         string s = "CWallet::SelectCoinsMinConf best subset: ";
-        for (unsigned int i = 0; i < vValue.size(); i++) {
+        for (size_t i = 0; i < vValue.size(); i++) {
             if (vfBest[i]) {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
-                s += FormatMoney(vValue[i].first) + " ";
+                const CSelectionCoin* pcoin = vEligible[vLower[i].second];
+                setCoinsRet.insert(make_pair(pcoin->pwtx, pcoin->n));
+                nValueRet += pcoin->nValue;
+                s += FormatMoney(pcoin->nValue) + " ";
             }
         }
         LogPrintf("%s - total %s\n", s, FormatMoney(nBest));
@@ -1561,9 +1991,13 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
         return (nValueRet >= nTargetValue);
     }
 
-    return (SelectCoinsMinConf(nTargetValue, 1, 6, vCoins, setCoinsRet, nValueRet) ||
-            SelectCoinsMinConf(nTargetValue, 1, 1, vCoins, setCoinsRet, nValueRet) ||
-            (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vCoins, setCoinsRet, nValueRet)));
+    // Values, depths and origin are looked up once for all three confirmation tiers
+    vector<CSelectionCoin> vSelectionCoins;
+    GetSelectionCoins(vCoins, vSelectionCoins);
+
+    return (SelectCoinsMinConf(nTargetValue, 1, 6, vSelectionCoins, setCoinsRet, nValueRet) ||
+            SelectCoinsMinConf(nTargetValue, 1, 1, vSelectionCoins, setCoinsRet, nValueRet) ||
+            (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vSelectionCoins, setCoinsRet, nValueRet)));
 }
 
 struct CompareByPriority {
@@ -1907,9 +2341,9 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     CAmount nCredit = 0;
     CScript scriptPubKeyKernel;
 
-    //prevent staking a time that won't be accepted
+    //prevent staking a time that won't be accepted, the minter retries on the next second
     if (GetAdjustedTime() <= chainActive.Tip()->nTime)
-        MilliSleep(10000);
+        return false;
 
     BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
         //make sure that enough time has elapsed between
@@ -2562,6 +2996,7 @@ bool CWallet::UpdatedTransaction(const uint256& hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end()) {
+            MarkBalanceDirty(hashTx);
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
             return true;
         }
@@ -2573,17 +3008,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkBalanceDirty(output.hash);
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkBalanceDirty(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    BOOST_FOREACH (const COutPoint& output, setLockedCoins)
+        MarkBalanceDirty(output.hash);
     setLockedCoins.clear();
 }
 
@@ -3041,23 +3480,12 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if (!fEnableSwiftTX) return -1;
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()) {
-        return (*i).second.CountSignatures();
-    }
-
-    return -1;
+    return txLockManager.CountSignatures(GetHash());
 }
 
 bool CMerkleTx::IsTransactionLockTimedOut() const
 {
     if (!fEnableSwiftTX) return 0;
 
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()) {
-        return GetTime() > (*i).second.nTimeout;
-    }
-
-    return false;
+    return txLockManager.IsLockTimedOut(GetHash());
 }
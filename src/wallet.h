@@ -10,6 +10,7 @@
 
 #include "amount.h"
 #include "base58.h"
+#include "coinselection.h"
 #include "crypter.h"
 #include "kernel.h"
 #include "key.h"
@@ -53,6 +54,10 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! -rescanthreads default
+static const int DEFAULT_RESCAN_THREADS = 4;
+//! Maximum number of block reader threads used by a rescan
+static const int MAX_RESCAN_THREADS = 16;
 
 class CAccountingEntry;
 class CCoinControl;
@@ -126,6 +131,67 @@ public:
     StringMap destdata;
 };
 
+/** Balance totals of a wallet, or the share a single wallet transaction contributes to them */
+class CWalletBalances
+{
+public:
+    CAmount nBalance;
+    CAmount nUnconfirmed;
+    CAmount nImmature;
+    CAmount nLocked;
+    CAmount nUnlocked;
+    CAmount nWatchOnly;
+    CAmount nUnconfirmedWatchOnly;
+    CAmount nImmatureWatchOnly;
+    CAmount nLockedWatchOnly;
+
+    CWalletBalances()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nBalance = 0;
+        nUnconfirmed = 0;
+        nImmature = 0;
+        nLocked = 0;
+        nUnlocked = 0;
+        nWatchOnly = 0;
+        nUnconfirmedWatchOnly = 0;
+        nImmatureWatchOnly = 0;
+        nLockedWatchOnly = 0;
+    }
+
+    CWalletBalances& operator+=(const CWalletBalances& b);
+    CWalletBalances& operator-=(const CWalletBalances& b);
+};
+
+/** An output in the wallet's unspent-output index, see CWallet::mapUnspent */
+class CWalletUnspent
+{
+public:
+    const CWalletTx* pwtx;
+    CAmount nValue;
+    isminetype mine;
+    CTxDestination dest; // CNoDestination if the script has no address
+};
+
+/**
+ * Conservative prefilter used while rescanning: matches every output script IsMine()
+ * accepts (and a few it does not, e.g. multisig scripts with only some of the keys).
+ * Read-only once built, so rescan reader threads can share it without locking.
+ */
+class CWalletScanFilter
+{
+public:
+    std::set<uint160> setIDs;     // key and redeem script ids
+    std::set<CScript> setScripts; // watch-only and multisig scripts
+
+    bool IsRelevant(const CTxOut& txout) const;
+    bool IsRelevant(const CTransaction& tx) const;
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -159,6 +225,44 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Balance ledger: the contribution of every wallet transaction to the totals
+     * returned by GetBalances(). Changes to a transaction only queue its hash in
+     * setBalancePending; entries that can still change with the chain tip, the
+     * mempool or SwiftTX locks (unconfirmed, immature or non-final) are kept in
+     * setBalanceVolatile and re-evaluated when one of those moves. Guarded by cs_wallet.
+     */
+    mutable std::map<uint256, CWalletBalances> mapBalanceEntries;
+    mutable std::set<uint256> setBalancePending;
+    mutable std::set<uint256> setBalanceVolatile;
+    mutable CWalletBalances balancesTotal;
+    mutable bool fBalancesStale;
+    mutable const CBlockIndex* pindexBalances;
+    mutable unsigned int nBalancesMempoolUpdated;
+    mutable int nBalancesTXLocks;
+
+    /**
+     * Unspent-output index: every output of a wallet transaction that IsMine() and is
+     * not spent by a transaction confirmed in the main chain, also indexed by value and
+     * destination. AddToWallet adds outputs, AvailableCoins drops those whose spender
+     * has confirmed; key store changes and reorgs rebuild it. Guarded by cs_wallet.
+     */
+    typedef std::map<COutPoint, CWalletUnspent> UnspentMap;
+    mutable UnspentMap mapUnspent;
+    mutable std::multimap<CAmount, COutPoint> mapUnspentByValue;
+    mutable std::map<CTxDestination, std::set<COutPoint> > mapUnspentByDest;
+    mutable bool fUnspentStale;
+    mutable const CBlockIndex* pindexUnspent;
+
+    void MarkBalanceDirty(const uint256& hash);
+    void MarkCachesStale();
+    void UpdateBalanceEntry(const uint256& hash) const;
+    void RefreshBalances() const;
+    void AddUnspentOutputs(const CWalletTx& wtx) const;
+    void EraseUnspent(const COutPoint& outpoint) const;
+    void RefreshUnspentIndex() const;
+    void AvailableCoinsFrom(const std::vector<UnspentMap::const_iterator>& vCandidates, std::vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX) const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -233,6 +337,12 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fWalletUnlockStakingOnly = false;
+        fBalancesStale = true;
+        pindexBalances = NULL;
+        nBalancesMempoolUpdated = 0;
+        nBalancesTXLocks = 0;
+        fUnspentStale = true;
+        pindexUnspent = NULL;
 
         // Stake Settings
         nHashDrift = 45;
@@ -288,8 +398,10 @@ public:
     }
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = NULL, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false) const;
+    void AvailableCoinsByDestination(std::vector<COutput>& vCoins, const std::set<CTxDestination>& setDest, bool fOnlyConfirmed = true) const;
     std::map<CBitcoinAddress, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<CSelectionCoin>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     /// Get 1000DASH output and keys which can be used for the Masternode
     bool GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash = "", std::string strOutputIndex = "");
@@ -379,9 +491,11 @@ public:
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
+    void GetScanFilter(CWalletScanFilter& filter) const;
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
+    CWalletBalances GetBalances() const;
     CAmount GetBalance() const;
     CAmount GetLockedCoins() const;
     CAmount GetUnlockedCoins() const;
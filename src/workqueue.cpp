@@ -0,0 +1,90 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "workqueue.h"
+
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+CWorkQueue::CWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), nThreads(0), fRunning(false), nRejected(0)
+{
+}
+
+CWorkQueue::~CWorkQueue()
+{
+    Stop();
+}
+
+void CWorkQueue::Start(int nThreadsIn, const char* pszName)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = true;
+        nThreads = nThreadsIn;
+    }
+    for (int i = 0; i < nThreadsIn; i++)
+        threads.create_thread(boost::bind(&TraceThread<WorkItem>, pszName, WorkItem(boost::bind(&CWorkQueue::Run, this))));
+}
+
+void CWorkQueue::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = false;
+        queue.clear();
+        nThreads = 0;
+    }
+    cond.notify_all();
+    threads.join_all();
+}
+
+void CWorkQueue::Run()
+{
+    while (true) {
+        WorkItem item;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (fRunning && queue.empty())
+                cond.wait(lock);
+            if (!fRunning)
+                return;
+            item.swap(queue.front());
+            queue.pop_front();
+        }
+        item();
+    }
+}
+
+bool CWorkQueue::Enqueue(const WorkItem& item)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fRunning || queue.size() >= nMaxDepth) {
+            nRejected++;
+            return false;
+        }
+        queue.push_back(item);
+    }
+    cond.notify_one();
+    return true;
+}
+
+size_t CWorkQueue::Depth() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+int CWorkQueue::Threads() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nThreads;
+}
+
+uint64_t CWorkQueue::Rejected() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nRejected;
+}
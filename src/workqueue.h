@@ -0,0 +1,55 @@
+// Copyright (c) 2019 The CBN Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WORKQUEUE_H
+#define BITCOIN_WORKQUEUE_H
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/**
+ * A bounded FIFO of work items run by its own threads. Enqueue refuses work
+ * instead of blocking once nMaxDepth items are waiting, so that a caller can
+ * turn overload into an error reply instead of an ever growing backlog.
+ */
+class CWorkQueue
+{
+public:
+    typedef boost::function<void()> WorkItem;
+
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<WorkItem> queue;
+    size_t nMaxDepth;
+    int nThreads;
+    bool fRunning;
+    uint64_t nRejected;
+    boost::thread_group threads;
+
+    void Run();
+
+public:
+    CWorkQueue(size_t nMaxDepthIn);
+    ~CWorkQueue();
+
+    void Start(int nThreadsIn, const char* pszName);
+    /** Let the running items finish and stop the threads; items still queued are dropped */
+    void Stop();
+
+    bool Enqueue(const WorkItem& item);
+
+    size_t Depth() const;
+    size_t MaxDepth() const { return nMaxDepth; }
+    int Threads() const;
+    uint64_t Rejected() const;
+};
+
+#endif // BITCOIN_WORKQUEUE_H
@@ -25,3 +25,28 @@ bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transacti
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyMasternode(const CMasternode &/*mn*/, bool /*fRemoved*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternodeWinner(const CMasternodePaymentWinner &/*winner*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyBudgetProposal(const CBudgetProposal &/*proposal*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyFinalizedBudget(const CFinalizedBudget &/*finalizedBudget*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifySpork(const CSporkMessage &/*spork*/)
+{
+    return true;
+}
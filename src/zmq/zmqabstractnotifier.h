@@ -8,6 +8,11 @@
 #include "zmqconfig.h"
 
 class CBlockIndex;
+class CBudgetProposal;
+class CFinalizedBudget;
+class CMasternode;
+class CMasternodePaymentWinner;
+class CSporkMessage;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
@@ -35,6 +40,11 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
     virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    virtual bool NotifyMasternode(const CMasternode &mn, bool fRemoved);
+    virtual bool NotifyMasternodeWinner(const CMasternodePaymentWinner &winner);
+    virtual bool NotifyBudgetProposal(const CBudgetProposal &proposal);
+    virtual bool NotifyFinalizedBudget(const CFinalizedBudget &finalizedBudget);
+    virtual bool NotifySpork(const CSporkMessage &spork);
 
 protected:
     void *psocket;
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
 #include <string>
 #include <map>
@@ -27,11 +28,20 @@ protected:
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
     void NotifyTransactionLock(const CTransaction &tx);
+    void NotifyMasternode(const CMasternode &mn, bool fRemoved);
+    void NotifyMasternodeWinner(const CMasternodePaymentWinner &winner);
+    void NotifyBudgetProposal(const CBudgetProposal &proposal);
+    void NotifyFinalizedBudget(const CFinalizedBudget &finalizedBudget);
+    void NotifySpork(const CSporkMessage &spork);
 
 private:
     CZMQNotificationInterface();
 
     void *pcontext;
+    // Notifications come from the message handler, RPC and the obfuscation
+    // thread, while zmq sockets may only be used by one thread at a time.
+    // Guards notifiers and every send on their sockets.
+    CCriticalSection cs_notifiers;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
 
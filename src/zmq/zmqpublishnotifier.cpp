@@ -5,6 +5,10 @@
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
 #include "main.h"
+#include "masternode.h"
+#include "masternode-budget.h"
+#include "masternode-payments.h"
+#include "spork.h"
 #include "util.h"
 #include "crypto/common.h"
 
@@ -16,6 +20,11 @@ static const char *MSG_HASHTXLOCK = "hashtxlock";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_MASTERNODE = "masternode";
+static const char *MSG_MNWINNER = "mnwinner";
+static const char *MSG_BUDGETPROPOSAL = "budgetproposal";
+static const char *MSG_FINALIZEDBUDGET = "finalizedbudget";
+static const char *MSG_SPORKVALUE = "spork";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -212,3 +221,45 @@ bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransac
     ss << transaction;
     return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishMasternodeNotifier::NotifyMasternode(const CMasternode &mn, bool fRemoved)
+{
+    LogPrint("zmq", "zmq: Publish masternode %s%s\n", mn.vin.prevout.ToStringShort(), fRemoved ? " (removed)" : "");
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mn.vin.prevout << fRemoved << mn.activeState << mn.addr << mn.protocolVersion << mn.lastPing.sigTime;
+    return SendMessage(MSG_MASTERNODE, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishMasternodeWinnerNotifier::NotifyMasternodeWinner(const CMasternodePaymentWinner &winner)
+{
+    LogPrint("zmq", "zmq: Publish mnwinner %d %s\n", winner.nBlockHeight, winner.vinMasternode.prevout.ToStringShort());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << winner.nBlockHeight << winner.payee << winner.vinMasternode.prevout;
+    return SendMessage(MSG_MNWINNER, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishBudgetProposalNotifier::NotifyBudgetProposal(const CBudgetProposal &proposal)
+{
+    uint256 hash = proposal.GetHash();
+    LogPrint("zmq", "zmq: Publish budgetproposal %s\n", hash.GetHex());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hash << proposal.GetName() << proposal.GetYeas() << proposal.GetNays() << proposal.GetAbstains();
+    return SendMessage(MSG_BUDGETPROPOSAL, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishFinalizedBudgetNotifier::NotifyFinalizedBudget(const CFinalizedBudget &finalizedBudget)
+{
+    uint256 hash = finalizedBudget.GetHash();
+    LogPrint("zmq", "zmq: Publish finalizedbudget %s\n", hash.GetHex());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hash << finalizedBudget.GetName() << finalizedBudget.GetBlockStart() << finalizedBudget.GetVoteCount();
+    return SendMessage(MSG_FINALIZEDBUDGET, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishSporkNotifier::NotifySpork(const CSporkMessage &spork)
+{
+    LogPrint("zmq", "zmq: Publish spork %d %d\n", spork.nSporkID, spork.nValue);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << spork.nSporkID << spork.nValue << spork.nTimeSigned;
+    return SendMessage(MSG_SPORKVALUE, &(*ss.begin()), ss.size());
+}
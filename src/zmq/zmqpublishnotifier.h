@@ -64,4 +64,34 @@ public:
     bool NotifyTransactionLock(const CTransaction &transaction);
 };
 
+class CZMQPublishMasternodeNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternode(const CMasternode &mn, bool fRemoved);
+};
+
+class CZMQPublishMasternodeWinnerNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodeWinner(const CMasternodePaymentWinner &winner);
+};
+
+class CZMQPublishBudgetProposalNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBudgetProposal(const CBudgetProposal &proposal);
+};
+
+class CZMQPublishFinalizedBudgetNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyFinalizedBudget(const CFinalizedBudget &finalizedBudget);
+};
+
+class CZMQPublishSporkNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifySpork(const CSporkMessage &spork);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H